@@ -13,11 +13,17 @@ void cjson_mem_setlua (lua_State *L)
 void *cjson_mem_malloc (uint32_t sz)
 {
   void *p = (void*)c_malloc (sz);
-  if (!p && gL)
-    luaL_error (gL, errfmt, "m", sz);
+  if (!p)
+    cjson_mem_fail (sz);
   return p;
 }
 
+void cjson_mem_fail (uint32_t sz)
+{
+  if (gL)
+    luaL_error (gL, errfmt, "m", sz);
+}
+
 
 void *cjson_mem_realloc (void *o, uint32_t sz)
 {
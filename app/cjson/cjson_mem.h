@@ -7,5 +7,7 @@ void cjson_mem_setlua (lua_State *L);
 
 void *cjson_mem_malloc (uint32_t sz);
 void *cjson_mem_realloc (void *p, uint32_t sz);
+/* Raises the out of memory error for a failed allocation of sz bytes */
+void cjson_mem_fail (uint32_t sz);
 
 #endif
@@ -184,7 +184,6 @@
  *	a decimal expansion to decide close cases. This logic is only
  *	used for input more than STRTOD_DIGLIM digits long (default 40).
  */
-#if 0
 #include "dtoa_config.h"
 
 #ifndef Long
@@ -199,8 +198,8 @@ typedef unsigned Long ULong;
 #define Bug(x) {fprintf(stderr, "%s\n", x); exit(1);}
 #endif
 
-#include "stdlib.h"
-#include "string.h"
+#include "c_stdlib.h"
+#include "c_string.h"
 
 #ifdef USE_LOCALE
 #include "locale.h"
@@ -285,7 +284,7 @@ static double private_mem[PRIVATE_mem], *pmem_next = private_mem;
 #endif /* Bad_float_h */
 
 #ifndef __MATH_H__
-#include "math.h"
+#include "c_math.h"
 #endif
 
 #ifdef __cplusplus
@@ -606,7 +605,7 @@ Bfree
 		}
 	}
 
-#define Bcopy(x,y) memcpy((char *)&x->sign, (char *)&y->sign, \
+#define Bcopy(x,y) c_memcpy((char *)&x->sign, (char *)&y->sign, \
 y->wds*sizeof(Long) + 2*sizeof(int))
 
  static Bigint *
@@ -914,6 +913,53 @@ mult
 
  static Bigint *p5s;
 
+#ifdef DTOA_TRACK_BLOCKS
+/* Every block from MALLOC sits on a list. MALLOC raises a Lua error when
+ * the heap runs out, and the Bigints the conversion holds at that point
+ * are only known to the frames the error unwinds. So all blocks are
+ * freed first, those on the free lists and the p5s powers included. */
+
+ typedef struct Dtoa_block {
+	struct Dtoa_block *next, *prev;
+	} Dtoa_block;
+
+ static Dtoa_block dtoa_blocks = { &dtoa_blocks, &dtoa_blocks };
+
+ void *
+dtoa_malloc(size_t n)
+{
+	Dtoa_block *b = (Dtoa_block *)c_malloc(sizeof(Dtoa_block) + n);
+
+	if (!b) {
+		while(dtoa_blocks.next != &dtoa_blocks) {
+			b = dtoa_blocks.next;
+			dtoa_blocks.next = b->next;
+			c_free(b);
+			}
+		dtoa_blocks.prev = &dtoa_blocks;
+		c_memset(freelist, 0, sizeof(freelist));
+		p5s = 0;
+		cjson_mem_fail(n);
+		return 0;
+		}
+	b->next = dtoa_blocks.next;
+	b->prev = &dtoa_blocks;
+	b->next->prev = b;
+	dtoa_blocks.next = b;
+	return b + 1;
+	}
+
+ void
+dtoa_free(void *p)
+{
+	Dtoa_block *b = (Dtoa_block *)p - 1;
+
+	b->prev->next = b->next;
+	b->next->prev = b->prev;
+	c_free(b);
+	}
+#endif /* DTOA_TRACK_BLOCKS */
+
  static Bigint *
 pow5mult
 #ifdef KR_headers
@@ -4356,4 +4402,3 @@ dtoa
 #ifdef __cplusplus
 }
 #endif
-#endif
@@ -1,9 +1,9 @@
 #ifndef _DTOA_CONFIG_H
 #define _DTOA_CONFIG_H
-#if 0
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdint.h>
+#include "c_stdlib.h"
+#include "c_string.h"
+#include "c_stdint.h"
+#include "cjson_mem.h"
 
 /* Ensure dtoa.c does not USE_LOCALE. Lua CJSON must not use locale
  * aware conversion routines. */
@@ -13,61 +13,33 @@
  * may not be threadsafe */
 #define NO_ERRNO
 
+/* JSON has no hexadecimal floating point */
+#define NO_HEX_FP
+
+/* The 2304 byte private pool would be permanent RAM, take Bigints from
+ * the heap instead. Freed ones are still kept on the Kmax free lists. */
+#define Omit_Private_Memory
+
 #define Long    int32_t
 #define ULong   uint32_t
 #define Llong   int64_t
 #define ULLong  uint64_t
 
-#ifdef IEEE_BIG_ENDIAN
-#define IEEE_MC68k
-#else
 #define IEEE_8087
-#endif
-
-#define MALLOC(n)   xmalloc(n)
-
-static void *xmalloc(size_t size)
-{
-    void *p;
-
-    p = malloc(size);
-    if (!p) {
-        fprintf(stderr, "Out of memory");
-        abort();
-    }
-
-    return p;
-}
-
-#ifdef MULTIPLE_THREADS
-
-/* Enable locking to support multi-threaded applications */
-
-#include <pthread.h>
 
-static pthread_mutex_t private_dtoa_lock[2] = {
-    PTHREAD_MUTEX_INITIALIZER,
-    PTHREAD_MUTEX_INITIALIZER
-};
+/* Raises a Lua error instead of returning NULL. The blocks are tracked
+ * so that the Bigints a conversion holds at that point can be freed
+ * before the error unwinds past them, see dtoa_malloc() in dtoa.c. */
+#define DTOA_TRACK_BLOCKS
+#define MALLOC(n)   dtoa_malloc(n)
+#define FREE(p)     dtoa_free(p)
 
-#define ACQUIRE_DTOA_LOCK(n)    do {                                \
-    int r = pthread_mutex_lock(&private_dtoa_lock[n]);              \
-    if (r) {                                                        \
-        fprintf(stderr, "pthread_mutex_lock failed with %d\n", r);  \
-        abort();                                                    \
-    }                                                               \
-} while (0)
+void dtoa_free(void *p);
 
-#define FREE_DTOA_LOCK(n)   do {                                    \
-    int r = pthread_mutex_unlock(&private_dtoa_lock[n]);            \
-    if (r) {                                                        \
-        fprintf(stderr, "pthread_mutex_unlock failed with %d\n", r);\
-        abort();                                                    \
-    }                                                               \
-} while (0)
+/* libc/c_stdio.c already has a dtoa() */
+#define dtoa        fpconv_dtoa
+#define freedtoa    fpconv_freedtoa
 
-#endif  /* MULTIPLE_THREADS */
-#endif
 #endif  /* _DTOA_CONFIG_H */
 
 /* vi:ai et sw=4 ts=4:
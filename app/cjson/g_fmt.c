@@ -20,8 +20,12 @@
 /* g_fmt(buf,x) stores the closest decimal approximation to x in buf;
  * it suffices to declare buf
  *	char buf[32];
+ *
+ * fpconv_g_fmt(buf,x,0) stores the shortest string that reads back as
+ * exactly x.
  */
-#if 0
+#include "dtoa_config.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -48,7 +52,10 @@ fpconv_g_fmt(char *b, double x, int precision)
 		goto done;
 		}
 #endif
-	s = s0 = dtoa(x, 2, precision, &decpt, &sign, &se);
+	/* Mode 0 is the shortest round trip representation */
+	s = s0 = dtoa(x, precision ? 2 : 0, precision, &decpt, &sign, &se);
+	if (!precision)
+		precision = 17;
 	if (sign)
 		*b++ = '-';
 	if (decpt == 9999) /* Infinity or Nan */ {
@@ -109,4 +116,3 @@ fpconv_g_fmt(char *b, double x, int precision)
 #endif
 	return b - b0;
 	}
-#endif
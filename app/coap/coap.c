@@ -1,6 +1,7 @@
 #include "user_config.h"
 #include "c_stdio.h"
 #include "c_string.h"
+#include "c_stdlib.h"
 #include "coap.h"
 #include "uri.h"
 
@@ -197,6 +198,13 @@ int coap_parseOptionsAndPayload(coap_option_t *options, uint8_t *numOptions, coa
     {
         if (0 != (rc = coap_parseOption(&options[optionIndex], &delta, &p, end-p)))
             return rc;
+        // Block1/Block2 are a 0..3 byte uint; SZX 7 is reserved
+        if (options[optionIndex].num == COAP_OPTION_BLOCK1 || options[optionIndex].num == COAP_OPTION_BLOCK2)
+        {
+            const coap_buffer_t *b = &options[optionIndex].buf;
+            if (b->len > 3 || (b->len > 0 && (b->p[b->len-1] & 0x07) == 0x07))
+                return COAP_ERR_OPTION_LEN_INVALID;
+        }
         optionIndex++;
     }
     *numOptions = optionIndex;
@@ -249,7 +257,7 @@ int coap_buildOptionHeader(uint32_t optDelta, size_t length, uint8_t *buf, size_
     else
     if (len == 14)
     {
-        *p++ = (length >> 8);
+        *p++ = ((length-269) >> 8);
         *p++ = (0xFF & (length-269));
         n+=2;
     }
@@ -405,7 +413,9 @@ int coap_make_response(coap_rw_buffer_t *scratch, coap_packet_t *pkt, const uint
     pkt->hdr.code = rspcode;
     pkt->hdr.id[0] = msgid_hi;
     pkt->hdr.id[1] = msgid_lo;
-    pkt->numopts = 1;
+    pkt->numopts = 0;
+    pkt->payload.p = content;
+    pkt->payload.len = content_len;
 
     // need token in response
     if (tok) {
@@ -413,7 +423,11 @@ int coap_make_response(coap_rw_buffer_t *scratch, coap_packet_t *pkt, const uint
         pkt->tok = *tok;
     }
 
+    if (content_type == COAP_CONTENTTYPE_NONE)
+        return 0;
+
     // safe because 1 < MAXOPT
+    pkt->numopts = 1;
     pkt->opts[0].num = COAP_OPTION_CONTENT_FORMAT;
     pkt->opts[0].buf.p = scratch->p;
     if (scratch->len < 2)
@@ -421,8 +435,8 @@ int coap_make_response(coap_rw_buffer_t *scratch, coap_packet_t *pkt, const uint
     scratch->p[0] = ((uint16_t)content_type & 0xFF00) >> 8;
     scratch->p[1] = ((uint16_t)content_type & 0x00FF);
     pkt->opts[0].buf.len = 2;
-    pkt->payload.p = content;
-    pkt->payload.len = content_len;
+    scratch->p += 2;    // keep it for coap_add_option()
+    scratch->len -= 2;
     return 0;
 }
 
@@ -467,7 +481,9 @@ int coap_make_request(coap_rw_buffer_t *scratch, coap_packet_t *pkt, coap_msgtyp
     if (scratch->len < 2)   // TBD...
         return COAP_ERR_BUFFER_TOO_SMALL;
 
-    uint8_t *saved = scratch->p;
+    // the Uri-* options are written to scratch and it is left past them, so
+    // the caller can coap_add_option() more; pass a copy if the pointer
+    // must be kept (coap_pdu_t frees scratch.p)
 
     /* split arg into Uri-* options */
     // const char *addr = uri->host.s;
@@ -501,7 +517,110 @@ int coap_make_request(coap_rw_buffer_t *scratch, coap_packet_t *pkt, coap_msgtyp
 
     pkt->payload.p = payload;
     pkt->payload.len = payload_len;
-    scratch->p = saved;     // save back the pointer.
+    return 0;
+}
+
+// Adds option num with an RFC 7252 uint value (shortest big-endian
+// encoding, 0 is empty), keeping pkt->opts sorted as coap_build() needs.
+// The value bytes are taken from scratch.
+int coap_add_option(coap_rw_buffer_t *scratch, coap_packet_t *pkt, uint8_t num, uint32_t value)
+{
+    int i, len;
+
+    if (pkt->numopts >= MAXOPT)
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    if (scratch->len < sizeof(value))
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    len = coap_encode_var_bytes(scratch->p, value);
+
+    for (i = pkt->numopts; i > 0 && pkt->opts[i-1].num > num; i--)
+        pkt->opts[i] = pkt->opts[i-1];
+    pkt->opts[i].num = num;
+    pkt->opts[i].buf.p = scratch->p;
+    pkt->opts[i].buf.len = len;
+    pkt->numopts++;
+
+    scratch->p += len;
+    scratch->len -= len;
+    return 0;
+}
+
+// http://tools.ietf.org/html/rfc7959#section-2.2
+// Returns 1 and fills block if pkt carries option num (Block1 or Block2),
+// 0 if not. coap_parse() has already rejected malformed values.
+int coap_get_block(const coap_packet_t *pkt, uint8_t num, coap_block_t *block)
+{
+    const coap_option_t *opt;
+    uint32_t v = 0;
+    uint8_t count;
+    size_t i;
+
+    if (NULL == (opt = coap_findOptions(pkt, num, &count)))
+        return 0;
+    for (i = 0; i < opt->buf.len; i++)
+        v = (v << 8) | opt->buf.p[i];
+    block->num = v >> 4;
+    block->m = (v >> 3) & 1;
+    block->szx = v & 0x07;
+    return 1;
+}
+
+int coap_add_block(coap_rw_buffer_t *scratch, coap_packet_t *pkt, uint8_t num, const coap_block_t *block)
+{
+    return coap_add_option(scratch, pkt, num, (block->num << 4) | (block->m ? 0x08 : 0) | block->szx);
+}
+
+// Responds to inpkt with one block of a total byte representation, read
+// through read(arg, ...) into a buffer of one block, so the memory used
+// does not depend on total. The block is the one asked for in the
+// request's Block2 option (its size capped at COAP_MAX_BLOCK_SZX), or the
+// first. A representation that fits in one block, and was not asked for
+// block-wise, gets a plain response.
+int coap_make_block_response(coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt, coap_block_reader read, void *arg, uint32_t total, coap_content_type_t content_type)
+{
+    coap_block_t block = { 0, 0, COAP_MAX_BLOCK_SZX };
+    int blockwise = coap_get_block(inpkt, COAP_OPTION_BLOCK2, &block);
+    uint32_t size, offset;
+    int n, rc;
+
+    if (block.szx > COAP_MAX_BLOCK_SZX)
+    {
+        // same offset, in our smaller blocks
+        block.num <<= block.szx - COAP_MAX_BLOCK_SZX;
+        block.szx = COAP_MAX_BLOCK_SZX;
+    }
+    size = COAP_BLOCK_SIZE(block.szx);
+    offset = block.num * size;
+    if (block.num > 0 && offset >= total)
+        return coap_make_response(scratch, outpkt, NULL, 0, inpkt->hdr.id[0], inpkt->hdr.id[1], &inpkt->tok, COAP_RSPCODE_BAD_OPTION, COAP_CONTENTTYPE_NONE);
+    if (total - offset > size)
+        blockwise = 1;
+    else
+        size = total - offset;
+
+    if (size > 0)
+    {
+        outpkt->content.p = (uint8_t *)c_malloc(size);   // freed in coap_server_respond()
+        if (outpkt->content.p == NULL)
+        {
+            NODE_DBG("not enough memory\n");
+            return coap_make_response(scratch, outpkt, NULL, 0, inpkt->hdr.id[0], inpkt->hdr.id[1], &inpkt->tok, COAP_RSPCODE_INTERNAL_SERVER_ERROR, COAP_CONTENTTYPE_NONE);
+        }
+        outpkt->content.len = size;
+    }
+    n = size > 0 ? read(arg, offset, outpkt->content.p, size) : 0;
+    if (n < 0)
+        return coap_make_response(scratch, outpkt, NULL, 0, inpkt->hdr.id[0], inpkt->hdr.id[1], &inpkt->tok, COAP_RSPCODE_INTERNAL_SERVER_ERROR, COAP_CONTENTTYPE_NONE);
+
+    if (0 != (rc = coap_make_response(scratch, outpkt, outpkt->content.p, n, inpkt->hdr.id[0], inpkt->hdr.id[1], &inpkt->tok, COAP_RSPCODE_CONTENT, content_type)))
+        return rc;
+    if (!blockwise)
+        return 0;
+    block.m = offset + n < total;
+    if (0 != (rc = coap_add_block(scratch, outpkt, COAP_OPTION_BLOCK2, &block)))
+        return rc;
+    if (block.num == 0)     // http://tools.ietf.org/html/rfc7959#section-4
+        return coap_add_option(scratch, outpkt, COAP_OPTION_SIZE2, total);
     return 0;
 }
 
@@ -510,7 +629,7 @@ int coap_make_request(coap_rw_buffer_t *scratch, coap_packet_t *pkt, coap_msgtyp
 int coap_handle_req(coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt)
 {
     const coap_option_t *opt;
-    int i;
+    int i, rc;
     uint8_t count;
     const coap_endpoint_t *ep = endpoints;
 
@@ -533,7 +652,21 @@ int coap_handle_req(coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_
             // pre-path match!
             if (count==ep->path->count+1 && ep->user_entry == NULL)
                 goto next;
-            return ep->handler(ep, scratch, inpkt, outpkt, inpkt->hdr.id[0], inpkt->hdr.id[1]);
+            // a payload split across requests can only go where it is
+            // reassembled, http://tools.ietf.org/html/rfc7959#section-2.9.3
+            if (!(ep->flags & COAP_EP_BLOCK1))
+            {
+                coap_block_t block1;
+                if (coap_get_block(inpkt, COAP_OPTION_BLOCK1, &block1) && (block1.num > 0 || block1.m))
+                {
+                    coap_make_response(scratch, outpkt, NULL, 0, inpkt->hdr.id[0], inpkt->hdr.id[1], &inpkt->tok, COAP_RSPCODE_REQUEST_ENTITY_TOO_LARGE, COAP_CONTENTTYPE_NONE);
+                    return coap_add_option(scratch, outpkt, COAP_OPTION_SIZE1, MAX_PAYLOAD_SIZE);
+                }
+            }
+            rc = ep->handler(ep, scratch, inpkt, outpkt, inpkt->hdr.id[0], inpkt->hdr.id[1]);
+            if (rc == 0 && (ep->flags & COAP_EP_OBSERVE))
+                rc = coap_observe_request(ep, scratch, inpkt, outpkt);
+            return rc;
         }
 next:
         ep++;
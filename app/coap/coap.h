@@ -48,6 +48,13 @@ typedef struct
     coap_buffer_t buf;          /* Option value */
 } coap_option_t;
 
+typedef struct
+{
+    void *conn;                 /* transport handle, given back to coap_observe_send() */
+    uint32_t ip;
+    uint16_t port;
+} coap_peer_t;
+
 typedef struct
 {
     coap_header_t hdr;          /* Header of the packet */
@@ -57,6 +64,7 @@ typedef struct
                                  * http://tools.ietf.org/html/rfc7252#section-5.10 */
     coap_buffer_t payload;      /* Payload carried by the packet */
     coap_rw_buffer_t content;       // content->p = malloc(...) , and free it when done.
+    const coap_peer_t *peer;    /* sender of a request being served, NULL otherwise */
 } coap_packet_t;
 
 /////////////////////////////////////////
@@ -77,8 +85,12 @@ typedef enum
     COAP_OPTION_URI_QUERY = 15,
     COAP_OPTION_ACCEPT = 17,
     COAP_OPTION_LOCATION_QUERY = 20,
+    COAP_OPTION_BLOCK2 = 23,            /* http://tools.ietf.org/html/rfc7959#section-2.1 */
+    COAP_OPTION_BLOCK1 = 27,
+    COAP_OPTION_SIZE2 = 28,
     COAP_OPTION_PROXY_URI = 35,
-    COAP_OPTION_PROXY_SCHEME = 39
+    COAP_OPTION_PROXY_SCHEME = 39,
+    COAP_OPTION_SIZE1 = 60
 } coap_option_num_t;
 
 //http://tools.ietf.org/html/rfc7252#section-12.1.1
@@ -107,7 +119,12 @@ typedef enum
     COAP_RSPCODE_CONTENT = MAKE_RSPCODE(2, 5),
     COAP_RSPCODE_NOT_FOUND = MAKE_RSPCODE(4, 4),
     COAP_RSPCODE_BAD_REQUEST = MAKE_RSPCODE(4, 0),
-    COAP_RSPCODE_CHANGED = MAKE_RSPCODE(2, 4)
+    COAP_RSPCODE_CHANGED = MAKE_RSPCODE(2, 4),
+    COAP_RSPCODE_CONTINUE = MAKE_RSPCODE(2, 31),
+    COAP_RSPCODE_BAD_OPTION = MAKE_RSPCODE(4, 2),
+    COAP_RSPCODE_REQUEST_ENTITY_INCOMPLETE = MAKE_RSPCODE(4, 8),
+    COAP_RSPCODE_REQUEST_ENTITY_TOO_LARGE = MAKE_RSPCODE(4, 13),
+    COAP_RSPCODE_INTERNAL_SERVER_ERROR = MAKE_RSPCODE(5, 0)
 } coap_responsecode_t;
 
 //http://tools.ietf.org/html/rfc7252#section-12.3
@@ -116,6 +133,7 @@ typedef enum
     COAP_CONTENTTYPE_NONE = -1, // bodge to allow us not to send option block
     COAP_CONTENTTYPE_TEXT_PLAIN = 0,
     COAP_CONTENTTYPE_APPLICATION_LINKFORMAT = 40,
+    COAP_CONTENTTYPE_APPLICATION_OCTET_STREAM = 42,
 } coap_content_type_t;
 
 ///////////////////////
@@ -136,6 +154,23 @@ typedef enum
     COAP_ERR_OPTION_DELTA_INVALID = 11,
 } coap_error_t;
 
+//http://tools.ietf.org/html/rfc7959#section-2.2
+typedef struct
+{
+    uint32_t num;               /* block number, counted in blocks of this size */
+    uint8_t m;                  /* more blocks follow */
+    uint8_t szx;                /* block size is COAP_BLOCK_SIZE(szx) */
+} coap_block_t;
+
+#define COAP_BLOCK_SIZE(szx) (1U << ((szx) + 4))
+#define COAP_MAX_BLOCK_SZX 6    /* 1024 bytes, MAX_PAYLOAD_SIZE */
+#define COAP_REQ_BLOCK_SZX 5    /* 512 bytes, leaves MAX_REQUEST_SIZE room for the Uri-* options */
+
+/* Produces a representation for coap_make_block_response() one block at a
+ * time: copies up to len bytes starting at offset into buf and returns the
+ * number copied, or -1 on error. */
+typedef int (*coap_block_reader)(void *arg, uint32_t offset, uint8_t *buf, size_t len);
+
 ///////////////////////
 typedef struct coap_endpoint_t coap_endpoint_t;
 
@@ -152,12 +187,22 @@ typedef struct coap_luser_entry coap_luser_entry;
 
 struct coap_luser_entry{
     lua_State *L;
-    // int ref;
-    // char name[MAX_SEGMENTS_SIZE+1];         // +1 for string '\0'
-    const char *name;
-    coap_luser_entry *next;
+    coap_luser_entry *next;             /* next entry in the same bucket */
+    uint32_t hash;                      /* coap_luser_hash() of name */
+    uint8_t len;                        /* c_strlen(name) */
+    char name[1];                       /* copied, '\0' terminated */
 };
 
+/* Lua variables/functions published under one endpoint (/v1/v, /v1/f),
+ * hashed on their name so a request costs one bucket walk however many
+ * are registered. */
+#define COAP_LUSER_BUCKETS 16           /* power of 2 */
+typedef struct
+{
+    uint16_t count;
+    coap_luser_entry *bucket[COAP_LUSER_BUCKETS];
+} coap_luser_table;
+
 struct coap_endpoint_t{
     coap_method_t method;               /* (i.e. POST, PUT or GET) */
     coap_endpoint_func handler;         /* callback function which handles this 
@@ -169,9 +214,24 @@ struct coap_endpoint_t{
                                          * provides a hint about the 
                                          * Content-Formats this resource returns." 
                                          * (Section 12.3. lists possible ct values.) */
-	coap_luser_entry *user_entry;
+    coap_luser_table *user_entry;       /* NULL unless /path/[name] is served */
+    uint8_t flags;                      /* COAP_EP_* */
 };
 
+#define COAP_EP_BLOCK1  0x01            /* handler takes Block1 uploads block by block;
+                                         * others get 4.13 for anything but a single block */
+#define COAP_EP_OBSERVE 0x02            /* GET can be observed, RFC 7641 */
+
+//http://tools.ietf.org/html/rfc7641
+#define COAP_MAX_OBSERVERS 8            /* (peer, resource) pairs; more registrations get plain responses */
+#define COAP_OBSERVE_CHECK_MS 1000      /* observed resources are re-read this often, and
+                                         * a notification sent only if the response changed */
+#define COAP_OBSERVE_MAX_AGE 60         /* s, Max-Age of notifications; a fresh one is
+                                         * sent COAP_OBSERVE_MAX_AGE_MARGIN s before it runs out */
+#define COAP_OBSERVE_MAX_AGE_MARGIN 5
+#define COAP_OBSERVE_CON_EVERY 8        /* every n-th notification is confirmable... */
+#define COAP_OBSERVE_MAX_UNACKED 3      /* ...and an observer that acks none of this many is dropped */
+
 
 ///////////////////////
 void coap_dumpPacket(coap_packet_t *pkt);
@@ -182,10 +242,26 @@ int coap_build(uint8_t *buf, size_t *buflen, const coap_packet_t *pkt);
 void coap_dump(const uint8_t *buf, size_t buflen, bool bare);
 int coap_make_response(coap_rw_buffer_t *scratch, coap_packet_t *pkt, const uint8_t *content, size_t content_len, uint8_t msgid_hi, uint8_t msgid_lo, const coap_buffer_t* tok, coap_responsecode_t rspcode, coap_content_type_t content_type);
 int coap_handle_req(coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt);
+int coap_add_option(coap_rw_buffer_t *scratch, coap_packet_t *pkt, uint8_t num, uint32_t value);
+int coap_get_block(const coap_packet_t *pkt, uint8_t num, coap_block_t *block);
+int coap_add_block(coap_rw_buffer_t *scratch, coap_packet_t *pkt, uint8_t num, const coap_block_t *block);
+int coap_make_block_response(coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt, coap_block_reader read, void *arg, uint32_t total, coap_content_type_t content_type);
 void coap_option_nibble(uint32_t value, uint8_t *nibble);
 void coap_setup(void);
 void endpoint_setup(void);
 
+int coap_observe_request(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt);
+void coap_observe_reply(const coap_packet_t *pkt);
+void coap_observe_check(void);
+void coap_observe_forget(void *conn);
+/* supplied by the transport: send a notification to peer, retransmitting
+ * it if con until coap_observe_acked() is called with the peer's answer */
+void coap_observe_send(const coap_peer_t *peer, const uint8_t *buf, size_t len, int con);
+void coap_observe_acked(const coap_peer_t *peer, const coap_packet_t *pkt);
+
+coap_luser_entry *coap_luser_find(const coap_luser_table *t, const uint8_t *name, size_t len);
+coap_luser_entry *coap_luser_add(coap_luser_table *t, lua_State *L, const char *name, size_t len);
+
 int coap_buildOptionHeader(uint32_t optDelta, size_t length, uint8_t *buf, size_t buflen);
 
 #ifdef __cplusplus
@@ -1,10 +1,11 @@
 #include "c_string.h"
+#include "c_stdlib.h"
 #include "coap_io.h"
 #include "node.h"
 #include "espconn.h"
 #include "coap_timer.h"
 
-extern coap_queue_t *gQueue;
+extern coap_sendqueue_t gQueue;
 
 /* releases space allocated by PDU if free_pdu is set */
 coap_tid_t coap_send(struct espconn *pesp_conn, coap_pdu_t *pdu) {
@@ -26,11 +27,32 @@ coap_tid_t coap_send(struct espconn *pesp_conn, coap_pdu_t *pdu) {
   return id;
 }
 
+void coap_resend(coap_queue_t *node) {
+  struct espconn *pesp_conn = node->pconn;
+
+  // the connection may have been pointed elsewhere since
+  c_memcpy(pesp_conn->proto.udp->remote_ip, &node->ip, sizeof(node->ip));
+  pesp_conn->proto.udp->remote_port = node->port;
+  espconn_sent(pesp_conn, (unsigned char *)(node->pdu->msg.p), node->pdu->msg.len);
+}
+
+/* first transmission; the timer only needs moving if node is due first */
+static void coap_start_transaction(coap_sendqueue_t *queue, coap_queue_t *node) {
+  coap_resend(node);
+  node->t = coap_timer_now() + node->timeout;
+  coap_insert_node(queue, node);
+  if (node->index == 0)
+    coap_timer_start(queue);
+}
+
 coap_tid_t coap_send_confirmed(struct espconn *pesp_conn, coap_pdu_t *pdu) {
   coap_queue_t *node;
-  coap_tick_t diff;
+  coap_tid_t id;
   uint32_t r;
 
+  if ( !pesp_conn || !pdu )
+    return COAP_INVALID_TID;
+
   node = coap_new_node();
   if (!node) {
     NODE_DBG("coap_send_confirmed: insufficient memory\n");
@@ -38,12 +60,9 @@ coap_tid_t coap_send_confirmed(struct espconn *pesp_conn, coap_pdu_t *pdu) {
   }
 
   node->retransmit_cnt = 0;
-  node->id = coap_send(pesp_conn, pdu);
-  if (COAP_INVALID_TID == node->id) {
-    NODE_DBG("coap_send_confirmed: error sending pdu\n");
-    coap_free_node(node);
-    return COAP_INVALID_TID;
-  }
+  c_memcpy(&node->ip, pesp_conn->proto.udp->remote_ip, sizeof(node->ip));
+  node->port = pesp_conn->proto.udp->remote_port;
+  coap_transaction_id(node->ip, node->port, pdu->pkt, &node->id);
   r = rand();
 
   /* add randomized RESPONSE_TIMEOUT to determine retransmission timeout */
@@ -54,18 +73,42 @@ coap_tid_t coap_send_confirmed(struct espconn *pesp_conn, coap_pdu_t *pdu) {
   node->pconn = pesp_conn;
   node->pdu = pdu;
 
-  /* Set timer for pdu retransmission. If this is the first element in
-   * the retransmission queue, the base time is set to the current
-   * time and the retransmission time is node->timeout. If there is
-   * already an entry in the sendqueue, we must check if this node is
-   * to be retransmitted earlier. Therefore, node->timeout is first
-   * normalized to the timeout and then inserted into the queue with
-   * an adjusted relative time.
-   */
-  coap_timer_stop();
-  coap_timer_update(&gQueue);
-  node->t = node->timeout;  
-  coap_insert_node(&gQueue, node);
+  /* At most COAP_NSTART messages are in flight to one peer (RFC 7252
+   * 4.7); later ones go out, in order, as earlier ones are answered or
+   * given up on. */
+  id = node->id;
+  coap_wait_node(&gQueue, node);
+  while ((node = coap_next_waiting(&gQueue)) != NULL)
+    coap_start_transaction(&gQueue, node);
+  return id;
+}
+
+void coap_transaction_end(coap_sendqueue_t *queue, coap_queue_t *node) {
+  coap_delete_node(node);
+  while ((node = coap_next_waiting(queue)) != NULL)
+    coap_start_transaction(queue, node);
+}
+
+int coap_transaction_done(coap_tid_t id) {
+  coap_queue_t *node = coap_find_node(&gQueue, id);
+  int first;
+
+  if (!node)
+    return 0;
+  first = node->index == 0;
+  coap_unlink_node(&gQueue, node);
+  coap_transaction_end(&gQueue, node);
+  // an ACK for a later retransmission leaves the timer alone
+  if (first)
+    coap_timer_start(&gQueue);
+  return 1;
+}
+
+void coap_transaction_forget(struct espconn *pesp_conn) {
+  coap_queue_t *node;
+
+  coap_delete_all(&gQueue, pesp_conn);
+  while ((node = coap_next_waiting(&gQueue)) != NULL)
+    coap_start_transaction(&gQueue, node);
   coap_timer_start(&gQueue);
-  return node->id;
 }
@@ -8,11 +8,28 @@ extern "C" {
 #include "espconn.h"
 #include "pdu.h"
 #include "hash.h"
+#include "node.h"
 	
 coap_tid_t coap_send(struct espconn *pesp_conn, coap_pdu_t *pdu);
 
+/** Sends pdu and retransmits it until coap_transaction_done(), or holds
+ * it back while its peer has COAP_NSTART messages in flight. pdu is freed
+ * with the transaction. */
 coap_tid_t coap_send_confirmed(struct espconn *pesp_conn, coap_pdu_t *pdu);
 
+/** Sends node's PDU again, to the peer it was first sent to. */
+void coap_resend(coap_queue_t *node);
+
+/** Frees node, already unlinked from queue, and starts what waited for it. */
+void coap_transaction_end(coap_sendqueue_t *queue, coap_queue_t *node);
+
+/** The ACK or response for id came: stops retransmitting it. Returns 0 if
+ * there was no such transaction. */
+int coap_transaction_done(coap_tid_t id);
+
+/** Drops the messages of pesp_conn, which is going away. */
+void coap_transaction_forget(struct espconn *pesp_conn);
+
 #ifdef __cplusplus
 }
 #endif
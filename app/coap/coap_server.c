@@ -4,14 +4,14 @@
 
 #include "coap.h"
 
-size_t coap_server_respond(char *req, unsigned short reqlen, char *rsp, unsigned short rsplen)
+size_t coap_server_respond(char *req, unsigned short reqlen, char *rsp, unsigned short rsplen, const coap_peer_t *peer)
 {
   NODE_DBG("coap_server_respond is called.\n");
   size_t rlen = rsplen;
   coap_packet_t pkt;
   pkt.content.p = NULL;
   pkt.content.len = 0;
-  uint8_t scratch_raw[4];
+  uint8_t scratch_raw[16];   // Content-Format, Block1/Block2 and Size1/Size2 values
   coap_rw_buffer_t scratch_buf = {scratch_raw, sizeof(scratch_raw)};
   int rc;
 
@@ -25,8 +25,16 @@ size_t coap_server_respond(char *req, unsigned short reqlen, char *rsp, unsigned
     NODE_DBG("Bad packet rc=%d\n", rc);
     return 0;
   }
+  else if (pkt.hdr.t == COAP_TYPE_ACK || pkt.hdr.t == COAP_TYPE_RESET)
+  {
+    // only ever an answer to a notification
+    pkt.peer = peer;
+    coap_observe_reply(&pkt);
+    return 0;
+  }
   else
   {
+    pkt.peer = peer;
     coap_packet_t rsppkt;
     rsppkt.content.p = NULL;
     rsppkt.content.len = 0;
@@ -1,78 +1,60 @@
 #include "node.h"
 #include "coap_timer.h"
+#include "coap_io.h"
 #include "os_type.h"
+#include "user_interface.h"
 
 static os_timer_t coap_timer;
-static coap_tick_t basetime = 0;
-
-void coap_timer_elapsed(coap_tick_t *diff){
-  coap_tick_t now = system_get_time() / 1000;   // coap_tick_t is in ms. also sys_timer
-  if(now>=basetime){
-    *diff = now-basetime;
-  } else {
-    *diff = now + SYS_TIME_MAX -basetime;
-  }
-  basetime = now;
+static uint32_t last_us = 0, frac_us = 0;
+static coap_tick_t now_ms = 0;
+
+coap_tick_t coap_timer_now(void){
+  uint32_t us = system_get_time();
+  uint32_t diff = us - last_us + frac_us;   // wraps with system_get_time()
+  last_us = us;
+  now_ms += diff / 1000;
+  frac_us = diff % 1000;
+  return now_ms;
 }
 
-void coap_timer_tick(void *arg){
-  if( !arg )
-    return;
-  coap_queue_t **queue = (coap_queue_t **)arg;
-  if( !(*queue) )
-    return;
-
-  coap_queue_t *node = coap_pop_next( queue );
-  /* re-initialize timeout when maximum number of retransmissions are not reached yet */
-  if (node->retransmit_cnt < COAP_DEFAULT_MAX_RETRANSMIT) {
-    node->retransmit_cnt++;
-    node->t = node->timeout << node->retransmit_cnt;
-
-    NODE_DBG("** retransmission #%d of transaction %d\n", 
-        node->retransmit_cnt, (((uint16_t)(node->pdu->pkt->hdr.id[0]))<<8)+node->pdu->pkt->hdr.id[1]);
-    node->id = coap_send(node->pconn, node->pdu);
-    if (COAP_INVALID_TID == node->id) {
-      NODE_DBG("retransmission: error sending pdu\n");
-      coap_delete_node(node);
+static void coap_timer_tick(void *arg){
+  coap_sendqueue_t *queue = (coap_sendqueue_t *)arg;
+  coap_tick_t now = coap_timer_now();
+  coap_queue_t *node;
+
+  // everything that is due, earliest first
+  while ((node = coap_peek_next(queue)) && (int32_t)(node->t - now) <= 0) {
+    coap_unlink_node(queue, node);
+    /* re-initialize timeout when maximum number of retransmissions are not reached yet */
+    if (node->retransmit_cnt < COAP_DEFAULT_MAX_RETRANSMIT) {
+      node->retransmit_cnt++;
+      node->t = now + (node->timeout << node->retransmit_cnt);
+
+      NODE_DBG("** retransmission #%d of transaction %d\n", 
+          node->retransmit_cnt, (((uint16_t)(node->pdu->pkt->hdr.id[0]))<<8)+node->pdu->pkt->hdr.id[1]);
+      coap_resend(node);
+      coap_insert_node(queue, node);
     } else {
-      coap_insert_node(queue, node);    
+      /* And finally delete the node, which lets the next one to its peer go */
+      coap_transaction_end(queue, node);
     }
-  } else {
-    /* And finally delete the node */
-    coap_delete_node( node );
   }
 
   coap_timer_start(queue);
 }
 
-void coap_timer_setup(coap_queue_t ** queue, coap_tick_t t){
-  os_timer_disarm(&coap_timer);
-  os_timer_setfn(&coap_timer, (os_timer_func_t *)coap_timer_tick, queue);
-  os_timer_arm(&coap_timer, t, 0);   // no repeat
-}
-
 void coap_timer_stop(void){
   os_timer_disarm(&coap_timer);
 }
 
-void coap_timer_update(coap_queue_t ** queue){
-  if (!queue)
-    return;
-  coap_tick_t diff = 0;
-  coap_queue_t *first = *queue;
-  coap_timer_elapsed(&diff); // update: basetime = now, diff = now - oldbase, means time elapsed
-  if (first) {
-    // diff ms time is elapsed, re-calculate the first node->t
-    if (first->t >= diff){
-      first->t -= diff;
-    } else {
-      first->t = 0;  // when timer enabled, time out almost immediately
-    }
-  }
-}
+void coap_timer_start(coap_sendqueue_t *queue){
+  coap_queue_t *first = coap_peek_next(queue);
+  int32_t t;
 
-void coap_timer_start(coap_queue_t ** queue){
-  if(*queue){ // if there is node in the queue, set timeout to its ->t.
-    coap_timer_setup(queue, (*queue)->t);
-  }
+  os_timer_disarm(&coap_timer);
+  if(!first)
+    return;
+  t = (int32_t)(first->t - coap_timer_now());
+  os_timer_setfn(&coap_timer, (os_timer_func_t *)coap_timer_tick, queue);
+  os_timer_arm(&coap_timer, t > 0 ? t : 0, 0);   // no repeat
 }
@@ -2,164 +2,186 @@
 #include "c_string.h"
 #include "c_stdlib.h"
 #include "coap.h"
+#include "coap_timer.h"
 
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
 
 #include "os_type.h"
+#include "user_interface.h"
+#include "flash_fs.h"
 
-void build_well_known_rsp(char *rsp, uint16_t rsplen);
+static uint16_t notify_id;
 
 void endpoint_setup(void)
 {
     coap_setup();
+    notify_id = (uint16_t)rand();
+}
+
+// djb2 (xor variant); cheaper per byte than coap_hash() and these are
+// short names, not transport addresses
+static uint32_t coap_luser_hash(const uint8_t *name, size_t len)
+{
+    uint32_t h = 5381;
+    while (len--)
+        h = ((h << 5) + h) ^ *name++;
+    return h;
+}
+
+coap_luser_entry *coap_luser_find(const coap_luser_table *t, const uint8_t *name, size_t len)
+{
+    uint32_t hash = coap_luser_hash(name, len);
+    coap_luser_entry *h = t->bucket[hash & (COAP_LUSER_BUCKETS - 1)];
+    for (; h != NULL; h = h->next)
+    {
+        if (h->hash == hash && h->len == len && 0 == c_memcmp(h->name, name, len))
+            return h;
+    }
+    return NULL;
+}
+
+// Registers (or re-registers) name; the name is copied. NULL if out of memory.
+coap_luser_entry *coap_luser_add(coap_luser_table *t, lua_State *L, const char *name, size_t len)
+{
+    coap_luser_entry *h = coap_luser_find(t, (const uint8_t *)name, len);
+    if (h == NULL)
+    {
+        uint32_t hash = coap_luser_hash((const uint8_t *)name, len);
+        coap_luser_entry **b = &t->bucket[hash & (COAP_LUSER_BUCKETS - 1)];
+        h = (coap_luser_entry *)c_zalloc(sizeof(coap_luser_entry) + len);
+        if (h == NULL)
+            return NULL;
+        h->hash = hash;
+        h->len = len;
+        c_memcpy(h->name, name, len);
+        h->name[len] = '\0';
+        h->next = *b;
+        *b = h;
+        t->count++;
+    }
+    h->L = L;
+    return h;
+}
+
+// The entry for /path/[name], or NULL if name is not registered or the
+// request is for /path itself (then *known is set).
+static coap_luser_entry *endpoint_luser(const coap_endpoint_t *ep, const coap_packet_t *inpkt, int *known)
+{
+    const coap_option_t *opt;
+    uint8_t count;
+    coap_luser_entry *h;
+
+    *known = 0;
+    if (NULL == (opt = coap_findOptions(inpkt, COAP_OPTION_URI_PATH, &count)))
+        return NULL;
+    if (count != ep->path->count + 1)   // +1 for /f/[function], /v/[variable]
+    {
+        *known = (count == ep->path->count);
+        return NULL;
+    }
+    h = coap_luser_find(ep->user_entry, opt[count-1].buf.p, opt[count-1].buf.len);
+    if (h != NULL)
+    {
+        NODE_DBG("/%s/%s/", ep->path->elems[0], ep->path->elems[1]);
+        NODE_DBG(h->name);
+        NODE_DBG(" match.\n");
+    }
+    return h;
+}
+
+static uint32_t well_known_read_window(uint8_t *buf, uint32_t offset, size_t len);
+static int well_known_read(void *arg, uint32_t offset, uint8_t *buf, size_t len)
+{
+    uint32_t total = well_known_read_window(buf, offset, len);
+    return total - offset < len ? total - offset : len;
 }
 
 static const coap_endpoint_path_t path_well_known_core = {2, {".well-known", "core"}};
 static int handle_get_well_known_core(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt, uint8_t id_hi, uint8_t id_lo)
 {
-    outpkt->content.p = (uint8_t *)c_zalloc(MAX_PAYLOAD_SIZE);      // this should be free-ed when outpkt is built in coap_server_respond()
-    if(outpkt->content.p == NULL){
-        NODE_DBG("not enough memory\n");
-        return COAP_ERR_BUFFER_TOO_SMALL;
-    }
-    outpkt->content.len = MAX_PAYLOAD_SIZE;
-    build_well_known_rsp(outpkt->content.p, outpkt->content.len);
-    return coap_make_response(scratch, outpkt, (const uint8_t *)outpkt->content.p, c_strlen(outpkt->content.p), id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_APPLICATION_LINKFORMAT);
+    // generated a block at a time, however many names are published
+    uint32_t total = well_known_read_window(NULL, 0, 0);
+    return coap_make_block_response(scratch, inpkt, outpkt, well_known_read, NULL, total, COAP_CONTENTTYPE_APPLICATION_LINKFORMAT);
 }
 
 static const coap_endpoint_path_t path_variable = {2, {"v1", "v"}};
 static int handle_get_variable(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt, uint8_t id_hi, uint8_t id_lo)
 {
-    const coap_option_t *opt;
-    uint8_t count;
-    int n;
-    if (NULL != (opt = coap_findOptions(inpkt, COAP_OPTION_URI_PATH, &count)))
+    int n, known;
+    coap_luser_entry *h = endpoint_luser(ep, inpkt, &known);
+    if (h == NULL)
     {
-        if ((count != ep->path->count ) && (count != ep->path->count + 1)) // +1 for /f/[function], /v/[variable]
-        {
-            NODE_DBG("should never happen.\n");
-            goto end;
-        }
-        if (count == ep->path->count + 1)
-        {
-            coap_luser_entry *h = ep->user_entry->next;     // ->next: skip the first entry(head)
-            while(NULL != h){
-                if (opt[count-1].buf.len != c_strlen(h->name))
-                {
-                    h = h->next;
-                    continue;
-                }
-                if (0 == c_memcmp(h->name, opt[count-1].buf.p, opt[count-1].buf.len))
-                {
-                    NODE_DBG("/v1/v/");
-                    NODE_DBG((char *)h->name);
-                    NODE_DBG(" match.\n");
-                    if(h->L == NULL)
-                        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
-                    if(c_strlen(h->name))
-                    {
-                        n = lua_gettop(h->L);
-                        lua_getglobal(h->L, h->name);
-                        if (!lua_isnumber(h->L, -1)) {
-                            NODE_DBG ("should be a number.\n");
-                            lua_settop(h->L, n);
-                            return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
-                        } else {
-                            const char *res = lua_tostring(h->L,-1);
-                            lua_settop(h->L, n);
-                            return coap_make_response(scratch, outpkt, (const uint8_t *)res, c_strlen(res), id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
-                        }
-                    }
-                } else {
-                    h = h->next;
-                }
-            }
-        }else{
+        if (known)
             NODE_DBG("/v1/v match.\n");
-            goto end;
-        }
+        else
+            NODE_DBG("none match.\n");
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
+    }
+    if (h->L == NULL)
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
+
+    n = lua_gettop(h->L);
+    lua_getglobal(h->L, h->name);
+    if (!lua_isnumber(h->L, -1)) {
+        NODE_DBG ("should be a number.\n");
+        lua_settop(h->L, n);
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
+    } else {
+        const char *res = lua_tostring(h->L,-1);
+        lua_settop(h->L, n);
+        return coap_make_response(scratch, outpkt, (const uint8_t *)res, c_strlen(res), id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
     }
-    NODE_DBG("none match.\n");
-end:
-    return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
 }
 
 static const coap_endpoint_path_t path_function = {2, {"v1", "f"}};
 static int handle_post_function(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt, uint8_t id_hi, uint8_t id_lo)
 {
-    const coap_option_t *opt;
-    uint8_t count;
-    int n;
-    if (NULL != (opt = coap_findOptions(inpkt, COAP_OPTION_URI_PATH, &count)))
+    int n, known;
+    coap_luser_entry *h = endpoint_luser(ep, inpkt, &known);
+    if (h == NULL)
     {
-        if ((count != ep->path->count ) && (count != ep->path->count + 1)) // +1 for /f/[function], /v/[variable]
-        {
-            NODE_DBG("should never happen.\n");
-            goto end;
-        }
-        if (count == ep->path->count + 1)
-        {
-            coap_luser_entry *h = ep->user_entry->next;     // ->next: skip the first entry(head)
-            while(NULL != h){
-                if (opt[count-1].buf.len != c_strlen(h->name))
-                {
-                    h = h->next;
-                    continue;
-                }
-                if (0 == c_memcmp(h->name, opt[count-1].buf.p, opt[count-1].buf.len))
-                {
-                    NODE_DBG("/v1/f/");
-                    NODE_DBG((char *)h->name);
-                    NODE_DBG(" match.\n");
-
-                    if(h->L == NULL)
-                        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
-
-                    if(c_strlen(h->name))
-                    {
-                        n = lua_gettop(h->L);
-                        lua_getglobal(h->L, h->name);
-                        if (lua_type(h->L, -1) != LUA_TFUNCTION) {
-                            NODE_DBG ("should be a function\n");
-                            lua_settop(h->L, n);
-                            return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
-                        } else {
-                            lua_pushlstring(h->L, inpkt->payload.p, inpkt->payload.len);     // make sure payload.p is filled with '\0' after payload.len, or use lua_pushlstring
-                            lua_call(h->L, 1, 1);
-                            if (!lua_isnil(h->L, -1)){  /* get return? */
-                                if( lua_isstring(h->L, -1) )   // deal with the return string
-                                {
-                                    size_t len = 0;
-                                    const char *ret = luaL_checklstring( h->L, -1, &len );
-                                    if(len > MAX_PAYLOAD_SIZE){
-                                        lua_settop(h->L, n);
-                                        luaL_error( h->L, "return string:<MAX_PAYLOAD_SIZE" );
-                                        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
-                                    }
-                                    NODE_DBG((char *)ret);
-                                    NODE_DBG("\n");
-                                    lua_settop(h->L, n);
-                                    return coap_make_response(scratch, outpkt, ret, len, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
-                                } 
-                            } else {
-                                lua_settop(h->L, n);
-                                return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
-                            }
-                        }
-                    }
-                } else {
-                    h = h->next;
+        if (known)
+            NODE_DBG("/v1/f match.\n");
+        else
+            NODE_DBG("none match.\n");
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
+    }
+    if (h->L == NULL)
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
+
+    n = lua_gettop(h->L);
+    lua_getglobal(h->L, h->name);
+    if (lua_type(h->L, -1) != LUA_TFUNCTION) {
+        NODE_DBG ("should be a function\n");
+        lua_settop(h->L, n);
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
+    } else {
+        lua_pushlstring(h->L, inpkt->payload.p, inpkt->payload.len);     // make sure payload.p is filled with '\0' after payload.len, or use lua_pushlstring
+        lua_call(h->L, 1, 1);
+        if (!lua_isnil(h->L, -1)){  /* get return? */
+            if( lua_isstring(h->L, -1) )   // deal with the return string
+            {
+                size_t len = 0;
+                const char *ret = luaL_checklstring( h->L, -1, &len );
+                if(len > MAX_PAYLOAD_SIZE){
+                    lua_settop(h->L, n);
+                    luaL_error( h->L, "return string:<MAX_PAYLOAD_SIZE" );
+                    return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
                 }
+                NODE_DBG((char *)ret);
+                NODE_DBG("\n");
+                lua_settop(h->L, n);
+                return coap_make_response(scratch, outpkt, ret, len, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
             }
-        }else{
-            NODE_DBG("/v1/f match.\n");
-            goto end;
+            lua_settop(h->L, n);
+        } else {
+            lua_settop(h->L, n);
+            return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
         }
     }
-    NODE_DBG("none match.\n");    
-end:
+    // any other return value
     return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
 }
 
@@ -200,95 +222,467 @@ static int handle_get_id(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, c
     return coap_make_response(scratch, outpkt, (const uint8_t *)(&id), sizeof(uint32_t), id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_CONTENT, COAP_CONTENTTYPE_TEXT_PLAIN);
 }
 
-coap_luser_entry var_head = {NULL,NULL,NULL};
-coap_luser_entry *variable_entry = &var_head;
+static int file_read(void *arg, uint32_t offset, uint8_t *buf, size_t len)
+{
+    int fd = *(int *)arg;
+    if (fs_seek(fd, offset, FS_SEEK_SET) < 0)
+        return -1;
+    return fs_read(fd, buf, len);
+}
+
+// GET /v1/file/[name]: the file, one block per request
+static const coap_endpoint_path_t path_file = {2, {"v1", "file"}};
+static int handle_get_file(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt, uint8_t id_hi, uint8_t id_lo)
+{
+    int known, fd, size, rc;
+    coap_luser_entry *h = endpoint_luser(ep, inpkt, &known);
+    if (h == NULL || (fd = fs_open(h->name, FS_RDONLY)) < FS_OPEN_OK)
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
+
+    size = fs_seek(fd, 0, FS_SEEK_END);
+    if (size < 0)
+        rc = coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_INTERNAL_SERVER_ERROR, COAP_CONTENTTYPE_NONE);
+    else
+        rc = coap_make_block_response(scratch, inpkt, outpkt, file_read, &fd, size, COAP_CONTENTTYPE_APPLICATION_OCTET_STREAM);
+    fs_close(fd);
+    return rc;
+}
+
+// Block1 uploads in progress, so that a late duplicate of block 0 is told
+// apart from block 0 of a new upload: the same file, peer and token are the
+// same upload. A client that sends no token or changes it between blocks
+// gets no such protection, its block 0 always starts over.
+#define COAP_MAX_UPLOADS 2
+typedef struct
+{
+    const coap_luser_entry *file;   // NULL if the slot is free
+    uint32_t ip;
+    uint16_t port;
+    uint8_t tkl;
+    uint8_t tok[8];
+} coap_upload_t;
+static coap_upload_t uploads[COAP_MAX_UPLOADS];
+static uint8_t upload_next;
+
+static coap_upload_t *upload_find(const coap_luser_entry *h, const coap_packet_t *inpkt)
+{
+    int i;
+    for (i = 0; i < COAP_MAX_UPLOADS; i++)
+    {
+        coap_upload_t *u = &uploads[i];
+        if (u->file == h && u->tkl == inpkt->tok.len && 0 == c_memcmp(u->tok, inpkt->tok.p, u->tkl) &&
+            (inpkt->peer == NULL || (u->ip == inpkt->peer->ip && u->port == inpkt->peer->port)))
+            return u;
+    }
+    return NULL;
+}
+
+static void upload_start(const coap_luser_entry *h, const coap_packet_t *inpkt)
+{
+    int i;
+    coap_upload_t *u = NULL;
+    for (i = 0; i < COAP_MAX_UPLOADS; i++)      // one per file
+        if (uploads[i].file == h)
+            u = &uploads[i];
+    if (u == NULL)                              // else replace the oldest
+    {
+        u = &uploads[upload_next];
+        upload_next = (upload_next + 1) % COAP_MAX_UPLOADS;
+    }
+    u->file = h;
+    u->ip = inpkt->peer ? inpkt->peer->ip : 0;
+    u->port = inpkt->peer ? inpkt->peer->port : 0;
+    u->tkl = inpkt->tok.len;
+    c_memcpy(u->tok, inpkt->tok.p, inpkt->tok.len);
+}
+
+// PUT /v1/file/[name]: the payload replaces the file. A Block1 upload is
+// appended a block per request, the file closed again before each
+// response, so nothing is held between blocks.
+static int handle_put_file(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt, uint8_t id_hi, uint8_t id_lo)
+{
+    coap_block_t block1 = { 0, 0, COAP_MAX_BLOCK_SZX };
+    int known, fd, size, blockwise, rc, start;
+    size_t len = inpkt->payload.len;
+    uint32_t offset;
+    coap_responsecode_t code;
+    coap_upload_t *upload;
+    coap_luser_entry *h = endpoint_luser(ep, inpkt, &known);
+    if (h == NULL)
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_NOT_FOUND, COAP_CONTENTTYPE_NONE);
+
+    blockwise = coap_get_block(inpkt, COAP_OPTION_BLOCK1, &block1);
+    offset = block1.num * COAP_BLOCK_SIZE(block1.szx);
+    if (block1.m && len != COAP_BLOCK_SIZE(block1.szx))    // only the last block may be short
+        return coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, COAP_RSPCODE_BAD_REQUEST, COAP_CONTENTTYPE_NONE);
+
+    // block 0 truncates the file, unless it repeats that of the upload in progress
+    upload = blockwise ? upload_find(h, inpkt) : NULL;
+    start = offset == 0 && upload == NULL;
+    fd = fs_open(h->name, start ? FS_WRONLY|FS_CREAT|FS_TRUNC : FS_RDWR);
+    if (fd < FS_OPEN_OK)
+        code = start ? COAP_RSPCODE_INTERNAL_SERVER_ERROR : COAP_RSPCODE_REQUEST_ENTITY_INCOMPLETE;
+    else
+    {
+        size = fs_seek(fd, 0, FS_SEEK_END);
+        if (size >= 0 && (uint32_t)size == offset)
+            code = (len == 0 || fs_write(fd, inpkt->payload.p, len) == len) ? COAP_RSPCODE_CHANGED : COAP_RSPCODE_INTERNAL_SERVER_ERROR;
+        else if (size >= 0 && ((uint32_t)size == offset + len ||    // a retransmitted block, already written
+                               (upload != NULL && (uint32_t)size > offset + len)))
+            code = COAP_RSPCODE_CHANGED;
+        else                                                    // a block is missing
+            code = COAP_RSPCODE_REQUEST_ENTITY_INCOMPLETE;
+        fs_close(fd);
+    }
+    if (start && blockwise && block1.m && inpkt->tok.len > 0 && code == COAP_RSPCODE_CHANGED)
+        upload_start(h, inpkt);
+    else if (upload != NULL && !block1.m && code == COAP_RSPCODE_CHANGED)
+        upload->file = NULL;                                    // complete
+    if (code == COAP_RSPCODE_CHANGED && block1.m)
+        code = COAP_RSPCODE_CONTINUE;
+
+    rc = coap_make_response(scratch, outpkt, NULL, 0, id_hi, id_lo, &inpkt->tok, code, COAP_CONTENTTYPE_NONE);
+    if (rc == 0 && blockwise && (code == COAP_RSPCODE_CONTINUE || code == COAP_RSPCODE_CHANGED))
+        rc = coap_add_block(scratch, outpkt, COAP_OPTION_BLOCK1, &block1);
+    return rc;
+}
 
-coap_luser_entry func_head = {NULL,NULL,NULL};
-coap_luser_entry *function_entry = &func_head;
+coap_luser_table variable_table;
+coap_luser_table function_table;
+coap_luser_table file_table;
 
 const coap_endpoint_t endpoints[] =
 {
-    {COAP_METHOD_GET, handle_get_well_known_core, &path_well_known_core, "ct=40", NULL},
-    {COAP_METHOD_GET, handle_get_variable, &path_variable, "ct=0", &var_head},
-    {COAP_METHOD_POST, handle_post_function, &path_function, NULL, &func_head},
-    {COAP_METHOD_POST, handle_post_command, &path_command, NULL, NULL},
-    {COAP_METHOD_GET, handle_get_id, &path_id, "ct=0", NULL},
-    {(coap_method_t)0, NULL, NULL, NULL, NULL}
+    {COAP_METHOD_GET, handle_get_well_known_core, &path_well_known_core, "ct=40", NULL, 0},
+    {COAP_METHOD_GET, handle_get_variable, &path_variable, "ct=0;obs", &variable_table, COAP_EP_OBSERVE},
+    {COAP_METHOD_POST, handle_post_function, &path_function, NULL, &function_table, 0},
+    {COAP_METHOD_POST, handle_post_command, &path_command, NULL, NULL, 0},
+    {COAP_METHOD_GET, handle_get_id, &path_id, "ct=0", NULL, 0},
+    {COAP_METHOD_GET, handle_get_file, &path_file, "ct=42", &file_table, 0},
+    {COAP_METHOD_PUT, handle_put_file, &path_file, NULL, &file_table, COAP_EP_BLOCK1},
+    {(coap_method_t)0, NULL, NULL, NULL, NULL, 0}
 };
 
-void build_well_known_rsp(char *rsp, uint16_t rsplen)
+// The part of the link-format listing that falls in [offset, offset+len)
+// is copied to buf as it is generated; pos counts the whole listing.
+typedef struct
+{
+    uint8_t *buf;
+    uint32_t offset;
+    size_t len;
+    uint32_t pos;
+} link_window;
+
+static void window_put(link_window *w, const char *s, size_t n)
+{
+    uint32_t start = w->pos, end = w->pos + n;
+    if (end > w->offset && start < w->offset + w->len)
+    {
+        uint32_t from = start < w->offset ? w->offset - start : 0;
+        uint32_t to = end > w->offset + w->len ? w->offset + w->len - start : n;
+        c_memcpy(w->buf + start + from - w->offset, s + from, to - from);
+    }
+    w->pos = end;
+}
+
+// Appends "<[/elem]...[/name]>;attr", comma separated.
+static void append_link(link_window *w, const coap_endpoint_t *ep, const char *name)
 {
-    const coap_endpoint_t *ep = endpoints;
     int i;
-    uint16_t len = rsplen;
 
-    c_memset(rsp, 0, len);
+    if (w->pos)
+        window_put(w, ",", 1);
+    window_put(w, "<", 1);
+    for (i = 0; i < ep->path->count; i++) {
+        window_put(w, "/", 1);
+        window_put(w, ep->path->elems[i], c_strlen(ep->path->elems[i]));
+    }
+    if (name) {
+        window_put(w, "/", 1);
+        window_put(w, name, c_strlen(name));
+    }
+    window_put(w, ">;", 2);
+    window_put(w, ep->core_attr, c_strlen(ep->core_attr));
+}
 
-    len--; // Null-terminated string
+// Copies bytes [offset, offset+len) of the /.well-known/core listing to
+// buf; returns the listing's total length (buf may be NULL when len is 0).
+static uint32_t well_known_read_window(uint8_t *buf, uint32_t offset, size_t len)
+{
+    const coap_endpoint_t *ep = endpoints;
+    link_window w = { buf, offset, len, 0 };
+    coap_luser_entry *h;
+    int b;
 
-    while(NULL != ep->handler)
+    for (; NULL != ep->handler; ep++)
     {
-        if (NULL == ep->core_attr) {
-            ep++;
+        if (NULL == ep->core_attr)
             continue;
-        }
-        if (NULL == ep->user_entry){
-            if (0 < c_strlen(rsp)) {
-                c_strncat(rsp, ",", len);
-                len--;
-            }
-        
-            c_strncat(rsp, "<", len);
-            len--;
+        if (NULL == ep->user_entry)
+            append_link(&w, ep, NULL);
+        else
+            for (b = 0; b < COAP_LUSER_BUCKETS; b++)
+                for (h = ep->user_entry->bucket[b]; NULL != h; h = h->next)
+                    append_link(&w, ep, h->name);
+    }
+    return w.pos;
+}
 
-            for (i = 0; i < ep->path->count; i++) {
-                c_strncat(rsp, "/", len);
-                len--;
+// Observers (RFC 7641): each is a peer watching one resource, /path or
+// /path/[name]. coap_observe_check() re-runs the resource's handler for
+// every observer and sends the response as a notification only when it
+// differs from the last one sent, or the last one is about to reach its
+// Max-Age. Only side-effect free GET handlers may be observable, as they
+// are re-run from the timer.
+typedef struct
+{
+    const coap_endpoint_t *ep;          /* NULL if the slot is free */
+    coap_luser_entry *h;                /* NULL for /path itself */
+    coap_peer_t peer;
+    uint8_t tok[8];
+    uint8_t tkl;
+    uint8_t unacked;                    /* CON notifications not acknowledged */
+    uint8_t con_id[2];                  /* message id of the last one */
+    uint8_t last_id[2];                 /* message id of the last notification */
+    uint32_t seq;                       /* Observe value, 24 bits on the wire */
+    uint32_t hash;                      /* of the last response sent */
+    uint32_t sent;                      /* ms, when it was sent */
+} coap_observer_t;
 
-                c_strncat(rsp, ep->path->elems[i], len);
-                len -= c_strlen(ep->path->elems[i]);
-            }
+static coap_observer_t observers[COAP_MAX_OBSERVERS];
+static uint8_t observer_count;
+static os_timer_t observe_timer;
 
-            c_strncat(rsp, ">;", len);
-            len -= 2;
+// The notification being built. Kept off the stack: observe_notify() runs
+// on the SDK timer with the Lua handler on top, and never nests.
+static uint8_t notify_buf[MAX_MESSAGE_SIZE];
+static coap_packet_t notify_req, notify_rsp;
 
-            c_strncat(rsp, ep->core_attr, len);
-            len -= c_strlen(ep->core_attr);
-        } else {
-            coap_luser_entry *h = ep->user_entry->next;     // ->next: skip the first entry(head)
-            while(NULL != h){
-                if (0 < c_strlen(rsp)) {
-                    c_strncat(rsp, ",", len);
-                    len--;
-                }
-            
-                c_strncat(rsp, "<", len);
-                len--;
+static uint32_t response_hash(const coap_packet_t *pkt)
+{
+    return coap_luser_hash(pkt->payload.p, pkt->payload.len) ^ pkt->hdr.code;
+}
 
-                for (i = 0; i < ep->path->count; i++) {
-                    c_strncat(rsp, "/", len);
-                    len--;
+static int same_peer(const coap_peer_t *a, const coap_peer_t *b)
+{
+    return a->conn == b->conn && a->ip == b->ip && a->port == b->port;
+}
 
-                    c_strncat(rsp, ep->path->elems[i], len);
-                    len -= c_strlen(ep->path->elems[i]);
-                }
+static void observer_remove(coap_observer_t *o)
+{
+    o->ep = NULL;
+    if (--observer_count == 0)
+        os_timer_disarm(&observe_timer);
+}
 
-                c_strncat(rsp, "/", len);
-                len--;
+static int observe_add_options(coap_rw_buffer_t *scratch, coap_packet_t *pkt, const coap_observer_t *o)
+{
+    int rc = coap_add_option(scratch, pkt, COAP_OPTION_OBSERVE, o->seq & 0xFFFFFF);
+    if (rc == 0)
+        rc = coap_add_option(scratch, pkt, COAP_OPTION_MAX_AGE, COAP_OBSERVE_MAX_AGE);
+    return rc;
+}
 
-                c_strncat(rsp, h->name, len);
-                len -= c_strlen(h->name);
+// Called by coap_handle_req() once ep's handler has answered a GET: an
+// Observe 0 registers (or re-registers) the sender and marks the response
+// as the first notification; Observe 1, or a plain GET with the
+// observation's token, deregisters.
+int coap_observe_request(const coap_endpoint_t *ep, coap_rw_buffer_t *scratch, const coap_packet_t *inpkt, coap_packet_t *outpkt)
+{
+    const coap_option_t *opt;
+    coap_observer_t *o = NULL, *free_slot = NULL;
+    coap_luser_entry *h = NULL;
+    coap_block_t block2;
+    uint32_t value = 0;
+    uint8_t count;
+    int i, known;
 
-                c_strncat(rsp, ">;", len);
-                len -= 2;
+    if (inpkt->peer == NULL || inpkt->hdr.code != COAP_METHOD_GET)
+        return 0;
+    if (ep->user_entry && NULL == (h = endpoint_luser(ep, inpkt, &known)))
+        return 0;
+    for (i = 0; i < COAP_MAX_OBSERVERS; i++)
+    {
+        if (observers[i].ep == NULL)
+        {
+            if (free_slot == NULL)
+                free_slot = &observers[i];
+        }
+        else if (observers[i].ep == ep && observers[i].h == h && same_peer(&observers[i].peer, inpkt->peer))
+            o = &observers[i];
+    }
 
-                c_strncat(rsp, ep->core_attr, len);
-                len -= c_strlen(ep->core_attr);  
+    opt = coap_findOptions(inpkt, COAP_OPTION_OBSERVE, &count);
+    if (opt)
+        for (i = 0; i < opt->buf.len; i++)
+            value = (value << 8) | opt->buf.p[i];
+    if (opt == NULL || value != 0 || COAP_RESPONSE_CLASS(outpkt->hdr.code) != 2)
+    {
+        // later blocks of a notification are fetched without Observe
+        if (o && (opt || (!coap_get_block(inpkt, COAP_OPTION_BLOCK2, &block2) &&
+                          o->tkl == inpkt->tok.len && 0 == c_memcmp(o->tok, inpkt->tok.p, o->tkl))))
+            observer_remove(o);
+        return 0;
+    }
 
-                h = h->next;
-            }
+    if (o == NULL)
+    {
+        if (NULL == (o = free_slot))
+            return 0;   // table full: a plain response, which tells the client so
+        o->ep = ep;
+        o->h = h;
+        o->peer = *inpkt->peer;
+        o->seq = 0;
+        if (observer_count++ == 0)
+        {
+            os_timer_disarm(&observe_timer);
+            os_timer_setfn(&observe_timer, (os_timer_func_t *)coap_observe_check, NULL);
+            os_timer_arm(&observe_timer, COAP_OBSERVE_CHECK_MS, 1);
         }
-        ep++;
     }
+    o->tkl = inpkt->tok.len;
+    c_memcpy(o->tok, inpkt->tok.p, o->tkl);
+    o->unacked = 0;
+    o->seq++;
+    o->hash = response_hash(outpkt);
+    o->sent = coap_timer_now();
+    return observe_add_options(scratch, outpkt, o);
 }
 
+// An ACK or RST from a peer, which can only answer a notification
+void coap_observe_reply(const coap_packet_t *pkt)
+{
+    int i;
+    coap_observe_acked(pkt->peer, pkt);
+    for (i = 0; i < COAP_MAX_OBSERVERS; i++)
+    {
+        coap_observer_t *o = &observers[i];
+        if (o->ep == NULL || !same_peer(&o->peer, pkt->peer))
+            continue;
+        if (pkt->hdr.t == COAP_TYPE_RESET)
+        {
+            // the client has forgotten the observation
+            if (0 == c_memcmp(o->last_id, pkt->hdr.id, 2) || 0 == c_memcmp(o->con_id, pkt->hdr.id, 2))
+                observer_remove(o);
+        }
+        else if (0 == c_memcmp(o->con_id, pkt->hdr.id, 2))
+            o->unacked = 0;
+    }
+}
+
+// Drops the observers that came in through conn, when it closes
+void coap_observe_forget(void *conn)
+{
+    int i;
+    for (i = 0; i < COAP_MAX_OBSERVERS; i++)
+        if (observers[i].ep != NULL && observers[i].peer.conn == conn)
+            observer_remove(&observers[i]);
+}
+
+typedef struct
+{
+    coap_observer_t *o;
+    coap_rw_buffer_t *scratch;
+    coap_packet_t *req;
+    coap_packet_t *rsp;
+    int rc;
+} observe_call_t;
+
+static int observe_call(lua_State *L)
+{
+    observe_call_t *c = (observe_call_t *)lua_touserdata(L, 1);
+    c->rc = c->o->ep->handler(c->o->ep, c->scratch, c->req, c->rsp, c->req->hdr.id[0], c->req->hdr.id[1]);
+    return 0;
+}
+
+static void observe_notify(coap_observer_t *o, uint32_t now)
+{
+    size_t len = sizeof(notify_buf);
+    uint8_t scratch_raw[16];
+    coap_rw_buffer_t scratch = {scratch_raw, sizeof(scratch_raw)};
+    uint32_t hash;
+    int i, refresh, con, rc;
+
+    // the GET the observer would send now
+    c_memset(&notify_req, 0, sizeof(notify_req));
+    notify_req.hdr.ver = 0x01;
+    notify_req.hdr.t = COAP_TYPE_NONCON;
+    notify_req.hdr.tkl = o->tkl;
+    notify_req.hdr.code = COAP_METHOD_GET;
+    notify_req.hdr.id[0] = notify_id >> 8;
+    notify_req.hdr.id[1] = notify_id & 0xFF;
+    notify_req.tok.p = o->tok;
+    notify_req.tok.len = o->tkl;
+    for (i = 0; i < o->ep->path->count; i++)
+    {
+        notify_req.opts[i].num = COAP_OPTION_URI_PATH;
+        notify_req.opts[i].buf.p = (const uint8_t *)o->ep->path->elems[i];
+        notify_req.opts[i].buf.len = c_strlen(o->ep->path->elems[i]);
+    }
+    if (o->h)
+    {
+        notify_req.opts[i].num = COAP_OPTION_URI_PATH;
+        notify_req.opts[i].buf.p = (const uint8_t *)o->h->name;
+        notify_req.opts[i].buf.len = o->h->len;
+        i++;
+    }
+    notify_req.numopts = i;
+
+    notify_rsp.content.p = NULL;
+    notify_rsp.content.len = 0;
+    if (o->h && o->h->L)
+    {
+        // nothing would catch a Lua error on the timer, so run it protected
+        observe_call_t call = { o, &scratch, &notify_req, &notify_rsp, -1 };
+        if (0 != lua_cpcall(o->h->L, observe_call, &call))
+        {
+            NODE_DBG("observe: %s\n", lua_tostring(o->h->L, -1));
+            lua_pop(o->h->L, 1);
+        }
+        rc = call.rc;
+    }
+    else
+        rc = o->ep->handler(o->ep, &scratch, &notify_req, &notify_rsp, notify_req.hdr.id[0], notify_req.hdr.id[1]);
+    hash = response_hash(&notify_rsp);
+    refresh = now - o->sent >= (COAP_OBSERVE_MAX_AGE - COAP_OBSERVE_MAX_AGE_MARGIN) * 1000;
+    if (rc != 0 || (hash == o->hash && !refresh))
+        goto done;
+
+    o->seq++;
+    con = refresh || o->seq % COAP_OBSERVE_CON_EVERY == 0;
+    if (con && o->unacked >= COAP_OBSERVE_MAX_UNACKED)
+    {
+        NODE_DBG("observer gone.\n");
+        observer_remove(o);
+        goto done;
+    }
+    notify_rsp.hdr.t = con ? COAP_TYPE_CON : COAP_TYPE_NONCON;
+    if (0 != observe_add_options(&scratch, &notify_rsp, o) || 0 != coap_build(notify_buf, &len, &notify_rsp))
+        goto done;
+    notify_id++;
+    c_memcpy(o->last_id, notify_rsp.hdr.id, 2);
+    if (con)
+    {
+        c_memcpy(o->con_id, notify_rsp.hdr.id, 2);
+        o->unacked++;
+    }
+    o->hash = hash;
+    o->sent = now;
+    coap_observe_send(&o->peer, notify_buf, len, con);
+    // an error response ends the observation, http://tools.ietf.org/html/rfc7641#section-4.2
+    if (COAP_RESPONSE_CLASS(notify_rsp.hdr.code) != 2)
+        observer_remove(o);
+done:
+    if (notify_rsp.content.p)
+        c_free(notify_rsp.content.p);
+}
+
+// Runs every COAP_OBSERVE_CHECK_MS while anyone is observing
+void coap_observe_check(void)
+{
+    uint32_t now = coap_timer_now();
+    int i;
+    for (i = 0; i < COAP_MAX_OBSERVERS; i++)
+        if (observers[i].ep != NULL)
+            observe_notify(&observers[i], now);
+}
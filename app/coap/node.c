@@ -2,6 +2,9 @@
 #include "c_stdlib.h"
 #include "node.h"
 
+#define BEFORE(a, b) ((int32_t)((a)->t - (b)->t) < 0)
+#define BUCKET(queue, id) (&(queue)->bucket[(unsigned)(id) & (COAP_QUEUE_BUCKETS - 1)])
+
 static inline coap_queue_t *
 coap_malloc_node(void) {
   return (coap_queue_t *)c_zalloc(sizeof(coap_queue_t));
@@ -11,42 +14,6 @@ void coap_free_node(coap_queue_t *node) {
   c_free(node);
 }
 
-int coap_insert_node(coap_queue_t **queue, coap_queue_t *node) {
-  coap_queue_t *p, *q;
-  if ( !queue || !node )
-    return 0;
-
-  /* set queue head if empty */
-  if ( !*queue ) {
-    *queue = node;
-    return 1;
-  }
-
-  /* replace queue head if PDU's time is less than head's time */
-  q = *queue;
-  if (node->t < q->t) {
-    node->next = q;
-    *queue = node;
-    q->t -= node->t;		/* make q->t relative to node->t */
-    return 1;
-  }
-
-  /* search for right place to insert */
-  do {
-    node->t -= q->t;		/* make node-> relative to q->t */
-    p = q;
-    q = q->next;
-  } while (q && q->t <= node->t);
-
-  /* insert new item */
-  if (q) {
-    q->t -= node->t;		/* make q->t relative to node->t */
-  }
-  node->next = q;
-  p->next = node;
-  return 1;
-}
-
 int coap_delete_node(coap_queue_t *node) {
   if ( !node )
     return 0;
@@ -57,14 +24,6 @@ int coap_delete_node(coap_queue_t *node) {
   return 1;
 }
 
-void coap_delete_all(coap_queue_t *queue) {
-  if ( !queue )
-    return;
-
-  coap_delete_all( queue->next );
-  coap_delete_node( queue );
-}
-
 coap_queue_t * coap_new_node(void) {
   coap_queue_t *node;
   node = coap_malloc_node();
@@ -77,65 +36,194 @@ coap_queue_t * coap_new_node(void) {
   return node;
 }
 
-coap_queue_t * coap_peek_next( coap_queue_t *queue ) {
+static inline void heap_set(coap_sendqueue_t *queue, unsigned i, coap_queue_t *node) {
+  queue->heap[i] = node;
+  node->index = i;
+}
+
+/* moves the node at i towards the root while it is due before its parent */
+static void heap_up(coap_sendqueue_t *queue, unsigned i) {
+  coap_queue_t *node = queue->heap[i];
+
+  while (i > 0) {
+    unsigned parent = (i - 1) / 2;
+    if (!BEFORE(node, queue->heap[parent]))
+      break;
+    heap_set(queue, i, queue->heap[parent]);
+    i = parent;
+  }
+  heap_set(queue, i, node);
+}
+
+/* moves the node at i towards the leaves while a child is due before it */
+static void heap_down(coap_sendqueue_t *queue, unsigned i) {
+  coap_queue_t *node = queue->heap[i];
+  unsigned n = queue->count;
+
+  for (;;) {
+    unsigned child = 2 * i + 1;
+    if (child >= n)
+      break;
+    if (child + 1 < n && BEFORE(queue->heap[child + 1], queue->heap[child]))
+      child++;
+    if (!BEFORE(queue->heap[child], node))
+      break;
+    heap_set(queue, i, queue->heap[child]);
+    i = child;
+  }
+  heap_set(queue, i, node);
+}
+
+int coap_insert_node(coap_sendqueue_t *queue, coap_queue_t *node) {
+  coap_queue_t **b;
+  if ( !queue || !node || queue->count >= COAP_QUEUE_SIZE )
+    return 0;
+
+  b = BUCKET(queue, node->id);
+  node->next = *b;
+  *b = node;
+
+  heap_set(queue, queue->count++, node);
+  heap_up(queue, node->index);
+  return 1;
+}
+
+void coap_unlink_node(coap_sendqueue_t *queue, coap_queue_t *node) {
+  coap_queue_t **p;
+  unsigned i = node->index;
+
+  for (p = BUCKET(queue, node->id); *p; p = &(*p)->next) {
+    if (*p == node) {
+      *p = node->next;
+      break;
+    }
+  }
+  node->next = NULL;
+
+  /* fill the hole with the last node, which may belong above or below it */
+  if (i != --queue->count) {
+    coap_queue_t *last = queue->heap[queue->count];
+    heap_set(queue, i, last);
+    heap_up(queue, i);
+    heap_down(queue, last->index);
+  }
+  queue->heap[queue->count] = NULL;
+}
+
+coap_queue_t * coap_find_node(const coap_sendqueue_t *queue, const coap_tid_t id) {
+  coap_queue_t *node;
   if ( !queue )
     return NULL;
 
-  return queue;
+  for (node = queue->bucket[(unsigned)id & (COAP_QUEUE_BUCKETS - 1)]; node; node = node->next)
+    if (node->id == id)
+      return node;
+  return NULL;
 }
 
-coap_queue_t * coap_pop_next( coap_queue_t **queue ) {		// this function is called inside timeout callback only.
-  coap_queue_t *next;
-
-  if ( !(*queue) )
+coap_queue_t * coap_peek_next(const coap_sendqueue_t *queue) {
+  if ( !queue || !queue->count )
     return NULL;
 
-  next = *queue;
-  *queue = (*queue)->next;
-  // if (queue) {
-  //   queue->t += next->t;
-  // }
-  next->next = NULL;
-  return next;
+  return queue->heap[0];
 }
 
-int coap_remove_node( coap_queue_t **queue, const coap_tid_t id){
-  coap_queue_t *p, *q, *node;
-  if ( !queue ) 
-    return 0;
-  if ( !*queue )  // if empty
+int coap_remove_node(coap_sendqueue_t *queue, const coap_tid_t id) {
+  coap_queue_t *node = coap_find_node(queue, id);
+  if ( !node )
     return 0;
 
-  q = *queue;
-  if (q->id == id) {
-    node = q;
-    *queue = q->next;
-    node->next = NULL;
-    if(*queue){
-      (*queue)->t += node->t;
+  coap_unlink_node(queue, node);
+  coap_delete_node(node);
+  return 1;
+}
+
+int coap_inflight(const coap_sendqueue_t *queue, uint32_t ip, uint16_t port) {
+  int i, n = 0;
+
+  for (i = 0; i < queue->count; i++)
+    if (queue->heap[i]->ip == ip && queue->heap[i]->port == port)
+      n++;
+  return n;
+}
+
+void coap_wait_node(coap_sendqueue_t *queue, coap_queue_t *node) {
+  node->next = NULL;
+  if (queue->wait_tail)
+    queue->wait_tail->next = node;
+  else
+    queue->wait = node;
+  queue->wait_tail = node;
+}
+
+coap_queue_t * coap_next_waiting(coap_sendqueue_t *queue) {
+  coap_queue_t *node, *prev = NULL;
+
+  if (queue->count >= COAP_QUEUE_SIZE)
+    return NULL;
+  /* in order, but one busy peer does not hold up the others */
+  for (node = queue->wait; node; prev = node, node = node->next) {
+    if (coap_inflight(queue, node->ip, node->port) < COAP_NSTART) {
+      if (prev)
+        prev->next = node->next;
+      else
+        queue->wait = node->next;
+      if (queue->wait_tail == node)
+        queue->wait_tail = prev;
+      node->next = NULL;
+      return node;
     }
-    coap_delete_node(node);
-    return 1;
   }
+  return NULL;
+}
 
-  /* search for right node to remove */
-  while (q && q->id != id) {
-    p = q;
-    q = q->next;
-  }
+int coap_queue_busy(const coap_sendqueue_t *queue, const struct espconn *pconn) {
+  const coap_queue_t *node;
+  int i;
+
+  for (i = 0; i < queue->count; i++)
+    if (queue->heap[i]->pconn == pconn)
+      return 1;
+  for (node = queue->wait; node; node = node->next)
+    if (node->pconn == pconn)
+      return 1;
+  return 0;
+}
+
+void coap_delete_all(coap_sendqueue_t *queue, const struct espconn *pconn) {
+  coap_queue_t *node, **p;
+  unsigned i, n = 0;
+
+  if ( !queue )
+    return;
 
-  /* find the node */
-  if (q) {
-    node = q; /* save the node */
-    p->next = q->next;  /* remove the node */
-    q = q->next;
-    node->next = NULL;
-    if (q)   // add node->t to the node after.
-    {
-      q->t += node->t;
+  /* keep the others, then rebuild the hash and the heap around them */
+  c_memset(queue->bucket, 0, sizeof(queue->bucket));
+  for (i = 0; i < queue->count; i++) {
+    node = queue->heap[i];
+    if (!pconn || node->pconn == pconn) {
+      coap_delete_node(node);
+    } else {
+      p = BUCKET(queue, node->id);
+      node->next = *p;
+      *p = node;
+      heap_set(queue, n++, node);
+    }
+  }
+  for (i = n; i < queue->count; i++)
+    queue->heap[i] = NULL;
+  queue->count = n;
+  for (i = n / 2; i-- > 0; )
+    heap_down(queue, i);
+
+  queue->wait_tail = NULL;
+  for (p = &queue->wait; (node = *p); ) {
+    if (!pconn || node->pconn == pconn) {
+      *p = node->next;
+      coap_delete_node(node);
+    } else {
+      queue->wait_tail = node;
+      p = &node->next;
     }
-    coap_delete_node(node);
-    return 1;
   }
-  return 0;
 }
@@ -9,47 +9,87 @@ extern "C" {
 #include "pdu.h"
 
 struct coap_queue_t;
+struct espconn;
 typedef uint32_t coap_tick_t;
 
 /*
-1. queue(first)->t store when to send PDU for the next time, it's a base(absolute) time
-2. queue->next->t store the delta between time and base-time.  queue->next->t = timeout + now - basetime
-3. node->next->t store the delta between time and previous->t.  node->next->t = timeout + now - node->t - basetime
-4. time to fire:   10,   15,    18,    25
-		node->t:   10,   5,     3,     7
+Confirmable messages waiting for their ACK are kept twice over:
+1. in a binary min-heap on node->t, the absolute time of the next
+   retransmission, so the timer is armed for heap[0] and the earliest one
+   is found in O(1) and taken out in O(log n);
+2. in a hash on node->id, so the ACK finds its node without a walk.
+Messages held back because their peer already has COAP_NSTART in flight
+(RFC 7252 4.7), or because the heap is full, wait in a FIFO in neither.
+Times compare modulo 2^32: a is earlier than b if (int32_t)(a - b) < 0.
 */
 
+#define COAP_QUEUE_SIZE    32   /* confirmable messages in flight, at most */
+#define COAP_QUEUE_BUCKETS 16   /* tid hash buckets, a power of two */
+#define COAP_NSTART        4    /* in flight to one peer, at most */
+
 typedef struct coap_queue_t {
-  struct coap_queue_t *next;
+  struct coap_queue_t *next;	/**< next in the tid bucket, or waiting */
 
   coap_tick_t t;	        /**< when to send PDU for the next time */
   unsigned char retransmit_cnt;	/**< retransmission counter, will be removed when zero */
+  unsigned char index;		/**< place in the heap */
   unsigned int timeout;		/**< the randomized timeout value */
 
   coap_tid_t id;		/**< unique transaction id */
+  uint32_t ip;			/**< the peer it goes to */
+  uint16_t port;
 
   // coap_packet_t *pkt;
   coap_pdu_t *pdu;		/**< the CoAP PDU to send */
   struct espconn *pconn;
 } coap_queue_t;
 
-void coap_free_node(coap_queue_t *node);
+typedef struct coap_sendqueue_t {
+  coap_queue_t *heap[COAP_QUEUE_SIZE];
+  coap_queue_t *bucket[COAP_QUEUE_BUCKETS];
+  coap_queue_t *wait, *wait_tail;
+  unsigned char count;		/**< nodes in the heap */
+} coap_sendqueue_t;
 
-/** Adds node to given queue, ordered by node->t. */
-int coap_insert_node(coap_queue_t **queue, coap_queue_t *node);
+void coap_free_node(coap_queue_t *node);
 
 /** Destroys specified node. */
 int coap_delete_node(coap_queue_t *node);
 
-/** Removes all items from given queue and frees the allocated storage. */
-void coap_delete_all(coap_queue_t *queue);
-
 /** Creates a new node suitable for adding to the CoAP sendqueue. */
 coap_queue_t *coap_new_node(void);
 
-coap_queue_t *coap_pop_next( coap_queue_t **queue );
+/** Adds node to the heap and the hash, by node->t and node->id. Returns 0
+ * if the heap is full. */
+int coap_insert_node(coap_sendqueue_t *queue, coap_queue_t *node);
+
+/** Takes node out of the heap and the hash, without freeing it. */
+void coap_unlink_node(coap_sendqueue_t *queue, coap_queue_t *node);
+
+/** The node with transaction id, or NULL. */
+coap_queue_t *coap_find_node(const coap_sendqueue_t *queue, const coap_tid_t id);
+
+/** The node to retransmit first, or NULL. */
+coap_queue_t *coap_peek_next(const coap_sendqueue_t *queue);
+
+/** Unlinks and destroys the node with transaction id. */
+int coap_remove_node(coap_sendqueue_t *queue, const coap_tid_t id);
+
+/** Number of messages in flight to ip:port. */
+int coap_inflight(const coap_sendqueue_t *queue, uint32_t ip, uint16_t port);
+
+/** Appends node to the messages waiting for their turn. */
+void coap_wait_node(coap_sendqueue_t *queue, coap_queue_t *node);
+
+/** Takes the first waiting node that may be sent now off the FIFO, or
+ * returns NULL. */
+coap_queue_t *coap_next_waiting(coap_sendqueue_t *queue);
+
+/** Whether messages of pconn are in flight or waiting. */
+int coap_queue_busy(const coap_sendqueue_t *queue, const struct espconn *pconn);
 
-int coap_remove_node( coap_queue_t **queue, const coap_tid_t id);
+/** Destroys all messages of pconn, or all of them if pconn is NULL. */
+void coap_delete_all(coap_sendqueue_t *queue, const struct espconn *pconn);
 
 #ifdef __cplusplus
 }
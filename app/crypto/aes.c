@@ -0,0 +1,9 @@
+/*
+ * Builds the axTLS AES code into libcrypto.a under the crypto_aes_* names
+ * from aes.h. See there for why.
+ */
+#include "aes.h"
+
+uint8_t byte_of_aligned_array(const uint8_t *aligned_array, uint32_t index);
+
+#include "../ssl/crypto/ssl_aes.c"
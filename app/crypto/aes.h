@@ -0,0 +1,37 @@
+#ifndef _CRYPTO_AES_H_
+#define _CRYPTO_AES_H_
+
+/**
+ * AES for the crypto module.
+ *
+ * This is the axTLS implementation in app/ssl/crypto/ssl_aes.c, compiled
+ * into libcrypto.a by aes.c. The SDK's libssl.a exports an older copy of the
+ * same AES_* functions for its own TLS use, so ours are renamed here to stay
+ * clear of it; include this header instead of ssl/ssl_crypto.h and use the
+ * usual AES_* names. Only the AES part of the axTLS headers is pulled in, as
+ * the rest clashes with rom.h.
+ *
+ * Typical usage:
+ *   AES_CTX ctx;
+ *   AES_set_key (&ctx, key, iv, AES_MODE_128);
+ *   AES_cbc_encrypt (&ctx, in, out, len);      // len a multiple of 16
+ * or, for decryption,
+ *   AES_set_key (&ctx, key, iv, AES_MODE_128);
+ *   AES_convert_key (&ctx);
+ *   AES_cbc_decrypt (&ctx, in, out, len);
+ * or, in counter mode (either direction, any length),
+ *   int offset = 0;
+ *   uint8_t stream[AES_BLOCKSIZE];
+ *   AES_set_key (&ctx, key, counter, AES_MODE_256);
+ *   AES_ctr_crypt (&ctx, stream, &offset, in, out, len);
+ */
+#define AES_set_key      crypto_aes_set_key
+#define AES_convert_key  crypto_aes_convert_key
+#define AES_cbc_encrypt  crypto_aes_cbc_encrypt
+#define AES_cbc_decrypt  crypto_aes_cbc_decrypt
+#define AES_ctr_crypt    crypto_aes_ctr_crypt
+
+#include <c_types.h>
+#include "ssl/ssl_aes.h"
+
+#endif
@@ -121,31 +121,23 @@ int ICACHE_FLASH_ATTR crypto_hash (const digest_mech_info_t *mi,
 }
 
 
-int ICACHE_FLASH_ATTR crypto_hmac (const digest_mech_info_t *mi,
-   const char *data, size_t data_len,
-   const char *key, size_t key_len,
-   uint8_t *digest)
+void ICACHE_FLASH_ATTR crypto_hmac_begin (const digest_mech_info_t *mi,
+   void *ctx, const char *key, size_t key_len, uint8_t *k_opad)
 {
-  if (!mi)
-    return EINVAL;
-
-  void *ctx = os_malloc (mi->ctx_size);
-  if (!ctx)
-    return ENOMEM;
+  uint8_t hashed_key[mi->digest_size];
 
   // If key too long, it needs to be hashed before use
   if (key_len > mi->block_size)
   {
     mi->create (ctx);
     mi->update (ctx, key, key_len);
-    mi->finalize (digest, ctx);
-    key = digest;
+    mi->finalize (hashed_key, ctx);
+    key = hashed_key;
     key_len = mi->digest_size;
   }
 
   const size_t bs = mi->block_size;
   uint8_t k_ipad[bs];
-  uint8_t k_opad[bs];
 
   os_memset (k_ipad, 0x36, bs);
   os_memset (k_opad, 0x5c, bs);
@@ -158,13 +150,37 @@ int ICACHE_FLASH_ATTR crypto_hmac (const digest_mech_info_t *mi,
 
   mi->create (ctx);
   mi->update (ctx, k_ipad, bs);
-  mi->update (ctx, data, data_len);
+}
+
+
+void ICACHE_FLASH_ATTR crypto_hmac_finalize (const digest_mech_info_t *mi,
+   void *ctx, const uint8_t *k_opad, uint8_t *digest)
+{
   mi->finalize (digest, ctx);
 
   mi->create (ctx);
-  mi->update (ctx, k_opad, bs);
+  mi->update (ctx, k_opad, mi->block_size);
   mi->update (ctx, digest, mi->digest_size);
   mi->finalize (digest, ctx);
+}
+
+
+int ICACHE_FLASH_ATTR crypto_hmac (const digest_mech_info_t *mi,
+   const char *data, size_t data_len,
+   const char *key, size_t key_len,
+   uint8_t *digest)
+{
+  if (!mi)
+    return EINVAL;
+
+  void *ctx = os_malloc (mi->ctx_size);
+  if (!ctx)
+    return ENOMEM;
+
+  uint8_t k_opad[mi->block_size];
+  crypto_hmac_begin (mi, ctx, key, key_len, k_opad);
+  mi->update (ctx, data, data_len);
+  crypto_hmac_finalize (mi, ctx, k_opad, digest);
 
   os_free (ctx);
   return 0;
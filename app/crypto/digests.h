@@ -67,6 +67,28 @@ int crypto_hash (const digest_mech_info_t *mi, const char *data, size_t data_len
  */
 int crypto_hmac (const digest_mech_info_t *mi, const char *data, size_t data_len, const char *key, size_t key_len, uint8_t *digest);
 
+/**
+ * Begin an incremental HMAC computation. Afterwards, feed the message
+ * through @c mi->update(ctx, ...) and complete with
+ * @c crypto_hmac_finalize().
+ * @param mi       A mech from @c crypto_digest_mech(). Must not be null.
+ * @param ctx      Context buffer of at least @c mi->ctx_size bytes.
+ * @param key      The key to use.
+ * @param key_len  Number of bytes the @c key comprises.
+ * @param k_opad   Output buffer for the outer padded key, must be at least
+ *                 @c mi->block_size in size and be kept until finalization.
+ */
+void crypto_hmac_begin (const digest_mech_info_t *mi, void *ctx, const char *key, size_t key_len, uint8_t *k_opad);
+
+/**
+ * Complete an HMAC computation started with @c crypto_hmac_begin().
+ * @param mi       The mech passed to @c crypto_hmac_begin().
+ * @param ctx      The context passed to @c crypto_hmac_begin().
+ * @param k_opad   The outer padded key produced by @c crypto_hmac_begin().
+ * @param digest   Output buffer, must be at least @c mi->digest_size in size.
+ */
+void crypto_hmac_finalize (const digest_mech_info_t *mi, void *ctx, const uint8_t *k_opad, uint8_t *digest);
+
 /**
  * Perform ASCII Hex encoding. Does not null-terminate the buffer.
  *
@@ -53,10 +53,12 @@
  *
  *   cc -DSHA2_UNROLL_TRANSFORM -o sha2 sha2.c sha2prog.c
  *
- * or define below:
+ * or define below (NodeMCU: in user_config.h):
  *
  *   #define SHA2_UNROLL_TRANSFORM
  *
+ * The unrolled SHA-256 transform also accepts input that is not word
+ * aligned, and keeps its message schedule on the stack.
  */
 
 
@@ -145,8 +147,8 @@ typedef uint64_t sha2_word64;	/* Exactly 8 bytes */
 #define S64(b,x)	(((x) >> (b)) | ((x) << (64 - (b))))
 
 /* Two of six logical functions used in SHA-256, SHA-384, and SHA-512: */
-#define Ch(x,y,z)	(((x) & (y)) ^ ((~(x)) & (z)))
-#define Maj(x,y,z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define Ch(x,y,z)	((z) ^ ((x) & ((y) ^ (z))))
+#define Maj(x,y,z)	(((x) & (y)) | ((z) & ((x) | (y))))
 
 /* Four of six logical functions used in SHA-256: */
 #define Sigma0_256(x)	(S32(2,  (x)) ^ S32(13, (x)) ^ S32(22, (x)))
@@ -284,47 +286,55 @@ void ICACHE_FLASH_ATTR SHA256_Init(SHA256_CTX* context) {
 
 #ifdef SHA2_UNROLL_TRANSFORM
 
-/* Unrolled SHA-256 round macros: */
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN_
-
-#define ROUND256_0_TO_15(a,b,c,d,e,f,g,h)	\
-	REVERSE32(*data++, W256[j]); \
-	T1 = (h) + Sigma1_256(e) + Ch((e), (f), (g)) + \
-             K256[j] + W256[j]; \
-	(d) += T1; \
-	(h) = T1 + Sigma0_256(a) + Maj((a), (b), (c)); \
-	j++
-
-
-#else /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN_ */
-
-#define ROUND256_0_TO_15(a,b,c,d,e,f,g,h)	\
-	T1 = (h) + Sigma1_256(e) + Ch((e), (f), (g)) + \
-	     K256[j] + (W256[j] = *data++); \
-	(d) += T1; \
-	(h) = T1 + Sigma0_256(a) + Maj((a), (b), (c)); \
-	j++
-
-#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN_ */
+/*
+ * Unrolled SHA-256: the whole 64 word message schedule is expanded up
+ * front, so the rounds themselves only index W256/K256 with constants.
+ * Word aligned input is loaded a word at a time; anything else falls
+ * back to byte loads (the ESP8266 faults on unaligned word access).
+ */
+#define LOAD32_BE(p)	(((sha2_word32)(p)[0] << 24) | \
+			 ((sha2_word32)(p)[1] << 16) | \
+			 ((sha2_word32)(p)[2] <<  8) | \
+			  (sha2_word32)(p)[3])
 
-#define ROUND256(a,b,c,d,e,f,g,h)	\
-	s0 = W256[(j+1)&0x0f]; \
-	s0 = sigma0_256(s0); \
-	s1 = W256[(j+14)&0x0f]; \
-	s1 = sigma1_256(s1); \
-	T1 = (h) + Sigma1_256(e) + Ch((e), (f), (g)) + K256[j] + \
-	     (W256[j&0x0f] += s1 + W256[(j+9)&0x0f] + s0); \
+#define ROUND256(a,b,c,d,e,f,g,h,j)	\
+	T1 = (h) + Sigma1_256(e) + Ch((e), (f), (g)) + K256[j] + W256[j]; \
 	(d) += T1; \
-	(h) = T1 + Sigma0_256(a) + Maj((a), (b), (c)); \
-	j++
+	(h) = T1 + Sigma0_256(a) + Maj((a), (b), (c))
+
+#define ROUND256_8(j)	\
+	ROUND256(a,b,c,d,e,f,g,h,(j)+0); \
+	ROUND256(h,a,b,c,d,e,f,g,(j)+1); \
+	ROUND256(g,h,a,b,c,d,e,f,(j)+2); \
+	ROUND256(f,g,h,a,b,c,d,e,(j)+3); \
+	ROUND256(e,f,g,h,a,b,c,d,(j)+4); \
+	ROUND256(d,e,f,g,h,a,b,c,(j)+5); \
+	ROUND256(c,d,e,f,g,h,a,b,(j)+6); \
+	ROUND256(b,c,d,e,f,g,h,a,(j)+7)
 
 void ICACHE_FLASH_ATTR SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
-	sha2_word32	a, b, c, d, e, f, g, h, s0, s1;
-	sha2_word32	T1, *W256;
+	sha2_word32	a, b, c, d, e, f, g, h, T1;
+	sha2_word32	W256[64];
 	int		j;
 
-	W256 = (sha2_word32*)context->buffer;
+	if (((size_t)data & 3) == 0) {
+		for (j = 0; j < 16; j++) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			REVERSE32(data[j], W256[j]);
+#else
+			W256[j] = data[j];
+#endif
+		}
+	} else {
+		const sha2_byte *p = (const sha2_byte *)data;
+		for (j = 0; j < 16; j++, p += 4) {
+			W256[j] = LOAD32_BE(p);
+		}
+	}
+	for (j = 16; j < 64; j++) {
+		W256[j] = sigma1_256(W256[j-2]) + W256[j-7] +
+			  sigma0_256(W256[j-15]) + W256[j-16];
+	}
 
 	/* Initialize registers with the prev. intermediate value */
 	a = context->state[0];
@@ -336,30 +346,14 @@ void ICACHE_FLASH_ATTR SHA256_Transform(SHA256_CTX* context, const sha2_word32*
 	g = context->state[6];
 	h = context->state[7];
 
-	j = 0;
-	do {
-		/* Rounds 0 to 15 (unrolled): */
-		ROUND256_0_TO_15(a,b,c,d,e,f,g,h);
-		ROUND256_0_TO_15(h,a,b,c,d,e,f,g);
-		ROUND256_0_TO_15(g,h,a,b,c,d,e,f);
-		ROUND256_0_TO_15(f,g,h,a,b,c,d,e);
-		ROUND256_0_TO_15(e,f,g,h,a,b,c,d);
-		ROUND256_0_TO_15(d,e,f,g,h,a,b,c);
-		ROUND256_0_TO_15(c,d,e,f,g,h,a,b);
-		ROUND256_0_TO_15(b,c,d,e,f,g,h,a);
-	} while (j < 16);
-
-	/* Now for the remaining rounds to 64: */
-	do {
-		ROUND256(a,b,c,d,e,f,g,h);
-		ROUND256(h,a,b,c,d,e,f,g);
-		ROUND256(g,h,a,b,c,d,e,f);
-		ROUND256(f,g,h,a,b,c,d,e);
-		ROUND256(e,f,g,h,a,b,c,d);
-		ROUND256(d,e,f,g,h,a,b,c);
-		ROUND256(c,d,e,f,g,h,a,b);
-		ROUND256(b,c,d,e,f,g,h,a);
-	} while (j < 64);
+	ROUND256_8(0);
+	ROUND256_8(8);
+	ROUND256_8(16);
+	ROUND256_8(24);
+	ROUND256_8(32);
+	ROUND256_8(40);
+	ROUND256_8(48);
+	ROUND256_8(56);
 
 	/* Compute the current intermediate hash value */
 	context->state[0] += a;
@@ -491,6 +485,13 @@ void ICACHE_FLASH_ATTR SHA256_Update(SHA256_CTX* context, const sha2_byte *data,
 	}
 	while (len >= SHA256_BLOCK_LENGTH) {
 		/* Process as many complete blocks as we can */
+#ifndef SHA2_UNROLL_TRANSFORM
+		if ((size_t)data & 3) {
+			/* The reference transform needs word aligned input */
+			MEMCPY_BCOPY(context->buffer, data, SHA256_BLOCK_LENGTH);
+			SHA256_Transform(context, (sha2_word32*)context->buffer);
+		} else
+#endif
 		SHA256_Transform(context, (sha2_word32*)data);
 		context->bitcount += SHA256_BLOCK_LENGTH << 3;
 		len -= SHA256_BLOCK_LENGTH;
@@ -543,8 +544,8 @@ void ICACHE_FLASH_ATTR SHA256_Final(sha2_byte digest[], SHA256_CTX* context) {
 			/* Begin padding with a 1 bit: */
 			*context->buffer = 0x80;
 		}
-		/* Set the bit count: */
-		*(sha2_word64*)&context->buffer[SHA256_SHORT_BLOCK_LENGTH] = context->bitcount;
+		/* Set the bit count (copied, as the transform reads buffer as words): */
+		MEMCPY_BCOPY(&context->buffer[SHA256_SHORT_BLOCK_LENGTH], &context->bitcount, 8);
 
 		/* Final transform: */
 		SHA256_Transform(context, (sha2_word32*)context->buffer);
@@ -582,7 +583,7 @@ void ICACHE_FLASH_ATTR SHA512_Init(SHA512_CTX* context) {
 #ifdef SHA2_UNROLL_TRANSFORM
 
 /* Unrolled SHA-512 round macros: */
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN_
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
 
 #define ROUND512_0_TO_15(a,b,c,d,e,f,g,h)	\
 	REVERSE64(*data++, W512[j]); \
@@ -830,8 +831,8 @@ void ICACHE_FLASH_ATTR SHA512_Last(SHA512_CTX* context) {
 		*context->buffer = 0x80;
 	}
 	/* Store the length of input data (in bits): */
-	*(sha2_word64*)&context->buffer[SHA512_SHORT_BLOCK_LENGTH] = context->bitcount[1];
-	*(sha2_word64*)&context->buffer[SHA512_SHORT_BLOCK_LENGTH+8] = context->bitcount[0];
+	MEMCPY_BCOPY(&context->buffer[SHA512_SHORT_BLOCK_LENGTH], &context->bitcount[1], 8);
+	MEMCPY_BCOPY(&context->buffer[SHA512_SHORT_BLOCK_LENGTH+8], &context->bitcount[0], 8);
 
 	/* Final transform: */
 	SHA512_Transform(context, (sha2_word64*)context->buffer);
@@ -378,6 +378,40 @@ pwm_init(uint16 freq, uint16 *duty)
     ETS_FRC1_INTR_ENABLE();
 }
 
+/******************************************************************************
+ * FunctionName : pwm_timer_busy
+ * Description  : check whether any pwm channel is driving the FRC1 timer
+ * Parameters   : NONE
+ * Returns      : true if at least one channel is configured
+*******************************************************************************/
+bool ICACHE_FLASH_ATTR
+pwm_timer_busy(void)
+{
+    return pwm_channel_num != 0;
+}
+
+/******************************************************************************
+ * FunctionName : pwm_timer_attach
+ * Description  : give the FRC1 timer back to pwm after another user
+ *                has borrowed it, the next pwm_start() restarts it
+ * Parameters   : NONE
+ * Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR
+pwm_timer_attach(void)
+{
+    ETS_FRC1_INTR_DISABLE();
+    RTC_REG_WRITE(FRC1_CTRL_ADDRESS,
+                  DIVDED_BY_16
+                  | FRC1_ENABLE_TIMER
+                  | TM_EDGE_INT);
+    RTC_REG_WRITE(FRC1_LOAD_ADDRESS, 0);
+    pwm_timer_down = 1;
+    ETS_FRC_TIMER1_INTR_ATTACH(pwm_tim1_intr_handler, NULL);
+    TM1_EDGE_INT_ENABLE();
+    ETS_FRC1_INTR_ENABLE();
+}
+
 bool ICACHE_FLASH_ATTR
 pwm_add(uint8 channel){
     PWM_DBG("--Function pwm_add() is called. channel:%d\n", channel);
@@ -42,5 +42,7 @@ uint16 pwm_get_freq(uint8 channel);
 bool pwm_add(uint8 channel);
 bool pwm_delete(uint8 channel);
 bool pwm_exist(uint8 channel);
+bool pwm_timer_busy(void);
+void pwm_timer_attach(void);
 #endif
 
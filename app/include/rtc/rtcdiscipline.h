@@ -0,0 +1,130 @@
+/*
+ * Clock discipline for rtctime/sntp: turning NTP replies into offset
+ * samples, picking among the samples of several servers, and filtering the
+ * period of the sleep clock from one sync to the next.
+ *
+ * Nothing in here touches the hardware or RTC memory, so tools/sntpsim can
+ * run it on the host.
+ *
+ * Samples: for a request sent at local time t1, received by the server at
+ * t2, answered at t3 and back at local time t4,
+ *   offset = ((t2-t1) + (t3-t4)) / 2       server time minus local time
+ *   delay  = (t4-t1) - (t3-t2)             round trip on the network
+ * The true offset is within delay/2 of the measured one, and the server
+ * itself within its root distance (root delay/2 + root dispersion) of
+ * true time, so every sample gives an interval offset +- dist.
+ *
+ * Selection: a server is believed if its interval overlaps those of a
+ * majority of the servers asked, not only of those that answered, so that
+ * a lone reply out of three can't be a falseticker outvoting nobody; of
+ * those, the one with the smallest distance wins. Two servers that
+ * disagree give no majority, and no sync.
+ *
+ * Period: the sleep clock period, in 2^-RTC_DISCIPLINE_FRAC us, is measured
+ * over all the sleep between two syncs. The error of that measurement is
+ * the error of the two syncs over the length of the sleep, so the new
+ * measurement is given the weight
+ *   sleep_us / (sleep_us + RTC_DISCIPLINE_TRUST * err_us)
+ * against the previous estimate: a day of sleep between two syncs good to
+ * a few ms replaces it, a minute between two poor ones barely moves it.
+ */
+#ifndef _RTCDISCIPLINE_H_
+#define _RTCDISCIPLINE_H_
+
+#include <c_types.h>
+
+#define RTC_DISCIPLINE_FRAC    20
+#define RTC_DISCIPLINE_TRUST   2000
+#define RTC_DISCIPLINE_SERVERS 4
+
+#define NTP_TO_UNIX_EPOCH      2208988800ul
+
+typedef struct
+{
+  int64_t offset_us;  // server time minus local time
+  uint32_t delay_us;
+  uint32_t dist_us;   // the true offset is within this of offset_us
+} rtc_ntp_sample_t;
+
+// NTP timestamp (seconds since 1900, 2^-32 s) to unix microseconds
+static inline uint64_t rtc_discipline_ntp_to_us(uint32_t sec, uint32_t frac)
+{
+  return (uint64_t)(sec-NTP_TO_UNIX_EPOCH)*1000000+(((uint64_t)frac*1000000)>>32);
+}
+
+// NTP short format (2^-16 s) to microseconds
+static inline uint32_t rtc_discipline_short_to_us(uint32_t val)
+{
+  return ((uint64_t)val*1000000)>>16;
+}
+
+// t1/t4 in local microseconds, the rest as they come in the reply (host order)
+static inline void rtc_discipline_sample(rtc_ntp_sample_t* s, uint64_t t1, uint64_t t4,
+                                         uint32_t recv_sec, uint32_t recv_frac,
+                                         uint32_t xmit_sec, uint32_t xmit_frac,
+                                         uint32_t root_delay, uint32_t root_dispersion)
+{
+  uint64_t t2=rtc_discipline_ntp_to_us(recv_sec,recv_frac);
+  uint64_t t3=rtc_discipline_ntp_to_us(xmit_sec,xmit_frac);
+  int64_t delay=(int64_t)(t4-t1)-(int64_t)(t3-t2);
+
+  if (delay<0)
+    delay=0; // server clock faster than ours over the exchange, no way to tell
+  s->offset_us=((int64_t)(t2-t1)+(int64_t)(t3-t4))/2;
+  s->delay_us=delay>0xffffffffLL ? 0xffffffff : delay;
+  s->dist_us=s->delay_us/2+rtc_discipline_short_to_us(root_delay)/2+
+             rtc_discipline_short_to_us(root_dispersion);
+}
+
+// Index of the sample to sync to, or -1 if no majority of the servers
+// asked agrees; n samples came from the asked (>= n) servers
+static inline int rtc_discipline_select(const rtc_ntp_sample_t* s, int n, int asked)
+{
+  int best=-1;
+  int i, j;
+
+  for (i=0;i<n;i++)
+  {
+    int agree=0;
+    for (j=0;j<n;j++)
+    {
+      int64_t apart=s[i].offset_us-s[j].offset_us;
+      if (apart<0)
+        apart=-apart;
+      if (apart<=(int64_t)s[i].dist_us+s[j].dist_us)
+        agree++;
+    }
+    if (2*agree>asked && (best<0 || s[i].dist_us<s[best].dist_us))
+      best=i;
+  }
+  return best;
+}
+
+// New sleep clock period from the previous one (0 if there is none worth
+// keeping) and the sleep since the last sync: sleep_us intended, taking
+// sleep_cycles of the sleep clock, which left the clock diff_us ahead of
+// the server; err_us is the distance of this sync plus that of the last.
+static inline uint32_t rtc_discipline_period(uint32_t period, uint64_t sleep_us, uint64_t sleep_cycles,
+                                             int64_t diff_us, uint32_t err_us)
+{
+  int64_t actual_us=(int64_t)sleep_us-diff_us;
+  uint64_t cycles=sleep_cycles;
+
+  while (actual_us>>40) // keep the shift below in 64 bits
+  {
+    actual_us>>=1;
+    cycles>>=1;
+  }
+  if (actual_us<=0 || cycles==0)
+    return period;
+
+  uint32_t measured=((uint64_t)actual_us<<RTC_DISCIPLINE_FRAC)/cycles;
+  if (!period)
+    return measured;
+
+  // weight of the measurement, in 2^-16
+  uint64_t weight=(sleep_us<<16)/(sleep_us+(uint64_t)RTC_DISCIPLINE_TRUST*err_us);
+  return period+((int64_t)measured-period)*(int64_t)weight/65536;
+}
+
+#endif
@@ -53,7 +53,12 @@
 // 10: FIFO tail timestamp. Used and maintained when adding things to the FIFO. This is the timestamp of the
 //    most recent sample to have been added. I.e. a new sample's delta-t is calculated relative to this
 // (9/10) are meaningless when (3) is zero
+// 11: Spill watermark. On a real boot with at least this many samples in the FIFO, the rtcfifo
+//     module moves them to its log file in the file system. 0 for never.
 //
+// With RTC_FIFO_PACKED set in (5), the FIFO is a bit stream instead; see the packed encoding
+// below. (7)/(8) then hold a bit offset into the data area in bits 0:15 and the tag index of
+// the last sample written/read in bits 16:19.
 
 #define RTC_FIFO_BASE          10
 #define RTC_FIFO_MAGIC         0x44695553
@@ -72,6 +77,7 @@
 #define RTC_FIFOHEAD_POS       (RTC_FIFO_BASE+8)
 #define RTC_FIFOTAIL_T_POS     (RTC_FIFO_BASE+9)
 #define RTC_FIFOHEAD_T_POS     (RTC_FIFO_BASE+10)
+#define RTC_FIFOSPILL_POS      (RTC_FIFO_BASE+11)
 
 // 32-127: FIFO space. Consisting of a number of tag spaces (see 4), followed by data entries.
 //     Data entries consist of:
@@ -85,6 +91,23 @@
 #define RTC_DEFAULT_TAGCOUNT    5
 #define RTC_DEFAULT_FIFO_LOC (RTC_DEFAULT_FIFO_START + (RTC_DEFAULT_FIFO_END<<8) + (RTC_DEFAULT_TAGCOUNT<<16))
 
+// Packed encoding. The tag spaces are followed by one state word per tag for the writer and one
+// per tag for the reader, each holding the last sample of that tag in the entry format above
+// (without the tag index) plus RTC_FIFO_SEEN. Samples are then coded, LSB first, relative to
+// the state of their tag:
+//     1, tag:4, delta-t:9, decimals:3, value:16   raw; first sample of a tag or new decimals
+//     0, tag code, delta-t code, value code       otherwise
+//   tag code:     0 -> last tag + 1, 10 -> tag 0, 11 tag:4 -> tag
+//   delta-t code: 0 -> same delta-t as the tag's last sample, 1 delta-t:9 -> delta-t
+//   value code:   the zig-zag difference z from the tag's last value
+//                 0 -> z=0, 10 x:2 -> z=1+x, 110 x:4 -> z=5+x, 1110 x:8 -> z=21+x,
+//                 1111 value:16 -> the value itself
+// A sensor sampled at a fixed interval, in turn with the others, costs 4 bits plus 0-12 for its
+// change in value, against 32 bits unpacked.
+#define RTC_FIFO_PACKED        (1<<24)
+#define RTC_FIFO_SEEN          0x80000000
+#define RTC_FIFO_PACKED_TAGS   16
+
 #ifndef RTCTIME_SLEEP_ALIGNED
 # define RTCTIME_SLEEP_ALIGNED rtc_time_deep_sleep_until_aligned
 #endif
@@ -98,6 +121,7 @@ typedef struct
 } sample_t;
 
 static inline void rtc_fifo_clear_content(void);
+static uint32_t rtc_fifo_construct_entry(uint32_t val, uint32_t tagindex, uint32_t decimals, uint32_t deltat);
 
 static inline uint32_t rtc_fifo_get_tail(void)
 {
@@ -166,9 +190,17 @@ static inline uint32_t rtc_fifo_get_last(void)
   return (rtc_mem_read(RTC_FIFOLOC_POS)>>8)&0xff;
 }
 
+static inline uint32_t rtc_fifo_is_packed(void)
+{
+  return rtc_mem_read(RTC_FIFOLOC_POS)&RTC_FIFO_PACKED;
+}
+
 static inline uint32_t rtc_fifo_get_first(void)
 {
-  return rtc_fifo_get_tagpos()+rtc_fifo_get_tagcount();
+  uint32_t tagcount=rtc_fifo_get_tagcount();
+  if (rtc_fifo_is_packed())
+    tagcount*=3;
+  return rtc_fifo_get_tagpos()+tagcount;
 }
 
 static inline void rtc_fifo_put_loc(uint32_t first, uint32_t last, uint32_t tagcount)
@@ -250,6 +282,229 @@ static inline void rtc_fifo_fill_sample(sample_t* dst, uint32_t entry, uint32_t
   dst->tag=rtc_fifo_get_tag_from_entry(entry);
 }
 
+typedef struct
+{
+  uint32_t first;    // data area, in words
+  uint32_t size;     // data area, in bits
+  uint32_t pos;      // next bit
+  uint32_t tag;      // tag index of the last sample
+  uint32_t state[RTC_FIFO_PACKED_TAGS];
+} rtc_fifo_cursor_t;
+
+// at is RTC_FIFOTAIL_POS for the writer, RTC_FIFOHEAD_POS for the reader
+static inline void rtc_fifo_load_cursor(rtc_fifo_cursor_t* c, uint32_t at)
+{
+  uint32_t tagcount=rtc_fifo_get_tagcount();
+  uint32_t states=rtc_fifo_get_tagpos()+tagcount*(at==RTC_FIFOTAIL_POS ? 1 : 2);
+  uint32_t word=rtc_mem_read(at);
+  uint32_t i;
+
+  c->first=rtc_fifo_get_first();
+  c->size=(rtc_fifo_get_last()-c->first)*32;
+  c->pos=word&0xffff;
+  c->tag=(word>>16)&0xf;
+  for (i=0;i<tagcount;i++)
+    c->state[i]=rtc_mem_read(states+i);
+}
+
+static inline void rtc_fifo_save_cursor(const rtc_fifo_cursor_t* c, uint32_t at)
+{
+  uint32_t tagcount=rtc_fifo_get_tagcount();
+  uint32_t states=rtc_fifo_get_tagpos()+tagcount*(at==RTC_FIFOTAIL_POS ? 1 : 2);
+  uint32_t i;
+
+  rtc_mem_write(at,c->pos+(c->tag<<16));
+  for (i=0;i<tagcount;i++)
+    rtc_mem_write(states+i,c->state[i]);
+}
+
+// n <= 16
+static inline uint32_t rtc_fifo_read_bits(rtc_fifo_cursor_t* c, uint32_t n)
+{
+  uint32_t val=0;
+  uint32_t got=0;
+
+  while (got<n)
+  {
+    uint32_t off=c->pos&31;
+    uint32_t take=32-off;
+    if (take>n-got)
+      take=n-got;
+    uint32_t word=rtc_mem_read(c->first+c->pos/32);
+    val|=((word>>off)&((1u<<take)-1))<<got;
+    got+=take;
+    c->pos+=take;
+    if (c->pos>=c->size)
+      c->pos=0;
+  }
+  return val;
+}
+
+// n <= 16
+static inline void rtc_fifo_write_bits(rtc_fifo_cursor_t* c, uint32_t val, uint32_t n)
+{
+  while (n)
+  {
+    uint32_t off=c->pos&31;
+    uint32_t take=32-off;
+    if (take>n)
+      take=n;
+    uint32_t mask=((1u<<take)-1)<<off;
+    uint32_t at=c->first+c->pos/32;
+    rtc_mem_write(at,(rtc_mem_read(at)&~mask)|((val<<off)&mask));
+    val>>=take;
+    n-=take;
+    c->pos+=take;
+    if (c->pos>=c->size)
+      c->pos=0;
+  }
+}
+
+// Reads the next sample and returns it as an entry
+static inline uint32_t rtc_fifo_unpack_entry(rtc_fifo_cursor_t* c)
+{
+  uint32_t tag, deltat, decimals, value;
+
+  if (rtc_fifo_read_bits(c,1))
+  {
+    tag=rtc_fifo_read_bits(c,4);
+    deltat=rtc_fifo_read_bits(c,9);
+    decimals=rtc_fifo_read_bits(c,3);
+    value=rtc_fifo_read_bits(c,16);
+  }
+  else
+  {
+    if (!rtc_fifo_read_bits(c,1))
+      tag=c->tag+1;
+    else if (!rtc_fifo_read_bits(c,1))
+      tag=0;
+    else
+      tag=rtc_fifo_read_bits(c,4);
+    tag&=0xf;
+
+    uint32_t state=c->state[tag];
+    deltat=rtc_fifo_read_bits(c,1) ? rtc_fifo_read_bits(c,9) : rtc_fifo_get_deltat(state);
+    decimals=rtc_fifo_get_decimals(state);
+
+    uint32_t ones=0;
+    while (ones<4 && rtc_fifo_read_bits(c,1))
+      ones++;
+    if (ones==4)
+      value=rtc_fifo_read_bits(c,16);
+    else
+    {
+      static const uint8_t bits[4]={0,2,4,8};
+      static const uint8_t base[4]={0,1,5,21};
+      uint32_t z=base[ones]+rtc_fifo_read_bits(c,bits[ones]);
+      value=rtc_fifo_get_value(state)+((z>>1)^-(z&1));
+    }
+  }
+
+  uint32_t entry=rtc_fifo_construct_entry(value,tag,decimals,deltat);
+  c->state[tag]=(entry&0x0fffffff)|RTC_FIFO_SEEN;
+  c->tag=tag;
+  return entry;
+}
+
+static inline void rtc_fifo_append_bits(uint64_t* bits, uint32_t* len, uint32_t val, uint32_t n)
+{
+  *bits|=((uint64_t)val)<<*len;
+  *len+=n;
+}
+
+// Codes entry into bits against the writer's state, returns the number of bits
+static inline uint32_t rtc_fifo_pack_entry(const rtc_fifo_cursor_t* c, uint32_t entry, uint64_t* bits)
+{
+  uint32_t tag=rtc_fifo_get_tagindex(entry);
+  uint32_t deltat=rtc_fifo_get_deltat(entry);
+  uint32_t decimals=rtc_fifo_get_decimals(entry);
+  uint32_t value=rtc_fifo_get_value(entry);
+  uint32_t state=c->state[tag];
+  uint32_t len=0;
+
+  *bits=0;
+  if (!(state&RTC_FIFO_SEEN) || decimals!=rtc_fifo_get_decimals(state))
+  {
+    rtc_fifo_append_bits(bits,&len,1,1);
+    rtc_fifo_append_bits(bits,&len,tag,4);
+    rtc_fifo_append_bits(bits,&len,deltat,9);
+    rtc_fifo_append_bits(bits,&len,decimals,3);
+    rtc_fifo_append_bits(bits,&len,value,16);
+    return len;
+  }
+
+  rtc_fifo_append_bits(bits,&len,0,1);
+  if (tag==c->tag+1)
+    rtc_fifo_append_bits(bits,&len,0,1);
+  else if (tag==0)
+    rtc_fifo_append_bits(bits,&len,1,2);
+  else
+  {
+    rtc_fifo_append_bits(bits,&len,3,2);
+    rtc_fifo_append_bits(bits,&len,tag,4);
+  }
+
+  if (deltat==rtc_fifo_get_deltat(state))
+    rtc_fifo_append_bits(bits,&len,0,1);
+  else
+  {
+    rtc_fifo_append_bits(bits,&len,1,1);
+    rtc_fifo_append_bits(bits,&len,deltat,9);
+  }
+
+  int16_t diff=(int16_t)(value-rtc_fifo_get_value(state));
+  uint32_t z=((uint32_t)diff<<1)^(uint32_t)(diff>>15);
+  z&=0xffff;
+  if (z==0)
+    rtc_fifo_append_bits(bits,&len,0,1);
+  else if (z<5)
+  {
+    rtc_fifo_append_bits(bits,&len,1,2);
+    rtc_fifo_append_bits(bits,&len,z-1,2);
+  }
+  else if (z<21)
+  {
+    rtc_fifo_append_bits(bits,&len,3,3);
+    rtc_fifo_append_bits(bits,&len,z-5,4);
+  }
+  else if (z<277)
+  {
+    rtc_fifo_append_bits(bits,&len,7,4);
+    rtc_fifo_append_bits(bits,&len,z-21,8);
+  }
+  else
+  {
+    rtc_fifo_append_bits(bits,&len,15,4);
+    rtc_fifo_append_bits(bits,&len,value,16);
+  }
+  return len;
+}
+
+// Reads n samples from c, adding their delta-t to timestamp, and returns the last one
+static inline uint32_t rtc_fifo_unpack_entries(rtc_fifo_cursor_t* c, uint32_t n, uint32_t* timestamp)
+{
+  uint32_t entry=0;
+  while (n--)
+  {
+    entry=rtc_fifo_unpack_entry(c);
+    *timestamp+=rtc_fifo_get_deltat(entry);
+  }
+  return entry;
+}
+
+static inline int8_t rtc_fifo_pop_packed(sample_t* dst)
+{
+  rtc_fifo_cursor_t c;
+  uint32_t timestamp=rtc_fifo_get_head_t();
+
+  rtc_fifo_load_cursor(&c,RTC_FIFOHEAD_POS);
+  uint32_t entry=rtc_fifo_unpack_entries(&c,1,&timestamp);
+  rtc_fifo_fill_sample(dst,entry,timestamp);
+  rtc_fifo_save_cursor(&c,RTC_FIFOHEAD_POS);
+  rtc_fifo_put_head_t(timestamp);
+  rtc_fifo_decrement_count();
+  return 1;
+}
 
 // returns 1 if sample popped, 0 if not
 static inline int8_t rtc_fifo_pop_sample(sample_t* dst)
@@ -258,6 +513,8 @@ static inline int8_t rtc_fifo_pop_sample(sample_t* dst)
 
   if (count==0)
     return 0;
+  if (rtc_fifo_is_packed())
+    return rtc_fifo_pop_packed(dst);
   uint32_t head=rtc_fifo_get_head();
   uint32_t timestamp=rtc_fifo_get_head_t();
   uint32_t entry=rtc_mem_read(head);
@@ -277,6 +534,16 @@ static inline int8_t rtc_fifo_peek_sample(sample_t* dst, uint32_t from_top)
 {
   if (rtc_fifo_get_count()<=from_top)
     return 0;
+  if (rtc_fifo_is_packed())
+  {
+    rtc_fifo_cursor_t c;
+    uint32_t timestamp=rtc_fifo_get_head_t();
+
+    rtc_fifo_load_cursor(&c,RTC_FIFOHEAD_POS);
+    uint32_t entry=rtc_fifo_unpack_entries(&c,from_top+1,&timestamp);
+    rtc_fifo_fill_sample(dst,entry,timestamp);
+    return 1;
+  }
   uint32_t head=rtc_fifo_get_head();
   uint32_t entry=rtc_mem_read(head);
   uint32_t timestamp=rtc_fifo_get_head_t();
@@ -299,6 +566,18 @@ static inline void rtc_fifo_drop_samples(uint32_t from_top)
 
   if (count<=from_top)
     from_top=count;
+  if (rtc_fifo_is_packed())
+  {
+    rtc_fifo_cursor_t c;
+    uint32_t head_t=rtc_fifo_get_head_t();
+
+    rtc_fifo_load_cursor(&c,RTC_FIFOHEAD_POS);
+    rtc_fifo_unpack_entries(&c,from_top,&head_t);
+    rtc_fifo_save_cursor(&c,RTC_FIFOHEAD_POS);
+    rtc_fifo_put_head_t(head_t);
+    rtc_fifo_put_count(count-from_top);
+    return;
+  }
   uint32_t head=rtc_fifo_get_head();
   uint32_t head_t=rtc_fifo_get_head_t();
 
@@ -348,6 +627,39 @@ static uint32_t rtc_fifo_construct_entry(uint32_t val, uint32_t tagindex, uint32
          ((decimals & 0x7)<<25) + ((tagindex & 0xf)<<28);
 }
 
+static inline void rtc_fifo_store_packed(uint32_t entry)
+{
+  rtc_fifo_cursor_t c;
+  uint64_t bits;
+
+  rtc_fifo_load_cursor(&c,RTC_FIFOTAIL_POS);
+  uint32_t len=rtc_fifo_pack_entry(&c,entry,&bits);
+  if (len>c.size)
+    return;
+
+  for (;;)
+  { // Make room by dropping the oldest samples
+    uint32_t count=rtc_fifo_get_count();
+    uint32_t used=(c.pos+c.size-(rtc_fifo_get_head()&0xffff))%c.size;
+    if (count==0 || (used!=0 && c.size-used>=len))
+      break;
+    sample_t dummy;
+    rtc_fifo_pop_packed(&dummy);
+  }
+
+  while (len)
+  {
+    uint32_t n=len>16 ? 16 : len;
+    rtc_fifo_write_bits(&c,bits&0xffff,n);
+    bits>>=n;
+    len-=n;
+  }
+  uint32_t tag=rtc_fifo_get_tagindex(entry);
+  c.state[tag]=(entry&0x0fffffff)|RTC_FIFO_SEEN;
+  c.tag=tag;
+  rtc_fifo_save_cursor(&c,RTC_FIFOTAIL_POS);
+}
+
 static inline void rtc_fifo_store_sample(const sample_t* s)
 {
   uint32_t head=rtc_fifo_get_head();
@@ -377,6 +689,15 @@ static inline void rtc_fifo_store_sample(const sample_t* s)
     tagindex=rtc_fifo_find_tag_index(s->tag); // This should work now
     if (tagindex<0)
       return; // Uh-oh! This should never happen
+    deltat=0;
+  }
+
+  if (rtc_fifo_is_packed())
+  {
+    rtc_fifo_store_packed(rtc_fifo_construct_entry(s->value,tagindex,s->decimals,deltat));
+    rtc_fifo_put_tail_t(s->timestamp);
+    rtc_fifo_increment_count();
+    return;
   }
 
   if (head==tail && count>0)
@@ -421,17 +742,18 @@ static inline uint32_t rtc_fifo_get_divisor(const sample_t* s)
   return div;
 }
 
+// Clears the tag spaces, and in packed mode the tag states
 static inline void rtc_fifo_clear_tags(void)
 {
   uint32_t tags_at=rtc_fifo_get_tagpos();
-  uint32_t count=rtc_fifo_get_tagcount();
-  while (count--)
+  uint32_t first=rtc_fifo_get_first();
+  while (tags_at<first)
     rtc_mem_write(tags_at++,0);
 }
 
 static inline void rtc_fifo_clear_content(void)
 {
-  uint32_t first=rtc_fifo_get_first();
+  uint32_t first=rtc_fifo_is_packed() ? 0 : rtc_fifo_get_first();
   rtc_fifo_put_tail(first);
   rtc_fifo_put_head(first);
   rtc_fifo_put_count(0);
@@ -446,6 +768,15 @@ static inline void rtc_fifo_init(uint32_t first, uint32_t last, uint32_t tagcoun
   rtc_fifo_clear_content();
 }
 
+// The packed encoding takes up to RTC_FIFO_PACKED_TAGS tags, in 3*tagcount words before first
+static inline void rtc_fifo_init_packed(uint32_t first, uint32_t last, uint32_t tagcount)
+{
+  if (tagcount>RTC_FIFO_PACKED_TAGS)
+    tagcount=RTC_FIFO_PACKED_TAGS;
+  rtc_mem_write(RTC_FIFOLOC_POS,first+(last<<8)+(tagcount<<16)+RTC_FIFO_PACKED);
+  rtc_fifo_clear_content();
+}
+
 static inline void rtc_fifo_init_default(uint32_t tagcount)
 {
   if (tagcount==0)
@@ -484,6 +815,7 @@ static inline void rtc_fifo_prepare(uint32_t samples_per_boot, uint32_t us_per_s
   rtc_mem_write(RTC_ALIGNMENT_POS,us_per_sample);
 
   rtc_put_samples_to_take(0);
+  rtc_mem_write(RTC_FIFOSPILL_POS,0);
   rtc_fifo_init_default(tagcount);
   rtc_fifo_set_magic();
 }
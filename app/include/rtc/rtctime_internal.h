@@ -126,6 +126,7 @@
 #include <ets_sys.h>
 #include "rom.h"
 #include "rtcaccess.h"
+#include "rtcdiscipline.h"
 
 // Layout of the RTC storage space:
 //
@@ -144,8 +145,10 @@
 // 4: Length of a time source cycle in Unit Cycles.
 // 5: cached result of sleep clock calibration. Has the format of system_rtc_clock_cali_proc(),
 //    or 0 if not available (see 6/7 below)
-// 6: Number of microseconds we tried to sleep, or 0 if we didn't sleep since last calibration, ffffffff if invalid
-// 7: Number of RTC cycles we decided to sleep, or 0 if we didn't sleep since last calibration, ffffffff if invalid
+// 6: Number of microseconds we tried to sleep, or 0 if we didn't sleep since last calibration.
+//    Lower 32 bits, the upper ones are in (27)
+// 7: Number of RTC cycles we decided to sleep, or 0 if we didn't sleep since last calibration.
+//    Lower 32 bits, the upper ones are in (28)
 
 // 8: Number of microseconds which we add to (1/2) to avoid time going backwards
 // 9: microsecond value returned in the last gettimeofday() to "user space".
@@ -169,11 +172,21 @@
 //     timeofday(), but for calculating actual sleep time, we use the pre-adjustment one, thus bringing
 //     things back into line.
 //
+// The rtcfifo block follows at 10. Then, from 24:
+//
+// 24: RTC_TIME_MAGIC_DISCIPLINE if (25) holds a sleep clock period learnt from syncs.
+// 25: Sleep clock period, in 2^-20 us (see rtcdiscipline.h). Used instead of (5) to work out
+//     sleep cycles, as (5) is only good to 1/4096 us, some 40ppm. Unlike (5), it survives
+//     a reset that loses track of time: the clock did not change, only our idea of the time.
+// 26: Distance (error bound) in microseconds of the time given at the last settimeofday().
+// 27/28: Upper 32 bits of (6)/(7), so the sleep between syncs may run into days.
+//
 
 #define RTC_TIME_BASE  0  // Where the RTC timekeeping block starts in RTC user memory slots
 #define RTC_TIME_MAGIC_CCOUNT 0x44695573
 #define RTC_TIME_MAGIC_FRC2   (RTC_TIME_MAGIC_CCOUNT+1)
 #define RTC_TIME_MAGIC_SLEEP  (RTC_TIME_MAGIC_CCOUNT+2)
+#define RTC_TIME_MAGIC_DISCIPLINE (RTC_TIME_MAGIC_CCOUNT+3)
 
 #define UNITCYCLE_MHZ     2080
 #define CPU_OVERCLOCK_MHZ 160
@@ -192,6 +205,13 @@
 #define RTC_TODOFFSETUS_POS      (RTC_TIME_BASE+8)
 #define RTC_LASTTODUS_POS        (RTC_TIME_BASE+9)
 
+#define RTC_DISCIPLINE_BASE      24
+#define RTC_DISCIPLINE_MAGIC_POS (RTC_DISCIPLINE_BASE+0)
+#define RTC_SLEEPPERIOD_POS      (RTC_DISCIPLINE_BASE+1)
+#define RTC_LASTSYNCDIST_POS     (RTC_DISCIPLINE_BASE+2)
+#define RTC_SLEEPTOTALUSH_POS    (RTC_DISCIPLINE_BASE+3)
+#define RTC_SLEEPTOTALCYCLESH_POS (RTC_DISCIPLINE_BASE+4)
+
 
 struct rtc_timeval
 {
@@ -353,8 +373,19 @@ static inline void rtc_time_invalidate_calibration(void)
   rtc_mem_write(RTC_CALIBRATION_POS,0);
 }
 
+static inline uint32_t rtc_time_get_sleep_period(void)
+{
+  if (rtc_mem_read(RTC_DISCIPLINE_MAGIC_POS)!=RTC_TIME_MAGIC_DISCIPLINE)
+    return 0;
+  return rtc_mem_read(RTC_SLEEPPERIOD_POS);
+}
+
 static inline uint64_t rtc_time_us_to_ticks(uint64_t us)
 {
+  uint32_t period=rtc_time_get_sleep_period();
+  if (period)
+    return (us<<RTC_DISCIPLINE_FRAC)/period;
+
   uint32_t cal=rtc_time_get_calibration();
 
   return (us<<12)/cal;
@@ -381,17 +412,13 @@ static inline void rtc_time_add_sleep_tracking(uint32_t us, uint32_t cycles)
 {
   if (rtc_time_check_magic())
   {
-    // us is the one that will grow faster...
-    uint32_t us_before=rtc_mem_read(RTC_SLEEPTOTALUS_POS);
-    uint32_t us_after=us_before+us;
-    uint32_t cycles_after=rtc_mem_read(RTC_SLEEPTOTALCYCLES_POS)+cycles;
+    uint64_t us_after=rtc_make64(rtc_mem_read(RTC_SLEEPTOTALUSH_POS),rtc_mem_read(RTC_SLEEPTOTALUS_POS))+us;
+    uint64_t cycles_after=rtc_make64(rtc_mem_read(RTC_SLEEPTOTALCYCLESH_POS),rtc_mem_read(RTC_SLEEPTOTALCYCLES_POS))+cycles;
 
-    if (us_after<us_before) // Give up if it would cause an overflow
-    {
-      us_after=cycles_after=0xffffffff;
-    }
-    rtc_mem_write(RTC_SLEEPTOTALUS_POS,    us_after);
-    rtc_mem_write(RTC_SLEEPTOTALCYCLES_POS,cycles_after);
+    rtc_mem_write(RTC_SLEEPTOTALUS_POS,     us_after);
+    rtc_mem_write(RTC_SLEEPTOTALUSH_POS,    us_after>>32);
+    rtc_mem_write(RTC_SLEEPTOTALCYCLES_POS, cycles_after);
+    rtc_mem_write(RTC_SLEEPTOTALCYCLESH_POS,cycles_after>>32);
   }
 }
 
@@ -478,6 +505,9 @@ static inline void rtc_time_reset(bool clear_cali)
   rtc_mem_write64(RTC_CYCLEOFFSETL_POS,0);
   rtc_mem_write(RTC_SLEEPTOTALUS_POS,0);
   rtc_mem_write(RTC_SLEEPTOTALCYCLES_POS,0);
+  rtc_mem_write(RTC_SLEEPTOTALUSH_POS,0);
+  rtc_mem_write(RTC_SLEEPTOTALCYCLESH_POS,0);
+  rtc_mem_write(RTC_LASTSYNCDIST_POS,0);
   rtc_mem_write(RTC_TODOFFSETUS_POS,0);
   rtc_mem_write(RTC_LASTTODUS_POS,0);
   rtc_mem_write(RTC_SOURCECYCLEUNITS_POS,0);
@@ -658,6 +688,7 @@ static inline void rtc_time_switch_system(void)
 static inline void rtc_time_prepare(void)
 {
   rtc_time_reset(true);
+  rtc_mem_write(RTC_DISCIPLINE_MAGIC_POS,0);
   rtc_time_select_frc2_source();
 }
 
@@ -687,14 +718,15 @@ static inline void rtc_time_gettimeofday(struct rtc_timeval* tv)
   rtc_time_register_time_reached(sec,usec);
 }
 
-static inline void rtc_time_settimeofday(const struct rtc_timeval* tv)
+// dist_us: how far off tv may be, 0 if unknown
+static inline void rtc_time_settimeofday_dist(const struct rtc_timeval* tv, uint32_t dist_us)
 {
   if (!rtc_time_check_magic())
     return;
 
 
-  uint32_t sleep_us=rtc_mem_read(RTC_SLEEPTOTALUS_POS);
-  uint32_t sleep_cycles=rtc_mem_read(RTC_SLEEPTOTALCYCLES_POS);
+  uint64_t sleep_us=rtc_make64(rtc_mem_read(RTC_SLEEPTOTALUSH_POS),rtc_mem_read(RTC_SLEEPTOTALUS_POS));
+  uint64_t sleep_cycles=rtc_make64(rtc_mem_read(RTC_SLEEPTOTALCYCLESH_POS),rtc_mem_read(RTC_SLEEPTOTALCYCLES_POS));
   // At this point, the CPU clock will definitely be at the default rate (nodemcu fully booted)
   uint64_t now_esp_us=rtc_time_get_now_us_adjusted();
   uint64_t now_ntp_us=((uint64_t)tv->tv_sec)*1000000+tv->tv_usec;
@@ -705,18 +737,26 @@ static inline void rtc_time_settimeofday(const struct rtc_timeval* tv)
   uint64_t sourcecycles=rtc_time_source_offset();
   rtc_mem_write64(RTC_CYCLEOFFSETL_POS,target_unitcycles-sourcecycles);
 
-  // calibrate sleep period based on difference between expected time and actual time
-  if (sleep_us>0 && sleep_us<0xffffffff &&
-      sleep_cycles>0 && sleep_cycles<0xffffffff)
+  // calibrate sleep period based on difference between expected time and actual time,
+  // trusting the measurement according to the length of the sleep and the error of the syncs
+  if (sleep_us>0 && sleep_cycles>0)
   {
-    uint64_t actual_sleep_us=sleep_us-diff_us;
-    uint32_t cali=(actual_sleep_us<<12)/sleep_cycles;
+    uint32_t err_us=dist_us+rtc_mem_read(RTC_LASTSYNCDIST_POS);
+    uint32_t period=rtc_discipline_period(rtc_time_get_sleep_period(),sleep_us,sleep_cycles,diff_us,err_us);
+    uint32_t cali=period>>(RTC_DISCIPLINE_FRAC-12);
     if (rtc_time_calibration_is_sane(cali))
+    {
       rtc_mem_write(RTC_CALIBRATION_POS,cali);
+      rtc_mem_write(RTC_SLEEPPERIOD_POS,period);
+      rtc_mem_write(RTC_DISCIPLINE_MAGIC_POS,RTC_TIME_MAGIC_DISCIPLINE);
+    }
   }
+  rtc_mem_write(RTC_LASTSYNCDIST_POS,dist_us);
 
   rtc_mem_write(RTC_SLEEPTOTALUS_POS,0);
   rtc_mem_write(RTC_SLEEPTOTALCYCLES_POS,0);
+  rtc_mem_write(RTC_SLEEPTOTALUSH_POS,0);
+  rtc_mem_write(RTC_SLEEPTOTALCYCLESH_POS,0);
 
   // Deal with time adjustment if necessary
   if (diff_us>0) // Time went backwards. Avoid that....
@@ -734,4 +774,9 @@ static inline void rtc_time_settimeofday(const struct rtc_timeval* tv)
   rtc_time_register_time_reached(now_s,now_us);
 }
 
+static inline void rtc_time_settimeofday(const struct rtc_timeval* tv)
+{
+  rtc_time_settimeofday_dist(tv,0);
+}
+
 #endif
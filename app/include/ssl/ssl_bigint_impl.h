@@ -41,6 +41,14 @@
 #define BIGINT_NUM_MODS     1    
 #endif
 
+/* Largest sliding window bi_mod_power() will use (16 precomputed powers) */
+#define BIGINT_MAX_WINDOW   5
+
+/* bi_mod_power() reserves this many bigints of 2k+2 components (k being the
+ * size of the main modulus) the first time it runs on a context, so that an
+ * exponentiation recycles arena slots instead of going to the heap. */
+#define BIGINT_ARENA_COUNT  16
+
 /* Architecture specific functions for big ints */
 #if defined(CONFIG_INTEGER_8BIT)
 #define COMP_RADIX          256U       /**< Max component + 1 */
@@ -87,6 +95,7 @@ struct _bigint
     short max_comps;            /**< The heapsize allocated for this bigint */
     int refs;                   /**< An internal reference count. */
     comp* comps;                /**< A ptr to the actual component data */
+    uint8_t arena;              /**< Header/comps live in the ctx arena. */
 };
 
 typedef struct _bigint bigint;  /**< An alias for _bigint */
@@ -110,8 +119,12 @@ typedef struct /**< A big integer "session" context. */
     bigint *bi_mu[BIGINT_NUM_MODS];         /**< Storage for mu */
 #endif
     bigint *bi_normalised_mod[BIGINT_NUM_MODS]; /**< Normalised mod storage. */
-    bigint **g;                 /**< Used by sliding-window. */
+    bigint *g[1 << (BIGINT_MAX_WINDOW-1)]; /**< Used by sliding-window. */
     int window;                 /**< The size of the sliding window */
+    bigint *arena;              /**< Preallocated bigint slots. */
+    comp *arena_comps;          /**< Component storage for the slots. */
+    short arena_count;          /**< Number of arena slots. */
+    short arena_slot;           /**< Components per arena slot. */
     int active_count;           /**< Number of active bigints. */
     int free_count;             /**< Number of free bigints. */
 
@@ -128,4 +141,8 @@ typedef struct /**< A big integer "session" context. */
 
 #define PERMANENT           0x7FFF55AA  /**< A magic number for permanents. */
 
+/* bigint.arena flags */
+#define BI_ARENA_HDR        0x01    /**< Header is an arena slot. */
+#define BI_ARENA_COMPS      0x02    /**< Comps are the slot's own storage. */
+
 #endif
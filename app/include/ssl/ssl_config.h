@@ -113,8 +113,8 @@
  * BigInt Options
  */
 #undef CONFIG_BIGINT_CLASSICAL
-#undef CONFIG_BIGINT_MONTGOMERY
-#define CONFIG_BIGINT_BARRETT 1
+#define CONFIG_BIGINT_MONTGOMERY 1
+#undef CONFIG_BIGINT_BARRETT
 #define CONFIG_BIGINT_CRT 1
 #undef CONFIG_BIGINT_KARATSUBA
 #define MUL_KARATSUBA_THRESH 
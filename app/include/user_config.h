@@ -43,6 +43,17 @@
 #define GPIO_INTERRUPT_ENABLE
 //#define MD2_ENABLE
 #define SHA2_ENABLE
+// Unrolled SHA-256 (app/crypto) compression function; several times faster
+// for bulk hashing at the cost of a few KB of flash. tools/hashbench
+// compares it against the reference loop on the host.
+#define SHA2_UNROLL_TRANSFORM
+// The same for SHA-1 in app/ssl/crypto/ssl_sha1.c. That file is not built
+// into the image and the firmware's SHA-1 comes from ROM, so this has no
+// effect on the firmware; it only matters to builds of app/ssl.
+#define SHA1_UNROLL_TRANSFORM
+// Table-driven AES rounds for crypto.encrypt()/decrypt() (2KB of flash);
+// tools/aesbench compares them against the byte-wise rounds.
+#define AES_TTABLE_TRANSFORM
 
 // #define BUILD_WOFS		1
 #define BUILD_SPIFFS	1
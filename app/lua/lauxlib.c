@@ -566,6 +566,46 @@ LUALIB_API void luaL_unref (lua_State *L, int t, int ref) {
 }
 
 
+/*
+** {======================================================
+** Coroutine waits on SDK callbacks
+** A C function running inside a coroutine parks it with luaL_park,
+** keeps the returned ref and returns lua_yield(L, 0). The SDK callback
+** later pushes the results on its own stack and calls luaL_wakeup.
+** =======================================================
+*/
+
+LUALIB_API int luaL_park (lua_State *L) {
+  if (lua_pushthread(L))
+    luaL_error(L, "attempt to wait outside a coroutine");
+  return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+
+LUALIB_API void luaL_wakeup (lua_State *L, int ref, int nargs) {
+  lua_State *co;
+  int status;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+  co = lua_tothread(L, -1);
+  lua_pop(L, 1);
+  luaL_unref(L, LUA_REGISTRYINDEX, ref);
+  if (co == NULL) {
+    lua_pop(L, nargs);
+    return;
+  }
+  lua_xmove(L, co, nargs);
+  status = lua_resume(co, nargs);
+  if (status != 0 && status != LUA_YIELD) {
+    /* report it the same way as an error raised by a callback */
+    lua_xmove(co, L, 1);
+    lua_error(L);
+  }
+  lua_settop(co, 0);  /* discard values yielded or returned */
+}
+
+/* }====================================================== */
+
+
 
 /*
 ** {======================================================
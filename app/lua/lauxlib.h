@@ -79,6 +79,9 @@ LUALIB_API int (luaL_checkoption) (lua_State *L, int narg, const char *def,
 LUALIB_API int (luaL_ref) (lua_State *L, int t);
 LUALIB_API void (luaL_unref) (lua_State *L, int t, int ref);
 
+LUALIB_API int (luaL_park) (lua_State *L);
+LUALIB_API void (luaL_wakeup) (lua_State *L, int ref, int nargs);
+
 #if 0
 LUALIB_API int (luaL_loadfile) (lua_State *L, const char *filename);
 #else
@@ -0,0 +1,183 @@
+// Lua sampling profiler, see lprofile.h
+
+#include "lprofile.h"
+#include "lauxlib.h"
+#include "lstate.h"
+#include "c_types.h"
+#include "c_stdio.h"
+#include "c_stdlib.h"
+
+typedef struct
+{
+  uint16_t fn;      // function id, 0 for functions beyond LPROFILE_MAX_FUNCS
+  uint16_t line;    // current line, 0 for C functions
+} profile_sample_t;
+
+// Functions are anchored in a registry table while profiling so the
+// samples stay valid until stop() resolves them to names.
+typedef struct
+{
+  lua_State *L;
+  lprofile_clock_fn clock;
+  int anchor_ref;               // table: function -> id and id -> function
+  uint16_t nfn;
+  uint16_t head;
+  uint32_t samples;
+  uint32_t idle;                // ticks not serviced in time
+  uint32_t late;
+  volatile uint8_t armed;       // tick taken, hook not yet run
+  volatile uint32_t tick_time;
+  uint32_t counts[LPROFILE_MAX_FUNCS + 1];
+  profile_sample_t ring[LPROFILE_RING_SIZE];
+} profile_t;
+
+static profile_t *profile = NULL;
+
+static void profile_hook(lua_State *L, lua_Debug *ar)
+{
+  uint32_t late = profile->clock() - profile->tick_time;
+  int id;
+
+  lua_sethook(L, NULL, 0, 0);
+  profile->armed = 0;
+  // The VM was idle (or inside a coroutine) when the tick fired; whatever
+  // runs now did not consume that time.
+  if (late > profile->late)
+  {
+    profile->idle++;
+    return;
+  }
+
+  lua_getinfo(L, "lf", ar);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, profile->anchor_ref);
+  lua_pushvalue(L, -2);
+  lua_rawget(L, -2);
+  id = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  if (id == 0 && profile->nfn < LPROFILE_MAX_FUNCS)
+  {
+    id = ++profile->nfn;
+    lua_pushvalue(L, -2);
+    lua_pushinteger(L, id);
+    lua_rawset(L, -3);
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, -2, id);
+  }
+  lua_pop(L, 2);
+
+  profile->counts[id]++;
+  profile->ring[profile->head].fn = id;
+  profile->ring[profile->head].line = ar->currentline > 0 ? ar->currentline : 0;
+  profile->head = (profile->head + 1) % LPROFILE_RING_SIZE;
+  profile->samples++;
+}
+
+void ICACHE_RAM_ATTR lprofile_tick(uint32_t now)
+{
+  lua_State *L;
+  if (!profile || profile->armed)
+    return;
+  L = profile->L;
+  profile->tick_time = now;
+  profile->armed = 1;
+  // lua_sethook() lives in flash, set the hook fields directly
+  L->hook = profile_hook;
+  L->basehookcount = 1;
+  L->hookcount = 1;
+  L->hookmask = LUA_MASKCOUNT;
+}
+
+int lprofile_start(lua_State *L, lprofile_clock_fn clock, uint32_t late)
+{
+  profile_t *p;
+  if (profile)
+    return -1;
+  p = (profile_t *)c_zalloc(sizeof(profile_t));
+  if (!p)
+    return -1;
+  p->L = G(L)->mainthread;
+  p->clock = clock;
+  p->late = late;
+  lua_newtable(L);
+  p->anchor_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  profile = p;
+  return 0;
+}
+
+int lprofile_running(void)
+{
+  return profile != NULL;
+}
+
+// Push the name of function id as "source:line" (or "[C]:address"), using
+// its linedefined when line is negative. Expects the anchor table on top.
+static void profile_push_name(lua_State *L, int id, lua_Debug *ar, int line)
+{
+  char buf[LUA_IDSIZE + 16];
+  if (id == 0)
+  {
+    lua_pushliteral(L, "?");
+    return;
+  }
+  lua_rawgeti(L, -1, id);
+  if (lua_iscfunction(L, -1) || lua_islightfunction(L, -1))
+  {
+    c_sprintf(buf, "[C]:%x", (unsigned)(size_t)lua_topointer(L, -1));
+    lua_pop(L, 1);
+  }
+  else
+  {
+    lua_getinfo(L, ">S", ar);
+    c_sprintf(buf, "%s:%d", ar->short_src, line < 0 ? ar->linedefined : line);
+  }
+  lua_pushstring(L, buf);
+}
+
+static void profile_count(lua_State *L, int tbl, uint32_t n)
+{
+  lua_pushvalue(L, -1);
+  lua_rawget(L, tbl);
+  n += lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  lua_pushinteger(L, n);
+  lua_rawset(L, tbl);
+}
+
+int lprofile_stop(lua_State *L)
+{
+  profile_t *p = profile;
+  lua_Debug ar;
+  uint32_t i, n;
+  int base;
+
+  if (!p)
+    return 0;
+  // no more ticks from here on
+  profile = NULL;
+  if (p->armed)
+    lua_sethook(p->L, NULL, 0, 0);
+
+  lua_newtable(L);
+  lua_newtable(L);
+  base = lua_gettop(L);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, p->anchor_ref);
+  for (i = 0; i <= p->nfn; i++)
+  {
+    if (p->counts[i] == 0)
+      continue;
+    profile_push_name(L, i, &ar, -1);
+    profile_count(L, base - 1, p->counts[i]);
+  }
+  n = p->samples < LPROFILE_RING_SIZE ? p->samples : LPROFILE_RING_SIZE;
+  for (i = 0; i < n; i++)
+  {
+    profile_push_name(L, p->ring[i].fn, &ar, p->ring[i].line);
+    profile_count(L, base, 1);
+  }
+  lua_pop(L, 1);
+  luaL_unref(L, LUA_REGISTRYINDEX, p->anchor_ref);
+  lua_pushinteger(L, p->samples);
+  lua_pushinteger(L, p->idle);
+  c_free(p);
+  return 4;
+}
@@ -0,0 +1,31 @@
+// Lua sampling profiler
+//
+// A periodic interrupt (FRC1 on the device, SIGPROF on the host) calls
+// lprofile_tick(), which arms a count hook on the main Lua thread, the
+// same trick lua.c uses to interrupt a running chunk. The hook runs at the
+// next VM instruction and charges the sample to the running function.
+
+#ifndef __LPROFILE_H__
+#define __LPROFILE_H__
+
+#include "lua.h"
+
+#define LPROFILE_RING_SIZE    256   // most recent (function, line) samples
+#define LPROFILE_MAX_FUNCS    128   // functions counted individually
+
+// Any free running counter; a tick the hook gets to more than late counts
+// after it fired was taken while the VM was idle.
+typedef uint32_t (*lprofile_clock_fn)(void);
+
+// 0, or -1 if running already or out of memory
+int lprofile_start(lua_State *L, lprofile_clock_fn clock, uint32_t late);
+// From the interrupt, now as read from the clock
+void lprofile_tick(uint32_t now);
+int lprofile_running(void);
+// Pushes funcs, lines, samples, idle and returns 4, or 0 if not running.
+// funcs maps "source:linedefined" to the samples taken in that function,
+// lines maps "source:line" to samples among the most recent
+// LPROFILE_RING_SIZE ones.
+int lprofile_stop(lua_State *L);
+
+#endif
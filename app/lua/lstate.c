@@ -23,6 +23,14 @@
 #include "ltable.h"
 #include "ltm.h"
 
+#ifndef LUA_CROSS_COMPILER
+#include "user_interface.h"
+#define luai_timeseed()  system_get_time()
+#else
+#include <time.h>
+#define luai_timeseed()  time(NULL)
+#endif
+
 #define state_size(x)	(sizeof(x) + LUAI_EXTRASPACE)
 #define fromstate(l)	(cast(lu_byte *, (l)) - LUAI_EXTRASPACE)
 #define tostate(l)   (cast(lua_State *, cast(lu_byte *, l) + LUAI_EXTRASPACE))
@@ -142,6 +150,18 @@ void luaE_freethread (lua_State *L, lua_State *L1) {
 }
 
 
+/*
+** Per-boot seed for the string hash, so that chain layout in the string
+** table cannot be predicted from the string contents alone.
+*/
+static unsigned int makeseed (lua_State *L) {
+  unsigned int h = cast(unsigned int, luai_timeseed());
+  h ^= cast(unsigned int, cast(size_t, L));
+  h ^= cast(unsigned int, cast(size_t, &h));
+  return h;
+}
+
+
 LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   int i;
   lua_State *L;
@@ -166,6 +186,7 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->strt.size = 0;
   g->strt.nuse = 0;
   g->strt.hash = NULL;
+  g->seed = makeseed(L);
   setnilvalue(registry(L));
   luaZ_initbuffer(L, &g->buff);
   g->panic = NULL;
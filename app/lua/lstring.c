@@ -80,18 +80,38 @@ static TString *newlstr (lua_State *L, const char *str, size_t l,
 }
 
 
+/*
+** Strings up to LUAS_HASH_TAIL chars are hashed in full. Longer strings
+** hash their last LUAS_HASH_TAIL chars in full (keys and topics sharing
+** a long prefix usually differ at the end) and sample the remainder, so
+** hashing a large payload costs a bounded number of char reads.
+*/
+#define LUAS_HASH_TAIL            32
+
+#define hashchar(h,c)  ((h) ^ (((h)<<5)+((h)>>2)+cast(unsigned char, (c))))
+
+static unsigned int hashstr (const char *str, size_t l, unsigned int seed) {
+  unsigned int h = seed ^ cast(unsigned int, l);
+  size_t l1 = l;
+  size_t step;
+  for (; l1 > 0 && l - l1 < LUAS_HASH_TAIL; l1--)
+    h = hashchar(h, str[l1-1]);
+  step = (l1>>5)+1;
+  for (; l1 >= step; l1-=step)
+    h = hashchar(h, str[l1-1]);
+  return h;
+}
+
+
 static TString *luaS_newlstr_helper (lua_State *L, const char *str, size_t l, int readonly) {
   GCObject *o;
-  unsigned int h = cast(unsigned int, l);  /* seed */
-  size_t step = (l>>5)+1;  /* if string is too long, don't hash all its chars */
-  size_t l1;
-  for (l1=l; l1>=step; l1-=step)  /* compute hash */
-    h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
+  unsigned int h = hashstr(str, l, G(L)->seed);
   for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
        o != NULL;
        o = o->gch.next) {
     TString *ts = rawgco2ts(o);
-    if (ts->tsv.len == l && (c_memcmp(str, getstr(ts), l) == 0)) {
+    if (ts->tsv.hash == h && ts->tsv.len == l &&
+        (c_memcmp(str, getstr(ts), l) == 0)) {
       /* string may be dead */
       if (isdead(G(L), o)) changewhite(o);
       return ts;
@@ -111,10 +131,26 @@ static int lua_is_ptr_in_ro_area(const char *p) {
 #endif
 }
 
+/*
+** A read-only string must be '\0' terminated where Lua expects it. Flash
+** only supports aligned word loads (byte loads go through the exception
+** handler), so test the terminator with a single aligned load instead
+** of a c_strlen over the whole string.
+*/
+static int lua_is_ro_terminated(const char *str, size_t l) {
+#ifdef LUA_CROSS_COMPILER
+  return str[l] == '\0';
+#else
+  const char *p = str + l;
+  const lu_int32 *w = (const lu_int32 *)((size_t)p & ~(size_t)3);
+  return ((*w >> (((size_t)p & 3) * 8)) & 0xff) == 0;
+#endif
+}
+
 TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
   // If the pointer is in a read-only memory and the string is at least 4 chars in length,
   // create it as a read-only string instead
-  if(lua_is_ptr_in_ro_area(str) && l+1 > sizeof(char**) && l == c_strlen(str))
+  if(l+1 > sizeof(char**) && lua_is_ptr_in_ro_area(str) && lua_is_ro_terminated(str, l))
     return luaS_newlstr_helper(L, str, l, LUAS_READONLY_STRING);
   else
     return luaS_newlstr_helper(L, str, l, LUAS_REGULAR_STRING);
@@ -122,13 +158,33 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 
 
 LUAI_FUNC TString *luaS_newrolstr (lua_State *L, const char *str, size_t l) {
-  if(l+1 > sizeof(char**) && l == c_strlen(str))
+  if(l+1 > sizeof(char**) && lua_is_ro_terminated(str, l))
     return luaS_newlstr_helper(L, str, l, LUAS_READONLY_STRING);
   else // no point in creating a RO string, as it would actually be larger
     return luaS_newlstr_helper(L, str, l, LUAS_REGULAR_STRING);
 }
 
 
+/*
+** Collect string table statistics: hist[i] counts the chains of length i,
+** with the last slot accumulating every chain of length nhist-1 or more.
+** Returns the length of the longest chain.
+*/
+LUAI_FUNC int luaS_stats (lua_State *L, lu_int32 *hist, int nhist) {
+  stringtable *tb = &G(L)->strt;
+  int i, maxchain = 0;
+  for (i=0; i<nhist; i++) hist[i] = 0;
+  for (i=0; i<tb->size; i++) {
+    GCObject *p;
+    int n = 0;
+    for (p = tb->hash[i]; p != NULL; p = p->gch.next) n++;
+    if (n > maxchain) maxchain = n;
+    hist[n < nhist ? n : nhist-1]++;
+  }
+  return maxchain;
+}
+
+
 Udata *luaS_newudata (lua_State *L, size_t s, Table *e) {
   Udata *u;
   if (s > MAX_SIZET - sizeof(Udata))
@@ -42,14 +42,14 @@
 #include "c_limits.h"
 #include "lua.h"
 #include "lauxlib.h"
+#include "auxmods.h"
 #include "flash_api.h"
 
 #include "strbuf.h"
 #include "cjson_mem.h"
 
-#define FPCONV_G_FMT_BUFSIZE   32
-#define fpconv_strtod c_strtod
-#define fpconv_init() ((void)0)
+#define USE_INTERNAL_FPCONV
+#include "fpconv.h"
 
 #ifndef CJSON_MODNAME
 #define CJSON_MODNAME   "cjson"
@@ -72,7 +72,7 @@
 #define DEFAULT_ENCODE_INVALID_NUMBERS 0
 #define DEFAULT_DECODE_INVALID_NUMBERS 1
 #define DEFAULT_ENCODE_KEEP_BUFFER 0
-#define DEFAULT_ENCODE_NUMBER_PRECISION 14
+#define DEFAULT_ENCODE_NUMBER_PRECISION 0     /* 0 => Shortest round trip */
 
 #ifdef DISABLE_INVALID_NUMBERS
 #undef DEFAULT_DECODE_INVALID_NUMBERS
@@ -589,6 +589,43 @@ static int cfg_init(json_config_t *cfg){
 }
 /* ===== ENCODING ===== */
 
+/* cjson.encode_to() hands the output to a sink in JSON_SINK_CHUNK byte
+ * pieces while the encoder walks the value, so the buffer never holds
+ * much more than one chunk. The encoder functions keep writing to a
+ * plain strbuf; json_sink_check() is called at element boundaries and
+ * only acts on the buffer owned by the active sink. */
+#define JSON_SINK_CHUNK 512
+/* Source bytes escaped at a time, bounds the buffer growth of long strings */
+#define JSON_SINK_STRING_STEP 128
+
+typedef struct {
+    strbuf_t buf;
+    int index;      /* Stack index of the sink function */
+} json_sink_t;
+
+static json_sink_t *json_sink = NULL;
+
+static void json_sink_emit(lua_State *l, json_sink_t *sink, int len)
+{
+    lua_pushvalue(l, sink->index);
+    lua_pushlstring(l, sink->buf.buf, len);
+    lua_call(l, 1, 0);
+}
+
+static void json_sink_check(lua_State *l, strbuf_t *json)
+{
+    json_sink_t *sink = json_sink;
+
+    if (!sink || json != &sink->buf)
+        return;
+
+    while (json->length >= JSON_SINK_CHUNK) {
+        json_sink_emit(l, sink, JSON_SINK_CHUNK);
+        json->length -= JSON_SINK_CHUNK;
+        c_memmove(json->buf, json->buf + JSON_SINK_CHUNK, json->length);
+    }
+}
+
 static void json_encode_exception(lua_State *l, json_config_t *cfg, strbuf_t *json, int lindex,
                                   const char *reason)
 {
@@ -609,19 +646,36 @@ static void json_append_string(lua_State *l, strbuf_t *json, int lindex)
     const char *escstr;
     int i;
     const char *str;
+    unsigned char c;
     size_t len;
+    size_t step, flush_at;
 
     str = lua_tolstring(l, lindex, &len);
 
     /* Worst case is len * 6 (all unicode escapes).
      * This buffer is reused constantly for small strings
      * If there are any excess pages, they won't be hit anyway.
-     * This gains ~5% speedup. */
-    strbuf_ensure_empty_length(json, len * 6 + 2);
+     * This gains ~5% speedup.
+     * When streaming, reserve and flush a slice at a time instead. */
+    step = (json_sink && json == &json_sink->buf) ? JSON_SINK_STRING_STEP : len;
+    strbuf_ensure_empty_length(json, (len < step ? len : step) * 6 + 2);
+
+    flush_at = step;
 
     strbuf_append_char_unsafe(json, '\"');
     for (i = 0; i < len; i++) {
-        escstr = char2escape((unsigned char)str[i]);
+        if (i == flush_at) {
+            json_sink_check(l, json);
+            strbuf_ensure_empty_length(json, step * 6 + 1);
+            flush_at += step;
+        }
+        /* Most characters need no escape, skip the table for them */
+        c = (unsigned char)str[i];
+        if (c >= 32 && c != '"' && c != '/' && c != '\\' && c != 127) {
+            strbuf_append_char_unsafe(json, c);
+            continue;
+        }
+        escstr = char2escape(c);
         if (escstr){
             int i;
             char temp[8];  // for now, 8-bytes is enough.
@@ -733,11 +787,37 @@ static void json_append_array(lua_State *l, json_config_t *cfg, int current_dept
         lua_rawgeti(l, -1, i);
         json_append_data(l, cfg, current_depth, json);
         lua_pop(l, 1);
+        json_sink_check(l, json);
     }
 
     strbuf_append_char(json, ']');
 }
 
+/* Integers are the bulk of most documents, print them directly rather
+ * than through the floating point formatter. */
+static void json_append_integer(strbuf_t *json, long long value)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    unsigned long long u = value < 0 ? -value : value;
+    uint32_t lo;
+
+    /* 64 bit division is a library call, only use it for the top digits */
+    while (u > 0xFFFFFFFFULL) {
+        *--p = '0' + (int)(u % 10);
+        u /= 10;
+    }
+    lo = (uint32_t)u;
+    do {
+        *--p = '0' + lo % 10;
+        lo /= 10;
+    } while (lo);
+    if (value < 0)
+        *--p = '-';
+
+    strbuf_append_mem(json, p, buf + sizeof(buf) - p);
+}
+
 static void json_append_number(lua_State *l, json_config_t *cfg,
                                strbuf_t *json, int lindex)
 {
@@ -771,11 +851,16 @@ static void json_append_number(lua_State *l, json_config_t *cfg,
         }
     }
 
-    strbuf_ensure_empty_length(json, FPCONV_G_FMT_BUFSIZE);
-    // len = fpconv_g_fmt(strbuf_empty_ptr(json), num, cfg->encode_number_precision);
-    c_sprintf(strbuf_empty_ptr(json), LUA_NUMBER_FMT, (LUA_NUMBER)num);
-    len = c_strlen(strbuf_empty_ptr(json));
+    /* Every integer below 2^53 is exact; -0 is left to the formatter
+     * so it keeps its sign */
+    if (num >= -1e15 && num <= 1e15 && num == (double)(long long)num &&
+        (num != 0 || 1 / num > 0)) {
+        json_append_integer(json, (long long)num);
+        return;
+    }
 
+    strbuf_ensure_empty_length(json, FPCONV_G_FMT_BUFSIZE);
+    len = fpconv_g_fmt(strbuf_empty_ptr(json), num, cfg->encode_number_precision);
     strbuf_extend_length(json, len);
 }
 
@@ -815,6 +900,7 @@ static void json_append_object(lua_State *l, json_config_t *cfg,
         json_append_data(l, cfg, current_depth, json);
         lua_pop(l, 1);
         /* table, key */
+        json_sink_check(l, json);
     }
 
     strbuf_append_char(json, '}');
@@ -896,6 +982,326 @@ static int json_encode(lua_State *l)
     return 1;
 }
 
+static int json_encode_to_run(lua_State *l)
+{
+    json_sink_t *sink = (json_sink_t *)lua_touserdata(l, 1);
+
+    /* Encodes the value at the top of the stack, the sink is at 2 */
+    sink->index = 2;
+    json_append_data(l, json_fetch_config(l), 0, &sink->buf);
+    if (sink->buf.length > 0)
+        json_sink_emit(l, sink, sink->buf.length);
+    return 0;
+}
+
+// Lua: cjson.encode_to( sink, value )
+static int json_encode_to(lua_State *l)
+{
+    json_sink_t sink;
+    json_sink_t *outer = json_sink;
+    int err;
+
+    luaL_argcheck(l, lua_gettop(l) == 2, 2, "expected 2 arguments");
+    luaL_argcheck(l, lua_isfunction(l, 1) || lua_islightfunction(l, 1), 1,
+                  "sink must be a function");
+
+    if (-1 == strbuf_init(&sink.buf, JSON_SINK_CHUNK * 2))
+        return luaL_error(l, "not enough memory");
+
+    /* The encoder raises errors, and the buffer has to be freed either
+     * way, so run it protected */
+    lua_pushcfunction(l, json_encode_to_run);
+    lua_pushlightuserdata(l, &sink);
+    lua_pushvalue(l, 1);
+    lua_pushvalue(l, 2);
+    json_sink = &sink;
+    err = lua_pcall(l, 3, 0, 0);
+    json_sink = outer;
+    strbuf_free(&sink.buf);
+
+    if (err)
+        return lua_error(l);
+    return 0;
+}
+
+/* ===== TEMPLATES ===== */
+
+/* cjson.template(example) compiles the shape of an example object once:
+ * key order and the escaped key fragments become literal runs in a byte
+ * program, and encoding a value only looks up those keys and formats
+ * what it finds. Keys missing from the value encode as null, keys not in
+ * the example are ignored. Nested objects are compiled as well; arrays,
+ * empty tables and scalars are encoded generically at run time.
+ *
+ * Program, 16 bit operands little endian:
+ *   OP_LIT n bytes[n]      append literal
+ *   OP_VALUE k             encode t[key k]
+ *   OP_ENTER k skip        descend into t[key k], or encode it generically
+ *                          and skip the nested program if it is no table
+ *   OP_LEAVE
+ *   OP_END
+ * Key k is slot k of the userdata environment. */
+
+#define JSON_TEMPLATE_MT "cjson.template"
+
+enum {
+    OP_END,
+    OP_LIT,
+    OP_VALUE,
+    OP_ENTER,
+    OP_LEAVE
+};
+
+typedef struct {
+    strbuf_t prog;
+    strbuf_t scratch;   /* Escaped key */
+    int lit;            /* Offset of the open OP_LIT, -1 if none */
+    int keys;
+    int depth;
+    int max_depth;
+} json_template_build_t;
+
+typedef struct {
+    strbuf_t buf;       /* Output, reused across calls */
+    uint16_t depth;
+    uint16_t len;
+    uint8_t prog[1];
+} json_template_t;
+
+static void json_template_u16(strbuf_t *prog, int v)
+{
+    strbuf_append_char(prog, v & 0xff);
+    strbuf_append_char(prog, v >> 8);
+}
+
+static void json_template_lit(json_template_build_t *b, const char *str, int len)
+{
+    int n;
+
+    if (b->lit < 0) {
+        b->lit = b->prog.length;
+        strbuf_append_char(&b->prog, OP_LIT);
+        json_template_u16(&b->prog, 0);
+    }
+    strbuf_append_mem(&b->prog, str, len);
+
+    n = b->prog.length - b->lit - 3;
+    b->prog.buf[b->lit + 1] = n & 0xff;
+    b->prog.buf[b->lit + 2] = n >> 8;
+}
+
+static void json_template_op(json_template_build_t *b, int op, int key)
+{
+    b->lit = -1;
+    strbuf_append_char(&b->prog, op);
+    if (op == OP_VALUE || op == OP_ENTER)
+        json_template_u16(&b->prog, key);
+}
+
+/* Compiles the object on top of the stack, the environment is at index 2 */
+static void json_template_object(lua_State *l, json_config_t *cfg,
+                                 json_template_build_t *b)
+{
+    int comma = 0;
+    int skip;
+
+    if (++b->depth > cfg->encode_max_depth || !lua_checkstack(l, 4))
+        luaL_error(l, "Cannot compile template, excessive nesting (%d)", b->depth);
+    if (b->depth > b->max_depth)
+        b->max_depth = b->depth;
+
+    json_template_lit(b, "{", 1);
+
+    lua_pushnil(l);
+    while (lua_next(l, -2) != 0) {
+        /* table, key, value */
+        if (lua_type(l, -2) != LUA_TSTRING)
+            luaL_error(l, "template keys must be strings");
+        if (b->keys >= 0xffff)
+            luaL_error(l, "template too large");
+
+        strbuf_reset(&b->scratch);
+        if (comma)
+            strbuf_append_char(&b->scratch, ',');
+        comma = 1;
+        json_append_string(l, &b->scratch, -2);
+        strbuf_append_char(&b->scratch, ':');
+        json_template_lit(b, b->scratch.buf, b->scratch.length);
+
+        lua_pushvalue(l, -2);
+        lua_rawseti(l, 2, ++b->keys);
+
+        if (lua_istable(l, -1) && lua_array_length(l, cfg, &b->scratch) < 0) {
+            json_template_op(b, OP_ENTER, b->keys);
+            skip = b->prog.length;
+            json_template_u16(&b->prog, 0);
+            json_template_object(l, cfg, b);
+            json_template_op(b, OP_LEAVE, 0);
+            b->prog.buf[skip] = (b->prog.length - skip - 2) & 0xff;
+            b->prog.buf[skip + 1] = (b->prog.length - skip - 2) >> 8;
+        } else {
+            json_template_op(b, OP_VALUE, b->keys);
+        }
+        lua_pop(l, 1);
+    }
+
+    json_template_lit(b, "}", 1);
+    b->depth--;
+}
+
+static int json_template_compile(lua_State *l)
+{
+    json_template_build_t *b = (json_template_build_t *)lua_touserdata(l, 1);
+
+    /* Example at 3 */
+    json_template_object(l, json_fetch_config(l), b);
+    json_template_op(b, OP_END, 0);
+    if (b->prog.length > 0xffff)
+        luaL_error(l, "template too large");
+    return 0;
+}
+
+// Lua: tpl = cjson.template( example )
+static int json_template_new(lua_State *l)
+{
+    json_template_build_t b;
+    json_template_t *tpl;
+    int err;
+
+    luaL_checktype(l, 1, LUA_TTABLE);
+    lua_settop(l, 1);
+
+    b.lit = -1;
+    b.keys = 0;
+    b.depth = 0;
+    b.max_depth = 0;
+    if (-1 == strbuf_init(&b.prog, 0))
+        return luaL_error(l, "not enough memory");
+    if (-1 == strbuf_init(&b.scratch, 0)) {
+        strbuf_free(&b.prog);
+        return luaL_error(l, "not enough memory");
+    }
+
+    /* Keys are collected in the table that becomes the environment */
+    lua_pushcfunction(l, json_template_compile);
+    lua_pushlightuserdata(l, &b);
+    lua_newtable(l);
+    lua_pushvalue(l, 1);
+    lua_pushvalue(l, -2);
+    lua_insert(l, 2);
+    err = lua_pcall(l, 3, 0, 0);
+    strbuf_free(&b.scratch);
+    if (err) {
+        strbuf_free(&b.prog);
+        return lua_error(l);
+    }
+
+    tpl = (json_template_t *)lua_newuserdata(l, sizeof(json_template_t) + b.prog.length - 1);
+    tpl->buf.buf = NULL;
+    tpl->depth = b.max_depth;
+    tpl->len = b.prog.length;
+    c_memcpy(tpl->prog, b.prog.buf, b.prog.length);
+    strbuf_free(&b.prog);
+    luaL_getmetatable(l, JSON_TEMPLATE_MT);
+    lua_setmetatable(l, -2);
+    lua_pushvalue(l, 2);
+    lua_setfenv(l, -2);
+
+    return 1;
+}
+
+/* luaL_checkudata() looks the metatable up by name, which costs as much
+ * as encoding a small object. Compare against a cached reference. */
+static int json_template_mt = LUA_NOREF;
+
+static json_template_t *json_checktemplate(lua_State *l, int index)
+{
+    void *p = lua_touserdata(l, index);
+
+    if (p != NULL && lua_getmetatable(l, index)) {
+        lua_rawgeti(l, LUA_REGISTRYINDEX, json_template_mt);
+        if (lua_rawequal(l, -1, -2)) {
+            lua_pop(l, 2);
+            return (json_template_t *)p;
+        }
+    }
+    luaL_typerror(l, index, JSON_TEMPLATE_MT);
+    return NULL;
+}
+
+static int json_template_u16_at(const uint8_t *pc)
+{
+    return pc[0] | (pc[1] << 8);
+}
+
+// Lua: text = tpl:encode( value )
+static int json_template_encode(lua_State *l)
+{
+    json_template_t *tpl = json_checktemplate(l, 1);
+    json_config_t *cfg = json_fetch_config(l);
+    const uint8_t *pc = tpl->prog;
+    strbuf_t *json = &tpl->buf;
+    int depth = 0;
+    int n;
+
+    luaL_checktype(l, 2, LUA_TTABLE);
+    lua_settop(l, 2);
+    lua_getfenv(l, 1);
+    lua_insert(l, 2);
+    /* env, value */
+    luaL_checkstack(l, tpl->depth + 3, "template too deep");
+
+    /* The generic encoder frees the buffer when it raises an error */
+    if (!strbuf_allocated(json) && -1 == strbuf_init(json, 0))
+        return luaL_error(l, "not enough memory");
+    strbuf_reset(json);
+
+    while (1) {
+        switch (*pc++) {
+        case OP_LIT:
+            n = json_template_u16_at(pc);
+            strbuf_append_mem(json, (const char *)pc + 2, n);
+            pc += 2 + n;
+            break;
+        case OP_VALUE:
+            lua_rawgeti(l, 2, json_template_u16_at(pc));
+            lua_rawget(l, -2);
+            json_append_data(l, cfg, depth, json);
+            lua_pop(l, 1);
+            pc += 2;
+            break;
+        case OP_ENTER:
+            lua_rawgeti(l, 2, json_template_u16_at(pc));
+            lua_rawget(l, -2);
+            n = json_template_u16_at(pc + 2);
+            pc += 4;
+            if (lua_istable(l, -1)) {
+                depth++;
+            } else {
+                json_append_data(l, cfg, depth, json);
+                lua_pop(l, 1);
+                pc += n;
+            }
+            break;
+        case OP_LEAVE:
+            lua_pop(l, 1);
+            depth--;
+            break;
+        default:
+            lua_pushlstring(l, json->buf, json->length);
+            return 1;
+        }
+    }
+}
+
+static int json_template_delete(lua_State *l)
+{
+    json_template_t *tpl = (json_template_t *)luaL_checkudata(l, 1, JSON_TEMPLATE_MT);
+
+    strbuf_free(&tpl->buf);
+    return 0;
+}
+
 /* ===== DECODING ===== */
 
 static void json_process_value(lua_State *l, json_parse_t *json,
@@ -1171,9 +1577,29 @@ static int json_is_invalid_number(json_parse_t *json)
 
 static void json_next_number_token(json_parse_t *json, json_token_t *token)
 {
+    const char *p = json->ptr;
     char *endptr;
+    uint32_t n = 0;
+    int digits = 0;
 
     token->type = T_NUMBER;
+
+    /* Fast path for plain integers of up to 9 digits: accumulate them
+     * directly. Anything with a fraction, exponent or more digits goes
+     * through strtod() */
+    if (*p == '-')
+        p++;
+    while ('0' <= *p && *p <= '9' && digits < 10) {
+        n = n * 10 + (*p++ - '0');
+        digits++;
+    }
+    if (digits && digits < 10 && *p != '.' &&
+        (*p | 0x20) != 'e' && (*p | 0x20) != 'x') {
+        token->value.number = *json->ptr == '-' ? -(double)n : (double)n;
+        json->ptr = p;
+        return;
+    }
+
     token->value.number = fpconv_strtod(json->ptr, &endptr);
     if (json->ptr == endptr)
         json_set_token_error(token, json, "invalid number");
@@ -1479,6 +1905,426 @@ static int json_decode(lua_State *l)
     return 1;
 }
 
+/* ===== STREAMING DECODER ===== */
+
+/* cjson.decoder() returns an object that is fed the document in chunks,
+ * e.g. straight from a net receive callback:
+ *
+ *   local dec = cjson.decoder()
+ *   sk:on("receive", function(sk, chunk)
+ *     local t = dec:write(chunk)
+ *     if t then ... end
+ *   end)
+ *
+ * write() returns nil until the top level value is complete and the value
+ * itself after that. Only whitespace may follow it.
+ *
+ * Containers are built in place as tables held in the userdata environment
+ * (slot d is the container at depth d, slot -d its pending key, slot 0 the
+ * result). The parser state is a small fixed struct; the only buffer is the
+ * scratch space for the token being read, so it grows to the longest single
+ * string or number rather than to the size of the document. */
+
+#define JSON_STREAM_MT "cjson.decoder"
+#define JSON_STREAM_MAX_DEPTH 128
+#define JSON_STREAM_TMP_SIZE 32
+
+typedef enum {
+    S_VALUE,            /* Expecting any value */
+    S_VALUE_OR_END,     /* After [ */
+    S_KEY,              /* After , in an object */
+    S_KEY_OR_END,       /* After { */
+    S_COLON,
+    S_AFTER_VALUE,      /* Expecting , or the end of the container */
+    S_STRING,
+    S_ESCAPE,           /* After \ */
+    S_UNICODE,          /* Reading the hex digits of \uXXXX */
+    S_SURROGATE,        /* Expecting \ of the low surrogate */
+    S_SURROGATE_U,      /* Expecting u of the low surrogate */
+    S_BARE,             /* Number or literal */
+    S_DONE,
+    S_FAILED
+} json_stream_state_t;
+
+typedef struct {
+    strbuf_t tmp;           /* Current string, number or literal */
+    int offset;             /* Bytes consumed, for error messages */
+    int codepoint;          /* \u escape being decoded */
+    int surrogate_hi;       /* Pending high surrogate, 0 if none */
+    uint16_t depth;
+    uint8_t state;
+    uint8_t hex_digits;
+    uint8_t is_key;         /* The string being read is an object key */
+    uint8_t is_object[JSON_STREAM_MAX_DEPTH / 8];
+} json_stream_t;
+
+static int json_stream_is_object(json_stream_t *s)
+{
+    return s->is_object[(s->depth - 1) >> 3] & (1 << ((s->depth - 1) & 7));
+}
+
+static void json_stream_error(lua_State *l, json_stream_t *s, const char *msg)
+{
+    s->state = S_FAILED;
+    luaL_error(l, "%s at character %d", msg, s->offset + 1);
+}
+
+/* Store the value on top of the stack in the current container.
+ * The environment table is at index 2. */
+static void json_stream_store(lua_State *l, json_stream_t *s)
+{
+    if (s->depth == 0) {
+        lua_rawseti(l, 2, 0);
+        s->state = S_DONE;
+        return;
+    }
+
+    lua_rawgeti(l, 2, s->depth);
+    lua_insert(l, -2);
+    if (json_stream_is_object(s)) {
+        lua_rawgeti(l, 2, -(int)s->depth);
+        lua_insert(l, -2);
+        lua_rawset(l, -3);
+        lua_pushnil(l);
+        lua_rawseti(l, 2, -(int)s->depth);
+    } else {
+        lua_rawseti(l, -2, lua_objlen(l, -2) + 1);
+    }
+    lua_pop(l, 1);
+    s->state = S_AFTER_VALUE;
+}
+
+static void json_stream_open(lua_State *l, json_stream_t *s, int is_object)
+{
+    if (s->depth >= JSON_STREAM_MAX_DEPTH ||
+        s->depth >= json_fetch_config(l)->decode_max_depth)
+        json_stream_error(l, s, "Found too many nested data structures");
+
+    if (is_object)
+        s->is_object[s->depth >> 3] |= 1 << (s->depth & 7);
+    else
+        s->is_object[s->depth >> 3] &= ~(1 << (s->depth & 7));
+    s->depth++;
+
+    lua_newtable(l);
+    lua_rawseti(l, 2, s->depth);
+    s->state = is_object ? S_KEY_OR_END : S_VALUE_OR_END;
+}
+
+static void json_stream_close(lua_State *l, json_stream_t *s)
+{
+    lua_rawgeti(l, 2, s->depth);
+    lua_pushnil(l);
+    lua_rawseti(l, 2, s->depth);
+    s->depth--;
+    json_stream_store(l, s);
+}
+
+static void json_stream_string_done(lua_State *l, json_stream_t *s)
+{
+    lua_pushlstring(l, s->tmp.buf, s->tmp.length);
+    if (s->is_key) {
+        lua_rawseti(l, 2, -(int)s->depth);
+        s->state = S_COLON;
+    } else {
+        json_stream_store(l, s);
+    }
+}
+
+/* Converts a completed bare token, reusing the whole-document token
+ * rules so both decoders accept exactly the same input */
+static void json_stream_bare_done(lua_State *l, json_stream_t *s)
+{
+    json_parse_t json;
+    json_token_t token;
+
+    strbuf_ensure_null(&s->tmp);
+    json.cfg = json_fetch_config(l);
+    json.data = json.ptr = s->tmp.buf;
+    json_next_token(&json, &token);
+    if ((token.type != T_NUMBER && token.type != T_BOOLEAN &&
+         token.type != T_NULL) || json.ptr != s->tmp.buf + s->tmp.length)
+        json_stream_error(l, s, "invalid token");
+
+    if (token.type == T_NUMBER)
+        lua_pushnumber(l, token.value.number);
+    else if (token.type == T_BOOLEAN)
+        lua_pushboolean(l, token.value.boolean);
+    else
+        lua_pushlightuserdata(l, NULL);
+    json_stream_store(l, s);
+}
+
+static int json_stream_is_bare(unsigned char ch)
+{
+    return ('0' <= ch && ch <= '9') || ('a' <= (ch | 0x20) && (ch | 0x20) <= 'z') ||
+           ch == '-' || ch == '+' || ch == '.';
+}
+
+static void json_stream_unicode(lua_State *l, json_stream_t *s)
+{
+    char utf8[4];
+    int codepoint = s->codepoint;
+    int len;
+
+    if ((codepoint & 0xF800) == 0xD800) {
+        if (!s->surrogate_hi) {
+            /* Error if the 1st surrogate is not high */
+            if (codepoint & 0x400)
+                json_stream_error(l, s, "invalid unicode escape code");
+            s->surrogate_hi = codepoint;
+            s->state = S_SURROGATE;
+            return;
+        }
+        if ((codepoint & 0xFC00) != 0xDC00)
+            json_stream_error(l, s, "invalid unicode escape code");
+        codepoint = (((s->surrogate_hi & 0x3FF) << 10) | (codepoint & 0x3FF)) + 0x10000;
+        s->surrogate_hi = 0;
+    } else if (s->surrogate_hi) {
+        json_stream_error(l, s, "invalid unicode escape code");
+    }
+
+    len = codepoint_to_utf8(utf8, codepoint);
+    if (!len)
+        json_stream_error(l, s, "invalid unicode escape code");
+    strbuf_append_mem(&s->tmp, utf8, len);
+    s->state = S_STRING;
+}
+
+/* Runs the state machine over one chunk. The environment table is at
+ * index 2. */
+static void json_stream_feed(lua_State *l, json_stream_t *s,
+                             const char *p, size_t len)
+{
+    const char *end = p + len;
+    unsigned char ch;
+
+    while (p < end) {
+        ch = (unsigned char)*p;
+
+        switch (s->state) {
+        case S_STRING:
+            /* Copy plain runs in one go, this is the hot path */
+            {
+                const char *run = p;
+                while (p < end && *p != '"' && *p != '\\' && *p)
+                    p++;
+                if (p > run) {
+                    strbuf_append_mem(&s->tmp, run, p - run);
+                    s->offset += p - run;
+                    continue;
+                }
+            }
+            if (ch == '"')
+                json_stream_string_done(l, s);
+            else if (ch == '\\')
+                s->state = S_ESCAPE;
+            else
+                json_stream_error(l, s, "unexpected end of string");
+            break;
+
+        case S_ESCAPE:
+            ch = escape2char(ch);
+            if (ch == 'u') {
+                s->codepoint = 0;
+                s->hex_digits = 0;
+                s->state = S_UNICODE;
+            } else if (!ch) {
+                json_stream_error(l, s, "invalid escape code");
+            } else {
+                strbuf_append_char(&s->tmp, ch);
+                s->state = S_STRING;
+            }
+            break;
+
+        case S_UNICODE:
+            {
+                int digit = hexdigit2int(ch);
+                if (digit < 0)
+                    json_stream_error(l, s, "invalid unicode escape code");
+                s->codepoint = (s->codepoint << 4) | digit;
+                if (++s->hex_digits == 4)
+                    json_stream_unicode(l, s);
+            }
+            break;
+
+        case S_SURROGATE:
+            if (ch != '\\')
+                json_stream_error(l, s, "invalid unicode escape code");
+            s->state = S_SURROGATE_U;
+            break;
+
+        case S_SURROGATE_U:
+            if (ch != 'u')
+                json_stream_error(l, s, "invalid unicode escape code");
+            s->codepoint = 0;
+            s->hex_digits = 0;
+            s->state = S_UNICODE;
+            break;
+
+        case S_BARE:
+            if (json_stream_is_bare(ch)) {
+                strbuf_append_char(&s->tmp, ch);
+                break;
+            }
+            json_stream_bare_done(l, s);
+            /* The terminating character belongs to the next token */
+            continue;
+
+        default:
+            if (ch2token(ch) == T_WHITESPACE)
+                break;
+
+            switch (s->state) {
+            case S_VALUE_OR_END:
+                if (ch == ']') {
+                    json_stream_close(l, s);
+                    break;
+                }
+                /* Fall through */
+            case S_VALUE:
+                if (ch == '{' || ch == '[') {
+                    json_stream_open(l, s, ch == '{');
+                } else if (ch == '"') {
+                    strbuf_reset(&s->tmp);
+                    s->is_key = 0;
+                    s->state = S_STRING;
+                } else if (json_stream_is_bare(ch)) {
+                    strbuf_reset(&s->tmp);
+                    strbuf_append_char(&s->tmp, ch);
+                    s->state = S_BARE;
+                } else {
+                    json_stream_error(l, s, "Expected value");
+                }
+                break;
+
+            case S_KEY_OR_END:
+                if (ch == '}') {
+                    json_stream_close(l, s);
+                    break;
+                }
+                /* Fall through */
+            case S_KEY:
+                if (ch != '"')
+                    json_stream_error(l, s, "Expected object key string");
+                strbuf_reset(&s->tmp);
+                s->is_key = 1;
+                s->state = S_STRING;
+                break;
+
+            case S_COLON:
+                if (ch != ':')
+                    json_stream_error(l, s, "Expected colon");
+                s->state = S_VALUE;
+                break;
+
+            case S_AFTER_VALUE:
+                if (ch == ',')
+                    s->state = json_stream_is_object(s) ? S_KEY : S_VALUE;
+                else if (ch == (json_stream_is_object(s) ? '}' : ']'))
+                    json_stream_close(l, s);
+                else
+                    json_stream_error(l, s, "Expected comma or container end");
+                break;
+
+            case S_DONE:
+                json_stream_error(l, s, "Expected the end");
+                break;
+
+            default:
+                json_stream_error(l, s, "decoder failed earlier");
+            }
+        }
+        p++;
+        s->offset++;
+    }
+}
+
+static void json_stream_reset(lua_State *l, json_stream_t *s, int ud)
+{
+    strbuf_reset(&s->tmp);
+    s->offset = 0;
+    s->surrogate_hi = 0;
+    s->depth = 0;
+    s->state = S_VALUE;
+
+    lua_newtable(l);
+    lua_setfenv(l, ud);
+}
+
+// Lua: decoder = cjson.decoder()
+static int json_decoder_new(lua_State *l)
+{
+    json_stream_t *s = (json_stream_t *)lua_newuserdata(l, sizeof(json_stream_t));
+
+    s->tmp.buf = NULL;
+    luaL_getmetatable(l, JSON_STREAM_MT);
+    lua_setmetatable(l, -2);
+    /* A failed allocation leaves buf NULL, which __gc handles */
+    strbuf_init(&s->tmp, JSON_STREAM_TMP_SIZE);
+    json_stream_reset(l, s, lua_gettop(l));
+
+    return 1;
+}
+
+// Lua: value = decoder:write( chunk )
+static int json_decoder_write(lua_State *l)
+{
+    json_stream_t *s = (json_stream_t *)luaL_checkudata(l, 1, JSON_STREAM_MT);
+    size_t len;
+    const char *chunk = luaL_checklstring(l, 2, &len);
+
+    if (!strbuf_allocated(&s->tmp))
+        return luaL_error(l, "not enough memory");
+
+    lua_settop(l, 2);
+    lua_getfenv(l, 1);
+    lua_insert(l, 2);       /* Keep the chunk anchored above it */
+
+    json_stream_feed(l, s, chunk, len);
+
+    /* A top level number has no terminator, it is only complete once
+     * the caller says so via finish() */
+    if (s->state != S_DONE)
+        return 0;
+    lua_rawgeti(l, 2, 0);
+    return 1;
+}
+
+// Lua: value = decoder:finish()
+static int json_decoder_finish(lua_State *l)
+{
+    json_stream_t *s = (json_stream_t *)luaL_checkudata(l, 1, JSON_STREAM_MT);
+
+    lua_settop(l, 1);
+    lua_getfenv(l, 1);
+    if (s->state == S_BARE && s->depth == 0)
+        json_stream_bare_done(l, s);
+    if (s->state != S_DONE)
+        json_stream_error(l, s, "unexpected end of input");
+
+    lua_rawgeti(l, 2, 0);
+    json_stream_reset(l, s, 1);
+    return 1;
+}
+
+// Lua: decoder:reset()
+static int json_decoder_reset(lua_State *l)
+{
+    json_stream_t *s = (json_stream_t *)luaL_checkudata(l, 1, JSON_STREAM_MT);
+
+    json_stream_reset(l, s, 1);
+    return 0;
+}
+
+static int json_decoder_delete(lua_State *l)
+{
+    json_stream_t *s = (json_stream_t *)luaL_checkudata(l, 1, JSON_STREAM_MT);
+
+    strbuf_free(&s->tmp);
+    return 0;
+}
+
 /* ===== INITIALISATION ===== */
 #if 0
 #if !defined(LUA_VERSION_NUM) || LUA_VERSION_NUM < 502
@@ -1533,10 +2379,35 @@ static int json_protect_conversion(lua_State *l)
 // Module function map
 #define MIN_OPT_LEVEL 2
 #include "lrodefs.h"
+static const LUA_REG_TYPE json_decoder_map[] =
+{
+  { LSTRKEY( "write" ), LFUNCVAL( json_decoder_write ) },
+  { LSTRKEY( "finish" ), LFUNCVAL( json_decoder_finish ) },
+  { LSTRKEY( "reset" ), LFUNCVAL( json_decoder_reset ) },
+  { LSTRKEY( "__gc" ), LFUNCVAL( json_decoder_delete ) },
+#if LUA_OPTIMIZE_MEMORY > 0
+  { LSTRKEY( "__index" ), LROVAL( json_decoder_map ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE json_template_map[] =
+{
+  { LSTRKEY( "encode" ), LFUNCVAL( json_template_encode ) },
+  { LSTRKEY( "__gc" ), LFUNCVAL( json_template_delete ) },
+#if LUA_OPTIMIZE_MEMORY > 0
+  { LSTRKEY( "__index" ), LROVAL( json_template_map ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
 const LUA_REG_TYPE cjson_map[] = 
 {
   { LSTRKEY( "encode" ), LFUNCVAL( json_encode ) },
+  { LSTRKEY( "encode_to" ), LFUNCVAL( json_encode_to ) },
+  { LSTRKEY( "template" ), LFUNCVAL( json_template_new ) },
   { LSTRKEY( "decode" ), LFUNCVAL( json_decode ) },
+  { LSTRKEY( "decoder" ), LFUNCVAL( json_decoder_new ) },
   // { LSTRKEY( "encode_sparse_array" ), LFUNCVAL( json_cfg_encode_sparse_array ) },
   // { LSTRKEY( "encode_max_depth" ), LFUNCVAL( json_cfg_encode_max_depth ) },
   // { LSTRKEY( "decode_max_depth" ), LFUNCVAL( json_cfg_decode_max_depth ) },
@@ -1561,13 +2432,31 @@ LUALIB_API int luaopen_cjson( lua_State *L )
     return luaL_error(L, "BUG: Unable to init config for cjson");;
   }
 #if LUA_OPTIMIZE_MEMORY > 0
+  luaL_rometatable(L, JSON_STREAM_MT, (void *)json_decoder_map);
+  luaL_rometatable(L, JSON_TEMPLATE_MT, (void *)json_template_map);
+  luaL_getmetatable(L, JSON_TEMPLATE_MT);
+  json_template_mt = luaL_ref(L, LUA_REGISTRYINDEX);
   return 0;
 #else // #if LUA_OPTIMIZE_MEMORY > 0
+  luaL_newmetatable(L, JSON_STREAM_MT);
+  lua_pushliteral(L, "__index");
+  lua_pushvalue(L, -2);
+  lua_rawset(L, -3);
+  luaL_register(L, NULL, json_decoder_map);
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, JSON_TEMPLATE_MT);
+  lua_pushliteral(L, "__index");
+  lua_pushvalue(L, -2);
+  lua_rawset(L, -3);
+  luaL_register(L, NULL, json_template_map);
+  json_template_mt = luaL_ref(L, LUA_REGISTRYINDEX);
+
   luaL_register( L, AUXLIB_CJSON, cjson_map );
   // Add constants
   /* Set cjson.null */
-  lua_pushlightuserdata(l, NULL);
-  lua_setfield(l, -2, "null");
+  lua_pushlightuserdata(L, NULL);
+  lua_setfield(L, -2, "null");
 
   /* Return cjson table */
   return 1;
@@ -22,35 +22,97 @@
 #include "coap_io.h"
 #include "coap_server.h"
 
-coap_queue_t *gQueue = NULL;
+coap_sendqueue_t gQueue;   // confirmable messages of all clients
 
 typedef struct lcoap_userdata
 {
   lua_State *L;
   struct espconn *pesp_conn;
   int self_ref;
+  // a client's request, kept until its last response arrives as it may
+  // take several exchanges (block-wise transfer, RFC 7959)
+  coap_uri_t *uri;
+  int cb_ref;               // function(code, payload, more), or LUA_NOREF
+  int payload_ref;          // the payload string, until it is all sent
+  const char *payload;
+  size_t payload_len;
+  size_t sent;              // payload bytes the server has taken
+  uint8_t type, method;
+  uint8_t seq;              // bumped by each new request
+  uint8_t block1_on, block2_on;
+  coap_block_t block1;      // payload block being sent
+  coap_block_t block2;      // response block being asked for
 }lcoap_userdata;
 
+// Drops the client's request in progress, if any.
+static void coap_transfer_end(lcoap_userdata *cud)
+{
+  if(cud->uri){
+    c_free(cud->uri);
+    cud->uri = NULL;
+  }
+  if(LUA_NOREF!=cud->cb_ref){
+    luaL_unref(cud->L, LUA_REGISTRYINDEX, cud->cb_ref);
+    cud->cb_ref = LUA_NOREF;
+  }
+  if(LUA_NOREF!=cud->payload_ref){
+    luaL_unref(cud->L, LUA_REGISTRYINDEX, cud->payload_ref);
+    cud->payload_ref = LUA_NOREF;
+  }
+  cud->payload = NULL;
+  cud->payload_len = 0;
+}
+
 static void coap_received(void *arg, char *pdata, unsigned short len)
 {
   NODE_DBG("coap_received is called.\n");
   struct espconn *pesp_conn = arg;
   lcoap_userdata *cud = (lcoap_userdata *)pesp_conn->reverse;
 
-  // static uint8_t buf[MAX_MESSAGE_SIZE+1] = {0}; // +1 for string '\0'
-  uint8_t buf[MAX_MESSAGE_SIZE+1] = {0}; // +1 for string '\0'
-  c_memset(buf, 0, sizeof(buf)); // wipe prev data
+  // The request is parsed in place in pdata; only the response needs room.
+  uint8_t buf[MAX_MESSAGE_SIZE+1]; // +1 for string '\0'
 
   if (len > MAX_MESSAGE_SIZE) {
     NODE_DBG("Request Entity Too Large.\n"); // NOTE: should response 4.13 to client...
     return;
   }
-  // c_memcpy(buf, pdata, len);
 
-  size_t rsplen = coap_server_respond(pdata, len, buf, MAX_MESSAGE_SIZE+1);
-  espconn_sent(pesp_conn, (unsigned char *)buf, rsplen);
+  coap_peer_t peer;
+  peer.conn = pesp_conn;
+  c_memcpy(&peer.ip, pesp_conn->proto.udp->remote_ip, sizeof(peer.ip));
+  peer.port = pesp_conn->proto.udp->remote_port;
 
-  // c_memset(buf, 0, sizeof(buf));
+  size_t rsplen = coap_server_respond(pdata, len, buf, MAX_MESSAGE_SIZE+1, &peer);
+  if (rsplen > 0)
+    espconn_sent(pesp_conn, (unsigned char *)buf, rsplen);
+}
+
+// Observe notifications leave through the server's connection, readdressed.
+// A confirmable one goes on the retransmission queue like a client's
+// request; if it can't, it is sent once.
+void coap_observe_send(const coap_peer_t *peer, const uint8_t *buf, size_t len, int con)
+{
+  struct espconn *pesp_conn = peer->conn;
+  coap_pdu_t *pdu;
+  c_memcpy(pesp_conn->proto.udp->remote_ip, &peer->ip, sizeof(peer->ip));
+  pesp_conn->proto.udp->remote_port = peer->port;
+  if(con && len <= MAX_REQUEST_SIZE && (pdu = coap_new_pdu()) != NULL){
+    c_memcpy(pdu->msg.p, buf, len);
+    pdu->msg.len = len;
+    if(0 == coap_parse(pdu->pkt, pdu->msg.p, len) &&
+       COAP_INVALID_TID != coap_send_confirmed(pesp_conn, pdu))
+      return;
+    coap_delete_pdu(pdu);
+  }
+  espconn_sent(pesp_conn, (unsigned char *)buf, len);
+}
+
+// The observer's ACK or RST ends the retransmission of a notification
+void coap_observe_acked(const coap_peer_t *peer, const coap_packet_t *pkt)
+{
+  coap_tid_t id = COAP_INVALID_TID;
+  coap_transaction_id(peer->ip, peer->port, pkt, &id);
+  coap_transaction_done(id);
 }
 
 static void coap_sent(void *arg)
@@ -71,6 +133,10 @@ static int coap_create( lua_State* L, const char* mt )
   // pre-initialize it, in case of errors
   cud->self_ref = LUA_NOREF;
   cud->pesp_conn = NULL;
+  cud->uri = NULL;
+  cud->cb_ref = LUA_NOREF;
+  cud->payload_ref = LUA_NOREF;
+  cud->payload = NULL;
 
   // set its metatable
   luaL_getmetatable(L, mt);
@@ -121,10 +187,13 @@ static int coap_delete( lua_State* L, const char* mt )
     luaL_unref(L, LUA_REGISTRYINDEX, cud->self_ref);
     cud->self_ref = LUA_NOREF;
   }
+  coap_transfer_end(cud);
 
   cud->L = NULL;
   if(cud->pesp_conn)
   {
+    coap_observe_forget(cud->pesp_conn);
+    coap_transaction_forget(cud->pesp_conn);
     if(cud->pesp_conn->proto.udp->remote_port || cud->pesp_conn->proto.udp->local_port)
       espconn_delete(cud->pesp_conn);
     c_free(cud->pesp_conn->proto.udp);
@@ -201,6 +270,8 @@ static int coap_close( lua_State* L, const char* mt )
 
   if(cud->pesp_conn)
   {
+    coap_observe_forget(cud->pesp_conn);
+    coap_transaction_forget(cud->pesp_conn);
     if(cud->pesp_conn->proto.udp->remote_port || cud->pesp_conn->proto.udp->local_port)
       espconn_delete(cud->pesp_conn);
   }
@@ -221,27 +292,131 @@ static int coap_on( lua_State* L, const char* mt )
   return 0;  
 }
 
+// Builds and sends the next request of the client's transfer: the whole
+// payload or block cud->block1 of it, asking for block cud->block2 of the
+// response once that is block-wise. Returns 0 if nothing was sent.
+static int coap_client_send(lcoap_userdata *cud)
+{
+  coap_pdu_t *pdu = coap_new_pdu();   // freed once acknowledged, or here
+  coap_rw_buffer_t scratch;
+  const char *payload = cud->payload;
+  size_t l = cud->payload_len;
+  coap_tid_t tid;
+  int rc;
+
+  if(!pdu)
+    return 0;
+  scratch = pdu->scratch;   // coap_delete_pdu() frees pdu->scratch.p
+
+  if(cud->block1_on){
+    size_t offset = cud->block1.num * COAP_BLOCK_SIZE(cud->block1.szx);
+    payload += offset;
+    l -= offset;
+    cud->block1.m = l > COAP_BLOCK_SIZE(cud->block1.szx);
+    if(cud->block1.m)
+      l = COAP_BLOCK_SIZE(cud->block1.szx);
+  }
+
+  rc = coap_make_request(&scratch, pdu->pkt, cud->type, cud->method, cud->uri, payload, l);
+  if(rc == 0 && cud->block1_on)
+    rc = coap_add_block(&scratch, pdu->pkt, COAP_OPTION_BLOCK1, &cud->block1);
+  if(rc == 0 && cud->block2_on)
+    rc = coap_add_block(&scratch, pdu->pkt, COAP_OPTION_BLOCK2, &cud->block2);
+
+#ifdef COAP_DEBUG
+  coap_dumpPacket(pdu->pkt);
+#endif
+
+  if (rc != 0 || 0 != (rc = coap_build(pdu->msg.p, &(pdu->msg.len), pdu->pkt))){
+    NODE_DBG("coap_build failed rc=%d\n", rc);
+    coap_delete_pdu(pdu);
+    return 0;
+  }
+#ifdef COAP_DEBUG
+  NODE_DBG("Sending: ");
+  coap_dump(pdu->msg.p, pdu->msg.len, true);
+  NODE_DBG("\n");
+#endif
+
+  if (pdu->pkt->hdr.t == COAP_TYPE_CON){
+    tid = coap_send_confirmed(cud->pesp_conn, pdu);
+  }
+  else {
+    tid = coap_send(cud->pesp_conn, pdu);
+  }
+  if (pdu->pkt->hdr.t != COAP_TYPE_CON || tid == COAP_INVALID_TID){
+    coap_delete_pdu(pdu);
+  }
+  return tid != COAP_INVALID_TID;
+}
+
+// Moves the client's transfer on by one response: after 2.31 Continue the
+// next payload block goes out; any other response ends the upload and is
+// passed to the callback, and while it is a Block2 block with more to
+// come the next one is asked for.
+static void coap_client_response(lcoap_userdata *cud, const coap_packet_t *pkt)
+{
+  lua_State *L = cud->L;
+  coap_block_t block;
+  uint8_t seq = cud->seq;
+  int more = 0;
+
+  if(!cud->uri || !L)
+    return;
+
+  if(cud->block1_on && cud->payload && pkt->hdr.code == COAP_RSPCODE_CONTINUE &&
+      coap_get_block(pkt, COAP_OPTION_BLOCK1, &block) && block.num == cud->block1.num){
+    cud->sent = (cud->block1.num + 1) * COAP_BLOCK_SIZE(cud->block1.szx);
+    if(block.szx < cud->block1.szx)   // the server wants smaller blocks
+      cud->block1.szx = block.szx;
+    cud->block1.num = cud->sent >> (cud->block1.szx + 4);
+    if(cud->sent < cud->payload_len && coap_client_send(cud))
+      return;
+  }
+  if(LUA_NOREF!=cud->payload_ref){
+    luaL_unref(L, LUA_REGISTRYINDEX, cud->payload_ref);
+    cud->payload_ref = LUA_NOREF;
+  }
+  cud->payload = NULL;
+  cud->payload_len = 0;
+  cud->block1_on = 0;
+
+  if(LUA_NOREF!=cud->cb_ref){
+    more = COAP_RESPONSE_CLASS(pkt->hdr.code) == 2 &&
+        coap_get_block(pkt, COAP_OPTION_BLOCK2, &block) && block.m;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, cud->cb_ref);
+    lua_pushinteger(L, (pkt->hdr.code >> 5) * 100 + (pkt->hdr.code & 0x1F));  // 2.05 is 205
+    lua_pushlstring(L, (const char *)pkt->payload.p, pkt->payload.len);
+    lua_pushboolean(L, more);
+    lua_call(L, 3, 0);
+    if(cud->seq != seq)   // the callback has started another request
+      return;
+  }
+  if(more){
+    cud->block2_on = 1;
+    cud->block2.num = block.num + 1;
+    cud->block2.m = 0;
+    cud->block2.szx = block.szx;
+    if(coap_client_send(cud))
+      return;
+  }
+  coap_transfer_end(cud);
+}
+
 static void coap_response_handler(void *arg, char *pdata, unsigned short len)
 {
   NODE_DBG("coap_response_handler is called.\n");
   struct espconn *pesp_conn = arg;
+  lcoap_userdata *cud = (lcoap_userdata *)pesp_conn->reverse;
 
   coap_packet_t pkt;
   pkt.content.p = NULL;
   pkt.content.len = 0;
-  // static uint8_t buf[MAX_MESSAGE_SIZE+1] = {0}; // +1 for string '\0'
-  uint8_t buf[MAX_MESSAGE_SIZE+1] = {0}; // +1 for string '\0'
-  c_memset(buf, 0, sizeof(buf)); // wipe prev data
 
+  // parsed in place: pkt points into pdata, which is only valid during
+  // this callback
   int rc;
-  if( len > MAX_MESSAGE_SIZE )
-  {
-    NODE_DBG("Request Entity Too Large.\n"); // NOTE: should response 4.13 to client...
-    return;
-  }
-  c_memcpy(buf, pdata, len);
-
-  if (0 != (rc = coap_parse(&pkt, buf, len))){
+  if (0 != (rc = coap_parse(&pkt, pdata, len))){
     NODE_DBG("Bad packet rc=%d\n", rc);
   }
   else
@@ -249,6 +424,22 @@ static void coap_response_handler(void *arg, char *pdata, unsigned short len)
 #ifdef COAP_DEBUG
     coap_dumpPacket(&pkt);
 #endif
+    uint32_t ip = 0, port = 0;
+    coap_tid_t id = COAP_INVALID_TID;
+
+    c_memcpy(&ip, pesp_conn->proto.udp->remote_ip, sizeof(ip));
+    port = pesp_conn->proto.udp->remote_port;
+
+    coap_transaction_id(ip, port, &pkt, &id);
+
+    /* an empty ACK (the response comes separately) or RST has no token,
+     * only the message id, but ends the retransmissions all the same */
+    if (pkt.hdr.code == 0 && (pkt.hdr.t == COAP_TYPE_ACK || pkt.hdr.t == COAP_TYPE_RESET)) {
+      NODE_DBG("got empty ACK/RST\n");
+      coap_transaction_done(id);
+      goto end;
+    }
+
     /* check if this is a response to our original request */
     if (!check_token(&pkt)) {
       /* drop if this was just some message, or send RST in case of notification */
@@ -259,50 +450,30 @@ static void coap_response_handler(void *arg, char *pdata, unsigned short len)
       goto end;
     }
 
-    if (pkt.hdr.t == COAP_TYPE_RESET) {
-      NODE_DBG("got RST\n");
-      goto end;
-    }
-
-    uint32_t ip = 0, port = 0;
-    coap_tid_t id = COAP_INVALID_TID;
+    /* transaction done, stop retransmitting it */
+    coap_transaction_done(id);
 
-    c_memcpy(&ip, pesp_conn->proto.udp->remote_ip, sizeof(ip));
-    port = pesp_conn->proto.udp->remote_port;
-
-    coap_transaction_id(ip, port, &pkt, &id);
-
-    /* transaction done, remove the node from queue */
-    // stop timer
-    coap_timer_stop();
-    // remove the node
-    coap_remove_node(&gQueue, id);
-    // calculate time elapsed
-    coap_timer_update(&gQueue);
-    coap_timer_start(&gQueue);
-
-    if (COAP_RESPONSE_CLASS(pkt.hdr.code) == 2)
-    {
-      /* There is no block option set, just read the data and we are done. */
-      NODE_DBG("%d.%02d\t", (pkt.hdr.code >> 5), pkt.hdr.code & 0x1F);
-      NODE_DBG((char *)pkt.payload.p);
-    }
-    else if (COAP_RESPONSE_CLASS(pkt.hdr.code) >= 4)
-    {
-      NODE_DBG("%d.%02d\t", (pkt.hdr.code >> 5), pkt.hdr.code & 0x1F);
-      NODE_DBG((char *)pkt.payload.p);
-    }
+    // the payload is not '\0' terminated any more, so it is dumped as hex
+    NODE_DBG("%d.%02d\t", (pkt.hdr.code >> 5), pkt.hdr.code & 0x1F);
+#ifdef COAP_DEBUG
+    coap_dump(pkt.payload.p, pkt.payload.len, true);
+#endif
+    if(cud)
+      coap_client_response(cud, &pkt);
   }
 
 end:
-  if(!gQueue){ // if there is no node pending in the queue, disconnect from host.
+  // if none of ours is pending in the queue, and no block to come, disconnect from host.
+  if(!coap_queue_busy(&gQueue, pesp_conn) && (!cud || !cud->uri)){
     if(pesp_conn->proto.udp->remote_port || pesp_conn->proto.udp->local_port)
       espconn_delete(pesp_conn);
   }
-  // c_memset(buf, 0, sizeof(buf));
 }
 
-// Lua: client:request( [CON], uri, [payload] )
+// Lua: client:request( [CON], uri, [payload], [function(code, payload, more)] )
+// A payload longer than one block is sent block by block (Block1). The
+// callback gets every response; a block-wise response comes a block at a
+// time, with more set until the last one.
 static int coap_request( lua_State* L, coap_method_t m )
 {
   struct espconn *pesp_conn = NULL;
@@ -338,7 +509,18 @@ static int coap_request( lua_State* L, coap_method_t m )
   if (url == NULL)
     return luaL_error( L, "wrong arg type" );
 
-  coap_uri_t *uri = coap_new_uri(url, l);   // should call free(uri) somewhere
+  const char *payload = NULL;
+  size_t pl = 0;
+  int payload_idx = 0;
+  if( lua_isstring(L, stack) ){
+    payload = luaL_checklstring( L, stack, &pl );
+    payload_idx = stack;
+    stack++;
+  }
+  if( !lua_isnoneornil(L, stack) )
+    luaL_checktype(L, stack, LUA_TFUNCTION);
+
+  coap_uri_t *uri = coap_new_uri(url, l);   // freed by coap_transfer_end()
   if (uri == NULL)
     return luaL_error( L, "uri wrong format." );
 
@@ -361,101 +543,57 @@ static int coap_request( lua_State* L, coap_method_t m )
     NODE_DBG("\n");
   }
 
-  coap_pdu_t *pdu = coap_new_pdu();   // should call coap_delete_pdu() somewhere
-  if(!pdu){
-    if(uri)
-      c_free(uri);
-    return;
-  }
-
-  const char *payload = NULL;
-  l = 0;
-  if( lua_isstring(L, stack) ){
-    payload = luaL_checklstring( L, stack, &l );
-    if (payload == NULL)
-      l = 0;
+  // a new request replaces one still in progress
+  coap_transfer_end(cud);
+  cud->uri = uri;
+  cud->type = t;
+  cud->method = m;
+  cud->seq++;
+  if(payload){
+    lua_pushvalue(L, payload_idx);
+    cud->payload_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    cud->payload = payload;
+    cud->payload_len = pl;
   }
-
-  coap_make_request(&(pdu->scratch), pdu->pkt, t, m, uri, payload, l);
-
-#ifdef COAP_DEBUG
-  coap_dumpPacket(pdu->pkt);
-#endif
-
-  int rc;
-  if (0 != (rc = coap_build(pdu->msg.p, &(pdu->msg.len), pdu->pkt))){
-    NODE_DBG("coap_build failed rc=%d\n", rc);
+  if(lua_type(L, stack) == LUA_TFUNCTION){
+    lua_pushvalue(L, stack);
+    cud->cb_ref = luaL_ref(L, LUA_REGISTRYINDEX);
   }
-  else
-  {
-#ifdef COAP_DEBUG
-    NODE_DBG("Sending: ");
-    coap_dump(pdu->msg.p, pdu->msg.len, true);
-    NODE_DBG("\n");
-#endif
-    espconn_regist_recvcb(pesp_conn, coap_response_handler);
-    sint8_t con = espconn_create(pesp_conn);
-    if( ESPCONN_OK != con){
-      NODE_DBG("Connect to host. code:%d\n", con);
-      // coap_delete_pdu(pdu);
-    } 
-    // else 
-    {
-      coap_tid_t tid = COAP_INVALID_TID;
-      if (pdu->pkt->hdr.t == COAP_TYPE_CON){
-        tid = coap_send_confirmed(pesp_conn, pdu);
-      }
-      else {
-        tid = coap_send(pesp_conn, pdu);
-      }
-      if (pdu->pkt->hdr.t != COAP_TYPE_CON || tid == COAP_INVALID_TID){
-        coap_delete_pdu(pdu);
-      }
-    }
+  cud->sent = 0;
+  cud->block1_on = pl > COAP_BLOCK_SIZE(COAP_REQ_BLOCK_SZX);
+  cud->block1.num = 0;
+  cud->block1.szx = COAP_REQ_BLOCK_SZX;
+  cud->block2_on = 0;
+
+  espconn_regist_recvcb(pesp_conn, coap_response_handler);
+  sint8_t con = espconn_create(pesp_conn);
+  if( ESPCONN_OK != con){
+    NODE_DBG("Connect to host. code:%d\n", con);
   }
 
-  if(uri)
-    c_free((void *)uri);
+  // nothing more to do after this one message if nobody wants the answer
+  if(!coap_client_send(cud) || (!cud->block1_on && LUA_NOREF == cud->cb_ref))
+    coap_transfer_end(cud);
 
   NODE_DBG("coap_request is called.\n");
   return 0;  
 }
 
-extern coap_luser_entry *variable_entry;
-extern coap_luser_entry *function_entry;
-// Lua: coap:var/func( string )
-static int coap_regist( lua_State* L, const char* mt, int isvar )
+extern coap_luser_table variable_table;
+extern coap_luser_table function_table;
+extern coap_luser_table file_table;
+// Lua: coap:var/func/file( string )
+static int coap_regist( lua_State* L, const char* mt, coap_luser_table *t )
 {
   size_t l;
   const char *name = luaL_checklstring( L, 2, &l );
   if (name == NULL)
     return luaL_error( L, "name must be set." );
+  if (l == 0 || l > 255)   // one Uri-Path option
+    return luaL_error( L, "name length must be 1..255." );
 
-  coap_luser_entry *h = NULL;
-  // if(lua_isstring(L, 3))
-  if(isvar)
-    h = variable_entry;
-  else
-    h = function_entry;
-
-  while(NULL!=h->next){  // goto the end of the list
-    if(h->name!= NULL && c_strcmp(h->name, name)==0)  // key exist, override it
-      break;
-    h = h->next;
-  }
-
-  if(h->name==NULL || c_strcmp(h->name, name)!=0){   // not exists. make a new one.
-    h->next = (coap_luser_entry *)c_zalloc(sizeof(coap_luser_entry));
-    h = h->next;
-    if(h == NULL)
-      return luaL_error(L, "not enough memory");
-    h->next = NULL;
-    h->name = NULL;
-    h->L = NULL;
-  }  
-
-  h->L = L;
-  h->name = name;
+  if (coap_luser_add(t, L, name, l) == NULL)
+    return luaL_error(L, "not enough memory");
 
   NODE_DBG("coap_regist is called.\n");
   return 0;  
@@ -500,14 +638,21 @@ static int coap_server_on( lua_State* L )
 static int coap_server_var( lua_State* L )
 {
   const char *mt = "coap_server";
-  return coap_regist(L, mt, 1);
+  return coap_regist(L, mt, &variable_table);
 }
 
 // Lua: server:func( "name" )
 static int coap_server_func( lua_State* L )
 {
   const char *mt = "coap_server";
-  return coap_regist(L, mt, 0);
+  return coap_regist(L, mt, &function_table);
+}
+
+// Lua: server:file( "name" )
+static int coap_server_file( lua_State* L )
+{
+  const char *mt = "coap_server";
+  return coap_regist(L, mt, &file_table);
 }
 
 // Lua: s = coap.createClient(function(conn))
@@ -557,6 +702,7 @@ static const LUA_REG_TYPE coap_server_map[] =
   { LSTRKEY( "close" ), LFUNCVAL ( coap_server_close ) },
   { LSTRKEY( "var" ), LFUNCVAL ( coap_server_var ) },
   { LSTRKEY( "func" ), LFUNCVAL ( coap_server_func ) },
+  { LSTRKEY( "file" ), LFUNCVAL ( coap_server_file ) },
   { LSTRKEY( "__gc" ), LFUNCVAL ( coap_server_delete ) },
 #if LUA_OPTIMIZE_MEMORY > 0
   { LSTRKEY( "__index" ), LROVAL ( coap_server_map ) },
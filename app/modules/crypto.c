@@ -8,7 +8,10 @@
 #include "lrotable.h"
 #include "c_types.h"
 #include "c_stdlib.h"
+#include "c_string.h"
+#include "flash_fs.h"
 #include "../crypto/digests.h"
+#include "../crypto/aes.h"
 
 #include "user_interface.h"
 
@@ -152,9 +155,410 @@ static int crypto_lhmac (lua_State *L)
 }
 
 
+/* Incremental hash/HMAC object. The digest context (and for HMAC the outer
+ * padded key) is stored directly after this header in the userdata. */
+typedef struct
+{
+  const digest_mech_info_t *mi;
+  uint8_t *k_opad;
+} crypto_hasher_t;
+
+#define CRYPTO_HASHER_MT "crypto.hasher"
+#define HASHER_CTX(h) ((void *)((h) + 1))
+
+static crypto_hasher_t *crypto_checkhasher (lua_State *L)
+{
+  return (crypto_hasher_t *)luaL_checkudata (L, 1, CRYPTO_HASHER_MT);
+}
+
+static crypto_hasher_t *crypto_newhasher (lua_State *L, const digest_mech_info_t *mi, int hmac)
+{
+  size_t sz = sizeof (crypto_hasher_t) + mi->ctx_size + (hmac ? mi->block_size : 0);
+  crypto_hasher_t *h = (crypto_hasher_t *)lua_newuserdata (L, sz);
+  h->mi = mi;
+  h->k_opad = hmac ? (uint8_t *)HASHER_CTX (h) + mi->ctx_size : NULL;
+  luaL_getmetatable (L, CRYPTO_HASHER_MT);
+  lua_setmetatable (L, -2);
+  return h;
+}
+
+// Rewinds the context so the object can be reused after finalize()
+static void crypto_restarthasher (crypto_hasher_t *h)
+{
+  const digest_mech_info_t *mi = h->mi;
+  mi->create (HASHER_CTX (h));
+  if (h->k_opad)
+  {
+    uint8_t k_ipad[mi->block_size];
+    size_t i;
+    for (i = 0; i < mi->block_size; ++i)
+      k_ipad[i] = h->k_opad[i] ^ (0x5c ^ 0x36);
+    mi->update (HASHER_CTX (h), k_ipad, mi->block_size);
+  }
+}
+
+
+/* hashobj = crypto.new_hash("SHA1")
+ * hashobj:update(str) ...
+ * rawdigest = hashobj:finalize()
+ */
+static int crypto_new_hash (lua_State *L)
+{
+  const digest_mech_info_t *mi = crypto_digest_mech (luaL_checkstring (L, 1));
+  if (!mi)
+    return bad_mech (L);
+
+  crypto_hasher_t *h = crypto_newhasher (L, mi, 0);
+  mi->create (HASHER_CTX (h));
+  return 1;
+}
+
+
+/* hmacobj = crypto.new_hmac("SHA1", key)
+ * hmacobj:update(str) ...
+ * rawsignature = hmacobj:finalize()
+ */
+static int crypto_new_hmac (lua_State *L)
+{
+  const digest_mech_info_t *mi = crypto_digest_mech (luaL_checkstring (L, 1));
+  if (!mi)
+    return bad_mech (L);
+  size_t klen = 0;
+  const char *key = luaL_checklstring (L, 2, &klen);
+
+  crypto_hasher_t *h = crypto_newhasher (L, mi, 1);
+  crypto_hmac_begin (mi, HASHER_CTX (h), key, klen, h->k_opad);
+  return 1;
+}
+
+
+// Lua: hashobj:update(str)
+static int crypto_hasher_update (lua_State *L)
+{
+  crypto_hasher_t *h = crypto_checkhasher (L);
+  size_t len = 0;
+  const char *data = luaL_checklstring (L, 2, &len);
+
+  h->mi->update (HASHER_CTX (h), data, len);
+  return 0;
+}
+
+
+// Lua: rawdigest = hashobj:finalize(), the object may then be reused
+static int crypto_hasher_finalize (lua_State *L)
+{
+  crypto_hasher_t *h = crypto_checkhasher (L);
+  const digest_mech_info_t *mi = h->mi;
+
+  uint8_t digest[mi->digest_size];
+  if (h->k_opad)
+    crypto_hmac_finalize (mi, HASHER_CTX (h), h->k_opad, digest);
+  else
+    mi->finalize (digest, HASHER_CTX (h));
+  crypto_restarthasher (h);
+
+  lua_pushlstring (L, digest, sizeof (digest));
+  return 1;
+}
+
+
+/* Streaming AES object. CBC buffers up to one block between update() calls
+ * (for decryption a complete final block is held back, so finalize() can
+ * strip the padding); CTR keeps the current key stream block in buf. */
+typedef struct
+{
+  AES_CTX ctx;
+  uint8_t mode;
+  uint8_t decrypt;
+  uint8_t finished;
+  int used;                    // CBC: bytes in buf, CTR: key stream offset
+  uint8_t buf[AES_BLOCKSIZE];
+} crypto_cipher_t;
+
+enum { CIPHER_CBC, CIPHER_CTR };
+
+typedef struct
+{
+  const char *name;
+  uint8_t mode;
+  uint8_t key_len;
+} cipher_mech_t;
+
+static const cipher_mech_t cipher_mechs[] =
+{
+  { "AES-128-CBC", CIPHER_CBC, 16 },
+  { "AES-256-CBC", CIPHER_CBC, 32 },
+  { "AES-128-CTR", CIPHER_CTR, 16 },
+  { "AES-256-CTR", CIPHER_CTR, 32 },
+};
+
+#define CRYPTO_CIPHER_MT "crypto.cipher"
+
+static crypto_cipher_t *crypto_checkcipher (lua_State *L)
+{
+  crypto_cipher_t *c = (crypto_cipher_t *)luaL_checkudata (L, 1, CRYPTO_CIPHER_MT);
+  if (c->finished)
+    luaL_error (L, "cipher already finalized");
+  return c;
+}
+
+static int crypto_newcipher (lua_State *L, int decrypt)
+{
+  const char *algo = luaL_checkstring (L, 1);
+  const cipher_mech_t *m = NULL;
+  size_t i;
+  for (i = 0; i < sizeof (cipher_mechs) / sizeof (cipher_mechs[0]); ++i)
+    if (c_strcmp (algo, cipher_mechs[i].name) == 0)
+      m = &cipher_mechs[i];
+  if (!m)
+    return luaL_error (L, "unknown cipher");
+
+  size_t klen = 0, ivlen = 0;
+  const char *key = luaL_checklstring (L, 2, &klen);
+  const char *iv = luaL_optlstring (L, 3, NULL, &ivlen);
+  if (klen != m->key_len)
+    return luaL_error (L, "key must be %d bytes", m->key_len);
+  if (iv && ivlen != AES_IV_SIZE)
+    return luaL_error (L, "iv must be %d bytes", AES_IV_SIZE);
+
+  char zero_iv[AES_IV_SIZE];
+  if (!iv)
+  {
+    c_memset (zero_iv, 0, sizeof (zero_iv));
+    iv = zero_iv;
+  }
+
+  crypto_cipher_t *c = (crypto_cipher_t *)lua_newuserdata (L, sizeof (crypto_cipher_t));
+  AES_set_key (&c->ctx, (const uint8_t *)key, (const uint8_t *)iv,
+    m->key_len == 16 ? AES_MODE_128 : AES_MODE_256);
+  c->mode = m->mode;
+  // CTR runs the cipher forwards in both directions
+  c->decrypt = decrypt && m->mode == CIPHER_CBC;
+  if (c->decrypt)
+    AES_convert_key (&c->ctx);
+  c->finished = 0;
+  c->used = 0;
+  luaL_getmetatable (L, CRYPTO_CIPHER_MT);
+  lua_setmetatable (L, -2);
+  return 1;
+}
+
+
+/* encobj = crypto.encrypt("AES-128-CBC", key [, iv])
+ * encobj:update(str) ... returns the ciphertext produced so far
+ * tail = encobj:finalize()
+ *
+ * Ciphers are AES-128-CBC, AES-256-CBC, AES-128-CTR and AES-256-CTR. The key
+ * is 16 or 32 raw bytes and the iv (initial counter block for CTR) 16 raw
+ * bytes, all zero if omitted. CBC pads with PKCS#7 as "openssl enc" does; CTR
+ * output is the same length as its input.
+ */
+static int crypto_encrypt (lua_State *L)
+{
+  return crypto_newcipher (L, 0);
+}
+
+
+/* decobj = crypto.decrypt("AES-128-CBC", key [, iv])
+ * decobj:update(str) ... returns the plaintext produced so far
+ * tail = decobj:finalize()
+ *
+ * finalize() returns nil if CBC input was not a whole number of blocks or
+ * did not end in valid padding.
+ */
+static int crypto_decrypt (lua_State *L)
+{
+  return crypto_newcipher (L, 1);
+}
+
+
+// Run whole CBC blocks from in through the cipher into b
+static void crypto_cbc_blocks (crypto_cipher_t *c, luaL_Buffer *b, const uint8_t *in, size_t len)
+{
+  while (len)
+  {
+    size_t n = len < (LUAL_BUFFERSIZE & ~(AES_BLOCKSIZE - 1)) ?
+      len : (LUAL_BUFFERSIZE & ~(AES_BLOCKSIZE - 1));
+    uint8_t *out = (uint8_t *)luaL_prepbuffer (b);
+    if (c->decrypt)
+      AES_cbc_decrypt (&c->ctx, in, out, n);
+    else
+      AES_cbc_encrypt (&c->ctx, in, out, n);
+    luaL_addsize (b, n);
+    in += n;
+    len -= n;
+  }
+}
+
+
+// Lua: out = cipherobj:update(str)
+static int crypto_cipher_update (lua_State *L)
+{
+  crypto_cipher_t *c = crypto_checkcipher (L);
+  size_t len = 0;
+  const uint8_t *in = (const uint8_t *)luaL_checklstring (L, 2, &len);
+  luaL_Buffer b;
+  luaL_buffinit (L, &b);
+
+  if (c->mode == CIPHER_CTR)
+  {
+    while (len)
+    {
+      size_t n = len < LUAL_BUFFERSIZE ? len : LUAL_BUFFERSIZE;
+      AES_ctr_crypt (&c->ctx, c->buf, &c->used, in, (uint8_t *)luaL_prepbuffer (&b), n);
+      luaL_addsize (&b, n);
+      in += n;
+      len -= n;
+    }
+    luaL_pushresult (&b);
+    return 1;
+  }
+
+  // Decryption never consumes the last block of what it has been given
+  size_t keep = c->decrypt;
+  if (c->used)
+  {
+    size_t n = AES_BLOCKSIZE - c->used;
+    if (n > len)
+      n = len;
+    c_memcpy (c->buf + c->used, in, n);
+    c->used += n;
+    in += n;
+    len -= n;
+    if (c->used == AES_BLOCKSIZE && len >= keep)
+    {
+      crypto_cbc_blocks (c, &b, c->buf, AES_BLOCKSIZE);
+      c->used = 0;
+    }
+  }
+  if (len > keep)
+  {
+    size_t n = (len - keep) & ~(AES_BLOCKSIZE - 1);
+    crypto_cbc_blocks (c, &b, in, n);
+    in += n;
+    len -= n;
+  }
+  if (len)
+  {
+    c_memcpy (c->buf + c->used, in, len);
+    c->used += len;
+  }
+
+  luaL_pushresult (&b);
+  return 1;
+}
+
+
+// Lua: tail = cipherobj:finalize(), the object can't be used afterwards
+static int crypto_cipher_finalize (lua_State *L)
+{
+  crypto_cipher_t *c = crypto_checkcipher (L);
+  uint8_t out[AES_BLOCKSIZE];
+  int len = 0;
+
+  c->finished = 1;
+  if (c->mode == CIPHER_CBC && !c->decrypt)
+  {
+    uint8_t pad = AES_BLOCKSIZE - c->used;
+    c_memset (c->buf + c->used, pad, pad);
+    AES_cbc_encrypt (&c->ctx, c->buf, out, AES_BLOCKSIZE);
+    len = AES_BLOCKSIZE;
+  }
+  else if (c->mode == CIPHER_CBC)
+  {
+    if (c->used != AES_BLOCKSIZE)
+      goto bad;
+    AES_cbc_decrypt (&c->ctx, c->buf, out, AES_BLOCKSIZE);
+    uint8_t pad = out[AES_BLOCKSIZE - 1];
+    if (pad == 0 || pad > AES_BLOCKSIZE)
+      goto bad;
+    for (len = AES_BLOCKSIZE - pad; len < AES_BLOCKSIZE - 1; ++len)
+      if (out[len] != pad)
+        goto bad;
+    len = AES_BLOCKSIZE - pad;
+  }
+  // Don't leave key material behind in the (garbage) userdata
+  c_memset (&c->ctx, 0, sizeof (c->ctx));
+  lua_pushlstring (L, out, len);
+  return 1;
+
+bad:
+  c_memset (&c->ctx, 0, sizeof (c->ctx));
+  lua_pushnil (L);
+  return 1;
+}
+
+
+// Read size for crypto.fhash(); one SPIFFS logical page
+#define FHASH_CHUNK 256
+
+/* rawdigest = crypto.fhash("SHA1", filename)
+ *
+ * Hashes a file in fixed-size chunks without loading it into Lua strings.
+ * Returns nil if the file cannot be opened.
+ */
+static int crypto_fhash (lua_State *L)
+{
+  const digest_mech_info_t *mi = crypto_digest_mech (luaL_checkstring (L, 1));
+  if (!mi)
+    return bad_mech (L);
+  size_t len = 0;
+  const char *fname = luaL_checklstring (L, 2, &len);
+  if (len > FS_NAME_MAX_LENGTH)
+    return luaL_error (L, "filename too long");
+
+  void *ctx = c_malloc (mi->ctx_size);
+  if (!ctx)
+    return bad_mem (L);
+
+  int fd = fs_open (fname, FS_RDONLY);
+  if (fd < FS_OPEN_OK)
+  {
+    c_free (ctx);
+    lua_pushnil (L);
+    return 1;
+  }
+
+  uint8_t buf[FHASH_CHUNK];
+  mi->create (ctx);
+  int n;
+  while ((n = fs_read (fd, buf, FHASH_CHUNK)) > 0)
+    mi->update (ctx, buf, n);
+  fs_close (fd);
+
+  uint8_t digest[mi->digest_size];
+  mi->finalize (digest, ctx);
+  c_free (ctx);
+
+  lua_pushlstring (L, digest, sizeof (digest));
+  return 1;
+}
+
+
 // Module function map
+
 #define MIN_OPT_LEVEL 2
 #include "lrodefs.h"
+static const LUA_REG_TYPE crypto_hasher_map[] =
+{
+  { LSTRKEY( "update" ), LFUNCVAL( crypto_hasher_update ) },
+  { LSTRKEY( "finalize" ), LFUNCVAL( crypto_hasher_finalize ) },
+#if LUA_OPTIMIZE_MEMORY > 0
+  { LSTRKEY( "__index" ), LROVAL( crypto_hasher_map ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE crypto_cipher_map[] =
+{
+  { LSTRKEY( "update" ), LFUNCVAL( crypto_cipher_update ) },
+  { LSTRKEY( "finalize" ), LFUNCVAL( crypto_cipher_finalize ) },
+#if LUA_OPTIMIZE_MEMORY > 0
+  { LSTRKEY( "__index" ), LROVAL( crypto_cipher_map ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
 const LUA_REG_TYPE crypto_map[] =
 {
   { LSTRKEY( "sha1" ), LFUNCVAL( crypto_sha1 ) },
@@ -163,6 +567,11 @@ const LUA_REG_TYPE crypto_map[] =
   { LSTRKEY( "mask" ), LFUNCVAL( crypto_mask ) },
   { LSTRKEY( "hash"   ), LFUNCVAL( crypto_lhash ) },
   { LSTRKEY( "hmac"   ), LFUNCVAL( crypto_lhmac ) },
+  { LSTRKEY( "new_hash" ), LFUNCVAL( crypto_new_hash ) },
+  { LSTRKEY( "new_hmac" ), LFUNCVAL( crypto_new_hmac ) },
+  { LSTRKEY( "fhash"  ), LFUNCVAL( crypto_fhash ) },
+  { LSTRKEY( "encrypt" ), LFUNCVAL( crypto_encrypt ) },
+  { LSTRKEY( "decrypt" ), LFUNCVAL( crypto_decrypt ) },
 
 #if LUA_OPTIMIZE_MEMORY > 0
 
@@ -173,8 +582,22 @@ const LUA_REG_TYPE crypto_map[] =
 LUALIB_API int luaopen_crypto( lua_State *L )
 {
 #if LUA_OPTIMIZE_MEMORY > 0
+  luaL_rometatable( L, CRYPTO_HASHER_MT, (void *)crypto_hasher_map );
+  luaL_rometatable( L, CRYPTO_CIPHER_MT, (void *)crypto_cipher_map );
   return 0;
 #else // #if LUA_OPTIMIZE_MEMORY > 0
+  luaL_newmetatable( L, CRYPTO_HASHER_MT );
+  lua_pushvalue( L, -1 );
+  lua_setfield( L, -2, "__index" );
+  luaL_register( L, NULL, crypto_hasher_map );
+  lua_pop( L, 1 );
+
+  luaL_newmetatable( L, CRYPTO_CIPHER_MT );
+  lua_pushvalue( L, -1 );
+  lua_setfield( L, -2, "__index" );
+  luaL_register( L, NULL, crypto_cipher_map );
+  lua_pop( L, 1 );
+
   luaL_register( L, AUXLIB_CRYPTO, crypto_map );
   // Add constants
 
@@ -9,6 +9,7 @@
 
 #include "c_types.h"
 #include "c_string.h"
+#include "c_stdlib.h"
 
 #define PULLUP PLATFORM_GPIO_PULLUP
 #define FLOAT PLATFORM_GPIO_FLOAT
@@ -31,16 +32,84 @@ void lua_gpio_unref(unsigned pin){
   gpio_cb_ref[pin] = LUA_NOREF;
 }
 
-void gpio_intr_callback( unsigned pin, unsigned level )
+// Runs from the event queue; count > 1 when edges were coalesced, level
+// is the most recent one. A level trigger is re-armed only after the
+// callback, which may change it first.
+static void gpio_event_handler( uint16_t pin, uint16_t level, uint16_t count )
 {
-  NODE_DBG("pin:%d, level:%d \n", pin, level);
   if(gpio_cb_ref[pin] == LUA_NOREF)
     return;
   if(!gL)
     return;
   lua_rawgeti(gL, LUA_REGISTRYINDEX, gpio_cb_ref[pin]);
   lua_pushinteger(gL, level);
-  lua_call(gL, 1, 0);
+  lua_pushinteger(gL, count);
+  lua_call(gL, 2, 0);
+  platform_gpio_intr_rearm(pin);
+}
+
+// Interrupt context, defer the Lua callback
+void gpio_intr_callback( unsigned pin, unsigned level )
+{
+  if(gpio_cb_ref[pin] == LUA_NOREF)
+    return;
+  platform_event_post(PLATFORM_EVENT_PRIO_HIGH, gpio_event_handler, pin, level);
+}
+
+static unsigned gpio_intr_type( const char *str, size_t sl )
+{
+  if(sl == 2 && c_strcmp(str, "up") == 0){
+    return GPIO_PIN_INTR_POSEDGE;
+  }else if(sl == 4 && c_strcmp(str, "down") == 0){
+    return GPIO_PIN_INTR_NEGEDGE;
+  }else if(sl == 4 && c_strcmp(str, "both") == 0){
+    return GPIO_PIN_INTR_ANYEGDE;
+  }else if(sl == 3 && c_strcmp(str, "low") == 0){
+    return GPIO_PIN_INTR_LOLEVEL;
+  }else if(sl == 4 && c_strcmp(str, "high") == 0){
+    return GPIO_PIN_INTR_HILEVEL;
+  }
+  return GPIO_PIN_INTR_DISABLE;
+}
+
+// Runs from the event queue: hands each capturing pin its edges so far,
+// as function(times, levels, lost). times are system_get_time() us.
+static void gpio_capture_handler( uint16_t key, uint16_t value, uint16_t count )
+{
+  static gpio_edge_t batch[GPIO_CAPTURE_LEN];
+  unsigned n, i, j, pin;
+  uint32_t lost;
+
+  if(!gL)
+    return;
+  n = platform_gpio_capture_read(batch, GPIO_CAPTURE_LEN);
+  for(pin = 1; pin < GPIO_PIN_NUM; pin++){
+    lost = platform_gpio_capture_lost(pin);
+    for(i = 0; i < n && batch[i].pin != pin; i++)
+      ;
+    if(gpio_cb_ref[pin] == LUA_NOREF || (i == n && !lost))
+      continue;
+    lua_rawgeti(gL, LUA_REGISTRYINDEX, gpio_cb_ref[pin]);
+    lua_newtable(gL);
+    lua_newtable(gL);
+    for(j = 1; i < n; i++){
+      if(batch[i].pin != pin)
+        continue;
+      lua_pushnumber(gL, batch[i].us);
+      lua_rawseti(gL, -3, j);
+      lua_pushinteger(gL, batch[i].level);
+      lua_rawseti(gL, -2, j);
+      j++;
+    }
+    lua_pushinteger(gL, lost);
+    lua_call(gL, 3, 0);
+  }
+}
+
+// Interrupt context, once per interrupt with edges captured
+static void gpio_capture_callback( void )
+{
+  platform_event_post(PLATFORM_EVENT_PRIO_HIGH, gpio_capture_handler, GPIO_PIN_NUM, 0);
 }
 
 // Lua: trig( pin, type, function )
@@ -59,19 +128,7 @@ static int lgpio_trig( lua_State* L )
   if (str == NULL)
     return luaL_error( L, "wrong arg type" );
 
-  if(sl == 2 && c_strcmp(str, "up") == 0){
-    type = GPIO_PIN_INTR_POSEDGE;
-  }else if(sl == 4 && c_strcmp(str, "down") == 0){
-    type = GPIO_PIN_INTR_NEGEDGE;
-  }else if(sl == 4 && c_strcmp(str, "both") == 0){
-    type = GPIO_PIN_INTR_ANYEGDE;
-  }else if(sl == 3 && c_strcmp(str, "low") == 0){
-    type = GPIO_PIN_INTR_LOLEVEL;
-  }else if(sl == 4 && c_strcmp(str, "high") == 0){
-    type = GPIO_PIN_INTR_HILEVEL;
-  }else{
-    type = GPIO_PIN_INTR_DISABLE;
-  }
+  type = gpio_intr_type(str, sl);
 
   // luaL_checkanyfunction(L, 3);
   if (lua_type(L, 3) == LUA_TFUNCTION || lua_type(L, 3) == LUA_TLIGHTFUNCTION){
@@ -84,6 +141,49 @@ static int lgpio_trig( lua_State* L )
   platform_gpio_intr_init(pin, type);
   return 0;  
 }
+
+// Lua: capture( pin, type, function(times, levels, lost), [debounce_us] )
+// Edges are timestamped in the interrupt and handed over in batches; lost
+// counts those that did not fit in the ring. Edges closer than debounce_us
+// to the last one kept are dropped. type is "up", "down" or "both"; with
+// "both" an edge that repeats the last level is dropped as a glitch. No
+// function stops the capture.
+static int lgpio_capture( lua_State* L )
+{
+  unsigned type;
+  unsigned pin;
+  uint32_t debounce = 0;
+  size_t sl;
+
+  pin = luaL_checkinteger( L, 1 );
+  MOD_CHECK_ID( gpio, pin );
+  if(pin==0)
+    return luaL_error( L, "no interrupt for D0" );
+
+  const char *str = luaL_checklstring( L, 2, &sl );
+  type = gpio_intr_type(str, sl);
+  if(type == GPIO_PIN_INTR_LOLEVEL || type == GPIO_PIN_INTR_HILEVEL)
+    return luaL_error( L, "wrong arg type" );
+  if(lua_isnumber(L, 4)){
+    lua_Integer d = luaL_checkinteger( L, 4 );
+    luaL_argcheck( L, d >= 0, 4, "debounce_us must be >= 0" );
+    debounce = d;
+  }
+
+  if(gpio_cb_ref[pin] != LUA_NOREF)
+    luaL_unref(L, LUA_REGISTRYINDEX, gpio_cb_ref[pin]);
+  gpio_cb_ref[pin] = LUA_NOREF;
+  if (lua_type(L, 3) == LUA_TFUNCTION || lua_type(L, 3) == LUA_TLIGHTFUNCTION){
+    lua_pushvalue(L, 3);
+    gpio_cb_ref[pin] = luaL_ref(L, LUA_REGISTRYINDEX);
+  } else {
+    type = GPIO_PIN_INTR_DISABLE;
+  }
+  gL = L;
+
+  platform_gpio_capture(pin, type, debounce);
+  return 0;
+}
 #endif
 
 // Lua: mode( pin, mode, pullup )
@@ -146,12 +246,132 @@ static int lgpio_write( lua_State* L )
   return 0;  
 }
 
+#define GPIO_MANY_MAX 16
+
+// The pins of write_many()/read_many(): a mask of pin numbers (bit n is pin
+// n), or a table of up to GPIO_MANY_MAX of them. Returns how many there are
+// in the table, 0 for a mask; the mask covers them either way.
+static int gpio_many_pins( lua_State* L, int idx, uint8_t *pins, uint32_t *mask )
+{
+  int i, n;
+
+  *mask = 0;
+  if( !lua_istable( L, idx ) )
+  {
+    *mask = luaL_checkinteger( L, idx );
+    if( *mask >> NUM_GPIO )
+      return luaL_error( L, "wrong pin num." );
+    return 0;
+  }
+  n = lua_objlen( L, idx );
+  if( n <= 0 || n > GPIO_MANY_MAX )
+    return luaL_error( L, "wrong arg range" );
+  for( i = 0; i < n; i ++ )
+  {
+    lua_rawgeti( L, idx, i + 1 );
+    unsigned pin = luaL_checkinteger( L, -1 );
+    lua_pop( L, 1 );
+    MOD_CHECK_ID( gpio, pin );
+    pins[i] = pin;
+    *mask |= BIT( pin );
+  }
+  return n;
+}
+
+// Lua: write_many( pins, levels )
+// With a mask, bit n of levels is the level of pin n; with a table, bit k
+// is that of its k-th pin, lowest bit first:
+// gpio.write_many(0x0e, 0x0a) -- pins 1 and 3 high, pin 2 low
+// gpio.write_many({5,6,7,8}, 0x9) -- a nibble, bit 0 on pin 5
+// The pins' output drivers are turned on, as by write()
+static int lgpio_write_many( lua_State* L )
+{
+  uint8_t pins[GPIO_MANY_MAX];
+  uint32_t mask, set = 0;
+  uint32_t levels = luaL_checkinteger( L, 2 );
+  int i, n = gpio_many_pins( L, 1, pins, &mask );
+
+  if( n == 0 )
+    set = levels & mask;
+  for( i = 0; i < n; i ++ )
+    if( levels & BIT( i ) )
+      set |= BIT( pins[i] );
+  platform_gpio_write_many( set, mask & ~set );
+  return 0;
+}
+
+// Lua: levels = read_many( pins )
+// The levels of the pins from a single register read, laid out as in
+// write_many()
+static int lgpio_read_many( lua_State* L )
+{
+  uint8_t pins[GPIO_MANY_MAX];
+  uint32_t mask, levels = 0;
+  int i, n = gpio_many_pins( L, 1, pins, &mask );
+  uint32_t in = platform_gpio_read_many( mask );
+
+  if( n == 0 )
+    levels = in;
+  for( i = 0; i < n; i ++ )
+    if( in & BIT( pins[i] ) )
+      levels |= BIT( i );
+  lua_pushinteger( L, levels );
+  return 1;
+}
+#undef GPIO_MANY_MAX
+
 #define DELAY_TABLE_MAX_LEN 256
 #define noInterrupts os_intr_lock
 #define interrupts os_intr_unlock
 #define delayMicroseconds os_delay_us
 #define DIRECT_WRITE(pin, level)    (GPIO_OUTPUT_SET(GPIO_ID_PIN(pin_num[pin]), level))
-// Lua: serout( pin, firstLevel, delay_table, [repeatNum] )
+
+// The waveform gpio.serout() plays in the background
+static struct
+{
+  lua_State *L;
+  int cb_ref;         // function(), or LUA_NOREF
+  int data_ref;       // the delay string, or LUA_NOREF
+  uint32_t *table;    // the delay table, copied
+} serout_bg = { NULL, LUA_NOREF, LUA_NOREF, NULL };
+
+static void serout_bg_free( lua_State *L )
+{
+  platform_gpio_serout_stop();
+  if(serout_bg.table){
+    c_free(serout_bg.table);
+    serout_bg.table = NULL;
+  }
+  if(serout_bg.data_ref != LUA_NOREF){
+    luaL_unref(L, LUA_REGISTRYINDEX, serout_bg.data_ref);
+    serout_bg.data_ref = LUA_NOREF;
+  }
+}
+
+// Runs from the event queue once the waveform is over
+static void serout_done_handler( uint16_t key, uint16_t value, uint16_t count )
+{
+  lua_State *L = serout_bg.L;
+  int ref = serout_bg.cb_ref;
+
+  if(!L || platform_gpio_serout_busy())
+    return;
+  serout_bg_free(L);
+  serout_bg.cb_ref = LUA_NOREF;
+  if(ref == LUA_NOREF)
+    return;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, ref);
+  lua_call(L, 0, 0);
+}
+
+// Interrupt context, called from the FRC1 handler until the post succeeds
+static int ICACHE_RAM_ATTR serout_done( void )
+{
+  return platform_event_post(PLATFORM_EVENT_PRIO_HIGH, serout_done_handler, 0, 0);
+}
+
+// Lua: serout( pin, firstLevel, delay_table, [repeatNum], [function] )
 // -- serout( pin, firstLevel, delay_table, [repeatNum] )
 // gpio.mode(1,gpio.OUTPUT,gpio.PULLUP)
 // gpio.serout(1,1,{30,30,60,60,30,30})  -- serial one byte, b10110010
@@ -161,6 +381,11 @@ static int lgpio_write( lua_State* L )
 // gpio.mode(1,gpio.OUTPUT,gpio.PULLUP)
 // gpio.serout(1,0,{20,10,10,20,10,10,10,100}) -- sim uart one byte 0x5A at about 100kbps
 // gpio.serout(1,1,{8,18},8) -- serial 30% pwm 38k, lasts 8 cycles
+// With a function, serout() returns at once: the hardware timer plays the
+// waveform in the background and the function is called when it is over.
+// The table then has no length limit, and the delays may instead be a
+// string of 16 bit little endian us values, as kept for IR codes:
+// gpio.serout(1,1,ir_code,1,function() print("sent") end)
 static int lgpio_serout( lua_State* L )
 {
   unsigned level;
@@ -168,12 +393,81 @@ static int lgpio_serout( lua_State* L )
   unsigned table_len = 0;
   unsigned repeat = 0;
   int delay_table[DELAY_TABLE_MAX_LEN];
+  int fn = 0;
   
   pin = luaL_checkinteger( L, 1 );
   MOD_CHECK_ID( gpio, pin );
   level = luaL_checkinteger( L, 2 );
   if ( level!=HIGH && level!=LOW )
     return luaL_error( L, "wrong arg type" );
+  if(lua_isnumber(L, 4))
+    repeat = lua_tointeger( L, 4 );
+  if (lua_type(L, 4) == LUA_TFUNCTION || lua_type(L, 4) == LUA_TLIGHTFUNCTION)
+    fn = 4;
+  else if (lua_type(L, 5) == LUA_TFUNCTION || lua_type(L, 5) == LUA_TLIGHTFUNCTION)
+    fn = 5;
+
+  if( fn )
+  {
+    const void *delays;
+    unsigned width;
+    size_t i, n;
+
+    if( pin == 0 )
+      return luaL_error( L, "no background serout for D0" );
+    if( platform_gpio_serout_busy() || serout_bg.cb_ref != LUA_NOREF )
+      return luaL_error( L, "serout busy" );
+    if( repeat > DELAY_TABLE_MAX_LEN )    // negative ones wrap to large
+      return luaL_error( L, "delay must < 256" );
+    serout_bg_free( L );
+    if( lua_type( L, 3 ) == LUA_TSTRING )
+    {
+      delays = lua_tolstring( L, 3, &n );
+      luaL_argcheck( L, n % 2 == 0, 3, "delay string must hold 16 bit values" );
+      n /= 2;
+      width = 2;
+      if( n == 0 )
+        return luaL_error( L, "wrong arg range" );
+      lua_pushvalue( L, 3 );
+      serout_bg.data_ref = luaL_ref( L, LUA_REGISTRYINDEX );
+    }
+    else if( lua_istable( L, 3 ) )
+    {
+      n = lua_objlen( L, 3 );
+      if( n == 0 )
+        return luaL_error( L, "wrong arg range" );
+      serout_bg.table = (uint32_t *)c_malloc( n * sizeof( uint32_t ) );
+      if( !serout_bg.table )
+        return luaL_error( L, "not enough memory" );
+      for( i = 0; i < n; i ++ )
+      {
+        lua_rawgeti( L, 3, i + 1 );
+        int d = lua_tointeger( L, -1 );
+        lua_pop( L, 1 );
+        if( d < 0 || d > 1000000 )
+        {
+          serout_bg_free( L );
+          return luaL_error( L, "delay must < 1000000 us" );
+        }
+        serout_bg.table[i] = d;
+      }
+      delays = serout_bg.table;
+      width = 4;
+    }
+    else
+      return luaL_error( L, "wrong arg range" );
+
+    if( platform_gpio_serout_start( pin, level, delays, width, n, repeat, serout_done ) != PLATFORM_OK )
+    {
+      serout_bg_free( L );
+      return luaL_error( L, "hw timer in use" );
+    }
+    serout_bg.L = L;
+    lua_pushvalue( L, fn );
+    serout_bg.cb_ref = luaL_ref( L, LUA_REGISTRYINDEX );
+    return 0;
+  }
+
   if( lua_istable( L, 3 ) )
   {
     table_len = lua_objlen( L, 3 );
@@ -192,8 +486,6 @@ static int lgpio_serout( lua_State* L )
     return luaL_error( L, "wrong arg range" );
   } 
 
-  if(lua_isnumber(L, 4))
-    repeat = lua_tointeger( L, 4 );
   if( repeat < 0 || repeat > DELAY_TABLE_MAX_LEN )
     return luaL_error( L, "delay must < 256" );
 
@@ -230,9 +522,12 @@ const LUA_REG_TYPE gpio_map[] =
   { LSTRKEY( "mode" ), LFUNCVAL( lgpio_mode ) },
   { LSTRKEY( "read" ), LFUNCVAL( lgpio_read ) },
   { LSTRKEY( "write" ), LFUNCVAL( lgpio_write ) },
+  { LSTRKEY( "write_many" ), LFUNCVAL( lgpio_write_many ) },
+  { LSTRKEY( "read_many" ), LFUNCVAL( lgpio_read_many ) },
   { LSTRKEY( "serout" ), LFUNCVAL( lgpio_serout ) },
 #ifdef GPIO_INTERRUPT_ENABLE
   { LSTRKEY( "trig" ), LFUNCVAL( lgpio_trig ) },
+  { LSTRKEY( "capture" ), LFUNCVAL( lgpio_capture ) },
 #endif
 #if LUA_OPTIMIZE_MEMORY > 0
 #ifdef GPIO_INTERRUPT_ENABLE
@@ -255,7 +550,7 @@ LUALIB_API int luaopen_gpio( lua_State *L )
   for(i=0;i<GPIO_PIN_NUM;i++){
     gpio_cb_ref[i] = LUA_NOREF;
   }
-  platform_gpio_init(gpio_intr_callback);
+  platform_gpio_init(gpio_intr_callback, gpio_capture_callback);
 #endif
 
 #if LUA_OPTIMIZE_MEMORY > 0
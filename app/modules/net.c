@@ -51,11 +51,88 @@ typedef struct lnet_userdata
   int cb_receive_ref;
   int cb_send_ref;
   int cb_dns_found_ref;
+  int co_recv_ref;    // coroutine waiting in recv()
+  int co_sent_ref;    // coroutine waiting in flush()
+  int recv_buf_ref;   // table of chunks nobody has taken yet, for recv()
+  int recv_head;      // last chunk taken from it
+  int recv_tail;      // last chunk put in it
+  uint16_t recv_buffered;   // bytes in it
+  uint8_t recv_held;        // receive held until recv() catches up
+  uint8_t recv_used;        // recv() was called, so keep what it may want
 #ifdef CLIENT_SSL_ENABLE
   uint8_t secure;
 #endif
 }lnet_userdata;
 
+// Resume coroutines waiting on this connection with nil, "closed"
+static void net_wake_waiters(lua_State *L, lnet_userdata *nud)
+{
+  int recv_ref = nud->co_recv_ref;
+  int sent_ref = nud->co_sent_ref;
+  nud->co_recv_ref = LUA_NOREF;
+  nud->co_sent_ref = LUA_NOREF;
+  if(recv_ref != LUA_NOREF){
+    lua_pushnil(L);
+    lua_pushliteral(L, "closed");
+    luaL_wakeup(L, recv_ref, 2);
+  }
+  if(sent_ref != LUA_NOREF){
+    lua_pushnil(L);
+    lua_pushliteral(L, "closed");
+    luaL_wakeup(L, sent_ref, 2);
+  }
+}
+
+// Received data with neither a coroutine in recv() nor a receive callback
+// to take it is kept for the next recv(), once recv() has been used on the
+// socket; before that it is dropped as it always was. Past
+// NET_RECV_BUF_MAX bytes a TCP connection is held until recv() has taken
+// half of it; UDP drops.
+#define NET_RECV_BUF_MAX 4096
+
+static void net_recv_push(lnet_userdata *nud, const char *pdata, unsigned short len)
+{
+  if(nud->recv_buffered + len > NET_RECV_BUF_MAX && nud->pesp_conn->type != ESPCONN_TCP)
+    return;
+  if(nud->recv_buf_ref == LUA_NOREF){
+    lua_newtable(gL);
+    nud->recv_buf_ref = luaL_ref(gL, LUA_REGISTRYINDEX);
+  }
+  lua_rawgeti(gL, LUA_REGISTRYINDEX, nud->recv_buf_ref);
+  lua_pushlstring(gL, pdata, len);
+  lua_rawseti(gL, -2, ++nud->recv_tail);
+  lua_pop(gL, 1);
+  nud->recv_buffered += len;
+  if(nud->recv_buffered >= NET_RECV_BUF_MAX && !nud->recv_held && nud->pesp_conn->type == ESPCONN_TCP){
+    espconn_recv_hold(nud->pesp_conn);
+    nud->recv_held = 1;
+  }
+}
+
+// Pushes the oldest chunk kept and returns 1, or returns 0 if there is none
+static int net_recv_pop(lua_State *L, lnet_userdata *nud)
+{
+  if(nud->recv_head == nud->recv_tail)
+    return 0;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, nud->recv_buf_ref);
+  lua_rawgeti(L, -1, ++nud->recv_head);
+  lua_pushnil(L);
+  lua_rawseti(L, -3, nud->recv_head);
+  lua_remove(L, -2);
+  nud->recv_buffered -= lua_objlen(L, -1);
+  if(nud->recv_head == nud->recv_tail){   // empty, let the table go
+    luaL_unref(L, LUA_REGISTRYINDEX, nud->recv_buf_ref);
+    nud->recv_buf_ref = LUA_NOREF;
+    nud->recv_head = nud->recv_tail = 0;
+  }
+  if(nud->recv_held && nud->recv_buffered < NET_RECV_BUF_MAX / 2){
+    if(nud->pesp_conn)
+      espconn_recv_unhold(nud->pesp_conn);
+    nud->recv_held = 0;
+  }
+  return 1;
+}
+
 static void net_server_disconnected(void *arg)    // for tcp server only
 {
   NODE_DBG("net_server_disconnected is called.\n");
@@ -97,6 +174,7 @@ static void net_server_disconnected(void *arg)    // for tcp server only
     }
   }
   lua_gc(gL, LUA_GCRESTART, 0);
+  net_wake_waiters(gL, nud);
 }
 
 static void net_socket_disconnected(void *arg)    // tcp only
@@ -127,6 +205,7 @@ static void net_socket_disconnected(void *arg)    // tcp only
     nud->self_ref = LUA_NOREF; // unref this, and the net.socket userdata will delete it self
   }
   lua_gc(gL, LUA_GCRESTART, 0);
+  net_wake_waiters(gL, nud);
 }
 
 static void net_server_reconnected(void *arg, sint8_t err)
@@ -150,8 +229,18 @@ static void net_socket_received(void *arg, char *pdata, unsigned short len)
   lnet_userdata *nud = (lnet_userdata *)pesp_conn->reverse;
   if(nud == NULL)
     return;
-  if(nud->cb_receive_ref == LUA_NOREF)
+  if(nud->co_recv_ref != LUA_NOREF){   // a waiting coroutine takes the data
+    int ref = nud->co_recv_ref;
+    nud->co_recv_ref = LUA_NOREF;
+    lua_pushlstring(gL, pdata, len);
+    luaL_wakeup(gL, ref, 1);
     return;
+  }
+  if(nud->cb_receive_ref == LUA_NOREF){
+    if(nud->recv_used)
+      net_recv_push(nud, pdata, len);
+    return;
+  }
   if(nud->self_ref == LUA_NOREF)
     return;
   lua_rawgeti(gL, LUA_REGISTRYINDEX, nud->cb_receive_ref);
@@ -174,6 +263,13 @@ static void net_socket_sent(void *arg)
   lnet_userdata *nud = (lnet_userdata *)pesp_conn->reverse;
   if(nud == NULL)
     return;
+  if(nud->co_sent_ref != LUA_NOREF){   // a waiting coroutine takes the event
+    int ref = nud->co_sent_ref;
+    nud->co_sent_ref = LUA_NOREF;
+    lua_pushboolean(gL, 1);
+    luaL_wakeup(gL, ref, 1);
+    return;
+  }
   if(nud->cb_send_ref == LUA_NOREF)
     return;
   if(nud->self_ref == LUA_NOREF)
@@ -323,6 +419,13 @@ static void net_server_connected(void *arg) // for tcp only
   skt->cb_receive_ref = LUA_NOREF;
   skt->cb_send_ref = LUA_NOREF;
   skt->cb_dns_found_ref = LUA_NOREF;
+  skt->co_recv_ref = LUA_NOREF;
+  skt->co_sent_ref = LUA_NOREF;
+  skt->recv_buf_ref = LUA_NOREF;
+  skt->recv_head = skt->recv_tail = 0;
+  skt->recv_buffered = 0;
+  skt->recv_held = 0;
+  skt->recv_used = 0;
 
 #ifdef CLIENT_SSL_ENABLE
   skt->secure = 0;    // as a server SSL is not supported.
@@ -429,6 +532,13 @@ static int net_create( lua_State* L, const char* mt )
   nud->cb_receive_ref = LUA_NOREF;
   nud->cb_send_ref = LUA_NOREF;
   nud->cb_dns_found_ref = LUA_NOREF;
+  nud->co_recv_ref = LUA_NOREF;
+  nud->co_sent_ref = LUA_NOREF;
+  nud->recv_buf_ref = LUA_NOREF;
+  nud->recv_head = nud->recv_tail = 0;
+  nud->recv_buffered = 0;
+  nud->recv_held = 0;
+  nud->recv_used = 0;
   nud->pesp_conn = NULL;
 #ifdef CLIENT_SSL_ENABLE
   nud->secure = secure;
@@ -575,12 +685,20 @@ static int net_delete( lua_State* L, const char* mt )
     luaL_unref(L, LUA_REGISTRYINDEX, nud->cb_dns_found_ref);
     nud->cb_dns_found_ref = LUA_NOREF;
   }
+  if(LUA_NOREF!=nud->recv_buf_ref){
+    luaL_unref(L, LUA_REGISTRYINDEX, nud->recv_buf_ref);
+    nud->recv_buf_ref = LUA_NOREF;
+    nud->recv_head = nud->recv_tail = 0;
+    nud->recv_buffered = 0;
+  }
   lua_gc(gL, LUA_GCSTOP, 0);
   if(LUA_NOREF!=nud->self_ref){
     luaL_unref(L, LUA_REGISTRYINDEX, nud->self_ref);
     nud->self_ref = LUA_NOREF;
   }
   lua_gc(gL, LUA_GCRESTART, 0);
+  // last, as they may well use the socket again
+  net_wake_waiters(L, nud);
   return 0;  
 }
 
@@ -934,6 +1052,8 @@ static int net_close( lua_State* L, const char* mt )
           skt->self_ref = LUA_NOREF;   // for a socket, now only var in lua is ref to the userdata
         }
       }
+      // UDP has no disconnect callback to do it, and TCP need not wait for it
+      net_wake_waiters(L, skt);
     }
 #if 0
     // unref the self_ref
@@ -1143,11 +1263,77 @@ static int net_dns( lua_State* L, const char* mt )
 }
 
 // Lua: net.dns.resolve( domain, function(ip) )
+typedef struct
+{
+  struct espconn conn;  // keep first, the dns callback gets its address
+  ip_addr_t ip;
+  int co_ref;
+} dns_wait_t;
+
+static void net_dns_push_ip(lua_State *L, ip_addr_t *ipaddr)
+{
+  char ip_str[20];
+  if(ipaddr == NULL || ipaddr->addr == 0){
+    lua_pushnil(L);
+    return;
+  }
+  c_sprintf(ip_str, IPSTR, IP2STR(&(ipaddr->addr)));
+  lua_pushstring(L, ip_str);
+}
+
+static void net_dns_wait_found(const char *name, ip_addr_t *ipaddr, void *arg)
+{
+  dns_wait_t *w = (dns_wait_t *)arg;
+  lua_State *L = lua_getstate();
+  int ref = w->co_ref;
+  net_dns_push_ip(L, ipaddr);
+  c_free(w);
+  luaL_wakeup(L, ref, 1);
+}
+
+// Lua: ip = net.dns.resolve(domain), from inside a coroutine
+static int net_dns_wait( lua_State* L )
+{
+  size_t l;
+  dns_wait_t *w;
+  const char *domain = luaL_checklstring( L, 1, &l );
+  if (l>128 || domain == NULL)
+    return luaL_error( L, "need <128 domain" );
+  int ref = luaL_park(L);
+  w = (dns_wait_t *)c_zalloc(sizeof(dns_wait_t));
+  if(w == NULL){
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    return luaL_error( L, "not enough memory" );
+  }
+  w->co_ref = ref;
+  switch(espconn_gethostbyname(&w->conn, domain, &w->ip, net_dns_wait_found)){
+    case ESPCONN_INPROGRESS:
+      return lua_yield(L, 0);
+    case ESPCONN_OK:    // an ip literal or cached
+      net_dns_push_ip(L, &w->ip);
+      break;
+    default:
+      lua_pushnil(L);
+      break;
+  }
+  luaL_unref(L, LUA_REGISTRYINDEX, ref);
+  c_free(w);
+  return 1;
+}
+
 static int net_dns_static( lua_State* L )
 {
   const char *mt = "net.socket";
   if (!lua_isstring( L, 1 ))
     return luaL_error( L, "wrong parameter type (domain)" );
+  // without a callback, wait for the answer if inside a coroutine
+  if (lua_isnoneornil( L, 2 ))
+  {
+    int ismain = lua_pushthread( L );
+    lua_pop( L, 1 );
+    if (!ismain)
+      return net_dns_wait( L );
+  }
   
   int rfunc = LUA_NOREF; //save reference to func
   if (lua_type(L, 2) == LUA_TFUNCTION || lua_type(L, 2) == LUA_TLIGHTFUNCTION){
@@ -1339,6 +1525,46 @@ static int net_socket_unhold( lua_State* L )
   return 0;
 }
 
+// Lua: data = socket:recv(), from inside a coroutine
+// returns data kept since the last recv(), or suspends until data arrives;
+// nil, "closed" once the connection is closed and all data is taken
+static int net_socket_recv( lua_State* L )
+{
+  lnet_userdata *nud = (lnet_userdata *)luaL_checkudata(L, 1, "net.socket");
+  luaL_argcheck(L, nud, 1, "Server/Socket expected");
+  nud->recv_used = 1;
+  if(net_recv_pop(L, nud))
+    return 1;
+  if(nud->pesp_conn == NULL){
+    lua_pushnil(L);
+    lua_pushliteral(L, "closed");
+    return 2;
+  }
+  if(nud->co_recv_ref != LUA_NOREF)
+    return luaL_error( L, "recv already pending" );
+  nud->co_recv_ref = luaL_park(L);
+  return lua_yield(L, 0);
+}
+
+// Lua: ok = socket:flush(), from inside a coroutine
+// suspends until the last send() is acknowledged, nil, "closed" if the
+// connection closed
+static int net_socket_flush( lua_State* L )
+{
+  lnet_userdata *nud = (lnet_userdata *)luaL_checkudata(L, 1, "net.socket");
+  luaL_argcheck(L, nud, 1, "Server/Socket expected");
+  nud->recv_used = 1;     // the answer may come before recv() is called
+  if(nud->pesp_conn == NULL){
+    lua_pushnil(L);
+    lua_pushliteral(L, "closed");
+    return 2;
+  }
+  if(nud->co_sent_ref != LUA_NOREF)
+    return luaL_error( L, "flush already pending" );
+  nud->co_sent_ref = luaL_park(L);
+  return lua_yield(L, 0);
+}
+
 // Lua: ip,port = sk:getpeer()
 static int net_socket_getpeer( lua_State* L )
 {
@@ -1515,6 +1741,8 @@ static const LUA_REG_TYPE net_socket_map[] =
   { LSTRKEY( "close" ), LFUNCVAL ( net_socket_close ) },
   { LSTRKEY( "on" ), LFUNCVAL ( net_socket_on ) },
   { LSTRKEY( "send" ), LFUNCVAL ( net_socket_send ) },
+  { LSTRKEY( "recv" ), LFUNCVAL ( net_socket_recv ) },
+  { LSTRKEY( "flush" ), LFUNCVAL ( net_socket_flush ) },
   { LSTRKEY( "hold" ), LFUNCVAL ( net_socket_hold ) },
   { LSTRKEY( "unhold" ), LFUNCVAL ( net_socket_unhold ) },
   { LSTRKEY( "dns" ), LFUNCVAL ( net_socket_dns ) },
@@ -10,6 +10,7 @@
 #include "lopcodes.h"
 #include "lstring.h"
 #include "lundump.h"
+#include "lprofile.h"
 
 #include "platform.h"
 #include "auxmods.h"
@@ -430,9 +431,119 @@ static int node_restore (lua_State *L)
   return 0;
 }
 
+#define NODE_STRT_HIST 8
+
+// Lua: size, nuse, maxchain, hist = stringstats()
+// hist[i] is the number of string table chains of length i-1, the last
+// entry counts all chains of NODE_STRT_HIST-1 or more strings
+static int node_stringstats (lua_State *L)
+{
+  lu_int32 hist[NODE_STRT_HIST];
+  int maxchain, i;
+  lua_lock(L);
+  maxchain = luaS_stats(L, hist, NODE_STRT_HIST);
+  lua_unlock(L);
+  lua_pushinteger(L, G(L)->strt.size);
+  lua_pushinteger(L, G(L)->strt.nuse);
+  lua_pushinteger(L, maxchain);
+  lua_createtable(L, NODE_STRT_HIST, 0);
+  for (i = 0; i < NODE_STRT_HIST; i++)
+  {
+    lua_pushinteger(L, hist[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 4;
+}
+
+// Lua: stats = eventstats( [reset] )
+// one table per event queue priority, highest first
+static int node_eventstats( lua_State* L )
+{
+  platform_event_stats_t stats;
+  unsigned prio;
+  lua_createtable( L, PLATFORM_EVENT_PRIO_NUM, 0 );
+  for ( prio = 0; prio < PLATFORM_EVENT_PRIO_NUM; prio++ )
+  {
+    platform_event_get_stats( prio, &stats );
+    lua_createtable( L, 0, 6 );
+    lua_pushinteger( L, stats.posted );
+    lua_setfield( L, -2, "posted" );
+    lua_pushinteger( L, stats.delivered );
+    lua_setfield( L, -2, "delivered" );
+    lua_pushinteger( L, stats.coalesced );
+    lua_setfield( L, -2, "coalesced" );
+    lua_pushinteger( L, stats.overflow );
+    lua_setfield( L, -2, "overflow" );
+    lua_pushinteger( L, stats.latency_max );
+    lua_setfield( L, -2, "maxlatency" );
+    lua_pushinteger( L, stats.delivered ? stats.latency_total / stats.delivered : 0 );
+    lua_setfield( L, -2, "avglatency" );
+    lua_rawseti( L, -2, prio + 1 );
+  }
+  if ( lua_toboolean( L, 1 ) )
+    platform_event_reset_stats();
+  return 1;
+}
+
+// *****************************************************************************
+// Sampling profiler, on FRC1 ticks (the recorder is in lua/lprofile.c)
+
+#define PROFILE_MIN_INTERVAL  100   // us
+
+static uint32_t ICACHE_RAM_ATTR profile_ccount(void)
+{
+  uint32_t cycles;
+  __asm__ __volatile__("rsr %0,ccount":"=a" (cycles));
+  return cycles;
+}
+
+static void ICACHE_RAM_ATTR profile_tick (void)
+{
+  lprofile_tick(profile_ccount());
+}
+
+// Lua: node.profile.start( interval_us )
+static int node_profile_start( lua_State* L )
+{
+  uint32_t interval = luaL_optinteger( L, 1, 1000 );
+  if ( lprofile_running() )
+    return luaL_error( L, "profiler running" );
+  if ( interval < PROFILE_MIN_INTERVAL )
+    return luaL_error( L, "wrong arg range" );
+  if ( platform_hw_timer_claim( profile_tick ) != PLATFORM_OK )
+    return luaL_error( L, "hw timer in use" );
+  // a tick not serviced within one interval counts as idle
+  if ( lprofile_start( L, profile_ccount, interval * ets_get_cpu_frequency() ) != 0 )
+  {
+    platform_hw_timer_release();
+    return luaL_error( L, "not enough memory" );
+  }
+  platform_hw_timer_arm( interval, true );
+  return 0;
+}
+
+// Lua: funcs, lines, samples, idle = node.profile.stop()
+// funcs maps "source:linedefined" to the number of samples taken in that
+// function, lines maps "source:line" to samples among the most recent
+// LPROFILE_RING_SIZE ones.
+static int node_profile_stop( lua_State* L )
+{
+  if ( !lprofile_running() )
+    return luaL_error( L, "profiler not running" );
+  platform_hw_timer_release();
+  return lprofile_stop( L );
+}
+
 // Module function map
 #define MIN_OPT_LEVEL 2
 #include "lrodefs.h"
+static const LUA_REG_TYPE node_profile_map[] =
+{
+  { LSTRKEY( "start" ), LFUNCVAL( node_profile_start ) },
+  { LSTRKEY( "stop" ), LFUNCVAL( node_profile_stop ) },
+  { LNILKEY, LNILVAL }
+};
+
 const LUA_REG_TYPE node_map[] =
 {
   { LSTRKEY( "restart" ), LFUNCVAL( node_restart ) },
@@ -456,10 +567,12 @@ const LUA_REG_TYPE node_map[] =
   { LSTRKEY( "setcpufreq" ), LFUNCVAL( node_setcpufreq) },
   { LSTRKEY( "bootreason" ), LFUNCVAL( node_bootreason) },
   { LSTRKEY( "restore" ), LFUNCVAL( node_restore) },
+  { LSTRKEY( "stringstats" ), LFUNCVAL( node_stringstats) },
+  { LSTRKEY( "eventstats" ), LFUNCVAL( node_eventstats) },
 // Combined to dsleep(us, option)
 // { LSTRKEY( "dsleepsetoption" ), LFUNCVAL( node_deepsleep_setoption) },
 #if LUA_OPTIMIZE_MEMORY > 0
-
+  { LSTRKEY( "profile" ), LROVAL( node_profile_map ) },
 #endif
   { LNILKEY, LNILVAL }
 };
@@ -472,6 +585,11 @@ LUALIB_API int luaopen_node( lua_State *L )
   luaL_register( L, AUXLIB_NODE, node_map );
   // Add constants
 
+  // Setup the new table (profile) inside node
+  lua_newtable( L );
+  luaL_register( L, NULL, node_profile_map );
+  lua_setfield( L, -2, "profile" );
+
   return 1;
 #endif // #if LUA_OPTIMIZE_MEMORY > 0
 }
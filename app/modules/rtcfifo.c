@@ -5,13 +5,85 @@
 #include "rtc/rtctime.h"
 #define RTCTIME_SLEEP_ALIGNED rtctime_deep_sleep_until_aligned_us
 #include "rtc/rtcfifo.h"
+#include "flash_fs.h"
+#include "c_string.h"
+
+#ifdef BUILD_SPIFFS
+// The spill log: samples appended in FIFO order as packed records of
+//   timestamp (4 bytes), value (2), decimals (1), sensor name (4)
+// all little endian; rtcfifo.read_batch () hands them out in the same form.
+#define RTCFIFO_LOG        "rtcfifo.log"
+#define RTCFIFO_RECORD_LEN 11
+#define RTCFIFO_DRAIN_BATCH 16
+
+static void pack_record (uint8_t *p, const sample_t *s)
+{
+  p[0] = s->timestamp;
+  p[1] = s->timestamp >> 8;
+  p[2] = s->timestamp >> 16;
+  p[3] = s->timestamp >> 24;
+  p[4] = s->value;
+  p[5] = s->value >> 8;
+  p[6] = s->decimals;
+  p[7] = s->tag;
+  p[8] = s->tag >> 8;
+  p[9] = s->tag >> 16;
+  p[10] = s->tag >> 24;
+}
+
+// Moves the FIFO to the end of the log, a batch at a time. A sample leaves
+// the FIFO only once its whole record is written. A short write can still
+// leave part of a record at the end of the log, so each drain starts at
+// the last record boundary and overwrites that tail rather than appending
+// after it, which would shift every later record.
+// Returns the number of samples moved, or -1 if the log can't be opened.
+static int drain_to_log (void)
+{
+  uint8_t buf[RTCFIFO_DRAIN_BATCH * RTCFIFO_RECORD_LEN];
+  sample_t s;
+  int moved = 0;
+  int end;
+  int fd = fs_open (RTCFIFO_LOG, FS_RDWR | FS_CREAT);
+  if (fd < FS_OPEN_OK)
+    return -1;
+
+  end = fs_seek (fd, 0, FS_SEEK_END);
+  if (end < 0 || fs_seek (fd, end - end % RTCFIFO_RECORD_LEN, FS_SEEK_SET) < 0)
+  {
+    fs_close (fd);
+    return -1;
+  }
+
+  for (;;)
+  {
+    uint32_t n = 0, written;
+    while (n < RTCFIFO_DRAIN_BATCH && rtc_fifo_peek_sample (&s, n))
+    {
+      pack_record (buf + n * RTCFIFO_RECORD_LEN, &s);
+      n++;
+    }
+    if (n == 0)
+      break;
+    written = fs_write (fd, buf, n * RTCFIFO_RECORD_LEN) / RTCFIFO_RECORD_LEN;
+    if (written)
+      rtc_fifo_drop_samples (written);
+    moved += written;
+    if (written < n)
+      break;
+  }
+  fs_close (fd);
+  return moved;
+}
+#endif
 
-// rtcfifo.prepare ([{sensor_count=n, interval_us=m, storage_begin=x, storage_end=y}])
+// rtcfifo.prepare ([{sensor_count=n, interval_us=m, storage_begin=x, storage_end=y, packed=b, spill_at=s}])
 static int rtcfifo_prepare (lua_State *L)
 {
   uint32_t sensor_count = RTC_DEFAULT_TAGCOUNT;
   uint32_t interval_us = 0;
   int first = -1, last = -1;
+  int packed = 0;
+  uint32_t spill_at = 0;
 
   if (lua_istable (L, 1))
   {
@@ -35,6 +107,17 @@ static int rtcfifo_prepare (lua_State *L)
     if (lua_isnumber (L, -1))
       last = lua_tonumber (L, -1);
     lua_pop (L, 1);
+
+    lua_getfield (L, 1, "packed");
+    packed = lua_toboolean (L, -1);
+    lua_pop (L, 1);
+
+#ifdef BUILD_SPIFFS
+    lua_getfield (L, 1, "spill_at");
+    if (lua_isnumber (L, -1))
+      spill_at = lua_tonumber (L, -1);
+    lua_pop (L, 1);
+#endif
   }
   else if (!lua_isnone (L, 1))
     return luaL_error (L, "expected table as arg #1");
@@ -42,7 +125,10 @@ static int rtcfifo_prepare (lua_State *L)
   rtc_fifo_prepare (0, interval_us, sensor_count);
 
   if (first != -1 && last != -1)
-    rtc_fifo_put_loc (first, last, sensor_count);
+    rtc_fifo_init (first, last, rtc_fifo_get_tagcount ());
+  if (packed)
+    rtc_fifo_init_packed (rtc_fifo_get_tagpos (), rtc_fifo_get_last (), rtc_fifo_get_tagcount ());
+  rtc_mem_write (RTC_FIFOSPILL_POS, spill_at);
 
   return 0;
 }
@@ -151,6 +237,60 @@ static int rtcfifo_count (lua_State *L)
 }
 
 
+#ifdef BUILD_SPIFFS
+// num = rtcfifo.drain_to_file ()
+static int rtcfifo_drain_to_file (lua_State *L)
+{
+  check_fifo_magic (L);
+
+  int moved = drain_to_log ();
+  if (moved < 0)
+    return luaL_error (L, "can't open " RTCFIFO_LOG);
+  lua_pushnumber (L, moved);
+  return 1;
+}
+
+
+// records = rtcfifo.read_batch (num [, offset])
+static int rtcfifo_read_batch (lua_State *L)
+{
+  uint32_t num = luaL_checknumber (L, 1);
+  uint32_t offs = luaL_optnumber (L, 2, 0);
+  size_t want = RTCFIFO_RECORD_LEN * (size_t)num;
+  size_t chunk = LUAL_BUFFERSIZE - LUAL_BUFFERSIZE % RTCFIFO_RECORD_LEN;
+  luaL_Buffer b;
+
+  int fd = fs_open (RTCFIFO_LOG, FS_RDONLY);
+  if (fd < FS_OPEN_OK)
+    return 0;
+  if (fs_seek (fd, offs * RTCFIFO_RECORD_LEN, FS_SEEK_SET) < 0)
+  {
+    fs_close (fd);
+    return 0;
+  }
+
+  luaL_buffinit (L, &b);
+  while (want)
+  {
+    size_t n = want < chunk ? want : chunk;
+    size_t got = fs_read (fd, luaL_prepbuffer (&b), n);
+    if (got == 0)
+      break;
+    got -= got % RTCFIFO_RECORD_LEN;
+    luaL_addsize (&b, got);
+    want -= got;
+    if (got < n)
+      break;
+  }
+  fs_close (fd);
+  luaL_pushresult (&b);
+  if (lua_objlen (L, -1) == 0)
+    return 0;
+  return 1;
+}
+#endif
+
+
 #ifdef LUA_USE_MODULES_RTCTIME
 // rtcfifo.dsleep_until_sample (min_sleep_us)
 static int rtcfifo_dsleep_until_sample (lua_State *L)
@@ -175,6 +315,10 @@ const LUA_REG_TYPE rtcfifo_map[] =
   { LSTRKEY("peek"),                LFUNCVAL(rtcfifo_peek) },
   { LSTRKEY("drop"),                LFUNCVAL(rtcfifo_drop) },
   { LSTRKEY("count"),               LFUNCVAL(rtcfifo_count) },
+#ifdef BUILD_SPIFFS
+  { LSTRKEY("drain_to_file"),       LFUNCVAL(rtcfifo_drain_to_file) },
+  { LSTRKEY("read_batch"),          LFUNCVAL(rtcfifo_read_batch) },
+#endif
 #ifdef LUA_USE_MODULES_RTCTIME
   { LSTRKEY("dsleep_until_sample"), LFUNCVAL(rtcfifo_dsleep_until_sample) },
 #endif
@@ -183,6 +327,16 @@ const LUA_REG_TYPE rtcfifo_map[] =
 
 LUALIB_API int luaopen_rtcfifo (lua_State *L)
 {
+#ifdef BUILD_SPIFFS
+  // Lua starts after the file system is mounted; samples still to take
+  // before a real boot mean this is only a sampling wake-up
+  if (rtc_fifo_check_magic () && rtc_get_samples_to_take () == 0)
+  {
+    uint32_t spill_at = rtc_mem_read (RTC_FIFOSPILL_POS);
+    if (spill_at && rtc_fifo_get_count () >= spill_at)
+      drain_to_log ();
+  }
+#endif
 #if LUA_OPTIMIZE_MEMORY > 0
   return 0;
 #else
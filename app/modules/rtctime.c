@@ -33,6 +33,13 @@ void rtctime_settimeofday (const struct rtc_timeval *tv)
   rtc_time_settimeofday (tv);
 }
 
+void rtctime_settimeofday_dist (const struct rtc_timeval *tv, uint32_t dist_us)
+{
+  if (!rtc_time_check_magic ())
+    rtc_time_prepare ();
+  rtc_time_settimeofday_dist (tv, dist_us);
+}
+
 bool rtctime_have_time (void)
 {
   return rtc_time_have_time ();
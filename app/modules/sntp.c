@@ -40,6 +40,8 @@
 #include "c_stdlib.h"
 #include "user_modules.h"
 
+#include "rtc/rtcdiscipline.h"
+
 #ifdef LUA_USE_MODULES_RTCTIME
 #include "rtc/rtctime.h"
 #endif
@@ -81,15 +83,21 @@ typedef struct
 typedef struct
 {
   struct udp_pcb *pcb;
-  ntp_timestamp_t cookie;
   os_timer_t timer;
   int sync_cb_ref;
   int err_cb_ref;
   uint8_t attempts;
+  uint8_t answered;   // bitmap of the servers we have a sample from
+  uint32_t last_us;   // local_us () state
+  uint32_t high_us;
+  ntp_timestamp_t cookie[RTC_DISCIPLINE_SERVERS];
+  uint64_t sent_us[RTC_DISCIPLINE_SERVERS];
+  rtc_ntp_sample_t sample[RTC_DISCIPLINE_SERVERS];
 } sntp_state_t;
 
 static sntp_state_t *state;
-static ip_addr_t server;
+static ip_addr_t server[RTC_DISCIPLINE_SERVERS];
+static uint8_t server_count;
 
 static void cleanup (lua_State *L)
 {
@@ -116,35 +124,110 @@ static void handle_error (lua_State *L)
 }
 
 
+// The clock the exchanges are timed against: system_get_time (), carried
+// past its wrap. Offsets from the servers are relative to this, so that
+// they hold whether or not rtctime knows the time yet.
+static uint64_t local_us (void)
+{
+  uint32_t now = system_get_time ();
+  if (now < state->last_us)
+    ++state->high_us;
+  state->last_us = now;
+  return ((uint64_t)state->high_us << 32) | now;
+}
+
+
 static void sntp_dosend (lua_State *L)
 {
   ++state->attempts;
   sntp_dbg("sntp: attempt %d\n", state->attempts);
 
-  struct pbuf *p = pbuf_alloc (PBUF_TRANSPORT, sizeof (ntp_frame_t), PBUF_RAM);
-  if (!p)
-    handle_error (L);
-
-  ntp_frame_t req;
-  os_memset (&req, 0, sizeof (req));
-  req.ver = 4;
-  req.mode = 3; // client
+  int i;
+  for (i = 0; i < server_count; ++i)
+  {
+    if (state->answered & (1 << i))
+      continue;
+
+    struct pbuf *p = pbuf_alloc (PBUF_TRANSPORT, sizeof (ntp_frame_t), PBUF_RAM);
+    if (!p)
+    {
+      handle_error (L);
+      return;
+    }
+
+    ntp_frame_t req;
+    os_memset (&req, 0, sizeof (req));
+    req.ver = 4;
+    req.mode = 3; // client
 #ifdef LUA_USE_MODULES_RTCTIME
-  struct rtc_timeval tv;
-  rtctime_gettimeofday (&tv);
-  req.xmit.sec = htonl (tv.tv_sec);
-  req.xmit.frac = htonl (tv.tv_usec);
+    struct rtc_timeval tv;
+    rtctime_gettimeofday (&tv);
+    req.xmit.sec = htonl (tv.tv_sec);
+    req.xmit.frac = htonl (tv.tv_usec);
 #else
-  req.xmit.frac = htonl (system_get_time ());
+    req.xmit.frac = htonl (system_get_time ());
 #endif
-  state->cookie = req.xmit;
+    state->cookie[i] = req.xmit;
 
-  os_memcpy (p->payload, &req, sizeof (req));
-  int ret = udp_sendto (state->pcb, p, &server, NTP_PORT);
-  sntp_dbg("sntp: send: %d\n", ret);
-  pbuf_free (p);
-  if (ret != ERR_OK)
+    os_memcpy (p->payload, &req, sizeof (req));
+    state->sent_us[i] = local_us ();
+    int ret = udp_sendto (state->pcb, p, &server[i], NTP_PORT);
+    sntp_dbg("sntp: send %d: %d\n", i, ret);
+    pbuf_free (p);
+    if (ret != ERR_OK)
+    {
+      handle_error (L);
+      return;
+    }
+  }
+}
+
+
+// Picks among the samples in and sets the clock from the chosen one
+static void sntp_finish (lua_State *L)
+{
+  rtc_ntp_sample_t samples[RTC_DISCIPLINE_SERVERS];
+  uint8_t from[RTC_DISCIPLINE_SERVERS];
+  int i, n = 0;
+
+  for (i = 0; i < server_count; ++i)
+  {
+    if (state->answered & (1 << i))
+    {
+      samples[n] = state->sample[i];
+      from[n++] = i;
+    }
+  }
+
+  int best = rtc_discipline_select (samples, n, server_count);
+  if (best < 0)
+  {
+    sntp_dbg("sntp: no majority of %d among %d\n", server_count, n);
     handle_error (L);
+    return;
+  }
+
+  uint64_t now = local_us () + samples[best].offset_us;
+  struct rtc_timeval tv;
+  tv.tv_sec = now / 1000000;
+  tv.tv_usec = now % 1000000;
+#ifdef LUA_USE_MODULES_RTCTIME
+  rtctime_settimeofday_dist (&tv, samples[best].dist_us);
+#endif
+
+  bool have_cb = (state->sync_cb_ref != LUA_NOREF);
+  if (have_cb)
+  {
+    lua_rawgeti (L, LUA_REGISTRYINDEX, state->sync_cb_ref);
+    lua_pushnumber (L, tv.tv_sec);
+    lua_pushnumber (L, tv.tv_usec);
+    lua_pushstring (L, ipaddr_ntoa (&server[from[best]]));
+  }
+
+  cleanup (L);
+
+  if (have_cb)
+    lua_call (L, 3, 0);
 }
 
 
@@ -153,7 +236,12 @@ static void on_timeout (void *arg)
   sntp_dbg("sntp: timer\n");
   lua_State *L = arg;
   if (state->attempts >= MAX_ATTEMPTS)
-    handle_error (L);
+  {
+    if (state->answered)
+      sntp_finish (L);
+    else
+      handle_error (L);
+  }
   else
     sntp_dosend (L);
 }
@@ -177,6 +265,8 @@ static void on_recv (void *arg, struct udp_pcb *pcb, struct pbuf *p, struct ip_a
   if (!p)
     return;
 
+  uint64_t t4 = local_us ();
+
   if (p->len < sizeof (ntp_frame_t))
   {
     pbuf_free (p);
@@ -192,95 +282,52 @@ static void on_recv (void *arg, struct udp_pcb *pcb, struct pbuf *p, struct ip_a
   // sanity checks before we touch our clocks
   ip_addr_t anycast;
   NTP_ANYCAST_ADDR(&anycast);
-  if (server.addr != anycast.addr && server.addr != addr->addr)
+  int i, any = -1;
+  for (i = 0; i < server_count; ++i)
+  {
+    if (server[i].addr == addr->addr)
+      break;
+    if (server[i].addr == anycast.addr)
+      any = i;
+  }
+  if (i == server_count)
+    i = any;
+  if (i < 0)
     return; // unknown sender, ignore
 
-  if (ntp.origin.sec  != state->cookie.sec ||
-      ntp.origin.frac != state->cookie.frac)
+  if (state->answered & (1 << i))
+    return; // already heard from this one
+
+  if (ntp.origin.sec  != state->cookie[i].sec ||
+      ntp.origin.frac != state->cookie[i].frac)
     return; // unsolicited message, ignore
 
   if (ntp.LI == 3)
     return; // server clock not synchronized (why did it even respond?!)
 
-  server.addr = addr->addr;
-  ntp.origin.sec  = ntohl (ntp.origin.sec);
-  ntp.origin.frac = ntohl (ntp.origin.frac);
-  ntp.recv.sec  = ntohl (ntp.recv.sec);
-  ntp.recv.frac = ntohl (ntp.recv.frac);
-  ntp.xmit.sec  = ntohl (ntp.xmit.sec);
-  ntp.xmit.frac = ntohl (ntp.xmit.frac);
-
-  const uint32_t UINT32_MAXI = (uint32_t)-1;
-  const uint64_t MICROSECONDS = 1000000ull;
-  const uint32_t NTP_TO_UNIX_EPOCH = 2208988800ul;
-
-  bool have_cb = (state->sync_cb_ref != LUA_NOREF);
-
-  // if we have rtctime, do higher resolution delta calc, else just use
-  // the transmit timestamp
-#ifdef LUA_USE_MODULES_RTCTIME
-  struct rtc_timeval tv;
-
-  rtctime_gettimeofday (&tv);
-  ntp_timestamp_t dest;
-  dest.sec = tv.tv_sec;
-  dest.frac = (MICROSECONDS * tv.tv_usec) / UINT32_MAXI;
-
-  // Compensation as per RFC2030
-  int64_t delta_s = (((int64_t)ntp.recv.sec - ntp.origin.sec) +
-                     ((int64_t)ntp.xmit.sec - dest.sec)) / 2;
-
-  int64_t delta_f = (((int64_t)ntp.recv.frac - ntp.origin.frac) +
-                     ((int64_t)ntp.xmit.frac - dest.frac)) / 2;
-
-  dest.sec += delta_s;
-  if (delta_f + dest.frac < 0)
-  {
-    delta_f += UINT32_MAXI;
-    --dest.sec;
-  }
-  else if (delta_f + dest.frac > UINT32_MAXI)
-  {
-    delta_f -= UINT32_MAXI;
-    ++dest.sec;
-  }
-  dest.frac += delta_f;
-
-  tv.tv_sec = dest.sec - NTP_TO_UNIX_EPOCH;
-  tv.tv_usec = (MICROSECONDS * dest.frac) / UINT32_MAXI;
-  rtctime_settimeofday (&tv);
-
-  if (have_cb)
-  {
-    lua_rawgeti (L, LUA_REGISTRYINDEX, state->sync_cb_ref);
-    lua_pushnumber (L, tv.tv_sec);
-    lua_pushnumber (L, tv.tv_usec);
-  }
-#else
-  if (have_cb)
-  {
-    lua_rawgeti (L, LUA_REGISTRYINDEX, state->sync_cb_ref);
-    lua_pushnumber (L, ntp.xmit.sec - NTP_TO_UNIX_EPOCH);
-    lua_pushnumber (L, (MICROSECONDS * ntp.xmit.frac) / UINT32_MAXI);
-  }
-#endif
-
-  cleanup (L);
-
-  if (have_cb)
-  {
-    lua_pushstring (L, ipaddr_ntoa (&server));
-    lua_call (L, 3, 0);
-  }
+  server[i].addr = addr->addr;
+  rtc_discipline_sample (&state->sample[i], state->sent_us[i], t4,
+    ntohl (ntp.recv.sec), ntohl (ntp.recv.frac),
+    ntohl (ntp.xmit.sec), ntohl (ntp.xmit.frac),
+    ntohl (ntp.root_delay), ntohl (ntp.root_dispersion));
+  sntp_dbg("sntp: server %d offset %d delay %u\n", i,
+    (int)state->sample[i].offset_us, state->sample[i].delay_us);
+
+  state->answered |= 1 << i;
+  if (state->answered == (1 << server_count) - 1)
+    sntp_finish (L);
 }
 
 
-// sntp.sync (server or nil, syncfn or nil, errfn or nil)
+// sntp.sync (server or {servers} or nil, syncfn or nil, errfn or nil)
 static int sntp_sync (lua_State *L)
 {
-  // default to anycast address, then allow last server to stick
-  if (server.addr == IPADDR_ANY)
-    NTP_ANYCAST_ADDR(&server);
+  // default to anycast address, then allow last servers to stick
+  if (!server_count)
+  {
+    NTP_ANYCAST_ADDR(&server[0]);
+    server_count = 1;
+  }
 
   const char *errmsg = 0;
   #define sync_err(x) do { errmsg = x; goto error; } while (0)
@@ -306,11 +353,30 @@ static int sntp_sync (lua_State *L)
 
   udp_recv (state->pcb, on_recv, L);
 
-  // use last server, unless new one specified
-  if (!lua_isnoneornil (L, 1))
+  // use last servers, unless new ones specified
+  if (lua_istable (L, 1))
+  {
+    ip_addr_t list[RTC_DISCIPLINE_SERVERS];
+    int i, n = lua_objlen (L, 1);
+    if (n < 1 || n > RTC_DISCIPLINE_SERVERS)
+      sync_err ("bad server list");
+    for (i = 0; i < n; ++i)
+    {
+      lua_rawgeti (L, 1, i + 1);
+      const char *ip = lua_tostring (L, -1);
+      bool ok = ip && ipaddr_aton (ip, &list[i]);
+      lua_pop (L, 1);
+      if (!ok)
+        sync_err ("bad IP address");
+    }
+    os_memcpy (server, list, n * sizeof (ip_addr_t));
+    server_count = n;
+  }
+  else if (!lua_isnoneornil (L, 1))
   {
-    if (!ipaddr_aton (luaL_checkstring (L, 1), &server))
+    if (!ipaddr_aton (luaL_checkstring (L, 1), &server[0]))
       sync_err ("bad IP address");
+    server_count = 1;
   }
 
   if (!lua_isnoneornil (L, 2))
@@ -46,6 +46,22 @@ tmr.softwd(int)
 	any other value starts the timer, when the
 	countdown reaches zero, the device restarts
 	the timer units are seconds
+tmr.sleep(interval)
+	suspend the calling coroutine for interval ms
+	the event loop keeps running, only usable inside a coroutine
+
+tmr.create()
+	ret: timer object
+	a timer object has the methods register, alarm, start, stop,
+	unregister, interval and state, taking the same arguments as the
+	functions above without the id; the callback gets the object
+	there is no limit on the number of objects, they all share one
+	SDK timer through a timer wheel with TMR_WHEEL_TICK ms resolution
+	and timers due in the same tick fire as a batch
+tmr.wheelstats()
+	ret: (active, fired, maxjitter, avgjitter)
+	number of running timer objects, callbacks fired and the
+	max/average distance of a firing from its due time in us
 */
 
 #define MIN_OPT_LEVEL 2
@@ -57,6 +73,8 @@ tmr.softwd(int)
 #include "lrotable.h"
 #include "lrodefs.h"
 #include "c_types.h"
+#include "c_stdlib.h"
+#include "timer_wheel.h"
 
 #define TIMER_MODE_OFF 3
 #define TIMER_MODE_SINGLE 0
@@ -97,22 +115,33 @@ static sint32_t soft_watchdog  = -1;
 static timer_struct_t alarm_timers[NUM_TMR];
 static os_timer_t rtc_timer;
 
-static void alarm_timer_common(void* arg){
-	timer_t tmr = &alarm_timers[(uint32_t)arg];
+//runs from the event queue, so alarms are ordered behind gpio interrupts
+//and a backlog of firings of one alarm collapses into a single call
+static void alarm_timer_event(uint16_t id, uint16_t value, uint16_t count){
+	timer_t tmr = &alarm_timers[id];
 	if(tmr->lua_ref == LUA_NOREF || tmr->L == NULL)
 		return;
+	//an auto alarm stopped after it fired is not called anymore
+	if(tmr->mode == (TIMER_MODE_AUTO|TIMER_IDLE_FLAG))
+		return;
 	lua_rawgeti(tmr->L, LUA_REGISTRYINDEX, tmr->lua_ref);
 	//if the timer was set to single run we clean up after it
 	if(tmr->mode == TIMER_MODE_SINGLE){
 		luaL_unref(tmr->L, LUA_REGISTRYINDEX, tmr->lua_ref);
 		tmr->lua_ref = LUA_NOREF;
 		tmr->mode = TIMER_MODE_OFF;
-	}else if(tmr->mode == TIMER_MODE_SEMI){
-		tmr->mode |= TIMER_IDLE_FLAG;
 	}
 	lua_call(tmr->L, 0, 0);
 }
 
+static void alarm_timer_common(void* arg){
+	timer_t tmr = &alarm_timers[(uint32_t)arg];
+	//a semi alarm is idle as soon as it fired, it can be restarted right away
+	if(tmr->mode == TIMER_MODE_SEMI)
+		tmr->mode |= TIMER_IDLE_FLAG;
+	platform_event_post(PLATFORM_EVENT_PRIO_MEDIUM, alarm_timer_event, (uint32_t)arg, 0);
+}
+
 // Lua: tmr.delay( us )
 static int tmr_delay( lua_State* L ){
 	sint32_t us = luaL_checkinteger(L, 1);
@@ -130,6 +159,38 @@ static int tmr_delay( lua_State* L ){
 	return 0; 
 }
 
+typedef struct{
+	os_timer_t os;
+	lua_State* L;
+	sint32_t co_ref;
+}sleep_struct_t;
+
+static void sleep_timer_cb(void* arg){
+	sleep_struct_t *sl = (sleep_struct_t*)arg;
+	lua_State* L = sl->L;
+	sint32_t ref = sl->co_ref;
+	c_free(sl);
+	luaL_wakeup(L, ref, 0);
+}
+
+// Lua: tmr.sleep( ms ), from inside a coroutine
+static int tmr_sleep(lua_State* L){
+	sint32_t interval = luaL_checkinteger(L, 1);
+	if(interval <= 0)
+		return luaL_error(L, "wrong arg range");
+	sint32_t ref = luaL_park(L);
+	sleep_struct_t *sl = (sleep_struct_t*)c_zalloc(sizeof(sleep_struct_t));
+	if(sl == NULL){
+		luaL_unref(L, LUA_REGISTRYINDEX, ref);
+		return luaL_error(L, "not enough memory");
+	}
+	sl->L = lua_getstate();
+	sl->co_ref = ref;
+	ets_timer_setfn(&sl->os, sleep_timer_cb, sl);
+	ets_timer_arm_new(&sl->os, interval, 0, 1);
+	return lua_yield(L, 0);
+}
+
 // Lua: tmr.now() , return system timer in us
 static int tmr_now(lua_State* L){
 	uint32_t now = 0x7FFFFFFF & system_get_time();
@@ -250,6 +311,229 @@ static int tmr_state(lua_State* L){
 	return 2;
 }
 
+//timer objects, multiplexed over one SDK timer through a timer wheel
+#define TMR_WHEEL_TICK 10	//ms
+#define TMR_OBJ_MT "tmr.timer"
+
+typedef struct{
+	tw_node_t node;		//keep first, the wheel hands out node pointers
+	sint32_t lua_ref;
+	sint32_t self_ref;	//anchors the object while it is running
+	uint32_t interval;
+	uint32_t due;		//system_get_time() of the next firing
+	uint8_t mode;
+}tmr_obj_t;
+
+static timer_wheel_t tmr_wheel;
+static os_timer_t tmr_wheel_timer;
+static bool tmr_wheel_armed = false;
+static struct{
+	uint32_t fired;
+	uint32_t jitter_max;
+	uint32_t jitter_total;
+}tmr_wheel_stats;
+
+static void tmr_wheel_tick(void* arg);
+
+static void tmr_obj_arm(tmr_obj_t *t){
+	sint32_t remaining = (sint32_t)(t->due - system_get_time());
+	uint32_t ticks = remaining <= 0 ? 1 : (remaining + TMR_WHEEL_TICK*1000 - 1) / (TMR_WHEEL_TICK*1000);
+	tw_add(&tmr_wheel, &t->node, ticks);
+	if(!tmr_wheel_armed){
+		tmr_wheel_armed = true;
+		ets_timer_setfn(&tmr_wheel_timer, tmr_wheel_tick, NULL);
+		ets_timer_arm_new(&tmr_wheel_timer, TMR_WHEEL_TICK, 1, 1);
+	}
+}
+
+static void tmr_obj_fire(lua_State* L, tmr_obj_t *t){
+	uint32_t jitter = system_get_time() - t->due;
+	if((sint32_t)jitter < 0)
+		jitter = -jitter;
+	tmr_wheel_stats.fired++;
+	tmr_wheel_stats.jitter_total += jitter;
+	if(jitter > tmr_wheel_stats.jitter_max)
+		tmr_wheel_stats.jitter_max = jitter;
+
+	if(t->lua_ref == LUA_NOREF || t->self_ref == LUA_NOREF)
+		return;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, t->lua_ref);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, t->self_ref);
+	if(t->mode == TIMER_MODE_AUTO){
+		t->due += t->interval * 1000;
+		tmr_obj_arm(t);
+	}else{
+		//not running anymore, the callback holds the object from here
+		luaL_unref(L, LUA_REGISTRYINDEX, t->self_ref);
+		t->self_ref = LUA_NOREF;
+		if(t->mode == TIMER_MODE_SINGLE){
+			luaL_unref(L, LUA_REGISTRYINDEX, t->lua_ref);
+			t->lua_ref = LUA_NOREF;
+			t->mode = TIMER_MODE_OFF;
+		}else{
+			t->mode |= TIMER_IDLE_FLAG;
+		}
+	}
+	lua_call(L, 1, 0);
+}
+
+//runs from the event queue, count ticks may have elapsed since the last run
+static void tmr_wheel_event(uint16_t key, uint16_t value, uint16_t count){
+	lua_State* L = lua_getstate();
+	tw_node_t *n;
+	while(count--){
+		tw_advance(&tmr_wheel);
+		//callbacks may stop or restart any timer, take them one by one
+		while((n = tw_take_expired(&tmr_wheel)) != NULL)
+			tmr_obj_fire(L, (tmr_obj_t*)n);
+	}
+	if(tmr_wheel.count == 0 && tmr_wheel_armed){
+		tmr_wheel_armed = false;
+		ets_timer_disarm(&tmr_wheel_timer);
+	}
+}
+
+static void tmr_wheel_tick(void* arg){
+	platform_event_post(PLATFORM_EVENT_PRIO_MEDIUM, tmr_wheel_event, 0, 0);
+}
+
+static void tmr_obj_halt(lua_State* L, tmr_obj_t *t){
+	tw_remove(&tmr_wheel, &t->node);
+	if(t->self_ref != LUA_NOREF){
+		luaL_unref(L, LUA_REGISTRYINDEX, t->self_ref);
+		t->self_ref = LUA_NOREF;
+	}
+}
+
+// Lua: tmr.create()
+static int tmr_create(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)lua_newuserdata(L, sizeof(tmr_obj_t));
+	tw_node_init(&t->node);
+	t->lua_ref = LUA_NOREF;
+	t->self_ref = LUA_NOREF;
+	t->interval = 0;
+	t->due = 0;
+	t->mode = TIMER_MODE_OFF;
+	luaL_getmetatable(L, TMR_OBJ_MT);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+// Lua: t:register( interval, mode, function )
+static int tmr_obj_register(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)luaL_checkudata(L, 1, TMR_OBJ_MT);
+	sint32_t interval = luaL_checkinteger(L, 2);
+	uint8_t mode = luaL_checkinteger(L, 3);
+	uint8_t args_valid = interval <= 0
+		|| (mode != TIMER_MODE_SINGLE && mode != TIMER_MODE_SEMI && mode != TIMER_MODE_AUTO)
+		|| (lua_type(L, 4) != LUA_TFUNCTION && lua_type(L, 4) != LUA_TLIGHTFUNCTION);
+	if(args_valid)
+		return luaL_error(L, "wrong arg range");
+	lua_pushvalue(L, 4);
+	sint32_t ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	tmr_obj_halt(L, t);
+	if(t->lua_ref != LUA_NOREF)
+		luaL_unref(L, LUA_REGISTRYINDEX, t->lua_ref);
+	t->lua_ref = ref;
+	t->mode = mode|TIMER_IDLE_FLAG;
+	t->interval = interval;
+	return 0;
+}
+
+// Lua: t:start()
+static int tmr_obj_start(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)luaL_checkudata(L, 1, TMR_OBJ_MT);
+	if(!(t->mode & TIMER_IDLE_FLAG)){
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	t->mode &= ~TIMER_IDLE_FLAG;
+	lua_pushvalue(L, 1);
+	t->self_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	t->due = system_get_time() + t->interval * 1000;
+	tmr_obj_arm(t);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// Lua: t:alarm( interval, mode, function )
+static int tmr_obj_alarm(lua_State* L){
+	tmr_obj_register(L);
+	return tmr_obj_start(L);
+}
+
+// Lua: t:stop()
+static int tmr_obj_stop(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)luaL_checkudata(L, 1, TMR_OBJ_MT);
+	if(!(t->mode & TIMER_IDLE_FLAG) && t->mode != TIMER_MODE_OFF){
+		t->mode |= TIMER_IDLE_FLAG;
+		tmr_obj_halt(L, t);
+		lua_pushboolean(L, 1);
+	}else{
+		lua_pushboolean(L, 0);
+	}
+	return 1;
+}
+
+// Lua: t:unregister()
+static int tmr_obj_unregister(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)luaL_checkudata(L, 1, TMR_OBJ_MT);
+	tmr_obj_halt(L, t);
+	if(t->lua_ref != LUA_NOREF)
+		luaL_unref(L, LUA_REGISTRYINDEX, t->lua_ref);
+	t->lua_ref = LUA_NOREF;
+	t->mode = TIMER_MODE_OFF;
+	return 0;
+}
+
+// Lua: t:interval( interval )
+static int tmr_obj_interval(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)luaL_checkudata(L, 1, TMR_OBJ_MT);
+	sint32_t interval = luaL_checkinteger(L, 2);
+	if(interval <= 0)
+		return luaL_error(L, "wrong arg range");
+	if(t->mode != TIMER_MODE_OFF){
+		t->interval = interval;
+		if(!(t->mode & TIMER_IDLE_FLAG)){
+			tw_remove(&tmr_wheel, &t->node);
+			t->due = system_get_time() + t->interval * 1000;
+			tmr_obj_arm(t);
+		}
+	}
+	return 0;
+}
+
+// Lua: t:state()
+static int tmr_obj_state(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)luaL_checkudata(L, 1, TMR_OBJ_MT);
+	if(t->mode == TIMER_MODE_OFF){
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushboolean(L, (t->mode&TIMER_IDLE_FLAG)==0);
+	lua_pushinteger(L, t->mode&(~TIMER_IDLE_FLAG));
+	return 2;
+}
+
+// Lua: __gc, only reached by objects that are not running
+static int tmr_obj_delete(lua_State* L){
+	tmr_obj_t *t = (tmr_obj_t*)luaL_checkudata(L, 1, TMR_OBJ_MT);
+	tw_remove(&tmr_wheel, &t->node);
+	if(t->lua_ref != LUA_NOREF)
+		luaL_unref(L, LUA_REGISTRYINDEX, t->lua_ref);
+	t->lua_ref = LUA_NOREF;
+	return 0;
+}
+
+// Lua: tmr.wheelstats()
+static int tmr_wheelstats(lua_State* L){
+	lua_pushinteger(L, tmr_wheel.count);
+	lua_pushinteger(L, tmr_wheel_stats.fired);
+	lua_pushinteger(L, tmr_wheel_stats.jitter_max);
+	lua_pushinteger(L, tmr_wheel_stats.fired ? tmr_wheel_stats.jitter_total / tmr_wheel_stats.fired : 0);
+	return 4;
+}
+
 /*I left the led comments 'couse I don't know
 why they are here*/
 
@@ -310,8 +594,24 @@ static int tmr_softwd( lua_State* L ){
 
 // Module function map
 
+static const LUA_REG_TYPE tmr_obj_map[] = {
+	{ LSTRKEY( "register" ), LFUNCVAL( tmr_obj_register ) },
+	{ LSTRKEY( "alarm" ), LFUNCVAL( tmr_obj_alarm ) },
+	{ LSTRKEY( "start" ), LFUNCVAL( tmr_obj_start ) },
+	{ LSTRKEY( "stop" ), LFUNCVAL( tmr_obj_stop ) },
+	{ LSTRKEY( "unregister" ), LFUNCVAL( tmr_obj_unregister ) },
+	{ LSTRKEY( "interval" ), LFUNCVAL( tmr_obj_interval ) },
+	{ LSTRKEY( "state" ), LFUNCVAL( tmr_obj_state ) },
+	{ LSTRKEY( "__gc" ), LFUNCVAL( tmr_obj_delete ) },
+#if LUA_OPTIMIZE_MEMORY > 0
+	{ LSTRKEY( "__index" ), LROVAL( tmr_obj_map ) },
+#endif
+	{ LNILKEY, LNILVAL }
+};
+
 const LUA_REG_TYPE tmr_map[] = {
 	{ LSTRKEY( "delay" ), LFUNCVAL( tmr_delay ) },
+	{ LSTRKEY( "sleep" ), LFUNCVAL( tmr_sleep ) },
 	{ LSTRKEY( "now" ), LFUNCVAL( tmr_now ) },
 	{ LSTRKEY( "wdclr" ), LFUNCVAL( tmr_wdclr ) },
 	{ LSTRKEY( "softwd" ), LFUNCVAL( tmr_softwd ) },
@@ -323,6 +623,8 @@ const LUA_REG_TYPE tmr_map[] = {
 	{ LSTRKEY( "unregister" ), LFUNCVAL ( tmr_unregister ) },
 	{ LSTRKEY( "state" ), LFUNCVAL ( tmr_state ) },
 	{ LSTRKEY( "interval" ), LFUNCVAL ( tmr_interval) }, 
+	{ LSTRKEY( "create" ), LFUNCVAL ( tmr_create ) },
+	{ LSTRKEY( "wheelstats" ), LFUNCVAL ( tmr_wheelstats ) },
 #if LUA_OPTIMIZE_MEMORY > 0
 	{ LSTRKEY( "ALARM_SINGLE" ), LNUMVAL( TIMER_MODE_SINGLE ) },
 	{ LSTRKEY( "ALARM_SEMI" ), LNUMVAL( TIMER_MODE_SEMI ) },
@@ -342,10 +644,19 @@ LUALIB_API int luaopen_tmr( lua_State *L ){
 	ets_timer_disarm(&rtc_timer);
 	ets_timer_setfn(&rtc_timer, rtc_callback, NULL);
 	ets_timer_arm_new(&rtc_timer, 1000, 1, 1);
+	tw_init(&tmr_wheel);
 
 #if LUA_OPTIMIZE_MEMORY > 0
+	luaL_rometatable(L, TMR_OBJ_MT, (void *)tmr_obj_map);
 	return 0;
 #else
+	luaL_newmetatable(L, TMR_OBJ_MT);
+	lua_pushliteral(L, "__index");
+	lua_pushvalue(L, -2);
+	lua_rawset(L, -3);
+	luaL_register(L, NULL, tmr_obj_map);
+	lua_pop(L, 1);
+
 	luaL_register( L, AUXLIB_TMR, tmr_map );
 	lua_pushvalue( L, -1 );
 	lua_setmetatable( L, -2 );
@@ -0,0 +1,166 @@
+// Prioritized event queue between SDK callbacks and the Lua VM
+//
+// Callbacks, including interrupt handlers, post small (handler, key, value)
+// events instead of calling into Lua. The Lua task drains one event per
+// invocation, highest priority first, so a slow handler delays other
+// events by at most its own run time and the SDK gets to run in between.
+// An event posted while an identical (handler, key) one is still pending
+// is coalesced into it: the value is replaced and the count incremented.
+
+#include "platform.h"
+#include "c_string.h"
+#include "user_interface.h"
+#include "ets_sys.h"
+
+// Each ring has room for every (handler, key) pair posted at its priority,
+// so with coalescing a post can't find it full: one key per GPIO pin plus
+// gpio.capture and gpio.serout at HIGH, the tmr alarms plus the timer
+// wheel at MEDIUM.
+#define EVENT_QUEUE_LEN_HIGH    ( NUM_GPIO + 2 )
+#define EVENT_QUEUE_LEN_MEDIUM  ( NUM_TMR + 1 )
+#define EVENT_QUEUE_LEN_LOW     8
+#define EVENT_QUEUE_LEN_MAX     EVENT_QUEUE_LEN_HIGH
+
+static const uint8_t event_queue_len[PLATFORM_EVENT_PRIO_NUM] =
+{
+  EVENT_QUEUE_LEN_HIGH, EVENT_QUEUE_LEN_MEDIUM, EVENT_QUEUE_LEN_LOW
+};
+
+typedef struct
+{
+  platform_event_handler_t handler;
+  uint16_t key;
+  uint16_t value;
+  uint16_t count;
+  uint32_t posted;          // system_get_time() of the first post
+} event_t;
+
+typedef struct
+{
+  event_t ev[EVENT_QUEUE_LEN_MAX];
+  uint8_t head;
+  uint8_t len;
+} event_ring_t;
+
+static event_ring_t event_rings[PLATFORM_EVENT_PRIO_NUM];
+static platform_event_stats_t event_stats[PLATFORM_EVENT_PRIO_NUM];
+static uint8_t event_task_prio;
+static uint32_t event_task_sig;
+static volatile bool event_task_posted = false;
+
+void platform_event_init( uint8_t task_prio, uint32_t task_sig )
+{
+  c_memset( event_rings, 0, sizeof( event_rings ) );
+  c_memset( event_stats, 0, sizeof( event_stats ) );
+  event_task_prio = task_prio;
+  event_task_sig = task_sig;
+}
+
+// Must be called with interrupts locked. If the SDK queue is full the
+// flag stays clear, so that the next post or dispatch tries again.
+static void ICACHE_RAM_ATTR event_kick( void )
+{
+  if ( !event_task_posted )
+    event_task_posted = system_os_post( event_task_prio, event_task_sig, 0 );
+}
+
+int ICACHE_RAM_ATTR platform_event_post( unsigned prio, platform_event_handler_t handler, uint16_t key, uint16_t value )
+{
+  event_ring_t *ring;
+  platform_event_stats_t *stats;
+  event_t *ev;
+  uint8_t i, size;
+  int res = PLATFORM_OK;
+
+  if ( prio >= PLATFORM_EVENT_PRIO_NUM )
+    return PLATFORM_ERR;
+  ring = &event_rings[prio];
+  stats = &event_stats[prio];
+  size = event_queue_len[prio];
+
+  ETS_INTR_LOCK();
+  stats->posted++;
+  for ( i = 0; i < ring->len; i++ )
+  {
+    ev = &ring->ev[( ring->head + i ) % size];
+    if ( ev->handler == handler && ev->key == key )
+    {
+      ev->value = value;
+      if ( ev->count < 0xffff )
+        ev->count++;
+      stats->coalesced++;
+      goto out;
+    }
+  }
+  if ( ring->len == size )
+  {
+    stats->overflow++;
+    res = PLATFORM_ERR;
+    goto out;
+  }
+  ev = &ring->ev[( ring->head + ring->len ) % size];
+  ev->handler = handler;
+  ev->key = key;
+  ev->value = value;
+  ev->count = 1;
+  ev->posted = system_get_time();
+  ring->len++;
+out:
+  event_kick();
+  ETS_INTR_UNLOCK();
+  return res;
+}
+
+void platform_event_dispatch( void )
+{
+  event_t ev;
+  platform_event_stats_t *stats;
+  uint32_t latency;
+  unsigned prio, i;
+
+  ETS_INTR_LOCK();
+  event_task_posted = false;
+  for ( prio = 0; prio < PLATFORM_EVENT_PRIO_NUM; prio++ )
+    if ( event_rings[prio].len )
+      break;
+  if ( prio == PLATFORM_EVENT_PRIO_NUM )
+  {
+    ETS_INTR_UNLOCK();
+    return;
+  }
+  ev = event_rings[prio].ev[event_rings[prio].head];
+  event_rings[prio].head = ( event_rings[prio].head + 1 ) % event_queue_len[prio];
+  event_rings[prio].len--;
+  for ( i = prio; i < PLATFORM_EVENT_PRIO_NUM; i++ )
+    if ( event_rings[i].len )
+    {
+      event_kick();     // come back for the rest after the SDK had its turn
+      break;
+    }
+  ETS_INTR_UNLOCK();
+
+  stats = &event_stats[prio];
+  latency = system_get_time() - ev.posted;
+  stats->delivered++;
+  stats->latency_total += latency;
+  if ( latency > stats->latency_max )
+    stats->latency_max = latency;
+
+  ev.handler( ev.key, ev.value, ev.count );
+}
+
+void platform_event_get_stats( unsigned prio, platform_event_stats_t *stats )
+{
+  if ( prio >= PLATFORM_EVENT_PRIO_NUM )
+    return;
+  ETS_INTR_LOCK();
+  *stats = event_stats[prio];
+  ETS_INTR_UNLOCK();
+}
+
+void platform_event_reset_stats( void )
+{
+  ETS_INTR_LOCK();
+  c_memset( event_stats, 0, sizeof( event_stats ) );
+  ETS_INTR_UNLOCK();
+}
@@ -0,0 +1,98 @@
+// GPIO edge capture ring, see gpio_capture.h
+
+#include "gpio_capture.h"
+#include "c_string.h"
+#include "user_config.h"
+
+#define MASK ( GPIO_CAPTURE_LEN - 1 )
+// Keeps the compiler from moving slot accesses across the index update that
+// hands the slot to the other side. The interrupt cannot be interrupted by
+// the consumer, so on one core nothing more is needed.
+#define BARRIER() __asm__ __volatile__( "" ::: "memory" )
+
+void gpio_capture_init( gpio_capture_t *c )
+{
+  c_memset( c, 0, sizeof( *c ) );
+}
+
+void gpio_capture_pin( gpio_capture_t *c, unsigned pin, uint8_t flags, uint32_t debounce_us, uint8_t level )
+{
+  gpio_capture_pin_t *p;
+
+  if ( pin >= GPIO_CAPTURE_PINS )
+    return;
+  p = &c->pin[pin];
+  p->flags = flags;
+  p->debounce_us = debounce_us;
+  p->level = level;
+  p->primed = 0;
+}
+
+int ICACHE_RAM_ATTR gpio_capture_edge( gpio_capture_t *c, unsigned pin, uint8_t level, uint32_t us )
+{
+  gpio_capture_pin_t *p;
+  uint32_t head = c->head;
+
+  if ( pin >= GPIO_CAPTURE_PINS )
+    return 0;
+  p = &c->pin[pin];
+
+  if ( ( p->flags & GPIO_CAPTURE_BOTH ) && level == p->level )
+  {
+    p->filtered++;
+    return 0;
+  }
+  if ( p->primed && us - p->last_us < p->debounce_us )
+  {
+    p->filtered++;
+    return 0;
+  }
+  // the filter goes by what happened on the pin, kept or not
+  p->level = level;
+  p->last_us = us;
+  p->primed = 1;
+
+  if ( head - c->tail >= GPIO_CAPTURE_LEN )
+  {
+    p->lost++;
+    return -1;
+  }
+  c->ev[head & MASK].us = us;
+  c->ev[head & MASK].pin = pin;
+  c->ev[head & MASK].level = level;
+  BARRIER();
+  c->head = head + 1;     // publish only once the slot is written
+  return 1;
+}
+
+unsigned gpio_capture_read( gpio_capture_t *c, gpio_edge_t *out, unsigned max )
+{
+  uint32_t tail = c->tail, head = c->head;
+  unsigned n = 0;
+
+  BARRIER();
+  while ( tail != head && n < max )
+    out[n++] = c->ev[tail++ & MASK];
+  BARRIER();
+  c->tail = tail;         // frees the slots only once they are copied
+  return n;
+}
+
+unsigned gpio_capture_pending( const gpio_capture_t *c )
+{
+  return c->head - c->tail;
+}
+
+uint32_t gpio_capture_lost( gpio_capture_t *c, unsigned pin )
+{
+  gpio_capture_pin_t *p;
+  uint32_t lost, n;
+
+  if ( pin >= GPIO_CAPTURE_PINS )
+    return 0;
+  p = &c->pin[pin];
+  lost = p->lost;         // a single read, the interrupt may bump it meanwhile
+  n = lost - p->lost_seen;
+  p->lost_seen = lost;
+  return n;
+}
@@ -0,0 +1,64 @@
+// GPIO edge capture ring
+//
+// The GPIO interrupt records each edge as (pin, level, us) into a ring that
+// the Lua task drains in batches, instead of posting one event per edge.
+// There is one producer (the interrupt) and one consumer (the Lua task):
+// the producer only writes head and the per-pin producer counters, the
+// consumer only writes tail and the *_seen counters, so neither side needs
+// to lock out the other. Indices run freely and are masked on access.
+//
+// Per pin, an edge is dropped before it reaches the ring when it comes less
+// than debounce_us after the last edge kept, or, for pins captured on both
+// edges, when it reports the level already recorded: the pulse in between
+// was over before the interrupt could sample it.
+// The ring has no platform dependencies; the caller supplies the time.
+
+#ifndef __GPIO_CAPTURE_H__
+#define __GPIO_CAPTURE_H__
+
+#include "c_types.h"
+
+#define GPIO_CAPTURE_LEN  64    // edges, a power of two
+#define GPIO_CAPTURE_PINS 16
+
+#define GPIO_CAPTURE_BOTH 0x01  // expect alternating levels
+
+typedef struct
+{
+  uint32_t us;
+  uint8_t pin;
+  uint8_t level;
+} gpio_edge_t;
+
+typedef struct
+{
+  uint32_t debounce_us;
+  uint32_t last_us;     // time of the last edge kept
+  uint8_t flags;
+  uint8_t level;        // level of the last edge kept
+  uint8_t primed;       // last_us and level are valid
+  uint32_t lost;        // edges that found the ring full
+  uint32_t filtered;    // edges dropped by the filter
+  uint32_t lost_seen;   // consumer's copy of lost
+} gpio_capture_pin_t;
+
+typedef struct
+{
+  gpio_edge_t ev[GPIO_CAPTURE_LEN];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  gpio_capture_pin_t pin[GPIO_CAPTURE_PINS];
+} gpio_capture_t;
+
+void gpio_capture_init( gpio_capture_t *c );
+// (Re)start the filter of pin; level is the pin's current level
+void gpio_capture_pin( gpio_capture_t *c, unsigned pin, uint8_t flags, uint32_t debounce_us, uint8_t level );
+// Producer: returns 1 if the edge was recorded, 0 if filtered, -1 if lost
+int gpio_capture_edge( gpio_capture_t *c, unsigned pin, uint8_t level, uint32_t us );
+// Consumer: moves up to max edges, oldest first, to out
+unsigned gpio_capture_read( gpio_capture_t *c, gpio_edge_t *out, unsigned max );
+unsigned gpio_capture_pending( const gpio_capture_t *c );
+// Consumer: edges of pin lost to a full ring since the last call
+uint32_t gpio_capture_lost( gpio_capture_t *c, unsigned pin );
+
+#endif // #ifndef __GPIO_CAPTURE_H__
@@ -7,14 +7,17 @@
 #include "gpio.h"
 #include "user_interface.h"
 #include "driver/uart.h"
+#include "gpio_capture.h"
 // Platform specific includes
 
 static void pwms_init();
+static void gpio_bits_init();
 
 int platform_init()
 {
   // Setup PWMs
   pwms_init();
+  gpio_bits_init();
 
   cmn_platform_init();
   // All done
@@ -37,6 +40,9 @@ uint8_t platform_key_led( uint8_t level){
 // GPIO functions
 #ifdef GPIO_INTERRUPT_ENABLE
 extern void lua_gpio_unref(unsigned pin);
+static gpio_capture_t gpio_capture;
+static uint16_t gpio_capture_mask = 0;
+static platform_gpio_capture_fn_t gpio_capture_cb = NULL;
 #endif
 int platform_gpio_mode( unsigned pin, unsigned mode, unsigned pull )
 {
@@ -82,6 +88,7 @@ int platform_gpio_mode( unsigned pin, unsigned mode, unsigned pull )
       ETS_GPIO_INTR_DISABLE();
 #ifdef GPIO_INTERRUPT_ENABLE
       pin_int_type[pin] = GPIO_PIN_INTR_DISABLE;
+      gpio_capture_mask &= ~BIT(pin);
 #endif
       PIN_FUNC_SELECT(pin_mux[pin], pin_func[pin]);
       //disable interrupt
@@ -137,10 +144,70 @@ int platform_gpio_read( unsigned pin )
   return 0x1 & GPIO_INPUT_GET(GPIO_ID_PIN(pin_num[pin]));
 }
 
+// GPIO register bits for every combination of four pins and back, from
+// pin_num[]: a whole mask converts with four lookups
+static uint16_t gpio_pins_to_bits[4][16];
+static uint16_t gpio_bits_to_pins[4][16];
+
+static void gpio_bits_init()
+{
+  unsigned pin, g, m, b;
+
+  for( g = 0; g < 4; g++ )
+    for( m = 0; m < 16; m++ )
+      for( b = 0; b < 4; b++ )
+      {
+        if( !( m & BIT( b ) ) )
+          continue;
+        for( pin = 1; pin < NUM_GPIO; pin++ )
+        {
+          if( pin == 4 * g + b )
+            gpio_pins_to_bits[g][m] |= BIT( pin_num[pin] );
+          if( pin_num[pin] == 4 * g + b )
+            gpio_bits_to_pins[g][m] |= BIT( pin );
+        }
+      }
+}
+
+static inline uint32_t gpio_bits_convert( uint16_t (*t)[16], uint32_t m )
+{
+  return t[0][m & 15] | t[1][( m >> 4 ) & 15] | t[2][( m >> 8 ) & 15] | t[3][( m >> 12 ) & 15];
+}
+
+int platform_gpio_write_many( uint32_t set, uint32_t clear )
+{
+  if( ( set | clear ) >> NUM_GPIO )
+    return -1;
+
+  uint32_t s = gpio_bits_convert( gpio_pins_to_bits, set );
+  uint32_t c = gpio_bits_convert( gpio_pins_to_bits, clear );
+  os_intr_lock();
+  GPIO_REG_WRITE( GPIO_OUT_W1TC_ADDRESS, c );
+  GPIO_REG_WRITE( GPIO_OUT_W1TS_ADDRESS, s );
+  GPIO_REG_WRITE( GPIO_ENABLE_W1TS_ADDRESS, s | c );   // drive them, as GPIO_OUTPUT_SET does
+  os_intr_unlock();
+
+  if( ( set | clear ) & 1 ){
+    gpio16_output_conf();
+    gpio16_output_set( set & 1 );
+  }
+  return 1;
+}
+
+uint32_t platform_gpio_read_many( uint32_t pins )
+{
+  uint32_t in = gpio_bits_convert( gpio_bits_to_pins, GPIO_REG_READ( GPIO_IN_ADDRESS ) );
+
+  if( pins & 1 )
+    in |= 0x1 & gpio16_input_get();
+  return in & pins;
+}
+
 #ifdef GPIO_INTERRUPT_ENABLE
 static void platform_gpio_intr_dispatcher( platform_gpio_intr_handler_fn_t cb){
-  uint8 i, level;
+  uint8 i, level, captured = 0;
   uint32 gpio_status = GPIO_REG_READ(GPIO_STATUS_ADDRESS);
+  uint32 now = gpio_capture_mask ? system_get_time() : 0;
   for (i = 0; i < GPIO_PIN_NUM; i++) {
     if (pin_int_type[i] && (gpio_status & BIT(pin_num[i])) ) {
       //disable interrupt
@@ -148,16 +215,26 @@ static void platform_gpio_intr_dispatcher( platform_gpio_intr_handler_fn_t cb){
       //clear interrupt status
       GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, gpio_status & BIT(pin_num[i]));
       level = 0x1 & GPIO_INPUT_GET(GPIO_ID_PIN(pin_num[i]));
-      if(cb){
+      if(gpio_capture_mask & BIT(i)){
+        if(gpio_capture_edge(&gpio_capture, i, level, now))
+          captured = 1;   // recorded or lost, either way Lua hears of it
+      } else if(cb){
         cb(i, level);
       }
-      gpio_pin_intr_state_set(GPIO_ID_PIN(pin_num[i]), pin_int_type[i]);
+      // a level trigger would fire again at once while the level holds, so
+      // it stays off until platform_gpio_intr_rearm() once Lua has run
+      if(pin_int_type[i] != GPIO_PIN_INTR_LOLEVEL && pin_int_type[i] != GPIO_PIN_INTR_HILEVEL)
+        gpio_pin_intr_state_set(GPIO_ID_PIN(pin_num[i]), pin_int_type[i]);
     }
   }
+  if(captured && gpio_capture_cb)
+    gpio_capture_cb();
 }
 
-void platform_gpio_init( platform_gpio_intr_handler_fn_t cb )
+void platform_gpio_init( platform_gpio_intr_handler_fn_t cb, platform_gpio_capture_fn_t capture_cb )
 {
+  gpio_capture_init(&gpio_capture);
+  gpio_capture_cb = capture_cb;
   ETS_GPIO_INTR_ATTACH(platform_gpio_intr_dispatcher, cb);
 }
 
@@ -169,10 +246,49 @@ int platform_gpio_intr_init( unsigned pin, GPIO_INT_TYPE type )
   //clear interrupt status
   GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, BIT(pin_num[pin]));
   pin_int_type[pin] = type;
+  gpio_capture_mask &= ~BIT(pin);
   //enable interrupt
   gpio_pin_intr_state_set(GPIO_ID_PIN(pin_num[pin]), type);
   ETS_GPIO_INTR_ENABLE();
 }
+
+int platform_gpio_intr_rearm( unsigned pin )
+{
+  if (pin >= NUM_GPIO)
+    return -1;
+  ETS_GPIO_INTR_DISABLE();
+  gpio_pin_intr_state_set(GPIO_ID_PIN(pin_num[pin]), pin_int_type[pin]);
+  ETS_GPIO_INTR_ENABLE();
+  return 1;
+}
+
+int platform_gpio_capture( unsigned pin, GPIO_INT_TYPE type, uint32_t debounce_us )
+{
+  if (pin >= NUM_GPIO || pin >= GPIO_CAPTURE_PINS)
+    return -1;
+  ETS_GPIO_INTR_DISABLE();
+  GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, BIT(pin_num[pin]));
+  gpio_capture_pin(&gpio_capture, pin, type == GPIO_PIN_INTR_ANYEGDE ? GPIO_CAPTURE_BOTH : 0,
+                   debounce_us, 0x1 & GPIO_INPUT_GET(GPIO_ID_PIN(pin_num[pin])));
+  pin_int_type[pin] = type;
+  if (type == GPIO_PIN_INTR_DISABLE)
+    gpio_capture_mask &= ~BIT(pin);
+  else
+    gpio_capture_mask |= BIT(pin);
+  gpio_pin_intr_state_set(GPIO_ID_PIN(pin_num[pin]), type);
+  ETS_GPIO_INTR_ENABLE();
+  return 1;
+}
+
+unsigned platform_gpio_capture_read( gpio_edge_t *out, unsigned max )
+{
+  return gpio_capture_read(&gpio_capture, out, max);
+}
+
+uint32_t platform_gpio_capture_lost( unsigned pin )
+{
+  return gpio_capture_lost(&gpio_capture, pin);
+}
 #endif
 
 // ****************************************************************************
@@ -343,6 +459,9 @@ uint32_t platform_pwm_setup( unsigned pin, uint32_t frequency, unsigned duty )
   uint32_t clock;
   if ( pin < NUM_PWM)
   {
+    if ( platform_hw_timer_claimed() )
+      return 0;
+
     platform_gpio_mode(pin, PLATFORM_GPIO_OUTPUT, PLATFORM_GPIO_FLOAT);  // disable gpio interrupt first
     if(!pwm_add(pin)) 
       return 0;
@@ -392,6 +511,71 @@ void platform_pwm_stop( unsigned pin )
   }
 }
 
+// *****************************************************************************
+// Hardware timer (FRC1), borrowed from the PWM driver
+
+#define HW_TIMER_ENABLE       BIT7
+#define HW_TIMER_AUTOLOAD     BIT6
+#define HW_TIMER_DIV_16       4
+#define HW_TIMER_EDGE_INT     0
+// FRC1 counts APB_CLK/16 = 5 ticks per us, the load register has 23 bits
+#define HW_TIMER_TICKS_PER_US ((APB_CLK_FREQ>>4)/1000000)
+#define HW_TIMER_MAX_TICKS    0x7fffff
+
+static platform_hw_timer_cb_t hw_timer_cb = NULL;
+
+static void ICACHE_RAM_ATTR hw_timer_isr( void *arg )
+{
+  RTC_CLR_REG_MASK(FRC1_INT_ADDRESS, FRC1_INT_CLR_MASK);
+  if (hw_timer_cb)
+    hw_timer_cb();
+}
+
+int platform_hw_timer_claim( platform_hw_timer_cb_t cb )
+{
+  if ( hw_timer_cb || pwm_timer_busy() )
+    return PLATFORM_ERR;
+  ETS_FRC1_INTR_DISABLE();
+  hw_timer_cb = cb;
+  RTC_REG_WRITE(FRC1_CTRL_ADDRESS, HW_TIMER_DIV_16 | HW_TIMER_ENABLE | HW_TIMER_EDGE_INT);
+  ETS_FRC_TIMER1_INTR_ATTACH(hw_timer_isr, NULL);
+  TM1_EDGE_INT_ENABLE();
+  ETS_FRC1_INTR_ENABLE();
+  return PLATFORM_OK;
+}
+
+int platform_hw_timer_claimed( void )
+{
+  return hw_timer_cb != NULL;
+}
+
+// The waveform player re-arms from the interrupt, so this must be in IRAM
+void ICACHE_RAM_ATTR platform_hw_timer_arm( uint32_t us, bool autoload )
+{
+  uint32_t ticks = us > HW_TIMER_MAX_TICKS / HW_TIMER_TICKS_PER_US ?
+                   HW_TIMER_MAX_TICKS : us * HW_TIMER_TICKS_PER_US;
+  if ( ticks == 0 )
+    ticks = 1;
+  RTC_REG_WRITE(FRC1_CTRL_ADDRESS, HW_TIMER_DIV_16 | HW_TIMER_ENABLE | HW_TIMER_EDGE_INT |
+                (autoload ? HW_TIMER_AUTOLOAD : 0));
+  RTC_REG_WRITE(FRC1_LOAD_ADDRESS, ticks);
+}
+
+void ICACHE_RAM_ATTR platform_hw_timer_disarm( void )
+{
+  RTC_REG_WRITE(FRC1_CTRL_ADDRESS, HW_TIMER_DIV_16 | HW_TIMER_EDGE_INT);
+  RTC_CLR_REG_MASK(FRC1_INT_ADDRESS, FRC1_INT_CLR_MASK);
+}
+
+void platform_hw_timer_release( void )
+{
+  if ( !hw_timer_cb )
+    return;
+  platform_hw_timer_disarm();
+  hw_timer_cb = NULL;
+  pwm_timer_attach();
+}
+
 // *****************************************************************************
 // I2C platform interface
 
@@ -534,3 +718,109 @@ int platform_flash_erase_sector( uint32_t sector_id )
   WRITE_PERI_REG(0x60000914, 0x73);
   return flash_erase( sector_id ) == SPI_FLASH_RESULT_OK ? PLATFORM_OK : PLATFORM_ERR;
 }
+
+// *****************************************************************************
+// GPIO waveform player, on the hardware timer
+
+static struct
+{
+  const uint8_t *delays;
+  uint32_t count;
+  uint32_t index;
+  uint32_t repeats;
+  uint32_t mask;        // the pin's bit in the GPIO_OUT registers
+  uint8_t width;        // bytes per delay, 2 or 4
+  uint8_t level;
+  volatile uint8_t busy;
+  volatile uint8_t done_pending;  // done() failed, retried from the timer
+  platform_gpio_serout_done_fn_t done;
+} serout;
+
+static inline uint32_t ICACHE_RAM_ATTR serout_delay( uint32_t i )
+{
+  const uint8_t *d = serout.delays + i * serout.width;
+  if ( serout.width == 2 )
+    return d[0] | ( d[1] << 8 );
+  return *( const uint32_t * )d;
+}
+
+static inline void ICACHE_RAM_ATTR serout_write( uint8_t level )
+{
+  GPIO_REG_WRITE( level ? GPIO_OUT_W1TS_ADDRESS : GPIO_OUT_W1TC_ADDRESS, serout.mask );
+}
+
+// The delay that just ran out ends here: toggle and start the next one, or
+// leave the pin at its last level when the table has been played repeats
+// times.
+#define SEROUT_DONE_RETRY_US 1000
+
+static void ICACHE_RAM_ATTR serout_tick( void )
+{
+  if ( serout.done_pending )
+  {
+    if ( serout.done() == PLATFORM_OK )
+      serout.done_pending = 0;
+    else
+      platform_hw_timer_arm( SEROUT_DONE_RETRY_US, false );
+    return;
+  }
+  if ( !serout.busy )
+    return;
+  if ( ++serout.index == serout.count )
+  {
+    serout.index = 0;
+    if ( --serout.repeats == 0 )
+    {
+      platform_hw_timer_disarm();
+      serout.busy = 0;
+      if ( serout.done && serout.done() != PLATFORM_OK )
+      {
+        serout.done_pending = 1;
+        platform_hw_timer_arm( SEROUT_DONE_RETRY_US, false );
+      }
+      return;
+    }
+  }
+  serout.level = !serout.level;
+  serout_write( serout.level );
+  platform_hw_timer_arm( serout_delay( serout.index ), false );
+}
+
+int platform_gpio_serout_start( unsigned pin, unsigned level, const void *delays, unsigned width,
+                                uint32_t count, uint32_t repeats, platform_gpio_serout_done_fn_t done )
+{
+  if ( pin == 0 || pin >= NUM_GPIO || count == 0 || ( width != 2 && width != 4 ) )
+    return PLATFORM_ERR;
+  if ( serout.busy || platform_hw_timer_claim( serout_tick ) != PLATFORM_OK )
+    return PLATFORM_ERR;
+  serout.delays = ( const uint8_t * )delays;
+  serout.width = width;
+  serout.count = count;
+  serout.index = 0;
+  serout.repeats = repeats ? repeats : 1;
+  serout.mask = BIT( pin_num[pin] );
+  serout.level = level;
+  serout.done = done;
+  serout.done_pending = 0;
+  serout.busy = 1;
+  serout_write( level );
+  platform_hw_timer_arm( serout_delay( 0 ), false );
+  return PLATFORM_OK;
+}
+
+int platform_gpio_serout_busy( void )
+{
+  return serout.busy;
+}
+
+void platform_gpio_serout_stop( void )
+{
+  if ( !platform_hw_timer_claimed() || !serout.delays )
+    return;
+  ETS_FRC1_INTR_DISABLE();
+  serout.busy = 0;
+  serout.done_pending = 0;
+  ETS_FRC1_INTR_ENABLE();
+  platform_hw_timer_release();
+  serout.delays = NULL;
+}
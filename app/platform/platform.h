@@ -7,6 +7,7 @@
 
 #include "c_types.h"
 #include "driver/pwm.h"
+#include "gpio_capture.h"
 // Error / status codes
 enum
 {
@@ -38,18 +39,99 @@ uint8_t platform_key_led( uint8_t level);
 
 /* GPIO interrupt handler */
 typedef void (* platform_gpio_intr_handler_fn_t)( unsigned pin, unsigned level );
+/* Called from the interrupt once edges were captured (or lost) */
+typedef void (* platform_gpio_capture_fn_t)( void );
 
 int platform_gpio_mode( unsigned pin, unsigned mode, unsigned pull );
 int platform_gpio_write( unsigned pin, unsigned level );
 int platform_gpio_read( unsigned pin );
-void platform_gpio_init( platform_gpio_intr_handler_fn_t cb );
+// Several pins at once, as masks of pin numbers (bit n is pin n). Pins 1 and
+// up change together, with one write to GPIO_OUT_W1TC and then one to
+// GPIO_OUT_W1TS, so a pin in both masks ends high; pin 0 (GPIO16) is not
+// in that register and follows right after. Like platform_gpio_write(),
+// this turns the output drivers of the pins on.
+int platform_gpio_write_many( uint32_t set, uint32_t clear );
+uint32_t platform_gpio_read_many( uint32_t pins );
+void platform_gpio_init( platform_gpio_intr_handler_fn_t cb, platform_gpio_capture_fn_t capture_cb );
 int platform_gpio_intr_init( unsigned pin, GPIO_INT_TYPE type );
+// Arms pin's trigger again; level triggers are left off by the interrupt
+int platform_gpio_intr_rearm( unsigned pin );
+// Edges of a captured pin go to a timestamped ring (gpio_capture.h) instead
+// of the interrupt handler; GPIO_PIN_INTR_DISABLE stops the capture.
+int platform_gpio_capture( unsigned pin, GPIO_INT_TYPE type, uint32_t debounce_us );
+unsigned platform_gpio_capture_read( gpio_edge_t *out, unsigned max );
+uint32_t platform_gpio_capture_lost( unsigned pin );
 // *****************************************************************************
 // Timer subsection
 
 // Timer data type
 typedef uint32_t timer_data_type;
 
+// *****************************************************************************
+// Hardware timer subsection
+
+// The FRC1 hardware timer is shared with the PWM driver. A claim fails while
+// PWM channels are active, and PWM setup fails while the timer is claimed.
+// The callback runs in interrupt context and must live in IRAM.
+typedef void (* platform_hw_timer_cb_t)( void );
+
+int platform_hw_timer_claim( platform_hw_timer_cb_t cb );
+void platform_hw_timer_arm( uint32_t us, bool autoload );
+void platform_hw_timer_disarm( void );
+void platform_hw_timer_release( void );
+int platform_hw_timer_claimed( void );
+
+// *****************************************************************************
+// GPIO waveform player
+
+// Plays a waveform on pin from the hardware timer interrupt: the pin is set
+// to level and toggled as each of the count delays (us, little endian
+// entries of width 2 or 4 bytes) runs out, the table played repeats times
+// over. done runs in interrupt context after the last delay; if it does
+// not return PLATFORM_OK it is called again a millisecond later, so the
+// end of the waveform can't get lost. delays must stay valid until
+// platform_gpio_serout_stop(), which releases the timer and also cuts a
+// running waveform short. Not for pin 0 (GPIO16).
+typedef int (* platform_gpio_serout_done_fn_t)( void );
+
+int platform_gpio_serout_start( unsigned pin, unsigned level, const void *delays, unsigned width,
+                                uint32_t count, uint32_t repeats, platform_gpio_serout_done_fn_t done );
+int platform_gpio_serout_busy( void );
+void platform_gpio_serout_stop( void );
+
+// *****************************************************************************
+// Event queue subsection
+
+// SDK callbacks post events here instead of calling into Lua directly; the
+// Lua task drains them in priority order (PLATFORM_EVENT_PRIO_HIGH first).
+// Posting is interrupt safe. A post matching a pending (handler, key) event
+// is coalesced into it: value is replaced and count incremented.
+enum
+{
+  PLATFORM_EVENT_PRIO_HIGH,     // GPIO interrupts
+  PLATFORM_EVENT_PRIO_MEDIUM,   // timers
+  PLATFORM_EVENT_PRIO_LOW,
+  PLATFORM_EVENT_PRIO_NUM
+};
+
+typedef void (* platform_event_handler_t)( uint16_t key, uint16_t value, uint16_t count );
+
+typedef struct
+{
+  uint32_t posted;
+  uint32_t delivered;
+  uint32_t coalesced;
+  uint32_t overflow;
+  uint32_t latency_max;     // us from first post to dispatch
+  uint32_t latency_total;
+} platform_event_stats_t;
+
+void platform_event_init( uint8_t task_prio, uint32_t task_sig );
+int platform_event_post( unsigned prio, platform_event_handler_t handler, uint16_t key, uint16_t value );
+void platform_event_dispatch( void );
+void platform_event_get_stats( unsigned prio, platform_event_stats_t *stats );
+void platform_event_reset_stats( void );
+
 // *****************************************************************************
 // CAN subsection
 
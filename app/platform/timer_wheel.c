@@ -0,0 +1,93 @@
+// Hashed timer wheel, see timer_wheel.h
+
+#include "timer_wheel.h"
+
+static void list_init( tw_node_t *head )
+{
+  head->next = head->prev = head;
+}
+
+static void list_append( tw_node_t *head, tw_node_t *n )
+{
+  n->prev = head->prev;
+  n->next = head;
+  head->prev->next = n;
+  head->prev = n;
+}
+
+static void list_unlink( tw_node_t *n )
+{
+  n->prev->next = n->next;
+  n->next->prev = n->prev;
+  n->next = n->prev = NULL;
+}
+
+void tw_init( timer_wheel_t *w )
+{
+  unsigned i;
+  for ( i = 0; i < TW_SLOTS; i++ )
+    list_init( &w->slots[i] );
+  list_init( &w->expired );
+  w->now = 0;
+  w->count = 0;
+}
+
+void tw_node_init( tw_node_t *n )
+{
+  n->next = n->prev = NULL;
+  n->rounds = 0;
+}
+
+int tw_active( const tw_node_t *n )
+{
+  return n->next != NULL;
+}
+
+void tw_add( timer_wheel_t *w, tw_node_t *n, uint32_t ticks )
+{
+  if ( ticks == 0 )
+    ticks = 1;
+  n->rounds = ( ticks - 1 ) / TW_SLOTS;
+  list_append( &w->slots[( w->now + ticks ) % TW_SLOTS], n );
+  w->count++;
+}
+
+void tw_remove( timer_wheel_t *w, tw_node_t *n )
+{
+  if ( !tw_active( n ) )
+    return;
+  list_unlink( n );
+  w->count--;
+}
+
+uint32_t tw_advance( timer_wheel_t *w )
+{
+  tw_node_t *head, *n, *next;
+  uint32_t expired = 0;
+
+  w->now++;
+  head = &w->slots[w->now % TW_SLOTS];
+  for ( n = head->next; n != head; n = next )
+  {
+    next = n->next;
+    if ( n->rounds )
+    {
+      n->rounds--;
+      continue;
+    }
+    list_unlink( n );
+    list_append( &w->expired, n );
+    expired++;
+  }
+  return expired;
+}
+
+tw_node_t *tw_take_expired( timer_wheel_t *w )
+{
+  tw_node_t *n = w->expired.next;
+  if ( n == &w->expired )
+    return NULL;
+  list_unlink( n );
+  w->count--;
+  return n;
+}
@@ -0,0 +1,44 @@
+// Hashed timer wheel
+//
+// Timers are kept in TW_SLOTS circular slots indexed by expiry tick, each a
+// doubly linked list, so adding and cancelling a timer is O(1) and a tick
+// only visits the timers hashed to the current slot. Expired timers are
+// moved to a separate list and handed out one at a time, so a callback may
+// cancel or re-add any timer, including ones that expired in the same tick.
+// The wheel has no platform dependencies; the caller drives tw_advance().
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include "c_types.h"
+
+#define TW_SLOTS 64
+
+typedef struct tw_node
+{
+  struct tw_node *next;
+  struct tw_node *prev;
+  uint32_t rounds;      // full wheel turns left before expiry
+} tw_node_t;
+
+typedef struct
+{
+  tw_node_t slots[TW_SLOTS];  // list heads
+  tw_node_t expired;          // list head of timers due but not yet taken
+  uint32_t now;               // current tick
+  uint32_t count;             // timers in the wheel, including expired ones
+} timer_wheel_t;
+
+void tw_init( timer_wheel_t *w );
+void tw_node_init( tw_node_t *n );
+// Expire n after ticks (>= 1) calls to tw_advance(); n must not be active
+void tw_add( timer_wheel_t *w, tw_node_t *n, uint32_t ticks );
+// Cancel n if active
+void tw_remove( timer_wheel_t *w, tw_node_t *n );
+int tw_active( const tw_node_t *n );
+// Advance one tick, returns the number of timers that expired
+uint32_t tw_advance( timer_wheel_t *w );
+// Take the next expired timer, NULL when there are none left
+tw_node_t *tw_take_expired( timer_wheel_t *w );
+
+#endif // #ifndef __TIMER_WHEEL_H__
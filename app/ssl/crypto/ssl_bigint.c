@@ -36,6 +36,9 @@
  * This code tries to minimise use of malloc/free by maintaining a small 
  * cache. A bigint context may maintain state by being made "permanent". 
  * It be be later released with a bi_depermanent() and bi_free() call.
+ * The first bi_mod_power() on a context also reserves an arena of bigints
+ * big enough for its modulus, so exponentiations recycle those instead of
+ * calling malloc for each temporary.
  *
  * It supports the following reduction techniques:
  * - Classical
@@ -80,6 +83,7 @@ static bigint *bi_int_divide(BI_CTX *ctx, bigint *biR, comp denom);
 static bigint *alloc(BI_CTX *ctx, int size);
 static bigint *trim(bigint *bi);
 static void more_comps(bigint *bi, int n);
+static void bi_reserve(BI_CTX *ctx, int count, int size);
 #if defined(CONFIG_BIGINT_KARATSUBA) || defined(CONFIG_BIGINT_BARRETT) || \
     defined(CONFIG_BIGINT_MONTGOMERY)
 static bigint *comp_right_shift(bigint *biR, int num_shifts);
@@ -132,15 +136,20 @@ void ICACHE_FLASH_ATTR bi_terminate(BI_CTX *ctx)
     }
 
     bi_clear_cache(ctx);
+    os_free(ctx->arena);
     os_free(ctx);
 }
 
 /**
  *@brief Clear the memory cache.
+ *
+ * Arena slots stay on the free list; any heap storage they grew into is
+ * released and they go back to their own components.
  */
 void ICACHE_FLASH_ATTR bi_clear_cache(BI_CTX *ctx)
 {
-    bigint *p, *pn;
+    bigint *p, *pn, *keep = NULL;
+    int kept = 0;
 
     if (ctx->free_list == NULL)
         return;
@@ -148,12 +157,29 @@ void ICACHE_FLASH_ATTR bi_clear_cache(BI_CTX *ctx)
     for (p = ctx->free_list; p != NULL; p = pn)
     {
         pn = p->next;
-        os_free(p->comps);
-        os_free(p);
+
+        if (!(p->arena & BI_ARENA_COMPS))
+        {
+            os_free(p->comps);
+        }
+
+        if (p->arena & BI_ARENA_HDR)
+        {
+            p->comps = &ctx->arena_comps[(p - ctx->arena)*ctx->arena_slot];
+            p->max_comps = ctx->arena_slot;
+            p->arena |= BI_ARENA_COMPS;
+            p->next = keep;
+            keep = p;
+            kept++;
+        }
+        else
+        {
+            os_free(p);
+        }
     }
 
-    ctx->free_count = 0;
-    ctx->free_list = NULL;
+    ctx->free_count = kept;
+    ctx->free_list = keep;
 }
 
 /**
@@ -1071,7 +1097,19 @@ static void ICACHE_FLASH_ATTR more_comps(bigint *bi, int n)
     if (n > bi->max_comps)
     {
         bi->max_comps = max(bi->max_comps * 2, n);
-        bi->comps = (comp*)os_realloc(bi->comps, bi->max_comps * COMP_BYTE_SIZE);
+
+        if (bi->arena & BI_ARENA_COMPS)     /* outgrown its arena slot */
+        {
+            comp *c = (comp*)os_malloc(bi->max_comps * COMP_BYTE_SIZE);
+            os_memcpy(c, bi->comps, bi->size*COMP_BYTE_SIZE);
+            bi->comps = c;
+            bi->arena &= ~BI_ARENA_COMPS;
+        }
+        else
+        {
+            bi->comps = (comp*)os_realloc(bi->comps, 
+                    bi->max_comps * COMP_BYTE_SIZE);
+        }
     }
 
     if (n > bi->size)
@@ -1113,6 +1151,7 @@ static bigint * ICACHE_FLASH_ATTR alloc(BI_CTX *ctx, int size)
         biR = (bigint *)os_malloc(sizeof(bigint));
         biR->comps = (comp*)os_malloc(size * COMP_BYTE_SIZE);
         biR->max_comps = size;  /* give some space to spare */
+        biR->arena = 0;
     }
 
     biR->size = size;
@@ -1122,6 +1161,39 @@ static bigint * ICACHE_FLASH_ATTR alloc(BI_CTX *ctx, int size)
     return biR;
 }
 
+/*
+ * Put count bigints of size components each on the free list, carved out of
+ * a single allocation, so that an exponentiation can run without touching 
+ * the heap. Only one arena is kept per context.
+ */
+static void ICACHE_FLASH_ATTR bi_reserve(BI_CTX *ctx, int count, int size)
+{
+    int i;
+
+    ctx->arena = (bigint *)os_malloc(count*sizeof(bigint) + 
+                                        count*size*COMP_BYTE_SIZE);
+    if (ctx->arena == NULL)
+        return;
+
+    ctx->arena_comps = (comp *)&ctx->arena[count];
+    ctx->arena_count = count;
+    ctx->arena_slot = size;
+
+    for (i = 0; i < count; i++)
+    {
+        bigint *bi = &ctx->arena[i];
+        bi->comps = &ctx->arena_comps[i*size];
+        bi->max_comps = size;
+        bi->size = 0;
+        bi->refs = 0;
+        bi->arena = BI_ARENA_HDR|BI_ARENA_COMPS;
+        bi->next = ctx->free_list;
+        ctx->free_list = bi;
+    }
+
+    ctx->free_count += count;
+}
+
 /*
  * Work out the highest '1' bit in an exponent. Used when doing sliding-window
  * exponentiation.
@@ -1207,16 +1279,20 @@ static bigint * ICACHE_FLASH_ATTR trim(bigint *bi)
 #if defined(CONFIG_BIGINT_MONTGOMERY)
 /**
  * @brief Perform a single montgomery reduction.
+ *
+ * Word-by-word REDC done in place on bixy, so no temporaries are allocated.
+ * bixy must be less than m*R, which holds for the product of two residues.
  * @param ctx [in]  The bigint session context.
  * @param bixy [in]  A bigint.
  * @return The result of the montgomery reduction.
  */
 bigint * ICACHE_FLASH_ATTR bi_mont(BI_CTX *ctx, bigint *bixy)
 {
-    int i = 0, n;
+    int i, j, n;
     uint8_t mod_offset = ctx->mod_offset;
     bigint *bim = ctx->bi_mod[mod_offset];
     comp mod_inv = ctx->N0_dash[mod_offset];
+    comp *x, *m;
 
     check(bixy);
 
@@ -1227,13 +1303,35 @@ bigint * ICACHE_FLASH_ATTR bi_mont(BI_CTX *ctx, bigint *bixy)
 
     n = bim->size;
 
-    do
+    if (bixy->size > n*2)       /* not a product of residues */
+    {
+        bixy = bi_mod(ctx, bixy);
+    }
+
+    more_comps(bixy, n*2+1);
+    x = bixy->comps;
+    m = bim->comps;
+
+    for (i = 0; i < n; i++)
     {
-        bixy = bi_add(ctx, bixy, comp_left_shift(
-                    bi_int_multiply(ctx, bim, bixy->comps[i]*mod_inv), i));
-    } while (++i < n);
+        comp u = x[i]*mod_inv;  /* makes x[i] zero */
+        comp carry = 0;
+
+        for (j = 0; j < n; j++)
+        {
+            long_comp tmp = (long_comp)u*m[j] + x[i+j] + carry;
+            x[i+j] = (comp)tmp;
+            carry = (comp)(tmp >> COMP_BIT_SIZE);
+        }
+
+        for (j = i+n; carry; j++)
+        {
+            x[j] += carry;
+            carry = (x[j] < carry);
+        }
+    }
 
-    comp_right_shift(bixy, n);
+    bixy = trim(comp_right_shift(bixy, n));
 
     if (bi_compare(bixy, bim) >= 0)
     {
@@ -1317,7 +1415,6 @@ static void ICACHE_FLASH_ATTR precompute_slide_window(BI_CTX *ctx, int window, b
         k <<= 1;
     }
 
-    ctx->g = (bigint **)os_malloc(k*sizeof(bigint *));
     ctx->g[0] = bi_clone(ctx, g1);
     bi_permanent(ctx->g[0]);
     g2 = bi_residue(ctx, bi_square(ctx, ctx->g[0]));   /* g^2 */
@@ -1347,15 +1444,27 @@ static void ICACHE_FLASH_ATTR precompute_slide_window(BI_CTX *ctx, int window, b
 bigint * ICACHE_FLASH_ATTR bi_mod_power(BI_CTX *ctx, bigint *bi, bigint *biexp)
 {
     int i = find_max_exp_index(biexp), j, window_size = 1;
-    bigint *biR = int_to_bi(ctx, 1);
-
+    bigint *biR;
 #if defined(CONFIG_BIGINT_MONTGOMERY)
     uint8_t mod_offset = ctx->mod_offset;
+#endif
+
+    if (ctx->arena == NULL)
+    {
+        bigint *bim = ctx->bi_mod[BIGINT_M_OFFSET] ? 
+                ctx->bi_mod[BIGINT_M_OFFSET] : ctx->bi_mod[ctx->mod_offset];
+        bi_reserve(ctx, BIGINT_ARENA_COUNT, bim->size*2+2);
+    }
+
+    biR = int_to_bi(ctx, 1);
+
+#if defined(CONFIG_BIGINT_MONTGOMERY)
     if (!ctx->use_classical)
     {
-        /* preconvert */
-        bi = bi_mont(ctx, 
-                bi_multiply(ctx, bi, ctx->bi_RR_mod_m[mod_offset]));    /* x' */
+        /* preconvert, reducing first so that x*R^2 < m*R (CRT inputs are
+         * bigger than p and q) */
+        bi = bi_mont(ctx, bi_multiply(ctx, bi_mod(ctx, bi), 
+                    ctx->bi_RR_mod_m[mod_offset]));                     /* x' */
         bi_free(ctx, biR);
         biR = ctx->bi_R_mod_m[mod_offset];                              /* A */
     }
@@ -1365,13 +1474,13 @@ bigint * ICACHE_FLASH_ATTR bi_mod_power(BI_CTX *ctx, bigint *bi, bigint *biexp)
     check(biexp);
 
 #ifdef CONFIG_BIGINT_SLIDING_WINDOW
-    for (j = i; j > 32; j /= 5) /* work out an optimum size */
+    /* work out an optimum size */
+    for (j = i; j > 32 && window_size < BIGINT_MAX_WINDOW; j /= 5)
         window_size++;
 
     /* work out the slide constants */
     precompute_slide_window(ctx, window_size, bi);
 #else   /* just one constant */
-    ctx->g = (bigint **)os_malloc(sizeof(bigint *));
     ctx->g[0] = bi_clone(ctx, bi);
     ctx->window = 1;
     bi_permanent(ctx->g[0]);
@@ -1423,7 +1532,6 @@ bigint * ICACHE_FLASH_ATTR bi_mod_power(BI_CTX *ctx, bigint *bi, bigint *biexp)
         bi_free(ctx, ctx->g[i]);
     }
 
-    os_free(ctx->g);
     bi_free(ctx, bi);
     bi_free(ctx, biexp);
 #if defined CONFIG_BIGINT_MONTGOMERY
@@ -1490,13 +1598,11 @@ bigint * ICACHE_FLASH_ATTR bi_crt(BI_CTX *ctx, bigint *bi,
 {
     bigint *m1, *m2, *h;
 
-    /* Montgomery has a condition the 0 < x, y < m and these products violate
-     * that condition. So disable Montgomery when using CRT */
-#if defined(CONFIG_BIGINT_MONTGOMERY)
-    ctx->use_classical = 1;
-#endif
+    /* bi_mod_power() reduces bi mod p and q (in place, hence the clone)
+     * before converting it, so Montgomery can be used for both half-size
+     * exponentiations */
     ctx->mod_offset = BIGINT_P_OFFSET;
-    m1 = bi_mod_power(ctx, bi_copy(bi), dP);
+    m1 = bi_mod_power(ctx, bi_clone(ctx, bi), dP);
 
     ctx->mod_offset = BIGINT_Q_OFFSET;
     m2 = bi_mod_power(ctx, bi, dQ);
@@ -1504,10 +1610,7 @@ bigint * ICACHE_FLASH_ATTR bi_crt(BI_CTX *ctx, bigint *bi,
     h = bi_subtract(ctx, bi_add(ctx, m1, p), bi_copy(m2), NULL);
     h = bi_multiply(ctx, h, qInv);
     ctx->mod_offset = BIGINT_P_OFFSET;
-    h = bi_residue(ctx, h);
-#if defined(CONFIG_BIGINT_MONTGOMERY)
-    ctx->use_classical = 0;         /* reset for any further operation */
-#endif
+    h = bi_mod(ctx, h);     /* h is not in Montgomery form */
     return bi_add(ctx, m2, bi_multiply(ctx, q, h));
 }
 #endif
@@ -63,6 +63,45 @@ void ICACHE_FLASH_ATTR SHA1_Init(SHA1_CTX *ctx)
     ctx->Intermediate_Hash[4]   = 0xC3D2E1F0;
 }
 
+#ifdef SHA1_UNROLL_TRANSFORM
+static void SHA1Transform(uint32_t *H, const uint8_t *block);
+
+/**
+ * Accepts an array of octets as the next portion of the message.
+ * Whole blocks are compressed straight from the caller's buffer.
+ */
+void ICACHE_FLASH_ATTR SHA1_Update(SHA1_CTX *ctx, const uint8_t *msg, int len)
+{
+    while (len > 0)
+    {
+        int n = 64 - ctx->Message_Block_Index;
+
+        if (n == 64 && len >= 64)
+        {
+            SHA1Transform(ctx->Intermediate_Hash, msg);
+        }
+        else
+        {
+            if (n > len)
+                n = len;
+
+            os_memcpy(&ctx->Message_Block[ctx->Message_Block_Index], msg, n);
+            ctx->Message_Block_Index += n;
+
+            if (ctx->Message_Block_Index == 64)
+                SHA1ProcessMessageBlock(ctx);
+        }
+
+        ctx->Length_Low += n << 3;
+
+        if (ctx->Length_Low < (uint32_t)(n << 3))
+            ctx->Length_High++;
+
+        msg += n;
+        len -= n;
+    }
+}
+#else
 /**
  * Accepts an array of octets as the next portion of the message.
  */
@@ -82,6 +121,7 @@ void ICACHE_FLASH_ATTR SHA1_Update(SHA1_CTX *ctx, const uint8_t *msg, int len)
         msg++;
     }
 }
+#endif
 
 /**
  * Return the 160-bit message digest into the user's array
@@ -101,6 +141,106 @@ void ICACHE_FLASH_ATTR SHA1_Final(uint8_t *digest, SHA1_CTX *ctx)
     }
 }
 
+#ifdef SHA1_UNROLL_TRANSFORM
+/*
+ * Unrolled compression function. The message schedule is kept as a
+ * rolling window of 16 words; word aligned input is loaded a word at a
+ * time, anything else falls back to byte loads (the ESP8266 faults on
+ * unaligned word access).
+ */
+#define SHA1_LOAD_BYTES(p) \
+    (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+     ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SHA1_LOAD_WORD(p) __builtin_bswap32(*(const uint32_t *)(p))
+#else
+#define SHA1_LOAD_WORD(p) (*(const uint32_t *)(p))
+#endif
+
+#define SHA1_W(t) (W[(t) & 15] = SHA1CircularShift(1, \
+    W[((t) + 13) & 15] ^ W[((t) + 8) & 15] ^ W[((t) + 2) & 15] ^ W[(t) & 15]))
+
+#define SHA1_F0(b,c,d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_F1(b,c,d) ((b) ^ (c) ^ (d))
+#define SHA1_F2(b,c,d) (((b) & (c)) | ((d) & ((b) | (c))))
+
+#define SHA1_R(a,b,c,d,e,f,k,w) \
+    (e) += SHA1CircularShift(5, (a)) + f((b), (c), (d)) + (k) + (w); \
+    (b) = SHA1CircularShift(30, (b))
+
+#define SHA1_R5(t,f,k,w) \
+    SHA1_R(A, B, C, D, E, f, k, w((t) + 0)); \
+    SHA1_R(E, A, B, C, D, f, k, w((t) + 1)); \
+    SHA1_R(D, E, A, B, C, f, k, w((t) + 2)); \
+    SHA1_R(C, D, E, A, B, f, k, w((t) + 3)); \
+    SHA1_R(B, C, D, E, A, f, k, w((t) + 4))
+
+#define SHA1_W0(t) W[t]
+
+static void ICACHE_FLASH_ATTR SHA1Transform(uint32_t *H, const uint8_t *block)
+{
+    uint32_t W[16];
+    uint32_t A, B, C, D, E;
+    int t;
+
+    if (((size_t)block & 3) == 0)
+    {
+        for (t = 0; t < 16; t++)
+            W[t] = SHA1_LOAD_WORD(block + t * 4);
+    }
+    else
+    {
+        for (t = 0; t < 16; t++)
+            W[t] = SHA1_LOAD_BYTES(block + t * 4);
+    }
+
+    A = H[0];
+    B = H[1];
+    C = H[2];
+    D = H[3];
+    E = H[4];
+
+    SHA1_R5( 0, SHA1_F0, 0x5A827999, SHA1_W0);
+    SHA1_R5( 5, SHA1_F0, 0x5A827999, SHA1_W0);
+    SHA1_R5(10, SHA1_F0, 0x5A827999, SHA1_W0);
+    SHA1_R(A, B, C, D, E, SHA1_F0, 0x5A827999, W[15]);
+    SHA1_R(E, A, B, C, D, SHA1_F0, 0x5A827999, SHA1_W(16));
+    SHA1_R(D, E, A, B, C, SHA1_F0, 0x5A827999, SHA1_W(17));
+    SHA1_R(C, D, E, A, B, SHA1_F0, 0x5A827999, SHA1_W(18));
+    SHA1_R(B, C, D, E, A, SHA1_F0, 0x5A827999, SHA1_W(19));
+
+    SHA1_R5(20, SHA1_F1, 0x6ED9EBA1, SHA1_W);
+    SHA1_R5(25, SHA1_F1, 0x6ED9EBA1, SHA1_W);
+    SHA1_R5(30, SHA1_F1, 0x6ED9EBA1, SHA1_W);
+    SHA1_R5(35, SHA1_F1, 0x6ED9EBA1, SHA1_W);
+
+    SHA1_R5(40, SHA1_F2, 0x8F1BBCDC, SHA1_W);
+    SHA1_R5(45, SHA1_F2, 0x8F1BBCDC, SHA1_W);
+    SHA1_R5(50, SHA1_F2, 0x8F1BBCDC, SHA1_W);
+    SHA1_R5(55, SHA1_F2, 0x8F1BBCDC, SHA1_W);
+
+    SHA1_R5(60, SHA1_F1, 0xCA62C1D6, SHA1_W);
+    SHA1_R5(65, SHA1_F1, 0xCA62C1D6, SHA1_W);
+    SHA1_R5(70, SHA1_F1, 0xCA62C1D6, SHA1_W);
+    SHA1_R5(75, SHA1_F1, 0xCA62C1D6, SHA1_W);
+
+    H[0] += A;
+    H[1] += B;
+    H[2] += C;
+    H[3] += D;
+    H[4] += E;
+}
+
+/**
+ * Process the next 512 bits of the message stored in the array.
+ */
+static void ICACHE_FLASH_ATTR SHA1ProcessMessageBlock(SHA1_CTX *ctx)
+{
+    SHA1Transform(ctx->Intermediate_Hash, ctx->Message_Block);
+    ctx->Message_Block_Index = 0;
+}
+#else
 /**
  * Process the next 512 bits of the message stored in the array.
  */
@@ -189,6 +329,7 @@ static void ICACHE_FLASH_ATTR SHA1ProcessMessageBlock(SHA1_CTX *ctx)
     ctx->Intermediate_Hash[4] += E;
     ctx->Message_Block_Index = 0;
 }
+#endif
 
 /*
  * According to the standard, the message must be padded to an even
@@ -28,6 +28,7 @@
 #endif
 
 #define SIG_LUA 0
+#define SIG_EVENT 1
 #define TASK_QUEUE_LEN 4
 os_event_t *taskQueue;
 
@@ -58,6 +59,9 @@ void task_lua(os_event_t *e){
             NODE_DBG("SIG_LUA received.\n");
             lua_main( 2, lua_argv );
             break;
+        case SIG_EVENT:
+            platform_event_dispatch();
+            break;
         default:
             break;
     }
@@ -66,6 +70,7 @@ void task_lua(os_event_t *e){
 void task_init(void){
     taskQueue = (os_event_t *)os_malloc(sizeof(os_event_t) * TASK_QUEUE_LEN);
     system_os_task(task_lua, USER_TASK_PRIO_0, taskQueue, TASK_QUEUE_LEN);
+    platform_event_init(USER_TASK_PRIO_0, SIG_EVENT);
 }
 
 // extern void test_spiffs();
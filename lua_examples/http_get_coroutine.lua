@@ -0,0 +1,37 @@
+-- Sequential HTTP GET using coroutines instead of nested callbacks.
+-- Prints the heap before and after to compare with the callback style.
+-- Must run inside a coroutine: every step below suspends it until the
+-- answer is there, nothing polls.
+function http_get(host, path)
+	local ip = net.dns.resolve(host)
+	if ip == nil then return nil end
+	local conn = net.createConnection(net.TCP, 0)
+	-- connect() has no waiting form, so wake ourselves from its callbacks
+	local co, connecting = coroutine.running(), true
+	local function connected(ok)
+		if connecting then
+			connecting = false
+			coroutine.resume(co, ok)
+		end
+	end
+	conn:on("connection", function(c) connected(true) end)
+	conn:on("disconnection", function(c) connected(false) end)
+	conn:connect(80, ip)
+	if not coroutine.yield() then return nil end
+	conn:send("GET "..path.." HTTP/1.1\r\nHost: "..host.."\r\nConnection: close\r\n\r\n")
+	if not conn:flush() then return nil end
+	local body = {}
+	-- data that came before recv() is kept for it; nil once closed
+	local data = conn:recv()
+	while data do
+		body[#body + 1] = data
+		data = conn:recv()
+	end
+	return table.concat(body)
+end
+
+print("heap before", node.heap())
+coroutine.wrap(function()
+	local page = http_get("www.nodemcu.com", "/")
+	print("received", page and #page, "heap", node.heap())
+end)()
@@ -0,0 +1,81 @@
+-- The same HTTP GET twice, first with nested callbacks, then in a coroutine
+-- on the blocking calls, and the heap each one takes: the lowest free heap
+-- seen while the request runs, and what is left once it is collected.
+-- Run it on a fresh boot, with nothing else using the network.
+local host, path = "www.nodemcu.com", "/"
+local request = "GET "..path.." HTTP/1.1\r\nHost: "..host.."\r\nConnection: close\r\n\r\n"
+local low, base
+
+local function sample()
+	local h = node.heap()
+	if h < low then low = h end
+end
+
+local function start(name)
+	collectgarbage()
+	base = node.heap()
+	low = base
+	print(name, "heap", base)
+end
+
+local function report(name, bytes)
+	collectgarbage()
+	print(name, "received", bytes, "peak use", base - low, "kept", base - node.heap())
+end
+
+local function callback_style(done)
+	start("callbacks")
+	net.dns.resolve(host, function(_, ip)
+		sample()
+		local conn = net.createConnection(net.TCP, 0)
+		local bytes = 0
+		conn:on("receive", function(c, data)
+			sample()
+			bytes = bytes + #data
+		end)
+		conn:on("disconnection", function(c)
+			sample()
+			report("callbacks", bytes)
+			done()
+		end)
+		conn:on("connection", function(c)
+			sample()
+			c:send(request)
+		end)
+		conn:connect(80, ip)
+	end)
+end
+
+local function coroutine_style()
+	start("coroutine")
+	coroutine.wrap(function()
+		local ip = net.dns.resolve(host)
+		sample()
+		local conn = net.createConnection(net.TCP, 0)
+		local co, connecting = coroutine.running(), true
+		local function connected(ok)
+			if connecting then
+				connecting = false
+				coroutine.resume(co, ok)
+			end
+		end
+		conn:on("connection", function(c) connected(true) end)
+		conn:on("disconnection", function(c) connected(false) end)
+		conn:connect(80, ip)
+		local bytes = 0
+		if coroutine.yield() then
+			sample()
+			conn:send(request)
+			conn:flush()
+			local data = conn:recv()
+			while data do
+				sample()
+				bytes = bytes + #data
+				data = conn:recv()
+			end
+		end
+		report("coroutine", bytes)
+	end)()
+end
+
+callback_style(coroutine_style)
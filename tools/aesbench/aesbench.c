@@ -0,0 +1,213 @@
+/*
+ * Host benchmark for the AES code behind crypto.encrypt()/crypto.decrypt()
+ * (app/ssl/crypto/ssl_aes.c, built through app/crypto/aes.c). Checks the
+ * FIPS-197 and SP800-38A known answers, then reports MB/s for CBC encrypt,
+ * CBC decrypt and CTR with 128 and 256 bit keys.
+ *
+ *   make            builds aesbench_ref (byte-wise rounds) and
+ *                   aesbench_ttable (AES_TTABLE_TRANSFORM)
+ *   make run        runs both
+ *
+ * Numbers are for the host CPU only; use them to compare the two round
+ * implementations, not to predict ESP8266 throughput.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "aes.h"
+
+/* Normally in app/platform/flash_api.c; on the host the tables are plain
+ * memory. */
+uint8_t byte_of_aligned_array (const uint8_t *aligned_array, uint32_t index)
+{
+  return aligned_array[index];
+}
+
+static void unhex (const char *s, uint8_t *out)
+{
+  while (s[0] && s[1])
+  {
+    unsigned v;
+    sscanf (s, "%2x", &v);
+    *out++ = (uint8_t)v;
+    s += 2;
+  }
+}
+
+enum { CBC, CTR };
+
+static const char sp800_38a_plain[] =
+  "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+  "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+
+static const struct
+{
+  const char *name;
+  int mode;
+  const char *key, *iv, *plain, *cipher;
+} kat[] =
+{
+  /* FIPS-197 appendix C, as a single CBC block with a zero iv */
+  { "FIPS-197 C.1", CBC, "000102030405060708090a0b0c0d0e0f",
+    "00000000000000000000000000000000", "00112233445566778899aabbccddeeff",
+    "69c4e0d86a7b0430d8cdb78070b4c55a" },
+  { "FIPS-197 C.3", CBC,
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+    "00000000000000000000000000000000", "00112233445566778899aabbccddeeff",
+    "8ea2b7ca516745bfeafc49904b496089" },
+  { "SP800-38A F.2.1", CBC, "2b7e151628aed2a6abf7158809cf4f3c",
+    "000102030405060708090a0b0c0d0e0f", sp800_38a_plain,
+    "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+    "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7" },
+  { "SP800-38A F.2.5", CBC,
+    "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+    "000102030405060708090a0b0c0d0e0f", sp800_38a_plain,
+    "f58c4c04d6e5f1ba779eabfb5f7bfbd69cfc4e967edb808d679f777bc6702c7d"
+    "39f23369a9d9bacfa530e26304231461b2eb05e2c39be9fcda6c19078c6a9d1b" },
+  { "SP800-38A F.5.1", CTR, "2b7e151628aed2a6abf7158809cf4f3c",
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff", sp800_38a_plain,
+    "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+    "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee" },
+  { "SP800-38A F.5.5", CTR,
+    "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff", sp800_38a_plain,
+    "601ec313775789a5b7a7f504bbf3d228f443e3ca4d62b59aca84e990cacaf5c5"
+    "2b0930daa23de94ce87017ba2d84988ddfc9c58db67aada613c2dd08457941a6" },
+  /* counter carry across 64 bits, from "openssl enc -aes-128-ctr" */
+  { "CTR carry", CTR, "2b7e151628aed2a6abf7158809cf4f3c",
+    "00000000000000fffffffffffffffffe",
+    "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+    "30c81c46a35ce411e5fbc1191a0a52ef",
+    "fe3e4a35ddcc49eb08418e6f0e9400f574e11b1fe0b8537fdc62eff972459b0e"
+    "c68c4a2b4373b68b40865b797ea65859" },
+};
+
+/* CTR in uneven pieces, to exercise the key stream offset */
+static void ctr_pieces (AES_CTX *ctx, const uint8_t *in, uint8_t *out, int len)
+{
+  uint8_t stream[AES_BLOCKSIZE];
+  int offset = 0, done = 0, step = 1;
+
+  while (done < len)
+  {
+    int n = step < len - done ? step : len - done;
+    AES_ctr_crypt (ctx, stream, &offset, in + done, out + done, n);
+    done += n;
+    step = step * 3 % 17 + 1;
+  }
+}
+
+static int self_test (void)
+{
+  int fail = 0;
+  size_t i;
+
+  for (i = 0; i < sizeof (kat) / sizeof (kat[0]); ++i)
+  {
+    uint8_t key[32], iv[16], plain[64], cipher[64], out[64];
+    int klen = strlen (kat[i].key) / 2, len = strlen (kat[i].plain) / 2;
+    AES_MODE mode = klen == 16 ? AES_MODE_128 : AES_MODE_256;
+    AES_CTX ctx;
+
+    unhex (kat[i].key, key);
+    unhex (kat[i].iv, iv);
+    unhex (kat[i].plain, plain);
+    unhex (kat[i].cipher, cipher);
+
+    AES_set_key (&ctx, key, iv, mode);
+    if (kat[i].mode == CBC)
+      AES_cbc_encrypt (&ctx, plain, out, len);
+    else
+      ctr_pieces (&ctx, plain, out, len);
+    if (memcmp (out, cipher, len))
+    {
+      printf ("FAIL %s encrypt\n", kat[i].name);
+      fail = 1;
+    }
+
+    AES_set_key (&ctx, key, iv, mode);
+    if (kat[i].mode == CBC)
+    {
+      AES_convert_key (&ctx);
+      AES_cbc_decrypt (&ctx, cipher, out, len);
+    }
+    else
+      ctr_pieces (&ctx, cipher, out, len);
+    if (memcmp (out, plain, len))
+    {
+      printf ("FAIL %s decrypt\n", kat[i].name);
+      fail = 1;
+    }
+  }
+  return fail;
+}
+
+static double now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define TRIALS     7
+#define TRIAL_SECS 0.05
+
+enum { OP_CBC_ENC, OP_CBC_DEC, OP_CTR, NUM_OPS };
+static const char *op_names[NUM_OPS] = { "cbc-encrypt", "cbc-decrypt", "ctr" };
+
+static double bench (int op, AES_MODE mode, uint8_t *buf, int len)
+{
+  static const uint8_t key[32] = "0123456789abcdefghijklmnopqrstuv";
+  static const uint8_t iv[16] = "fedcba9876543210";
+  double best = 1e30;
+  int t;
+
+  for (t = 0; t < TRIALS; ++t)
+  {
+    AES_CTX ctx;
+    uint8_t stream[AES_BLOCKSIZE];
+    int offset = 0;
+    unsigned long n = 0;
+    double start = now (), el;
+
+    AES_set_key (&ctx, key, iv, mode);
+    if (op == OP_CBC_DEC)
+      AES_convert_key (&ctx);
+    do
+    {
+      if (op == OP_CBC_ENC)
+        AES_cbc_encrypt (&ctx, buf, buf, len);
+      else if (op == OP_CBC_DEC)
+        AES_cbc_decrypt (&ctx, buf, buf, len);
+      else
+        AES_ctr_crypt (&ctx, stream, &offset, buf, buf, len);
+      n++;
+    } while ((el = now () - start) < TRIAL_SECS);
+
+    if (el / n < best)
+      best = el / n;
+  }
+  return len / best / 1e6;
+}
+
+int main (void)
+{
+  static uint8_t buf[4096];
+  size_t i;
+  int op;
+
+  if (self_test ())
+    return 1;
+  printf ("known answers OK\n\n");
+
+  for (i = 0; i < sizeof (buf); ++i)
+    buf[i] = (uint8_t)(i * 31 + 7);
+
+  printf ("%-12s %10s %10s\n", "MB/s", "AES-128", "AES-256");
+  for (op = 0; op < NUM_OPS; ++op)
+    printf ("%-12s %10.1f %10.1f\n", op_names[op],
+            bench (op, AES_MODE_128, buf, sizeof (buf)),
+            bench (op, AES_MODE_256, buf, sizeof (buf)));
+  return 0;
+}
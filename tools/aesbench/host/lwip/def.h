@@ -0,0 +1,3 @@
+/* Host stand-in for lwip/def.h: ntohl()/htonl() for a little-endian host */
+#define ntohl(x) __builtin_bswap32(x)
+#define htonl(x) __builtin_bswap32(x)
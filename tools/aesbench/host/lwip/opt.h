@@ -0,0 +1 @@
+/* Host stand-in for lwip/opt.h; ssl_aes.c needs nothing from it */
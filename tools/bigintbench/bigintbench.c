@@ -0,0 +1,241 @@
+/*
+ * Host benchmark for the axTLS bigint code (app/ssl/crypto/ssl_bigint.c).
+ * Times RSA-1024/2048 public and private (plain and CRT) modular
+ * exponentiation the way ssl_rsa.c drives it, and counts heap calls per
+ * operation.
+ *
+ *   make            builds bigintbench (firmware config) and
+ *                   bigintbench_barrett (same tree, Barrett reduction)
+ *   make run        runs both
+ *
+ * A client handshake with an RSA key exchange costs one public operation on
+ * the server key plus one per certificate signature checked; a server
+ * handshake costs one private (CRT) operation. The "handshake" column is one
+ * public plus one CRT private operation.
+ *
+ * Numbers are for the host CPU only; use them to compare reductions and
+ * allocation behaviour, not to predict ESP8266 handshake times.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ssl/ssl_os_port.h"
+#include "ssl/ssl_crypto.h"
+
+#include "rsakeys.h"
+
+unsigned long bench_heap_calls;
+
+typedef struct
+{
+  int bits;
+  const uint8_t *n, *d, *p, *q, *dP, *dQ, *qInv;
+} key_t;
+
+#define KEY(b) { b, rsa##b##_n, rsa##b##_d, rsa##b##_p, rsa##b##_q, \
+                 rsa##b##_dP, rsa##b##_dQ, rsa##b##_qInv }
+
+static const key_t keys[] = { KEY(1024), KEY(2048) };
+
+static const uint8_t pub_exp[3] = { 0x01, 0x00, 0x01 };
+
+typedef struct
+{
+  BI_CTX *ctx;
+  int len;
+  bigint *m, *e, *d, *p, *q, *dP, *dQ, *qInv;
+} rsa_t;
+
+static void rsa_load (rsa_t *r, const key_t *k)
+{
+  int half = k->bits / 16;
+
+  r->len = k->bits / 8;
+  r->ctx = bi_initialize ();
+  r->m = bi_import (r->ctx, k->n, r->len);
+  bi_set_mod (r->ctx, r->m, BIGINT_M_OFFSET);
+  r->e = bi_import (r->ctx, pub_exp, sizeof (pub_exp));
+  bi_permanent (r->e);
+  r->d = bi_import (r->ctx, k->d, r->len);
+  bi_permanent (r->d);
+  r->p = bi_import (r->ctx, k->p, half);
+  r->q = bi_import (r->ctx, k->q, half);
+  r->dP = bi_import (r->ctx, k->dP, half);
+  r->dQ = bi_import (r->ctx, k->dQ, half);
+  r->qInv = bi_import (r->ctx, k->qInv, half);
+  bi_permanent (r->dP);
+  bi_permanent (r->dQ);
+  bi_permanent (r->qInv);
+  bi_set_mod (r->ctx, r->p, BIGINT_P_OFFSET);
+  bi_set_mod (r->ctx, r->q, BIGINT_Q_OFFSET);
+}
+
+static void rsa_unload (rsa_t *r)
+{
+  bi_depermanent (r->e);
+  bi_free (r->ctx, r->e);
+  bi_depermanent (r->d);
+  bi_free (r->ctx, r->d);
+  bi_depermanent (r->dP);
+  bi_depermanent (r->dQ);
+  bi_depermanent (r->qInv);
+  bi_free (r->ctx, r->dP);
+  bi_free (r->ctx, r->dQ);
+  bi_free (r->ctx, r->qInv);
+  bi_free_mod (r->ctx, BIGINT_M_OFFSET);
+  bi_free_mod (r->ctx, BIGINT_P_OFFSET);
+  bi_free_mod (r->ctx, BIGINT_Q_OFFSET);
+  bi_terminate (r->ctx);
+}
+
+enum { OP_PUBLIC, OP_PRIVATE, OP_CRT, OP_HANDSHAKE, NUM_OPS };
+static const char *op_names[NUM_OPS] = { "public", "private", "crt", "handshake" };
+
+/* One operation on in[], result exported to out[]. Mirrors RSA_public(),
+ * RSA_private() and RSA_encrypt()'s bi_clear_cache() afterwards. */
+static void rsa_op (rsa_t *r, int op, const uint8_t *in, uint8_t *out)
+{
+  bigint *x = bi_import (r->ctx, in, r->len);
+
+  switch (op)
+  {
+    case OP_PUBLIC:
+      r->ctx->mod_offset = BIGINT_M_OFFSET;
+      x = bi_mod_power (r->ctx, x, r->e);
+      break;
+    case OP_PRIVATE:
+      r->ctx->mod_offset = BIGINT_M_OFFSET;
+      x = bi_mod_power (r->ctx, x, r->d);
+      break;
+    case OP_CRT:
+      x = bi_crt (r->ctx, x, r->dP, r->dQ, r->p, r->q, r->qInv);
+      break;
+  }
+
+  bi_export (r->ctx, x, out, r->len);
+  bi_clear_cache (r->ctx);
+}
+
+static double now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int verify (rsa_t *r, int bits)
+{
+  uint8_t msg[256], c[256], m1[256], m2[256];
+  int i, failed = 0;
+
+  for (i = 0; i < r->len; i++)
+    msg[i] = (uint8_t)(i * 7 + 3);
+  msg[0] = 0x00;  /* keep msg < n */
+  msg[1] = 0x02;
+
+  rsa_op (r, OP_PUBLIC, msg, c);
+  rsa_op (r, OP_PRIVATE, c, m1);
+  rsa_op (r, OP_CRT, c, m2);
+
+  if (memcmp (m1, msg, r->len))
+  {
+    printf ("RSA-%d private round trip FAILED\n", bits);
+    failed = 1;
+  }
+  if (memcmp (m2, msg, r->len))
+  {
+    printf ("RSA-%d CRT round trip FAILED\n", bits);
+    failed = 1;
+  }
+
+  /* and the other way round, as for a signature */
+  rsa_op (r, OP_CRT, msg, c);
+  rsa_op (r, OP_PUBLIC, c, m1);
+  if (memcmp (m1, msg, r->len))
+  {
+    printf ("RSA-%d sign/verify round trip FAILED\n", bits);
+    failed = 1;
+  }
+  return failed;
+}
+
+#define TRIALS     9
+#define TRIAL_SECS 0.1
+
+static void bench (rsa_t *r, int op, double *ms, double *heap)
+{
+  uint8_t in[256], out[256];
+  double best = 1e30;
+  unsigned long calls = 0, ops = 0;
+  int t;
+
+  memset (in, 0x5a, sizeof (in));
+  in[0] = 0x00;
+
+  for (t = 0; t < TRIALS; t++)
+  {
+    unsigned long n = 0;
+    double start = now (), el;
+
+    bench_heap_calls = 0;
+    do
+    {
+      if (op == OP_HANDSHAKE)
+      {
+        rsa_op (r, OP_PUBLIC, in, out);
+        rsa_op (r, OP_CRT, out, in);
+      }
+      else
+        rsa_op (r, op, in, out);
+      n++;
+    } while ((el = now () - start) < TRIAL_SECS);
+
+    calls += bench_heap_calls;
+    ops += n;
+    if (el / n < best)
+      best = el / n;
+  }
+
+  *ms = best * 1e3;
+  *heap = (double)calls / ops;
+}
+
+int main (void)
+{
+  int failed = 0;
+  size_t k;
+  int op;
+
+  for (k = 0; k < sizeof (keys) / sizeof (keys[0]); k++)
+  {
+    rsa_t r;
+    rsa_load (&r, &keys[k]);
+    failed |= verify (&r, keys[k].bits);
+    rsa_unload (&r);
+  }
+  if (failed)
+    return 1;
+  printf ("round trips OK\n\n");
+
+  printf ("%-10s", "op");
+  for (k = 0; k < sizeof (keys) / sizeof (keys[0]); k++)
+    printf ("   RSA-%d ms  heap/op", keys[k].bits);
+  printf ("\n");
+
+  for (op = 0; op < NUM_OPS; op++)
+  {
+    printf ("%-10s", op_names[op]);
+    for (k = 0; k < sizeof (keys) / sizeof (keys[0]); k++)
+    {
+      rsa_t r;
+      double ms, heap;
+      rsa_load (&r, &keys[k]);
+      bench (&r, op, &ms, &heap);
+      rsa_unload (&r);
+      printf ("   %9.3f %8.1f", ms, heap);
+    }
+    printf ("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,21 @@
+/* Host stand-in for lwip/mem.h that counts heap calls for bigintbench */
+#ifndef _BENCH_MEM_H_
+#define _BENCH_MEM_H_
+
+#include <stddef.h>
+#include "osapi.h"
+
+/* not <stdlib.h>: it clashes with ssl_os_port.h's struct timeval */
+void *malloc(size_t size);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+
+extern unsigned long bench_heap_calls;
+
+#define os_malloc(s)     (bench_heap_calls++, malloc(s))
+#define os_zalloc(s)     (bench_heap_calls++, calloc(1, (s)))
+#define os_realloc(p, s) (bench_heap_calls++, realloc((p), (s)))
+#define os_free(p)       free(p)
+
+#endif
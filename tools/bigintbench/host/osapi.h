@@ -0,0 +1,14 @@
+/* Host stand-in for the SDK osapi.h, with the bits ssl_bigint.c needs */
+#ifndef _OSAPI_H_
+#define _OSAPI_H_
+
+#include <string.h>
+#include "user_config.h"
+
+#define os_memcpy memcpy
+#define os_memset memset
+#define os_strlen strlen
+#define os_printf printf
+#define os_putc(c) putchar(c)
+
+#endif
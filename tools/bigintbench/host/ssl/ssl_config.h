@@ -0,0 +1,8 @@
+/* Pull in the firmware's axTLS configuration, optionally swapping the
+ * reduction method so both can be timed from the same tree. */
+#include "../../../../app/include/ssl/ssl_config.h"
+
+#ifdef BENCH_BARRETT
+#undef CONFIG_BIGINT_MONTGOMERY
+#define CONFIG_BIGINT_BARRETT 1
+#endif
@@ -0,0 +1,197 @@
+/* RSA test keys for bigintbench, generated with "openssl genrsa". Never
+ * use these for anything but benchmarking. */
+static const uint8_t rsa1024_n[128] =
+{
+  0xd2, 0xdd, 0x27, 0xa1, 0xa8, 0x0d, 0xc1, 0x00, 0x07, 0x16, 0xbe, 0x19,
+  0xf8, 0xc3, 0x53, 0x1a, 0x15, 0x64, 0xd3, 0x18, 0x52, 0x1f, 0xbb, 0x60,
+  0xcd, 0x9d, 0x46, 0x7e, 0x8f, 0x1d, 0xc9, 0xf1, 0x54, 0x6b, 0x21, 0x1a,
+  0xa8, 0xeb, 0xba, 0x31, 0x34, 0x0d, 0x9b, 0x1a, 0xce, 0x9f, 0xd8, 0x49,
+  0x71, 0xb0, 0xa0, 0x87, 0xbf, 0x2b, 0x73, 0xad, 0x9f, 0xc5, 0x7a, 0x84,
+  0x03, 0x9f, 0xa7, 0x35, 0xb5, 0x5d, 0x56, 0x93, 0x5e, 0xaa, 0x72, 0x28,
+  0xb1, 0xf6, 0x84, 0x9a, 0x0f, 0xd3, 0x13, 0x11, 0x09, 0xfd, 0x4a, 0xfd,
+  0xe7, 0x69, 0x11, 0x94, 0xa9, 0xad, 0xcd, 0x50, 0xe5, 0x13, 0x52, 0x17,
+  0x7a, 0x02, 0x4c, 0x80, 0x0b, 0xd5, 0x27, 0xb6, 0x64, 0x6f, 0xc5, 0xf7,
+  0xda, 0xd3, 0xa7, 0x81, 0x47, 0x39, 0x6c, 0xb5, 0x4f, 0x35, 0x65, 0xc7,
+  0x81, 0x20, 0x2c, 0x12, 0xcd, 0xa0, 0x56, 0xeb,
+};
+static const uint8_t rsa1024_d[128] =
+{
+  0x97, 0x1d, 0x85, 0x04, 0x76, 0x42, 0x7d, 0x19, 0x3e, 0xfb, 0x4e, 0x7b,
+  0xa0, 0x6a, 0xa2, 0xc8, 0xa3, 0xa2, 0x61, 0x22, 0x21, 0xe0, 0xb9, 0xd1,
+  0x93, 0x29, 0x6e, 0x56, 0xce, 0xcc, 0x03, 0x68, 0x5f, 0x1e, 0x73, 0x57,
+  0xfe, 0xcd, 0x08, 0xdf, 0xb0, 0x35, 0x3b, 0xfe, 0x07, 0x2c, 0x48, 0xbd,
+  0xc1, 0xab, 0x5a, 0x30, 0x4e, 0x91, 0x9e, 0x52, 0x44, 0x99, 0x2a, 0xc7,
+  0x27, 0x2d, 0xa8, 0x8f, 0x28, 0xd8, 0x66, 0xf7, 0xd8, 0x34, 0xfe, 0x9e,
+  0x6b, 0x98, 0x81, 0x8b, 0xd7, 0xdd, 0x25, 0x76, 0x64, 0xcd, 0x01, 0x60,
+  0xbe, 0x76, 0xf0, 0x76, 0x23, 0xaf, 0x66, 0x57, 0x5d, 0x78, 0x47, 0xe8,
+  0x4b, 0x45, 0x42, 0x44, 0xe0, 0xc3, 0xe7, 0x9b, 0xda, 0x28, 0x6e, 0x59,
+  0x37, 0x46, 0x77, 0x70, 0x20, 0xdc, 0x9e, 0x92, 0x50, 0x20, 0x63, 0xad,
+  0x0a, 0xbf, 0x03, 0x79, 0xfa, 0x37, 0x70, 0xe1,
+};
+static const uint8_t rsa1024_p[64] =
+{
+  0xf0, 0x66, 0x4c, 0x62, 0x22, 0x40, 0x40, 0xb7, 0x31, 0x84, 0x4c, 0x40,
+  0x2b, 0x80, 0x40, 0x22, 0x73, 0x92, 0x0d, 0x7b, 0x28, 0x54, 0x65, 0x14,
+  0x45, 0x25, 0x23, 0x2e, 0x44, 0x73, 0xea, 0x8a, 0xaf, 0x33, 0x58, 0x11,
+  0xb1, 0x0a, 0xdc, 0x66, 0xe9, 0x8e, 0xc7, 0x6d, 0x02, 0x05, 0x9a, 0x14,
+  0x1f, 0x43, 0xfd, 0xc4, 0xec, 0xdd, 0xc4, 0x1a, 0x26, 0x23, 0x41, 0x6a,
+  0x1a, 0x5c, 0xe4, 0x7b,
+};
+static const uint8_t rsa1024_q[64] =
+{
+  0xe0, 0x8c, 0x2f, 0xc3, 0x20, 0x72, 0xcf, 0xc1, 0x3b, 0x83, 0x2b, 0xbb,
+  0x23, 0xd0, 0x05, 0xf5, 0x38, 0x35, 0x3c, 0x01, 0xf9, 0xdb, 0x4f, 0xce,
+  0xbe, 0xab, 0x06, 0x77, 0x01, 0x19, 0xd1, 0x79, 0x77, 0xff, 0xd5, 0x4a,
+  0x74, 0xe2, 0x32, 0xd9, 0x6e, 0x70, 0x61, 0xa4, 0x6d, 0xc4, 0x5c, 0xdf,
+  0x21, 0xf8, 0x48, 0x1b, 0xea, 0x21, 0x52, 0x8f, 0x10, 0x5e, 0x52, 0xe0,
+  0x0c, 0x34, 0x64, 0x51,
+};
+static const uint8_t rsa1024_dP[64] =
+{
+  0xef, 0x4b, 0xa5, 0x34, 0xfa, 0x0b, 0x23, 0x60, 0x37, 0x76, 0x0d, 0xc0,
+  0xc2, 0x8c, 0x83, 0x4a, 0xc7, 0xe7, 0xd6, 0x6b, 0x85, 0x95, 0x9c, 0x98,
+  0x34, 0xcb, 0xe6, 0xdd, 0x23, 0x5e, 0x8f, 0x55, 0x45, 0x58, 0xc2, 0x8d,
+  0xb9, 0xc1, 0xa9, 0xea, 0xf7, 0x0a, 0x1d, 0x11, 0x31, 0x36, 0x0a, 0x4d,
+  0x85, 0x61, 0xd4, 0xb5, 0xb5, 0x62, 0x7a, 0xd5, 0xdc, 0xa8, 0xb3, 0x70,
+  0xbe, 0x95, 0x41, 0x09,
+};
+static const uint8_t rsa1024_dQ[64] =
+{
+  0x0b, 0xb9, 0x86, 0x2c, 0xec, 0x1e, 0xd2, 0x96, 0x46, 0x63, 0x3c, 0xff,
+  0x52, 0x89, 0x64, 0x26, 0x3f, 0xbf, 0x17, 0xd9, 0x0a, 0x90, 0xd7, 0x03,
+  0xf6, 0x94, 0xbb, 0x8b, 0xaf, 0x35, 0x07, 0xe9, 0x0d, 0xc8, 0xff, 0xfc,
+  0x19, 0x4a, 0x4e, 0x59, 0x68, 0x18, 0xda, 0x20, 0x59, 0xd2, 0xec, 0xfe,
+  0x81, 0xa9, 0x93, 0x2a, 0x51, 0xf9, 0x57, 0x74, 0x3c, 0xe8, 0x8f, 0xef,
+  0x3e, 0xf3, 0xe5, 0x61,
+};
+static const uint8_t rsa1024_qInv[64] =
+{
+  0x32, 0xf0, 0x75, 0xbe, 0x79, 0x28, 0x07, 0x3d, 0x55, 0xde, 0x58, 0xba,
+  0xf7, 0x60, 0x60, 0x6d, 0xef, 0x01, 0x13, 0xa9, 0xae, 0xf5, 0x1c, 0x7f,
+  0x10, 0xb1, 0xe0, 0x9d, 0xfc, 0x59, 0xc3, 0xdd, 0xf9, 0x53, 0x38, 0x49,
+  0x68, 0x45, 0x5b, 0xdd, 0x79, 0xce, 0x4d, 0x09, 0x21, 0xdf, 0x74, 0xdd,
+  0xc4, 0x8b, 0x81, 0xcb, 0x8c, 0x0c, 0x07, 0xec, 0xb2, 0x18, 0x2b, 0x08,
+  0x4d, 0xf5, 0xdb, 0x8a,
+};
+
+static const uint8_t rsa2048_n[256] =
+{
+  0x91, 0xbc, 0xbf, 0x5c, 0x91, 0x74, 0x73, 0x48, 0xa1, 0xdb, 0x0e, 0xa4,
+  0x36, 0x18, 0xd8, 0xe4, 0x2f, 0xe2, 0xd9, 0x17, 0x18, 0x6b, 0xf3, 0xe0,
+  0x72, 0x8b, 0x69, 0x46, 0x6c, 0x19, 0xa5, 0x84, 0xb9, 0x93, 0x48, 0x8c,
+  0x9f, 0x7b, 0x75, 0x54, 0x5f, 0xc9, 0x77, 0x47, 0x18, 0x62, 0xd8, 0xbf,
+  0xcb, 0x96, 0x15, 0xac, 0x1c, 0xcc, 0xb6, 0xcd, 0x7c, 0xc4, 0x35, 0x9e,
+  0x8f, 0xb3, 0x57, 0x10, 0x61, 0x5d, 0xa6, 0x20, 0x9c, 0x38, 0x1d, 0xa3,
+  0x9c, 0xa3, 0x87, 0x3f, 0xf4, 0xad, 0x6e, 0x49, 0xab, 0xc7, 0xf3, 0xbc,
+  0xd8, 0x4d, 0x3e, 0x77, 0x1b, 0x5a, 0x36, 0x1d, 0x7d, 0xeb, 0x3e, 0x41,
+  0xc9, 0x52, 0xd7, 0xf2, 0xd1, 0xfb, 0x5c, 0x61, 0xce, 0x16, 0xeb, 0x1a,
+  0xfe, 0xaa, 0xc8, 0x2b, 0x05, 0x11, 0x43, 0xff, 0x62, 0xd4, 0xd6, 0x5b,
+  0x65, 0xe1, 0x4c, 0x2a, 0x06, 0xe6, 0x3f, 0xee, 0x46, 0x24, 0x60, 0x5c,
+  0xb8, 0xd9, 0x1a, 0x62, 0x93, 0xa6, 0x69, 0x87, 0xfe, 0x1b, 0x05, 0x27,
+  0x11, 0xce, 0x63, 0x6d, 0x36, 0x97, 0x5e, 0xa9, 0x6b, 0xe9, 0x7c, 0x8b,
+  0xfe, 0x5d, 0x80, 0xbf, 0x48, 0xf1, 0x79, 0x64, 0x11, 0xa1, 0x0a, 0x17,
+  0x44, 0xf0, 0xdd, 0x78, 0x97, 0xf5, 0x74, 0xeb, 0xf3, 0x7e, 0xdc, 0x9d,
+  0xd2, 0x05, 0xdb, 0x0e, 0x3c, 0xbf, 0xff, 0xd0, 0xdd, 0x74, 0xc7, 0x22,
+  0xf4, 0x31, 0x73, 0x92, 0x91, 0x50, 0xf6, 0x00, 0x67, 0x84, 0x12, 0x70,
+  0xfd, 0xf1, 0xc8, 0x0d, 0xe6, 0xcd, 0x40, 0x8f, 0x84, 0xb0, 0x0c, 0x4a,
+  0xef, 0x2d, 0x86, 0xba, 0x22, 0xed, 0xc0, 0xd2, 0x53, 0x54, 0x90, 0x85,
+  0x9d, 0x52, 0xe6, 0x13, 0x11, 0x81, 0xf3, 0xd7, 0x8e, 0x81, 0xd5, 0x8d,
+  0xbd, 0x49, 0x70, 0xce, 0x75, 0x24, 0xbc, 0xef, 0xc2, 0x11, 0x10, 0x52,
+  0xcd, 0x84, 0x6e, 0xaf,
+};
+static const uint8_t rsa2048_d[256] =
+{
+  0x13, 0x96, 0x93, 0xa9, 0xf4, 0xd5, 0xa5, 0x6b, 0xcd, 0x1a, 0xcd, 0x11,
+  0xa9, 0x41, 0x17, 0x0b, 0x39, 0xf1, 0xd0, 0x4d, 0x58, 0x62, 0x4f, 0x79,
+  0xe0, 0x2b, 0x78, 0xcf, 0x97, 0x01, 0x58, 0xcb, 0xf4, 0x1d, 0x7b, 0x12,
+  0x30, 0xf0, 0x13, 0xc9, 0xc4, 0x18, 0xd2, 0x1d, 0x63, 0x86, 0x60, 0x57,
+  0xb7, 0x1c, 0xc9, 0xcb, 0x99, 0x10, 0xb2, 0xe9, 0x55, 0x01, 0xbd, 0x00,
+  0x93, 0x93, 0xfe, 0xa4, 0x71, 0xa7, 0x22, 0xb3, 0x1e, 0x0c, 0x34, 0xd4,
+  0xf9, 0x88, 0x1e, 0x9f, 0xac, 0x05, 0x66, 0x33, 0x7a, 0x11, 0x50, 0x0e,
+  0x16, 0x8c, 0x9b, 0x54, 0x15, 0xab, 0x14, 0x66, 0xf6, 0x61, 0x18, 0xbc,
+  0x6d, 0x90, 0xe2, 0xfc, 0x52, 0x2e, 0x3f, 0x86, 0x83, 0x2a, 0xca, 0xc2,
+  0xea, 0xc3, 0xe2, 0xfa, 0x55, 0x48, 0xb2, 0xce, 0x5a, 0xbc, 0x52, 0x16,
+  0x20, 0x25, 0x73, 0x6a, 0x9a, 0xae, 0xcb, 0xf2, 0x1e, 0x2b, 0xc9, 0x99,
+  0x06, 0x43, 0x33, 0x1e, 0xf9, 0x68, 0x11, 0xaf, 0xe3, 0x95, 0x66, 0x1a,
+  0xa5, 0x3f, 0x35, 0x5c, 0x54, 0x73, 0x09, 0x82, 0x31, 0x2d, 0x8e, 0x39,
+  0xcb, 0x08, 0xc6, 0xee, 0xfe, 0x77, 0x77, 0x02, 0x8d, 0x0f, 0xaf, 0xb5,
+  0xed, 0xd8, 0x55, 0x15, 0x1c, 0xf7, 0x93, 0xf6, 0x7d, 0x93, 0x53, 0xd5,
+  0x23, 0x98, 0x09, 0x8f, 0x39, 0x5c, 0x37, 0x3e, 0xb1, 0x3d, 0x59, 0x35,
+  0x10, 0x15, 0x3a, 0x55, 0x2b, 0xbe, 0x88, 0x88, 0xe9, 0x42, 0xee, 0xe1,
+  0x3c, 0x0a, 0x4a, 0xba, 0x29, 0x0b, 0x69, 0xe6, 0xea, 0x1f, 0xc4, 0x9b,
+  0xef, 0x2e, 0x5d, 0x39, 0x3f, 0x76, 0xc2, 0xde, 0x5e, 0x45, 0xc3, 0x72,
+  0x70, 0x9e, 0xc0, 0x22, 0xba, 0x56, 0x8d, 0xd5, 0x81, 0x46, 0xc6, 0xb2,
+  0x9b, 0xce, 0xb2, 0x2b, 0xae, 0x40, 0xfb, 0xc8, 0xb0, 0x65, 0x6e, 0x1c,
+  0xdd, 0x04, 0xed, 0x91,
+};
+static const uint8_t rsa2048_p[128] =
+{
+  0xc7, 0x96, 0xe7, 0x67, 0x1a, 0x49, 0xb2, 0x9b, 0x74, 0x57, 0xca, 0xe2,
+  0xd8, 0xe9, 0x98, 0x43, 0x19, 0x35, 0xca, 0xd7, 0xaf, 0x08, 0xf5, 0x60,
+  0x65, 0x35, 0x17, 0x29, 0x14, 0xb6, 0x36, 0xb1, 0x5b, 0x94, 0x65, 0x43,
+  0x27, 0x3b, 0x26, 0x5c, 0xd7, 0x41, 0x0a, 0xa1, 0x4b, 0xbb, 0xc8, 0x37,
+  0x27, 0x6a, 0xa9, 0xd2, 0x43, 0x80, 0xe3, 0xcb, 0x19, 0x23, 0x4a, 0xb2,
+  0x5a, 0x85, 0xb3, 0x21, 0xbe, 0xa9, 0x4f, 0xc8, 0xd1, 0xee, 0xc4, 0xe1,
+  0xed, 0x3b, 0xf8, 0xb2, 0x8b, 0xc7, 0x5d, 0xdd, 0x31, 0x02, 0xc3, 0x56,
+  0x6d, 0xd0, 0xc1, 0x66, 0x2c, 0xde, 0x1e, 0x90, 0x62, 0x08, 0x5d, 0x18,
+  0x81, 0xfc, 0xb1, 0xa2, 0x26, 0x9c, 0x8d, 0xf8, 0x31, 0x2d, 0xaf, 0x78,
+  0xa7, 0xc5, 0x4c, 0xe7, 0xd3, 0x96, 0xbe, 0x1a, 0xa1, 0xa4, 0x34, 0xde,
+  0xcf, 0xe4, 0x24, 0xed, 0xbe, 0x6e, 0x69, 0x6d,
+};
+static const uint8_t rsa2048_q[128] =
+{
+  0xba, 0xed, 0x6c, 0x6b, 0x71, 0x23, 0x95, 0x34, 0xf1, 0x6a, 0x9f, 0x93,
+  0x89, 0x0d, 0x6a, 0xa4, 0x49, 0x10, 0x69, 0x70, 0x69, 0xad, 0xe5, 0x8a,
+  0x0c, 0x31, 0xf1, 0x6d, 0x6a, 0x7f, 0xc3, 0xf7, 0xb8, 0xbf, 0x5c, 0xf5,
+  0x4c, 0xfd, 0x60, 0xe6, 0xa7, 0xa1, 0x21, 0x3f, 0x6f, 0xa9, 0x44, 0x23,
+  0x5d, 0x10, 0xf5, 0xec, 0xd7, 0x0b, 0x47, 0x11, 0xc3, 0xbe, 0x03, 0xc1,
+  0x35, 0x1a, 0x99, 0xb7, 0xd1, 0x82, 0xa5, 0x06, 0xb2, 0xdb, 0x4b, 0xc6,
+  0x8f, 0x7b, 0x75, 0x8e, 0x77, 0x69, 0x20, 0xd7, 0xe2, 0x0e, 0x37, 0x2c,
+  0x60, 0xf1, 0x1d, 0x90, 0xa8, 0xab, 0x27, 0x8a, 0x33, 0x70, 0xa0, 0x82,
+  0xbd, 0x98, 0xb0, 0x0d, 0xb7, 0xe4, 0xb9, 0x98, 0x55, 0x87, 0x78, 0x46,
+  0x34, 0x70, 0xdb, 0x38, 0xe5, 0x2f, 0x3d, 0x83, 0x29, 0xe0, 0x11, 0x5d,
+  0xaf, 0x40, 0x51, 0x7d, 0xe2, 0x4c, 0x23, 0x0b,
+};
+static const uint8_t rsa2048_dP[128] =
+{
+  0xae, 0x68, 0xe2, 0xdb, 0x88, 0xf0, 0x3f, 0xc0, 0x72, 0x81, 0x49, 0x4c,
+  0xc4, 0x0a, 0x14, 0xc1, 0x05, 0xa5, 0xa9, 0x14, 0xa2, 0xe2, 0xec, 0x31,
+  0x89, 0x1f, 0x44, 0x96, 0xe4, 0x7f, 0x79, 0xf9, 0xb0, 0x32, 0x53, 0xee,
+  0xc3, 0xb8, 0x7f, 0x84, 0x7f, 0xa1, 0x59, 0x9d, 0xab, 0x65, 0x73, 0xc7,
+  0x26, 0x8d, 0xa1, 0xca, 0x98, 0xac, 0x67, 0xe2, 0x91, 0x9b, 0xf2, 0x69,
+  0x3a, 0x8b, 0x3d, 0x06, 0xce, 0xea, 0x7b, 0x4a, 0xdc, 0x90, 0x8e, 0xc1,
+  0x72, 0xa2, 0x86, 0x67, 0xd7, 0x97, 0xa7, 0x21, 0x63, 0xf3, 0xab, 0x28,
+  0xba, 0x9b, 0xc2, 0x74, 0xfb, 0xde, 0x39, 0xcd, 0x27, 0xad, 0x71, 0x54,
+  0xba, 0x3a, 0x4c, 0x2b, 0x8b, 0x1c, 0x21, 0x3f, 0x72, 0x12, 0x1f, 0x15,
+  0x0b, 0x5e, 0x71, 0x1e, 0xe0, 0x1a, 0x09, 0x13, 0x92, 0x8e, 0xc0, 0x98,
+  0xb8, 0x08, 0x00, 0x71, 0x34, 0x88, 0x9d, 0x5d,
+};
+static const uint8_t rsa2048_dQ[128] =
+{
+  0x81, 0x28, 0x79, 0xe8, 0x87, 0x25, 0x41, 0xfc, 0x71, 0xee, 0xed, 0x52,
+  0x00, 0xb9, 0xbf, 0x7c, 0xc2, 0x6b, 0x4f, 0x9f, 0x77, 0xb5, 0xcb, 0x4b,
+  0xa6, 0x7f, 0x7f, 0xc4, 0xcd, 0x78, 0x78, 0x8c, 0x9b, 0x1f, 0xc6, 0x78,
+  0x4b, 0xf9, 0x2b, 0x52, 0x54, 0x73, 0x16, 0x49, 0x01, 0xbb, 0x60, 0x34,
+  0x5b, 0x22, 0xd3, 0xfa, 0x10, 0xe0, 0x5e, 0xfb, 0xdc, 0x57, 0x57, 0xba,
+  0xd1, 0x19, 0x8f, 0x2b, 0x1e, 0xdd, 0x79, 0x6f, 0x76, 0x77, 0xe6, 0x14,
+  0xcd, 0xa1, 0x4d, 0xa9, 0xe1, 0xc2, 0x47, 0x0a, 0x43, 0xcc, 0xf4, 0xbc,
+  0x7a, 0x43, 0x3f, 0xdd, 0x6b, 0x5d, 0xcf, 0x95, 0x43, 0x53, 0xc7, 0xe4,
+  0x6e, 0x62, 0xa9, 0x0a, 0xe1, 0x8c, 0x6d, 0xdc, 0xdf, 0x04, 0x1a, 0xcb,
+  0xcf, 0x82, 0x47, 0x47, 0x39, 0xbc, 0x79, 0x71, 0x3e, 0xa6, 0xee, 0xf8,
+  0xdf, 0x95, 0xbe, 0x79, 0x0f, 0xba, 0xf1, 0xdf,
+};
+static const uint8_t rsa2048_qInv[128] =
+{
+  0x6a, 0x89, 0xcc, 0x97, 0x96, 0x4d, 0x03, 0x6a, 0x6c, 0xd8, 0x5a, 0x52,
+  0xb5, 0x1e, 0x7f, 0xde, 0x41, 0xb3, 0xb2, 0x56, 0x13, 0x39, 0x86, 0x3f,
+  0x01, 0xdd, 0xb7, 0x46, 0x20, 0xd7, 0xe8, 0x06, 0xcb, 0x4b, 0xfb, 0x07,
+  0xe4, 0x42, 0xc9, 0xf6, 0xe1, 0x16, 0x65, 0xda, 0x82, 0xbf, 0xdd, 0xab,
+  0x0b, 0xa1, 0xcc, 0xae, 0x4d, 0x61, 0x7c, 0xa2, 0xc9, 0x5f, 0x5d, 0xc7,
+  0x05, 0xd6, 0x67, 0xb7, 0x50, 0x46, 0xe8, 0xb9, 0x78, 0xf4, 0x44, 0x03,
+  0xf5, 0xa8, 0x74, 0xc9, 0xcc, 0xab, 0x8d, 0xeb, 0xa9, 0x66, 0x3e, 0x35,
+  0xf1, 0x3c, 0x2a, 0x12, 0x46, 0x73, 0x33, 0x82, 0x7f, 0x45, 0xc5, 0xe5,
+  0xcd, 0x8a, 0x2f, 0xd9, 0xce, 0xa8, 0x8c, 0x6f, 0x26, 0xd2, 0x72, 0xcb,
+  0x28, 0x6f, 0x0b, 0x55, 0xca, 0x53, 0x7c, 0xa6, 0x54, 0x1c, 0xc2, 0xcd,
+  0x36, 0x2a, 0x6d, 0x06, 0x53, 0xa2, 0x5e, 0x6c,
+};
+
@@ -0,0 +1,279 @@
+/*
+ * Host build of the cjson module (app/modules/cjson.c with app/cjson) on
+ * this tree's Lua VM, to run the upstream benchmark unchanged:
+ *
+ *   make                        builds cjsonbench
+ *   make run                    runs bench.lua on telemetry.json and a few
+ *                               of the upstream test files
+ *   ./cjsonbench bench.lua x.json ...
+ *
+ * bench.lua wants LuaSocket for its clock, cjson.util to read files and
+ * os.getenv; a require() that knows just these modules stands in for
+ * them. Only the base, string, table and math libraries are there, as
+ * on the device. Numbers are for the host CPU; use them to compare
+ * changes, not to predict ESP8266 rates.
+ *
+ * First it checks that the dtoa conversions give all their Bigints back
+ * when the heap runs out in the middle: each c_malloc() of a conversion
+ * is made to fail in turn, and once the error is back in Lua no block
+ * may be left.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lrotable.h"
+
+#define USE_INTERNAL_FPCONV
+#include "fpconv.h"
+
+const luaR_table lua_rotable[] = { { NULL, NULL } };
+
+LUALIB_API int luaopen_cjson (lua_State *L);
+
+/* ----- the c_malloc() heap ----- */
+
+static long heap_blocks;        /* live blocks */
+static long heap_fail_in = -1;  /* fail the allocation after this many */
+static int heap_failed;
+
+void *host_malloc (size_t n)
+{
+  if (heap_fail_in >= 0 && heap_fail_in-- == 0)
+  {
+    heap_failed = 1;
+    return NULL;
+  }
+  heap_blocks++;
+  return malloc (n);
+}
+
+void *host_realloc (void *p, size_t n)
+{
+  void *q = realloc (p, n);
+  if (!p && q)
+    heap_blocks++;
+  return q;
+}
+
+void host_free (void *p)
+{
+  if (p)
+    heap_blocks--;
+  free (p);
+}
+
+/* The VM itself allocates outside of the counted heap */
+static void *vm_alloc (void *ud, void *ptr, size_t osize, size_t nsize)
+{
+  (void)ud;
+  (void)osize;
+  if (nsize == 0)
+  {
+    free (ptr);
+    return NULL;
+  }
+  return realloc (ptr, nsize);
+}
+
+/* ----- what bench.lua requires ----- */
+
+/* socket.gettime () */
+static int socket_gettime (lua_State *L)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  lua_pushnumber (L, ts.tv_sec + ts.tv_nsec / 1e9);
+  return 1;
+}
+
+/* util.file_load (name) */
+static int util_file_load (lua_State *L)
+{
+  const char *name = luaL_checkstring (L, 1);
+  FILE *f = fopen (name, "rb");
+  luaL_Buffer b;
+  size_t n;
+
+  if (!f)
+    return luaL_error (L, "unable to open %s", name);
+  luaL_buffinit (L, &b);
+  while ((n = fread (luaL_prepbuffer (&b), 1, LUAL_BUFFERSIZE, f)) > 0)
+    luaL_addsize (&b, n);
+  fclose (f);
+  luaL_pushresult (&b);
+  return 1;
+}
+
+/* os.getenv (name) */
+static int os_getenv (lua_State *L)
+{
+  const char *v = getenv (luaL_checkstring (L, 1));
+  if (v)
+    lua_pushstring (L, v);
+  else
+    lua_pushnil (L);
+  return 1;
+}
+
+/* require (name), from the modules registered in new_state (). A plain
+ * name also becomes a global, as LuaSocket's module () makes "socket". */
+static int host_require (lua_State *L)
+{
+  const char *name = luaL_checkstring (L, 1);
+  lua_getfield (L, LUA_REGISTRYINDEX, "host_modules");
+  lua_getfield (L, -1, name);
+  if (lua_isnil (L, -1))
+    return luaL_error (L, "module '%s' not found", name);
+  if (!strchr (name, '.'))
+  {
+    lua_pushvalue (L, -1);
+    lua_setglobal (L, name);
+  }
+  return 1;
+}
+
+static void add_module (lua_State *L, const char *name, const char *func, lua_CFunction f)
+{
+  lua_getfield (L, LUA_REGISTRYINDEX, "host_modules");
+  lua_newtable (L);
+  lua_pushcfunction (L, f);
+  lua_setfield (L, -2, func);
+  lua_setfield (L, -2, name);
+  lua_pop (L, 1);
+}
+
+static lua_State *new_state (void)
+{
+  lua_State *L = lua_newstate (vm_alloc, NULL);
+
+  lua_pushcfunction (L, luaopen_base);
+  lua_call (L, 0, 0);
+  lua_pushcfunction (L, luaopen_string);
+  lua_pushstring (L, LUA_STRLIBNAME);
+  lua_call (L, 1, 0);
+  lua_pushcfunction (L, luaopen_table);
+  lua_pushstring (L, LUA_TABLIBNAME);
+  lua_call (L, 1, 0);
+  lua_pushcfunction (L, luaopen_math);
+  lua_pushstring (L, LUA_MATHLIBNAME);
+  lua_call (L, 1, 0);
+
+  lua_newtable (L);
+  lua_setfield (L, LUA_REGISTRYINDEX, "host_modules");
+  lua_getfield (L, LUA_REGISTRYINDEX, "host_modules");
+  lua_pushcfunction (L, luaopen_cjson);
+  lua_call (L, 0, 1);
+  lua_setfield (L, -2, "cjson");
+  lua_pop (L, 1);
+  add_module (L, "socket", "gettime", socket_gettime);
+  add_module (L, "cjson.util", "file_load", util_file_load);
+  lua_register (L, "require", host_require);
+
+  lua_newtable (L);
+  lua_pushcfunction (L, os_getenv);
+  lua_setfield (L, -2, "getenv");
+  lua_setglobal (L, "os");
+  return L;
+}
+
+/* ----- check ----- */
+
+/* Inputs that need Bigints: more digits than a double holds, subnormals
+ * and numbers whose shortest form takes the slow path */
+static const char *const strtod_in[] = {
+  "3.14159265358979323846264338327950288419716939937510582097494459",
+  "2.4703282292062327208828439643411068618252990130716238221279284e-324",
+  "1.7976931348623157e308",
+  "123456789012345678901234567890e-40",
+};
+static const double g_fmt_in[] = { 5e-324, 1.7976931348623157e308, 1e23, 0.3, 2.2250738585072014e-308 };
+
+static int convert (lua_State *L)
+{
+  char buf[FPCONV_G_FMT_BUFSIZE];
+  unsigned i;
+
+  for (i = 0; i < sizeof (strtod_in) / sizeof (strtod_in[0]); i++)
+    if (fpconv_strtod (strtod_in[i], NULL) != strtod (strtod_in[i], NULL))
+      return luaL_error (L, "strtod %s", strtod_in[i]);
+  for (i = 0; i < sizeof (g_fmt_in) / sizeof (g_fmt_in[0]); i++)
+  {
+    buf[fpconv_g_fmt (buf, g_fmt_in[i], 0)] = '\0';
+    if (strtod (buf, NULL) != g_fmt_in[i])
+      return luaL_error (L, "g_fmt %s", buf);
+  }
+  return 0;
+}
+
+static int check (void)
+{
+  lua_State *L = new_state ();
+  long base = heap_blocks, k;
+  int fail = 0;
+
+  for (k = 0; ; k++)
+  {
+    heap_fail_in = k;
+    heap_failed = 0;
+    if (lua_cpcall (L, convert, NULL) == 0)
+      break;
+    if (!heap_failed)
+    {
+      printf ("FAIL conversion: %s\n", lua_tostring (L, -1));
+      fail = 1;
+      break;
+    }
+    lua_pop (L, 1);
+    if (heap_blocks != base)
+    {
+      printf ("FAIL %ld blocks left after failing allocation %ld\n", heap_blocks - base, k);
+      fail = 1;
+      break;
+    }
+  }
+  heap_fail_in = -1;
+  if (!fail && k == 0)
+  {
+    printf ("FAIL no allocation to fail\n");
+    fail = 1;
+  }
+  if (!fail)
+    printf ("dtoa out of memory OK (%ld allocations)\n\n", k);
+  lua_close (L);
+  return fail;
+}
+
+int main (int argc, char **argv)
+{
+  lua_State *L;
+  int i;
+
+  if (argc < 2)
+  {
+    fprintf (stderr, "usage: cjsonbench bench.lua file.json ...\n");
+    return 2;
+  }
+  if (check ())
+    return 1;
+
+  L = new_state ();
+  lua_newtable (L);
+  for (i = 2; i < argc; i++)
+  {
+    lua_pushstring (L, argv[i]);
+    lua_rawseti (L, -2, i - 1);
+  }
+  lua_setglobal (L, "arg");
+  if (luaL_dofile (L, argv[1]))
+  {
+    printf ("FAIL %s\n", lua_tostring (L, -1));
+    return 1;
+  }
+  lua_close (L);
+  return 0;
+}
@@ -0,0 +1,19 @@
+/* Host stand-in for app/libc/c_stdlib.h; the heap goes through
+ * cjsonbench.c, which counts blocks and can make an allocation fail */
+#ifndef _C_STDLIB_H_
+#define _C_STDLIB_H_
+#include <stdlib.h>
+void *host_malloc(size_t n);
+void *host_realloc(void *p, size_t n);
+void host_free(void *p);
+#define c_free host_free
+#define c_malloc host_malloc
+#define c_zalloc(n) calloc(1, (n))
+#define c_realloc host_realloc
+#define c_abs abs
+#define c_atoi atoi
+#define c_strtol strtol
+#define c_strtoul strtoul
+#define c_strtod strtod
+#define c_getenv getenv
+#endif
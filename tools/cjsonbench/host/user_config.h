@@ -0,0 +1,14 @@
+/* Host stand-in for app/include/user_config.h: the Lua VM with its
+ * tables in RAM, as with LUA_OPTRAM off */
+#ifndef __USER_CONFIG_H__
+#define __USER_CONFIG_H__
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RAM_ATTR
+#define ICACHE_STORE_ATTR
+
+#define LUA_OPTIMIZE_MEMORY 0
+
+#define NODE_ERR printf
+
+#endif
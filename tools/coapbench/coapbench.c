@@ -0,0 +1,864 @@
+/*
+ * Host benchmark for the CoAP server path in app/coap: parse a request,
+ * dispatch it through the endpoint table and build the response, the way
+ * coap_received() drives coap_server_respond(). 100 Lua variables are
+ * registered under /v1/v and requested round-robin, as a gateway polling
+ * every published value would.
+ *
+ *   make            builds coapbench
+ *   make run        runs it
+ *
+ * The Lua API is stubbed out (every variable reads as the number 23.5), so
+ * this times the CoAP code alone. Numbers are for the host CPU only; use
+ * them to compare changes, not to predict ESP8266 request rates.
+ *
+ * It also checks block-wise transfer (RFC 7959): /.well-known/core, which
+ * outgrows one datagram with this many names, and a file published with
+ * server:file(), read with Block2 and uploaded with Block1. The file system
+ * is a single file in RAM (see host/flash_fs.h). And Observe (RFC 7641):
+ * registration, notifications on change and before Max-Age, RST and the
+ * bounded observer table, also across the system_get_time() wrap;
+ * coap_observe_check() is called directly instead of from its timer.
+ *
+ * Finally the client's retransmission queue (app/coap/node.c): the heap
+ * order across the 2^32 ms wrap, lookup by transaction id and COAP_NSTART,
+ * and the cost of a burst of confirmable messages acknowledged out of
+ * order.
+ */
+#define _GNU_SOURCE             /* memmem */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_server.h"
+#include "node.h"
+#include "os_type.h"
+#include "flash_fs.h"
+
+#define NUM_RESOURCES 100
+
+/* ----- Lua and SDK stubs ----- */
+
+static int stack_top;
+static const char *lua_value = "23.5";
+
+int lua_gettop (lua_State *L) { return stack_top; }
+void lua_settop (lua_State *L, int idx) { stack_top = idx; }
+void lua_getfield (lua_State *L, int idx, const char *k) { stack_top++; }
+int lua_type (lua_State *L, int idx) { return LUA_TNUMBER; }
+int lua_isnumber (lua_State *L, int idx) { return 1; }
+int lua_isstring (lua_State *L, int idx) { return 1; }
+const char *lua_tolstring (lua_State *L, int idx, size_t *len)
+{
+  if (len)
+    *len = strlen (lua_value);
+  return lua_value;
+}
+void lua_pushlstring (lua_State *L, const char *s, size_t l) { stack_top++; }
+void lua_call (lua_State *L, int nargs, int nresults) { stack_top -= nargs; }
+const char *luaL_checklstring (lua_State *L, int idx, size_t *len) { return lua_tolstring (L, idx, len); }
+int luaL_error (lua_State *L, const char *fmt, ...) { return 0; }
+/* observed handlers run through lua_cpcall() */
+static void *cpcall_ud;
+void *lua_touserdata (lua_State *L, int idx) { return cpcall_ud; }
+int lua_cpcall (lua_State *L, lua_CFunction func, void *ud)
+{
+  cpcall_ud = ud;
+  return func (L);
+}
+
+lua_Load gLoad;
+os_timer_t lua_timer;
+void dojob (lua_Load *load) { }
+uint32 system_get_chip_id (void) { return 0x123456; }
+
+static uint32 clock_us;
+uint32 system_get_time (void) { return clock_us; }
+
+/* ----- the transport ----- */
+
+/* the connections are only compared by address; the SDK's struct espconn
+ * is not needed for that */
+struct espconn
+{
+  int unused;
+};
+
+static struct espconn server_conn;
+static coap_peer_t peer = { &server_conn, 0x0100000a, 5683 };
+
+static uint8_t sent_buf[MAX_MESSAGE_SIZE];
+static size_t sent_len;
+static int sent_count;
+
+void coap_observe_send (const coap_peer_t *to, const uint8_t *buf, size_t len, int con)
+{
+  memcpy (sent_buf, buf, len);
+  sent_len = len;
+  sent_count++;
+}
+
+void coap_observe_acked (const coap_peer_t *peer, const coap_packet_t *pkt)
+{
+}
+
+/* coap_timer.c is linked for coap_timer_now(); its retransmissions never
+ * run, the os_timer is a no-op here */
+void coap_resend (coap_queue_t *node)
+{
+}
+
+void coap_transaction_end (coap_sendqueue_t *queue, coap_queue_t *node)
+{
+}
+
+/* ----- one file in RAM, "log.txt" ----- */
+
+#define FILE_NAME "log.txt"
+
+static uint8_t file_data[16384];
+static size_t file_len, file_pos;
+
+int fs_open (const char *name, int flags)
+{
+  if (strcmp (name, FILE_NAME))
+    return 0;
+  if (flags & FS_TRUNC)
+    file_len = 0;
+  file_pos = 0;
+  return FS_OPEN_OK;
+}
+int fs_close (int fd) { return 0; }
+int fs_seek (int fd, int off, int whence)
+{
+  file_pos = whence == FS_SEEK_END ? file_len + off : (size_t)off;
+  return file_pos;
+}
+size_t fs_read (int fd, void *ptr, size_t len)
+{
+  if (file_pos >= file_len)
+    return 0;
+  if (len > file_len - file_pos)
+    len = file_len - file_pos;
+  memcpy (ptr, file_data + file_pos, len);
+  file_pos += len;
+  return len;
+}
+size_t fs_write (int fd, const void *ptr, size_t len)
+{
+  if (file_pos + len > sizeof (file_data))
+    return 0;
+  memcpy (file_data + file_pos, ptr, len);
+  file_pos += len;
+  if (file_pos > file_len)
+    file_len = file_pos;
+  return len;
+}
+
+/* ----- requests ----- */
+
+extern coap_luser_table variable_table;
+extern coap_luser_table file_table;
+
+typedef struct
+{
+  uint8_t buf[64];
+  size_t len;
+} request_t;
+
+static request_t reqs[NUM_RESOURCES + 7];
+
+static void make_get (request_t *r, const char *const *segs, int nsegs, uint16_t id)
+{
+  static uint8_t token[4] = { 'g', 'w', 0, 1 };
+  coap_packet_t pkt;
+  int i;
+
+  memset (&pkt, 0, sizeof (pkt));
+  pkt.hdr.ver = 1;
+  pkt.hdr.t = COAP_TYPE_CON;
+  pkt.hdr.tkl = sizeof (token);
+  pkt.hdr.code = COAP_METHOD_GET;
+  pkt.hdr.id[0] = id >> 8;
+  pkt.hdr.id[1] = id & 0xff;
+  pkt.tok.p = token;
+  pkt.tok.len = sizeof (token);
+  for (i = 0; i < nsegs; i++)
+  {
+    pkt.opts[i].num = COAP_OPTION_URI_PATH;
+    pkt.opts[i].buf.p = (const uint8_t *)segs[i];
+    pkt.opts[i].buf.len = strlen (segs[i]);
+  }
+  pkt.numopts = nsegs;
+  r->len = sizeof (r->buf);
+  coap_build (r->buf, &r->len, &pkt);
+}
+
+static char names[NUM_RESOURCES][16];
+
+static void setup (void)
+{
+  static int dummy_L;
+  int i;
+
+  for (i = 0; i < NUM_RESOURCES; i++)
+  {
+    const char *segs[3] = { "v1", "v", names[i] };
+    sprintf (names[i], "sensor%d", i);
+    coap_luser_add (&variable_table, (lua_State *)&dummy_L, names[i], strlen (names[i]));
+    make_get (&reqs[i], segs, 3, i);
+  }
+  {
+    const char *segs[3] = { "v1", "v", "nosuchsensor" };
+    make_get (&reqs[NUM_RESOURCES], segs, 3, NUM_RESOURCES);
+  }
+  {
+    const char *segs[2] = { "v1", "id" };
+    make_get (&reqs[NUM_RESOURCES + 1], segs, 2, NUM_RESOURCES + 1);
+  }
+  coap_luser_add (&file_table, (lua_State *)&dummy_L, FILE_NAME, strlen (FILE_NAME));
+}
+
+/* A request for path ("a/b/c"), with one more option if opt is set (a
+ * Block1/Block2 value from BLOCK(), or an Observe value), and a payload;
+ * returns its length in buf. The token is req_token. */
+#define BLOCK(num, m, szx) (((num) << 4) | ((m) ? 0x08 : 0) | (szx))
+
+static uint8_t req_token[4] = { 'b', 'w', 0, 2 };
+
+static size_t make_req (uint8_t *buf, size_t size, uint8_t code, const char *path,
+                        uint8_t opt, uint32_t value, const uint8_t *payload, size_t plen)
+{
+  static uint16_t id;
+  char segs[64], *seg;
+  uint8_t scratch_raw[8];
+  coap_rw_buffer_t scratch = { scratch_raw, sizeof (scratch_raw) };
+  coap_packet_t pkt;
+
+  memset (&pkt, 0, sizeof (pkt));
+  pkt.hdr.ver = 1;
+  pkt.hdr.t = COAP_TYPE_CON;
+  pkt.hdr.tkl = sizeof (req_token);
+  pkt.hdr.code = code;
+  pkt.hdr.id[0] = ++id >> 8;
+  pkt.hdr.id[1] = id & 0xff;
+  pkt.tok.p = req_token;
+  pkt.tok.len = sizeof (req_token);
+  strcpy (segs, path);
+  for (seg = strtok (segs, "/"); seg; seg = strtok (NULL, "/"))
+  {
+    pkt.opts[pkt.numopts].num = COAP_OPTION_URI_PATH;
+    pkt.opts[pkt.numopts].buf.p = (const uint8_t *)path + (seg - segs);
+    pkt.opts[pkt.numopts].buf.len = strlen (seg);
+    pkt.numopts++;
+  }
+  if (opt)
+    coap_add_option (&scratch, &pkt, opt, value);
+  pkt.payload.p = payload;
+  pkt.payload.len = plen;
+  if (coap_build (buf, &size, &pkt))
+    return 0;
+  return size;
+}
+
+static uint8_t rsp_buf[MAX_MESSAGE_SIZE + 1];
+
+/* Sends a request through coap_server_respond() and parses the response */
+static int exchange (const uint8_t *req, size_t len, coap_packet_t *rsp)
+{
+  size_t rlen = coap_server_respond ((char *)req, len, (char *)rsp_buf, sizeof (rsp_buf), &peer);
+  return rlen > 0 && coap_parse (rsp, rsp_buf, rlen) == 0;
+}
+
+/* GETs path block by block with SZX szx into out; returns its length, or
+ * -1 if the exchange breaks the rules. If szx is negative, the first
+ * request carries no Block2 option and the server picks the size. */
+static long get_blockwise (const char *path, int szx, uint8_t *out, size_t size)
+{
+  uint8_t req[128];
+  coap_packet_t rsp;
+  coap_block_t block;
+  uint32_t num = 0;
+  long got = 0;
+
+  for (;;)
+  {
+    size_t len = szx < 0 && num == 0 ?
+      make_req (req, sizeof (req), COAP_METHOD_GET, path, 0, 0, NULL, 0) :
+      make_req (req, sizeof (req), COAP_METHOD_GET, path, COAP_OPTION_BLOCK2, BLOCK (num, 0, szx), NULL, 0);
+    if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_CONTENT)
+      return -1;
+    if (!coap_get_block (&rsp, COAP_OPTION_BLOCK2, &block))
+      block.m = 0, block.num = num, block.szx = szx < 0 ? COAP_MAX_BLOCK_SZX : szx;
+    if (block.num != num || (block.m && rsp.payload.len != COAP_BLOCK_SIZE (block.szx)))
+      return -1;
+    if (got + rsp.payload.len > size)
+      return -1;
+    memcpy (out + got, rsp.payload.p, rsp.payload.len);
+    got += rsp.payload.len;
+    if (!block.m)
+      return got;
+    szx = block.szx;
+    num++;
+  }
+}
+
+/* PUTs data to path in Block1 blocks of SZX szx; returns the final
+ * response code, or 0 if a 2.31 Continue was wrong */
+static int put_blockwise (const char *path, int szx, const uint8_t *data, size_t len)
+{
+  static uint8_t req[MAX_MESSAGE_SIZE];
+  size_t bs = COAP_BLOCK_SIZE (szx), off;
+  coap_packet_t rsp;
+  coap_block_t block;
+
+  for (off = 0; ; off += bs)
+  {
+    int m = len - off > bs;
+    size_t n = m ? bs : len - off;
+    size_t rlen = make_req (req, sizeof (req), COAP_METHOD_PUT, path, COAP_OPTION_BLOCK1,
+                            BLOCK (off / bs, m, szx), data + off, n);
+    if (!exchange (req, rlen, &rsp))
+      return 0;
+    if (!m)
+      return rsp.hdr.code;
+    if (rsp.hdr.code != COAP_RSPCODE_CONTINUE ||
+        !coap_get_block (&rsp, COAP_OPTION_BLOCK1, &block) || block.num != off / bs || !block.m)
+      return 0;
+  }
+}
+
+static int check_blockwise (void)
+{
+  static uint8_t a[8192], b[8192], data[5000];
+  static uint8_t req[MAX_MESSAGE_SIZE];
+  coap_packet_t rsp;
+  coap_block_t block;
+  const coap_option_t *size2;
+  uint8_t count;
+  long la, lb;
+  size_t i, len;
+  int fail = 0;
+
+  /* the listing, in server-sized blocks and in 64 byte ones */
+  la = get_blockwise (".well-known/core", -1, a, sizeof (a));
+  lb = get_blockwise (".well-known/core", 2, b, sizeof (b));
+  if (la <= MAX_PAYLOAD_SIZE || la != lb || memcmp (a, b, la) ||
+      memcmp (a, "</.well-known/core>;ct=40,", 26) ||
+      !memmem (a, la, "</v1/v/sensor99>;ct=0", 21) ||
+      !memmem (a, la, "</v1/file/" FILE_NAME ">;ct=42", sizeof ("</v1/file/" FILE_NAME ">;ct=42") - 1) ||
+      a[la - 1] == ',')
+  {
+    printf ("FAIL /.well-known/core block-wise (%ld, %ld bytes)\n", la, lb);
+    fail = 1;
+  }
+
+  /* the first block tells the total size */
+  len = make_req (req, sizeof (req), COAP_METHOD_GET, ".well-known/core", 0, 0, NULL, 0);
+  if (!exchange (req, len, &rsp) || !(size2 = coap_findOptions (&rsp, COAP_OPTION_SIZE2, &count)) ||
+      size2->buf.len != 2 || ((size2->buf.p[0] << 8) | size2->buf.p[1]) != la)
+  {
+    printf ("FAIL Size2\n");
+    fail = 1;
+  }
+
+  /* past the end */
+  len = make_req (req, sizeof (req), COAP_METHOD_GET, ".well-known/core", COAP_OPTION_BLOCK2, BLOCK (100, 0, 6), NULL, 0);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_BAD_OPTION)
+  {
+    printf ("FAIL Block2 past the end\n");
+    fail = 1;
+  }
+
+  /* a file up and down again, in several block sizes */
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = (uint8_t)(i * 7 + i / 251);
+  if (put_blockwise ("v1/file/" FILE_NAME, 5, data, sizeof (data)) != COAP_RSPCODE_CHANGED ||
+      file_len != sizeof (data) || memcmp (file_data, data, sizeof (data)))
+  {
+    printf ("FAIL PUT Block1\n");
+    fail = 1;
+  }
+  la = get_blockwise ("v1/file/" FILE_NAME, 4, a, sizeof (a));
+  lb = get_blockwise ("v1/file/" FILE_NAME, -1, b, sizeof (b));
+  if (la != sizeof (data) || lb != la || memcmp (a, data, la) || memcmp (b, data, lb))
+  {
+    printf ("FAIL GET Block2\n");
+    fail = 1;
+  }
+
+  /* a retransmitted block is acknowledged again, a missing one is not */
+  len = make_req (req, sizeof (req), COAP_METHOD_PUT, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK1, BLOCK (0, 1, 4), data, 256);
+  exchange (req, len, &rsp);
+  len = make_req (req, sizeof (req), COAP_METHOD_PUT, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK1, BLOCK (0, 1, 4), data, 256);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_CONTINUE ||
+      !coap_get_block (&rsp, COAP_OPTION_BLOCK1, &block) || block.num != 0 || file_len != 256)
+  {
+    printf ("FAIL PUT Block1 retransmission\n");
+    fail = 1;
+  }
+  len = make_req (req, sizeof (req), COAP_METHOD_PUT, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK1, BLOCK (2, 0, 4), data, 10);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_REQUEST_ENTITY_INCOMPLETE || file_len != 256)
+  {
+    printf ("FAIL PUT Block1 gap\n");
+    fail = 1;
+  }
+
+  /* a late block 0 of the upload in progress leaves what came after it;
+   * block 0 under another token starts a new upload */
+  len = make_req (req, sizeof (req), COAP_METHOD_PUT, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK1, BLOCK (1, 1, 4), data + 256, 256);
+  exchange (req, len, &rsp);
+  len = make_req (req, sizeof (req), COAP_METHOD_PUT, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK1, BLOCK (0, 1, 4), data, 256);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_CONTINUE || file_len != 512)
+  {
+    printf ("FAIL PUT Block1 late block 0\n");
+    fail = 1;
+  }
+  len = make_req (req, sizeof (req), COAP_METHOD_PUT, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK1, BLOCK (2, 0, 4), data + 512, 10);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_CHANGED || file_len != 522 ||
+      memcmp (file_data, data, 522))
+  {
+    printf ("FAIL PUT Block1 after late block 0\n");
+    fail = 1;
+  }
+  req_token[3]++;
+  len = make_req (req, sizeof (req), COAP_METHOD_PUT, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK1, BLOCK (0, 1, 4), data, 256);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_CONTINUE || file_len != 256)
+  {
+    printf ("FAIL PUT Block1 new upload\n");
+    fail = 1;
+  }
+  req_token[3]--;
+
+  /* endpoints that take the payload whole turn a partial one away */
+  len = make_req (req, sizeof (req), COAP_METHOD_POST, "v1/f/myfun", COAP_OPTION_BLOCK1, BLOCK (0, 1, 4), data, 256);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_REQUEST_ENTITY_TOO_LARGE)
+  {
+    printf ("FAIL POST Block1\n");
+    fail = 1;
+  }
+
+  /* and a reserved SZX is a bad packet */
+  len = make_req (req, sizeof (req), COAP_METHOD_GET, "v1/file/" FILE_NAME, COAP_OPTION_BLOCK2, BLOCK (0, 0, 7), NULL, 0);
+  if (coap_server_respond ((char *)req, len, (char *)rsp_buf, sizeof (rsp_buf), &peer) != 0)
+  {
+    printf ("FAIL SZX 7\n");
+    fail = 1;
+  }
+
+  /* leave a 4 KB file for the benchmark */
+  memcpy (file_data, data, 4096);
+  file_len = 4096;
+  return fail;
+}
+
+/* Each response must be an ACK carrying the request's message id */
+static int check (const request_t *r, const uint8_t *rsp, size_t len, uint8_t code)
+{
+  coap_packet_t pkt;
+  if (len == 0 || coap_parse (&pkt, rsp, len) != 0)
+    return 0;
+  return pkt.hdr.t == COAP_TYPE_ACK && pkt.hdr.code == code &&
+         pkt.hdr.id[0] == r->buf[2] && pkt.hdr.id[1] == r->buf[3];
+}
+
+/* Observe value of pkt, or -1 if it has none */
+static long observe_of (const coap_packet_t *pkt)
+{
+  const coap_option_t *opt;
+  uint8_t count;
+  long v = 0;
+  size_t i;
+  if (!(opt = coap_findOptions (pkt, COAP_OPTION_OBSERVE, &count)))
+    return -1;
+  for (i = 0; i < opt->buf.len; i++)
+    v = (v << 8) | opt->buf.p[i];
+  return v;
+}
+
+/* The notification coap_observe_check() sent, if any */
+static int notified (coap_packet_t *pkt)
+{
+  int n = sent_count;
+  sent_count = 0;
+  return n == 1 && coap_parse (pkt, sent_buf, sent_len) == 0;
+}
+
+static int check_observe (void)
+{
+  uint8_t req[128];
+  coap_packet_t rsp, note;
+  coap_packet_t ack;
+  size_t len;
+  int i, fail = 0;
+  long seq;
+
+  /* functions run on POST only, and are never re-run by the timer */
+  len = make_req (req, sizeof (req), COAP_METHOD_GET, "v1/f/myfun", COAP_OPTION_OBSERVE, 0, NULL, 0);
+  if (!exchange (req, len, &rsp) || rsp.hdr.code != COAP_RSPCODE_NOT_FOUND || observe_of (&rsp) >= 0)
+  {
+    printf ("FAIL Observe on /v1/f\n");
+    fail = 1;
+  }
+
+  /* register; the response is the first notification. system_get_time()
+   * is 5 s short of its 2^32 us wrap, which the checks below cross */
+  clock_us = 0xffffffffu - 5000000u;
+  len = make_req (req, sizeof (req), COAP_METHOD_GET, "v1/v/sensor1", COAP_OPTION_OBSERVE, 0, NULL, 0);
+  if (!exchange (req, len, &rsp) || (seq = observe_of (&rsp)) < 0 ||
+      !coap_findOptions (&rsp, COAP_OPTION_MAX_AGE, (uint8_t *)&i))
+  {
+    printf ("FAIL Observe registration\n");
+    return 1;
+  }
+
+  /* nothing changed, nothing sent */
+  coap_observe_check ();
+  if (sent_count)
+  {
+    printf ("FAIL notification without a change\n");
+    fail = 1;
+  }
+  sent_count = 0;
+
+  /* a change is pushed, once, with a higher sequence number */
+  lua_value = "24.0";
+  coap_observe_check ();
+  if (!notified (&note) || note.hdr.code != COAP_RSPCODE_CONTENT ||
+      note.payload.len != 4 || memcmp (note.payload.p, "24.0", 4) ||
+      observe_of (&note) <= seq || note.tok.len != sizeof (req_token) ||
+      memcmp (note.tok.p, req_token, sizeof (req_token)))
+  {
+    printf ("FAIL notification on change\n");
+    fail = 1;
+  }
+  coap_observe_check ();
+  if (sent_count)
+  {
+    printf ("FAIL repeated notification\n");
+    fail = 1;
+  }
+  sent_count = 0;
+
+  /* nor is anything refreshed when system_get_time() wraps */
+  clock_us += 10000000u;
+  coap_observe_check ();
+  if (sent_count)
+  {
+    printf ("FAIL refresh at the clock wrap\n");
+    fail = 1;
+  }
+  sent_count = 0;
+
+  /* before Max-Age runs out the value is refreshed, confirmably */
+  clock_us += (COAP_OBSERVE_MAX_AGE - COAP_OBSERVE_MAX_AGE_MARGIN) * 1000000u;
+  coap_observe_check ();
+  if (!notified (&note) || note.hdr.t != COAP_TYPE_CON)
+  {
+    printf ("FAIL Max-Age refresh\n");
+    fail = 1;
+  }
+
+  /* a reset ends the observation */
+  memset (&ack, 0, sizeof (ack));
+  ack.hdr.ver = 1;
+  ack.hdr.t = COAP_TYPE_RESET;
+  ack.hdr.id[0] = note.hdr.id[0];
+  ack.hdr.id[1] = note.hdr.id[1];
+  len = sizeof (req);
+  coap_build (req, &len, &ack);
+  if (coap_server_respond ((char *)req, len, (char *)rsp_buf, sizeof (rsp_buf), &peer) != 0)
+  {
+    printf ("FAIL RST answered\n");
+    fail = 1;
+  }
+  lua_value = "25.0";
+  coap_observe_check ();
+  if (sent_count)
+  {
+    printf ("FAIL notification after RST\n");
+    fail = 1;
+  }
+  sent_count = 0;
+
+  /* the table is bounded: one more than fits gets a plain response */
+  for (i = 0; i <= COAP_MAX_OBSERVERS; i++)
+  {
+    peer.port = 6000 + i;
+    len = make_req (req, sizeof (req), COAP_METHOD_GET, "v1/v/sensor2", COAP_OPTION_OBSERVE, 0, NULL, 0);
+    if (!exchange (req, len, &rsp) || (observe_of (&rsp) < 0) != (i == COAP_MAX_OBSERVERS))
+    {
+      printf ("FAIL observer %d\n", i);
+      fail = 1;
+    }
+  }
+
+  /* deregistering frees the slots again */
+  for (i = 0; i < COAP_MAX_OBSERVERS; i++)
+  {
+    peer.port = 6000 + i;
+    len = make_req (req, sizeof (req), COAP_METHOD_GET, "v1/v/sensor2", COAP_OPTION_OBSERVE, 1, NULL, 0);
+    if (!exchange (req, len, &rsp) || observe_of (&rsp) >= 0)
+    {
+      printf ("FAIL deregistration %d\n", i);
+      fail = 1;
+    }
+  }
+  lua_value = "26.0";
+  coap_observe_check ();
+  if (sent_count)
+  {
+    printf ("FAIL notification after deregistration\n");
+    fail = 1;
+  }
+  sent_count = 0;
+  peer.port = 5683;
+  lua_value = "23.5";
+  return fail;
+}
+
+static double now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define TRIALS     7
+#define TRIAL_SECS 0.1
+
+/* Requests per second over reqs[first .. first+count-1], round-robin */
+static double bench (int first, int count)
+{
+  static uint8_t rsp[MAX_MESSAGE_SIZE + 1];
+  double best = 0;
+  int t;
+
+  for (t = 0; t < TRIALS; t++)
+  {
+    unsigned long n = 0;
+    double start = now (), el;
+    do
+    {
+      request_t *r = &reqs[first + n % count];
+      coap_server_respond ((char *)r->buf, r->len, (char *)rsp, sizeof (rsp), &peer);
+      n++;
+    } while ((el = now () - start) < TRIAL_SECS);
+    if (n / el > best)
+      best = n / el;
+  }
+  return best;
+}
+
+/* coap_observe_check() per second, COAP_MAX_OBSERVERS observers whose
+ * values don't change */
+static double bench_observe (void)
+{
+  uint8_t req[128];
+  coap_packet_t rsp;
+  double best = 0;
+  size_t len;
+  int i, t;
+
+  for (i = 0; i < COAP_MAX_OBSERVERS; i++)
+  {
+    peer.port = 7000 + i;
+    len = make_req (req, sizeof (req), COAP_METHOD_GET, "v1/v/sensor3", COAP_OPTION_OBSERVE, 0, NULL, 0);
+    exchange (req, len, &rsp);
+  }
+  peer.port = 5683;
+
+  for (t = 0; t < TRIALS; t++)
+  {
+    unsigned long n = 0;
+    double start = now (), el;
+    do
+    {
+      coap_observe_check ();
+      n++;
+    } while ((el = now () - start) < TRIAL_SECS);
+    if (n / el > best)
+      best = n / el;
+  }
+  coap_observe_forget (&server_conn);
+  return best;
+}
+
+/* heap order and positions, and every node findable by its id */
+static int queue_ok (const coap_sendqueue_t *q)
+{
+  int i;
+  for (i = 0; i < q->count; i++)
+    if (q->heap[i]->index != i || coap_find_node (q, q->heap[i]->id) != q->heap[i] ||
+        (i && (int32_t)(q->heap[i]->t - q->heap[(i - 1) / 2]->t) < 0))
+      return 0;
+  return 1;
+}
+
+static coap_queue_t *queue_node (coap_tid_t id, coap_tick_t t, uint32_t ip, struct espconn *conn)
+{
+  coap_queue_t *node = coap_new_node ();
+  node->id = id;
+  node->t = t;
+  node->ip = ip;
+  node->port = 5683;
+  node->pconn = conn;
+  return node;
+}
+
+static int check_queue (void)
+{
+  static coap_sendqueue_t q;
+  coap_queue_t *node;
+  coap_tick_t last;
+  struct espconn other_conn;
+  int i, fail = 0;
+
+  /* due times straddling the wrap come out in order */
+  srand (1);
+  for (i = 0; i < COAP_QUEUE_SIZE; i++)
+    if (!coap_insert_node (&q, queue_node (i, 0xfffff000u + (rand () & 0x1fff), i & 3, &server_conn)))
+      fail = 1;
+  node = queue_node (99, 0, 0, &server_conn);
+  if (coap_insert_node (&q, node) || !queue_ok (&q))
+    fail = 1;
+  coap_free_node (node);
+
+  /* take out the odd ids by id, then the rest earliest first */
+  for (i = 1; i < COAP_QUEUE_SIZE; i += 2)
+    if (!coap_remove_node (&q, i) || coap_find_node (&q, i) || !queue_ok (&q))
+      fail = 1;
+  last = 0xfffff000u;
+  while ((node = coap_peek_next (&q)))
+  {
+    if ((int32_t)(node->t - last) < 0 || node->id & 1)
+      fail = 1;
+    last = node->t;
+    coap_unlink_node (&q, node);
+    coap_delete_node (node);
+    if (!queue_ok (&q))
+      fail = 1;
+  }
+  if (fail)
+    printf ("FAIL queue order\n");
+
+  /* NSTART: what one peer cannot take yet waits, without holding up others */
+  for (i = 0; i < COAP_NSTART + 2; i++)
+    coap_wait_node (&q, queue_node (100 + i, i, 1, &server_conn));
+  coap_wait_node (&q, queue_node (200, 0, 2, &other_conn));
+  i = 0;
+  while ((node = coap_next_waiting (&q)))
+  {
+    coap_insert_node (&q, node);
+    i++;
+  }
+  if (i != COAP_NSTART + 1 || coap_inflight (&q, 1, 5683) != COAP_NSTART ||
+      !coap_find_node (&q, 200) || coap_find_node (&q, 100 + COAP_NSTART))
+  {
+    printf ("FAIL NSTART\n");
+    fail = 1;
+  }
+  coap_remove_node (&q, 100);
+  node = coap_next_waiting (&q);
+  if (node)
+    coap_insert_node (&q, node);
+  if (!node || node->id != 100 + COAP_NSTART || coap_next_waiting (&q))
+  {
+    printf ("FAIL NSTART release\n");
+    fail = 1;
+  }
+
+  /* a closed connection takes its messages with it */
+  coap_delete_all (&q, &server_conn);
+  if (q.count != 1 || q.wait || !coap_find_node (&q, 200) || !queue_ok (&q) ||
+      !coap_queue_busy (&q, &other_conn) || coap_queue_busy (&q, &server_conn))
+  {
+    printf ("FAIL delete_all\n");
+    fail = 1;
+  }
+  coap_delete_all (&q, NULL);
+  return fail || q.count;
+}
+
+/* confirmable messages per second: bursts of COAP_QUEUE_SIZE, each
+ * acknowledged in a shuffled order */
+static double bench_queue (void)
+{
+  static coap_sendqueue_t q;
+  coap_tid_t ids[COAP_QUEUE_SIZE];
+  double best = 0;
+  int i, t;
+
+  for (t = 0; t < TRIALS; t++)
+  {
+    unsigned long n = 0;
+    double start = now (), el;
+    do
+    {
+      for (i = 0; i < COAP_QUEUE_SIZE; i++)
+      {
+        ids[i] = (n + i) * 40503u & 0xffff;
+        coap_insert_node (&q, queue_node (ids[i], n + 2000 + ((i * 7919) & 1023), i & 7, &server_conn));
+      }
+      for (i = 0; i < COAP_QUEUE_SIZE; i++)
+        coap_remove_node (&q, ids[(i * 13) % COAP_QUEUE_SIZE]);
+      n += COAP_QUEUE_SIZE;
+    } while ((el = now () - start) < TRIAL_SECS);
+    if (n / el > best)
+      best = n / el;
+  }
+  return best;
+}
+
+int main (void)
+{
+  static uint8_t rsp[MAX_MESSAGE_SIZE + 1];
+  int i, fail = 0;
+
+  endpoint_setup ();
+  setup ();
+
+  for (i = 0; i < NUM_RESOURCES + 2; i++)
+  {
+    /* an unknown variable gets an empty 2.05, as it always has */
+    uint8_t code = COAP_RSPCODE_CONTENT;
+    size_t len = coap_server_respond ((char *)reqs[i].buf, reqs[i].len, (char *)rsp, sizeof (rsp), &peer);
+    if (!check (&reqs[i], rsp, len, code))
+    {
+      printf ("FAIL request %d\n", i);
+      fail = 1;
+    }
+    if (i < NUM_RESOURCES && memcmp (rsp + len - 4, "23.5", 4))
+    {
+      printf ("FAIL payload %d\n", i);
+      fail = 1;
+    }
+  }
+  fail |= check_blockwise ();
+  fail |= check_observe ();
+  fail |= check_queue ();
+
+  /* benchmark requests: the second block of the listing, then each 1 KB
+   * block of the file in turn */
+  reqs[NUM_RESOURCES + 2].len = make_req (reqs[NUM_RESOURCES + 2].buf, sizeof (reqs[0].buf), COAP_METHOD_GET,
+                                          ".well-known/core", COAP_OPTION_BLOCK2, BLOCK (1, 0, 6), NULL, 0);
+  for (i = 0; i < 4; i++)
+    reqs[NUM_RESOURCES + 3 + i].len = make_req (reqs[NUM_RESOURCES + 3 + i].buf, sizeof (reqs[0].buf), COAP_METHOD_GET,
+                                                "v1/file/" FILE_NAME, COAP_OPTION_BLOCK2, BLOCK (i, 0, 6), NULL, 0);
+  if (fail)
+    return 1;
+  printf ("responses OK\n\n");
+
+  printf ("%-28s %12.0f req/s\n", "GET /v1/v/<first>", bench (0, 1));
+  printf ("%-28s %12.0f req/s\n", "GET /v1/v/<last>", bench (NUM_RESOURCES - 1, 1));
+  printf ("%-28s %12.0f req/s\n", "GET /v1/v/<all, in turn>", bench (0, NUM_RESOURCES));
+  printf ("%-28s %12.0f req/s\n", "GET /v1/v/<unknown>", bench (NUM_RESOURCES, 1));
+  printf ("%-28s %12.0f req/s\n", "GET /v1/id", bench (NUM_RESOURCES + 1, 1));
+  printf ("%-28s %12.0f req/s\n", "GET /.well-known/core blk", bench (NUM_RESOURCES + 2, 1));
+  printf ("%-28s %12.0f req/s\n", "GET /v1/file/<4K> blk", bench (NUM_RESOURCES + 3, 4));
+  printf ("%-28s %12.0f checks/s (%d observers, no change)\n", "coap_observe_check", bench_observe (), COAP_MAX_OBSERVERS);
+  printf ("%-28s %12.0f msg/s (bursts of %d)\n", "CON queue insert + ACK", bench_queue (), COAP_QUEUE_SIZE);
+  return 0;
+}
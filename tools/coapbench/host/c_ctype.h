@@ -0,0 +1,2 @@
+/* Host stand-in for app/libc/c_ctype.h */
+#include <ctype.h>
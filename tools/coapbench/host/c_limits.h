@@ -0,0 +1,2 @@
+/* Host stand-in for app/libc/c_limits.h */
+#include <limits.h>
@@ -0,0 +1,2 @@
+/* Host stand-in for app/libc/c_math.h */
+#include <math.h>
@@ -0,0 +1,14 @@
+/* Host stand-in for app/libc/c_stdio.h */
+#include <stdio.h>
+#include "user_config.h"
+#define c_printf printf
+#define c_sprintf sprintf
+#define c_stdout stdout
+#define c_stderr stderr
+#define c_stdin stdin
+#define c_fputs fputs
+#define c_puts puts
+#define c_getc getc
+#define c_ungetc ungetc
+#define c_EOF EOF
+#define BUFSIZ_LUA BUFSIZ
@@ -0,0 +1,10 @@
+/* Host stand-in for app/libc/c_stdlib.h */
+#include <stdlib.h>
+#define c_free free
+#define c_malloc malloc
+#define c_zalloc(s) calloc(1, s)
+#define c_realloc realloc
+#define c_strtod strtod
+#define c_strtol strtol
+#define c_strtoul strtoul
+#define c_abs abs
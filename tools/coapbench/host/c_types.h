@@ -0,0 +1,18 @@
+/* Host stand-in for the SDK c_types.h */
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+typedef int8_t   sint8_t;
+typedef int32_t  sint32_t;
+
+#endif
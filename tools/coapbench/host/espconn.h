@@ -0,0 +1,7 @@
+/* Host stand-in for the SDK espconn.h; coapbench.c defines the struct */
+#ifndef __ESPCONN_H__
+#define __ESPCONN_H__
+
+struct espconn;
+
+#endif
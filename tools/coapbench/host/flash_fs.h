@@ -0,0 +1,23 @@
+/* Host stand-in for app/platform/flash_fs.h: one file held in RAM by
+ * coapbench.c, enough for the /v1/file endpoints */
+#ifndef __FLASH_FS_H__
+#define __FLASH_FS_H__
+
+#define FS_OPEN_OK  1
+
+#define FS_RDONLY   0x01
+#define FS_WRONLY   0x02
+#define FS_RDWR     0x03
+#define FS_CREAT    0x04
+#define FS_TRUNC    0x08
+
+#define FS_SEEK_SET 0
+#define FS_SEEK_END 2
+
+int fs_open(const char *name, int flags);
+int fs_close(int fd);
+int fs_seek(int fd, int off, int whence);
+size_t fs_read(int fd, void *ptr, size_t len);
+size_t fs_write(int fd, const void *ptr, size_t len);
+
+#endif
@@ -0,0 +1,17 @@
+/* Host stand-in for the SDK os_type.h; the timer is only used by the
+ * /v1/c endpoint, which the benchmark doesn't call */
+#ifndef _OS_TYPE_H_
+#define _OS_TYPE_H_
+
+#include "c_types.h"
+
+typedef void os_timer_func_t(void *arg);
+typedef struct { int dummy; } os_timer_t;
+
+#define os_timer_disarm(t)
+#define os_timer_setfn(t, fn, arg)
+#define os_timer_arm(t, ms, rep)
+
+uint32 system_get_chip_id(void);
+
+#endif
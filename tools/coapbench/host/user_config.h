@@ -0,0 +1,17 @@
+/* Host stand-in for app/include/user_config.h, just enough for app/coap */
+#ifndef __USER_CONFIG_H__
+#define __USER_CONFIG_H__
+
+#include "c_types.h"
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define ICACHE_STORE_ATTR __attribute__((aligned(4)))
+
+#define NODE_DBG(...)
+#define NODE_ERR(...)
+
+#define LUA_OPTIMIZE_MEMORY 0
+#define READLINE_INTERVAL   80
+
+#endif
@@ -0,0 +1,9 @@
+/* Host stand-in for the SDK user_interface.h; coapbench.c keeps the clock */
+#ifndef __USER_INTERFACE_H__
+#define __USER_INTERFACE_H__
+
+#include "c_types.h"
+
+uint32 system_get_time(void);
+
+#endif
@@ -0,0 +1,250 @@
+/*
+ * Host test and benchmark for the GPIO edge capture ring behind
+ * gpio.capture() (app/platform/gpio_capture.c). Checks ordering across a
+ * full ring and index wrap, overflow accounting, the debounce and
+ * repeated-level filters, and runs the producer in a second thread against
+ * a draining consumer to check that every edge is either delivered in
+ * order or counted as lost. Then reports edges/s through the ring.
+ *
+ *   make            builds gpiocapture
+ *   make run        runs it
+ *
+ * On the ESP8266 the producer is the GPIO interrupt and both sides share
+ * one core; the thread test is only a stand-in for that interleaving.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpio_capture.h"
+
+static gpio_capture_t cap;
+
+static int check_ring (void)
+{
+  gpio_edge_t out[GPIO_CAPTURE_LEN];
+  unsigned i, n;
+  int fail = 0;
+
+  gpio_capture_init (&cap);
+  /* start just short of the index wrap */
+  cap.head = cap.tail = 0xfffffff0u;
+  gpio_capture_pin (&cap, 3, 0, 0, 0);
+
+  for (i = 0; i < GPIO_CAPTURE_LEN; i++)
+    if (gpio_capture_edge (&cap, 3, i & 1, i) != 1)
+      fail = 1;
+  if (gpio_capture_edge (&cap, 3, 1, 999) != -1 || gpio_capture_edge (&cap, 3, 0, 1000) != -1 ||
+      gpio_capture_pending (&cap) != GPIO_CAPTURE_LEN)
+    fail = 1;
+  if (fail)
+    printf ("FAIL full ring\n");
+
+  n = gpio_capture_read (&cap, out, 10);
+  for (i = 0; i < n; i++)
+    if (out[i].us != i || out[i].pin != 3 || out[i].level != (i & 1))
+      fail = 1;
+  if (n != 10 || gpio_capture_lost (&cap, 3) != 2 || gpio_capture_lost (&cap, 3) != 0)
+  {
+    printf ("FAIL partial read / lost count\n");
+    fail = 1;
+  }
+
+  /* room again for ten, in order behind the rest */
+  for (i = 0; i < 10; i++)
+    gpio_capture_edge (&cap, 3, i & 1, 2000 + i);
+  n = gpio_capture_read (&cap, out, GPIO_CAPTURE_LEN);
+  for (i = 0; i < n; i++)
+    if (out[i].us != (i < GPIO_CAPTURE_LEN - 10 ? i + 10 : 2000 + i - (GPIO_CAPTURE_LEN - 10)))
+      fail = 1;
+  if (n != GPIO_CAPTURE_LEN || gpio_capture_pending (&cap) || cap.head != (uint32_t)(0xfffffff0u + GPIO_CAPTURE_LEN + 10))
+  {
+    printf ("FAIL read across the wrap\n");
+    fail = 1;
+  }
+  return fail;
+}
+
+/* feeds (level, us) pairs to pin and returns the bitmap of those kept */
+static unsigned feed (unsigned pin, const unsigned (*e)[2], unsigned n)
+{
+  unsigned i, kept = 0;
+  for (i = 0; i < n; i++)
+    if (gpio_capture_edge (&cap, pin, e[i][0], e[i][1]) == 1)
+      kept |= 1u << i;
+  return kept;
+}
+
+static int check_filter (void)
+{
+  /* a bouncing contact: a press at 1000 that chatters for 300 us, a
+   * release at 50000 */
+  static const unsigned bounce[][2] = {
+    { 1, 1000 }, { 0, 1040 }, { 1, 1090 }, { 0, 1200 }, { 1, 1300 }, { 0, 50000 }, { 1, 50100 },
+  };
+  /* a 2 us glitch the interrupt sampled too late: same level twice */
+  static const unsigned glitch[][2] = {
+    { 1, 100 }, { 1, 102 }, { 0, 200 }, { 0, 202 }, { 1, 300 },
+  };
+  static const unsigned up[][2] = {
+    { 1, 10 }, { 1, 20 }, { 1, 30 }, { 1, 35 },
+  };
+  gpio_edge_t out[GPIO_CAPTURE_LEN];
+  unsigned kept;
+  int fail = 0;
+
+  gpio_capture_init (&cap);
+  gpio_capture_pin (&cap, 1, GPIO_CAPTURE_BOTH, 5000, 0);
+  kept = feed (1, bounce, 7);
+  if (kept != 0x21 || cap.pin[1].filtered != 5)
+  {
+    printf ("FAIL debounce: kept %#x\n", kept);
+    fail = 1;
+  }
+
+  gpio_capture_pin (&cap, 2, GPIO_CAPTURE_BOTH, 0, 0);
+  kept = feed (2, glitch, 5);
+  if (kept != 0x15)
+  {
+    printf ("FAIL repeated level: kept %#x\n", kept);
+    fail = 1;
+  }
+
+  /* one edge direction only: every level is the same, only time filters */
+  gpio_capture_pin (&cap, 4, 0, 8, 0);
+  kept = feed (4, up, 4);
+  if (kept != 0x07)
+  {
+    printf ("FAIL single edge: kept %#x\n", kept);
+    fail = 1;
+  }
+
+  /* the pins' edges share the ring in arrival order */
+  if (gpio_capture_read (&cap, out, GPIO_CAPTURE_LEN) != 8 || out[0].pin != 1 || out[2].pin != 2 ||
+      out[5].pin != 4 || out[1].us != 50000)
+  {
+    printf ("FAIL shared ring\n");
+    fail = 1;
+  }
+
+  /* restarting the filter forgets the last edge */
+  gpio_capture_pin (&cap, 4, 0, 8, 0);
+  if (gpio_capture_edge (&cap, 4, 1, 31) != 1)
+  {
+    printf ("FAIL filter restart\n");
+    fail = 1;
+  }
+  return fail;
+}
+
+/* ----- producer against consumer ----- */
+
+#define EDGES 2000000u
+
+static volatile int producer_done;
+
+static void *producer (void *arg)
+{
+  uint32_t i;
+  for (i = 0; i < EDGES; i++)
+    gpio_capture_edge (&cap, i % 3, i & 1, i);
+  producer_done = 1;
+  return NULL;
+}
+
+static int check_threads (void)
+{
+  gpio_edge_t out[16];
+  uint32_t next = 0, got = 0, lost = 0;
+  pthread_t t;
+  unsigned i, n, pin;
+  int fail = 0, done;
+
+  gpio_capture_init (&cap);
+  for (pin = 0; pin < 3; pin++)
+    gpio_capture_pin (&cap, pin, 0, 0, 0);
+  producer_done = 0;
+  pthread_create (&t, NULL, producer, NULL);
+  do
+  {
+    done = producer_done;
+    __sync_synchronize ();
+    while ((n = gpio_capture_read (&cap, out, 1 + got % 16)))
+    {
+      for (i = 0; i < n; i++)
+      {
+        /* strictly increasing, and the rest of the edge matches its time */
+        if (out[i].us < next || out[i].pin != out[i].us % 3 || out[i].level != (out[i].us & 1))
+          fail = 1;
+        next = out[i].us + 1;
+      }
+      got += n;
+    }
+  } while (!done);
+  pthread_join (t, NULL);
+  for (pin = 0; pin < 3; pin++)
+    lost += gpio_capture_lost (&cap, pin);
+
+  if (fail || got + lost != EDGES)
+  {
+    printf ("FAIL threads: %u delivered + %u lost of %u\n", got, lost, EDGES);
+    fail = 1;
+  }
+  return fail;
+}
+
+static double now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define TRIALS     7
+#define TRIAL_SECS 0.1
+
+/* edges/s recorded and drained in batches of batch */
+static double bench (unsigned batch, uint32_t debounce)
+{
+  gpio_edge_t out[GPIO_CAPTURE_LEN];
+  double best = 0;
+  uint32_t us = 0;
+  int t;
+
+  gpio_capture_init (&cap);
+  gpio_capture_pin (&cap, 5, GPIO_CAPTURE_BOTH, debounce, 0);
+  for (t = 0; t < TRIALS; t++)
+  {
+    unsigned long n = 0;
+    double start = now (), el;
+    unsigned i;
+    do
+    {
+      for (i = 0; i < batch; i++, us += 3)
+        gpio_capture_edge (&cap, 5, ((us / 3) & 1) ^ 1, us);
+      gpio_capture_read (&cap, out, batch);
+      n += batch;
+    } while ((el = now () - start) < TRIAL_SECS);
+    if (n / el > best)
+      best = n / el;
+  }
+  return best;
+}
+
+int main (void)
+{
+  int fail = 0;
+
+  fail |= check_ring ();
+  fail |= check_filter ();
+  fail |= check_threads ();
+  if (fail)
+    return 1;
+  printf ("ring and filters OK\n\n");
+
+  printf ("%-28s %12.0f edges/s\n", "edge + read, batch 1", bench (1, 0));
+  printf ("%-28s %12.0f edges/s\n", "edge + read, batch 32", bench (32, 0));
+  printf ("%-28s %12.0f edges/s\n", "edge + read, debounced", bench (32, 4));
+  return 0;
+}
@@ -0,0 +1,4 @@
+/* Host stand-in for app/libc/c_string.h */
+#include <string.h>
+#define c_memset memset
+#define c_memcpy memcpy
@@ -0,0 +1,13 @@
+/* Host stand-in for the SDK c_types.h */
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+
+#endif
@@ -0,0 +1,9 @@
+/* Host stand-in for app/include/user_config.h, just enough for the
+ * capture ring */
+#ifndef __USER_CONFIG_H__
+#define __USER_CONFIG_H__
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RAM_ATTR
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Host benchmark for the SHA-1 (app/ssl/crypto/ssl_sha1.c) and SHA-256
+ * (app/crypto/sha2.c) kernels, and HMAC built on them the same way
+ * crypto_hmac() does. Reports MB/s for message sizes from 16 B to 64 KB.
+ *
+ *   make            builds hashbench_ref and hashbench_unroll
+ *   make run        runs both
+ *
+ * Numbers are for the host CPU only; use them to compare the reference and
+ * unrolled transforms, not to predict ESP8266 throughput.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ssl/ssl_os_port.h"
+#include "ssl/ssl_crypto.h"
+#include "sha2.h"
+
+typedef struct
+{
+  const char *name;
+  void (*create)(void *ctx);
+  void (*update)(void *ctx, const uint8_t *msg, size_t len);
+  void (*finalize)(uint8_t *digest, void *ctx);
+  size_t digest_size;
+} mech_t;
+
+static void sha1_create (void *ctx) { SHA1_Init (ctx); }
+static void sha1_update (void *ctx, const uint8_t *msg, size_t len) { SHA1_Update (ctx, msg, (int)len); }
+static void sha1_final (uint8_t *digest, void *ctx) { SHA1_Final (digest, ctx); }
+
+static void sha256_create (void *ctx) { SHA256_Init (ctx); }
+static void sha256_update (void *ctx, const uint8_t *msg, size_t len) { SHA256_Update (ctx, msg, len); }
+static void sha256_final (uint8_t *digest, void *ctx) { SHA256_Final (digest, ctx); }
+
+static const mech_t mechs[] =
+{
+  { "SHA1",   sha1_create,   sha1_update,   sha1_final,   SHA1_SIZE },
+  { "SHA256", sha256_create, sha256_update, sha256_final, SHA256_DIGEST_LENGTH },
+};
+
+typedef union
+{
+  SHA1_CTX   sha1;
+  SHA256_CTX sha256;
+} any_ctx_t;
+
+#define BLOCK_SIZE 64
+
+#define TRIALS     7
+#define TRIAL_SECS 0.03
+
+static void hash (const mech_t *m, const uint8_t *msg, size_t len, uint8_t *digest)
+{
+  any_ctx_t ctx;
+  m->create (&ctx);
+  m->update (&ctx, msg, len);
+  m->finalize (digest, &ctx);
+}
+
+static void hmac (const mech_t *m, const uint8_t *msg, size_t len,
+                  const uint8_t *key, size_t key_len, uint8_t *digest)
+{
+  any_ctx_t ctx;
+  uint8_t k_ipad[BLOCK_SIZE], k_opad[BLOCK_SIZE];
+  size_t i;
+
+  memset (k_ipad, 0x36, BLOCK_SIZE);
+  memset (k_opad, 0x5c, BLOCK_SIZE);
+  for (i = 0; i < key_len; ++i)
+  {
+    k_ipad[i] ^= key[i];
+    k_opad[i] ^= key[i];
+  }
+
+  m->create (&ctx);
+  m->update (&ctx, k_ipad, BLOCK_SIZE);
+  m->update (&ctx, msg, len);
+  m->finalize (digest, &ctx);
+
+  m->create (&ctx);
+  m->update (&ctx, k_opad, BLOCK_SIZE);
+  m->update (&ctx, digest, m->digest_size);
+  m->finalize (digest, &ctx);
+}
+
+static void hex (const uint8_t *d, size_t n, char *out)
+{
+  static const char digits[] = "0123456789abcdef";
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    out[2 * i] = digits[d[i] >> 4];
+    out[2 * i + 1] = digits[d[i] & 0xf];
+  }
+  out[2 * n] = 0;
+}
+
+/* Known answers, including unaligned and multi-call input */
+static int self_test (void)
+{
+  static const struct { const char *mech, *msg, *key, *expect; } kat[] =
+  {
+    { "SHA1", "abc", NULL, "a9993e364706816aba3e25717850c26c9cd0d89d" },
+    { "SHA1", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", NULL,
+      "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+    { "SHA256", "abc", NULL,
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "SHA256", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", NULL,
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "SHA1", "The quick brown fox jumps over the lazy dog", "key",
+      "de7c9b85b8b78aa6bc8a7a36f70a90701c9db4d9" },
+    { "SHA256", "The quick brown fox jumps over the lazy dog", "key",
+      "f7bc83f430538424b13298e6aa6fb143ef4d59a14946175997479dbc2d1a3cd8" },
+  };
+  int fail = 0;
+  size_t i, j;
+  for (i = 0; i < sizeof (kat) / sizeof (kat[0]); ++i)
+  {
+    const mech_t *m = !strcmp (kat[i].mech, "SHA1") ? &mechs[0] : &mechs[1];
+    size_t len = strlen (kat[i].msg);
+    uint8_t buf[256], digest[32];
+    char out[65];
+
+    for (j = 0; j < 4; ++j)  /* every input alignment */
+    {
+      memcpy (buf + j, kat[i].msg, len);
+      if (kat[i].key)
+        hmac (m, buf + j, len, (const uint8_t *)kat[i].key, strlen (kat[i].key), digest);
+      else
+        hash (m, buf + j, len, digest);
+      hex (digest, m->digest_size, out);
+      if (strcmp (out, kat[i].expect))
+      {
+        printf ("FAIL %s(%s) offset %u: %s\n", kat[i].mech, kat[i].msg, (unsigned)j, out);
+        fail = 1;
+      }
+    }
+  }
+
+  /* One million 'a's fed in odd sized pieces */
+  {
+    static const char *expect[] =
+    {
+      "34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+      "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+    };
+    static uint8_t a[1000];
+    memset (a, 'a', sizeof (a));
+    for (i = 0; i < 2; ++i)
+    {
+      any_ctx_t ctx;
+      uint8_t digest[32];
+      char out[65];
+      size_t done = 0, step = 1;
+      mechs[i].create (&ctx);
+      while (done < 1000000)
+      {
+        size_t n = step < 1000000 - done ? step : 1000000 - done;
+        mechs[i].update (&ctx, a + (done & 3), n > 996 ? 996 : n);
+        done += n > 996 ? 996 : n;
+        step = (step * 7 + 3) % 997 + 1;
+      }
+      mechs[i].finalize (digest, &ctx);
+      hex (digest, mechs[i].digest_size, out);
+      if (strcmp (out, expect[i]))
+      {
+        printf ("FAIL %s(1M x 'a'): %s\n", mechs[i].name, out);
+        fail = 1;
+      }
+    }
+  }
+  return fail;
+}
+
+static double now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main (void)
+{
+  static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+  static uint8_t msg[65536];
+  static const uint8_t key[20] = "0123456789abcdefghij";
+  uint8_t digest[32];
+  size_t i, s;
+  int mac;
+
+  if (self_test ())
+    return 1;
+
+  for (i = 0; i < sizeof (msg); ++i)
+    msg[i] = (uint8_t)(i * 31 + 7);
+
+  printf ("%-12s", "MB/s");
+  for (s = 0; s < sizeof (sizes) / sizeof (sizes[0]); ++s)
+    printf ("%9u", (unsigned)sizes[s]);
+  printf ("\n");
+
+  for (mac = 0; mac < 2; ++mac)
+    for (i = 0; i < sizeof (mechs) / sizeof (mechs[0]); ++i)
+    {
+      const mech_t *m = &mechs[i];
+      char label[16];
+      snprintf (label, sizeof (label), mac ? "HMAC-%s" : "%s", m->name);
+      printf ("%-12s", label);
+      for (s = 0; s < sizeof (sizes) / sizeof (sizes[0]); ++s)
+      {
+        size_t len = sizes[s];
+        double best = 0;
+        int trial;
+        /* Best of several short runs, to ride out scheduler noise */
+        for (trial = 0; trial < TRIALS; ++trial)
+        {
+          size_t total = 0;
+          double t0 = now (), t;
+          do
+          {
+            int n;
+            for (n = 0; n < 16; ++n)
+            {
+              if (mac)
+                hmac (m, msg, len, key, sizeof (key), digest);
+              else
+                hash (m, msg, len, digest);
+              total += len;
+            }
+            t = now () - t0;
+          } while (t < TRIAL_SECS);
+          if (total / t > best)
+            best = total / t;
+        }
+        printf ("%9.1f", best / 1e6);
+      }
+      printf ("\n");
+    }
+  return 0;
+}
@@ -0,0 +1,19 @@
+/* Host stand-in for the SDK c_types.h */
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+typedef int8_t   int8;
+typedef int16_t  int16;
+typedef int32_t  int32;
+typedef int64_t  sint64_t;
+
+#endif
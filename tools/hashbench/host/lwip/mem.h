@@ -0,0 +1,2 @@
+/* Host stand-in for lwip/mem.h */
+#include "osapi.h"
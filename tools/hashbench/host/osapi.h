@@ -0,0 +1,12 @@
+/* Host stand-in for the SDK osapi.h */
+#ifndef _OSAPI_H_
+#define _OSAPI_H_
+
+#include <string.h>
+#include "user_config.h"
+
+#define os_memcpy memcpy
+#define os_memset memset
+#define os_printf printf
+
+#endif
@@ -0,0 +1,12 @@
+/* Host stand-in for app/include/user_config.h, just enough for the hash and
+ * cipher code */
+#ifndef __USER_CONFIG_H__
+#define __USER_CONFIG_H__
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define ICACHE_STORE_ATTR __attribute__((aligned(4)))
+
+#define SHA2_ENABLE
+
+#endif
@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_errno.h */
+#ifndef _C_ERRNO_H_
+#define _C_ERRNO_H_
+#include <errno.h>
+#endif
@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_fcntl.h */
+#ifndef _C_FCNTL_H_
+#define _C_FCNTL_H_
+#include <fcntl.h>
+#endif
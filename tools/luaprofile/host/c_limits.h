@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_limits.h */
+#ifndef _C_LIMITS_H_
+#define _C_LIMITS_H_
+#include <limits.h>
+#endif
@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_locale.h */
+#ifndef _C_LOCALE_H_
+#define _C_LOCALE_H_
+#include <locale.h>
+#endif
@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_math.h */
+#ifndef _C_MATH_H_
+#define _C_MATH_H_
+#include <math.h>
+#endif
@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_stdarg.h */
+#ifndef _C_STDARG_H_
+#define _C_STDARG_H_
+#include <stdarg.h>
+#endif
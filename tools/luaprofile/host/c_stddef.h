@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_stddef.h */
+#ifndef _C_STDDEF_H_
+#define _C_STDDEF_H_
+#include <stddef.h>
+#endif
@@ -0,0 +1,5 @@
+/* Host stand-in for app/libc/c_stdint.h */
+#ifndef _C_STDINT_H_
+#define _C_STDINT_H_
+#include <stdint.h>
+#endif
@@ -0,0 +1,11 @@
+/* Host stand-in for app/libc/c_stdio.h */
+#ifndef _C_STDIO_H_
+#define _C_STDIO_H_
+#include <stdio.h>
+#define c_puts(s) fputs((s), stdout)
+#define c_printf printf
+#define c_sprintf sprintf
+#define c_stdin 0
+#define c_stdout 1
+#define c_stderr 2
+#endif
@@ -0,0 +1,15 @@
+/* Host stand-in for app/libc/c_stdlib.h */
+#ifndef _C_STDLIB_H_
+#define _C_STDLIB_H_
+#include <stdlib.h>
+#define c_free free
+#define c_malloc malloc
+#define c_zalloc(n) calloc(1, (n))
+#define c_realloc realloc
+#define c_abs abs
+#define c_atoi atoi
+#define c_strtol strtol
+#define c_strtoul strtoul
+#define c_strtod strtod
+#define c_getenv getenv
+#endif
@@ -0,0 +1,23 @@
+/* Host stand-in for app/libc/c_string.h */
+#ifndef _C_STRING_H_
+#define _C_STRING_H_
+#include <string.h>
+#define c_memcmp memcmp
+#define c_memcpy memcpy
+#define c_memmove memmove
+#define c_memset memset
+#define c_strcat strcat
+#define c_strchr strchr
+#define c_strcmp strcmp
+#define c_strcpy strcpy
+#define c_strlen strlen
+#define c_strncmp strncmp
+#define c_strncpy strncpy
+#define c_strncasecmp strncmp
+#define c_strstr strstr
+#define c_strncat strncat
+#define c_strcspn strcspn
+#define c_strpbrk strpbrk
+#define c_strcoll strcoll
+#define c_strrchr strrchr
+#endif
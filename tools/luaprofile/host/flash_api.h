@@ -0,0 +1,11 @@
+/* Host stand-in for app/platform/flash_api.h: plain byte access for the
+ * tables the device keeps in flash */
+#ifndef __FLASH_API_H__
+#define __FLASH_API_H__
+
+#include <stdint.h>
+
+#define ICACHE_RODATA_ATTR
+#define byte_of_aligned_array(a, i) ((const uint8_t *)(a))[i]
+
+#endif
@@ -0,0 +1,29 @@
+/* Host stand-in for app/platform/flash_fs.h: the calls luaL_loadfile()
+ * makes, on stdio files. Handles are 1 + an index into a small table. */
+#ifndef __FLASH_FS_H__
+#define __FLASH_FS_H__
+
+#include <stdio.h>
+
+#define FS_OPEN_OK 1
+#define FS_RDONLY  0
+
+static FILE *host_fs[8];
+
+static inline int fs_open(const char *name, int mode)
+{
+  int i;
+  (void)mode;
+  for (i = 0; i < 8; i++)
+    if (!host_fs[i])
+      return (host_fs[i] = fopen(name, "rb")) ? i + 1 : -1;
+  return -1;
+}
+
+static inline void fs_close(int fd)    { fclose(host_fs[fd - 1]); host_fs[fd - 1] = NULL; }
+static inline size_t fs_read(int fd, void *p, size_t n) { return fread(p, 1, n, host_fs[fd - 1]); }
+static inline int fs_eof(int fd)       { return feof(host_fs[fd - 1]); }
+static inline int fs_getc(int fd)      { return getc(host_fs[fd - 1]); }
+static inline int fs_ungetc(int c, int fd) { return ungetc(c, host_fs[fd - 1]); }
+
+#endif
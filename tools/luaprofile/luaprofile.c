@@ -0,0 +1,249 @@
+/*
+ * Host variant of node.profile: the Lua VM from app/lua built for the
+ * host, with the sampling profiler of app/lua/lprofile.c driven by
+ * SIGPROF instead of FRC1. First checks that a hot function gets the
+ * samples it should, then runs a script under the profiler and reports
+ * where its time went.
+ *
+ *   make                        builds luaprofile
+ *   make run                    profiles workload.lua
+ *   ./luaprofile [-i us] x.lua  profiles x.lua, every us of CPU time
+ *
+ * Scripts may also call node.profile.start()/stop() themselves, as on
+ * the device. The VM is built with LUA_OPTIMIZE_MEMORY 0 (see
+ * host/user_config.h), only the base, string, table and math libraries
+ * are there, and files are read from the host file system. SIGPROF
+ * comes no more often than the kernel tick allows, often every 4 ms,
+ * whatever interval is asked for.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lrotable.h"
+#include "lprofile.h"
+
+const luaR_table lua_rotable[] = { { NULL, NULL } };
+
+#define PROFILE_MIN_INTERVAL 100
+
+/* ----- node.profile on SIGPROF ----- */
+
+/* CPU time in us, the time SIGPROF goes by */
+static uint32_t host_clock (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static void on_sigprof (int sig)
+{
+  (void)sig;
+  lprofile_tick (host_clock ());
+}
+
+static void host_timer (uint32_t us)
+{
+  struct itimerval it;
+  it.it_interval.tv_sec = it.it_value.tv_sec = us / 1000000;
+  it.it_interval.tv_usec = it.it_value.tv_usec = us % 1000000;
+  setitimer (ITIMER_PROF, &it, NULL);
+}
+
+/* Lua: node.profile.start( interval_us ) */
+static int node_profile_start (lua_State *L)
+{
+  uint32_t interval = luaL_optinteger (L, 1, 1000);
+  if (lprofile_running ())
+    return luaL_error (L, "profiler running");
+  if (interval < PROFILE_MIN_INTERVAL)
+    return luaL_error (L, "wrong arg range");
+  if (lprofile_start (L, host_clock, interval) != 0)
+    return luaL_error (L, "not enough memory");
+  signal (SIGPROF, on_sigprof);
+  host_timer (interval);
+  return 0;
+}
+
+/* Lua: funcs, lines, samples, idle = node.profile.stop() */
+static int node_profile_stop (lua_State *L)
+{
+  if (!lprofile_running ())
+    return luaL_error (L, "profiler not running");
+  host_timer (0);
+  return lprofile_stop (L);
+}
+
+static const luaL_Reg profile_funcs[] = {
+  { "start", node_profile_start },
+  { "stop", node_profile_stop },
+  { NULL, NULL }
+};
+
+static lua_State *new_state (void)
+{
+  lua_State *L = luaL_newstate ();
+
+  lua_pushcfunction (L, luaopen_base);
+  lua_call (L, 0, 0);
+  lua_pushcfunction (L, luaopen_string);
+  lua_pushstring (L, LUA_STRLIBNAME);
+  lua_call (L, 1, 0);
+  lua_pushcfunction (L, luaopen_table);
+  lua_pushstring (L, LUA_TABLIBNAME);
+  lua_call (L, 1, 0);
+  lua_pushcfunction (L, luaopen_math);
+  lua_pushstring (L, LUA_MATHLIBNAME);
+  lua_call (L, 1, 0);
+
+  lua_newtable (L);
+  lua_newtable (L);
+  luaL_register (L, NULL, profile_funcs);
+  lua_setfield (L, -2, "profile");
+  lua_setglobal (L, "node");
+  return L;
+}
+
+/* ----- check ----- */
+
+static const char check_chunk[] =
+  "local function hot () local x = 0 for i = 1, 10000000 do x = x + i % 7 end return x end\n"
+  "local function cold () local x = 0 for i = 1, 500000 do x = x + i % 7 end return x end\n"
+  "node.profile.start (200)\n"
+  "local again = pcall (node.profile.start, 200)\n"
+  "for i = 1, 4 do hot () cold () end\n"
+  "local funcs, lines, samples = node.profile.stop ()\n"
+  "local stopped = not pcall (node.profile.stop)\n"
+  "return funcs['check:1'] or 0, funcs['check:2'] or 0, samples, lines['check:1'] or 0,\n"
+  "  not again and stopped\n";
+
+static int check (void)
+{
+  lua_State *L = new_state ();
+  int fail = 0;
+
+  if (luaL_loadbuffer (L, check_chunk, strlen (check_chunk), "=check") || lua_pcall (L, 0, 5, 0))
+  {
+    printf ("FAIL check: %s\n", lua_tostring (L, -1));
+    lua_close (L);
+    return 1;
+  }
+  {
+    lua_Integer hot = lua_tointeger (L, 1), cold = lua_tointeger (L, 2);
+    lua_Integer samples = lua_tointeger (L, 3), hot_lines = lua_tointeger (L, 4);
+
+    /* hot() runs 20 times as long as cold(); allow for noise */
+    if (samples < 50 || hot < samples / 2 || hot < 5 * cold)
+    {
+      printf ("FAIL samples: hot %ld, cold %ld of %ld\n", (long)hot, (long)cold, (long)samples);
+      fail = 1;
+    }
+    if (hot_lines == 0)
+    {
+      printf ("FAIL no per-line samples in hot()\n");
+      fail = 1;
+    }
+    if (!lua_toboolean (L, 5))
+    {
+      printf ("FAIL start/stop errors\n");
+      fail = 1;
+    }
+  }
+  lua_close (L);
+  return fail;
+}
+
+/* ----- report ----- */
+
+typedef struct
+{
+  const char *name;
+  long n;
+} entry_t;
+
+static int by_count (const void *a, const void *b)
+{
+  const entry_t *x = a, *y = b;
+  return x->n < y->n ? 1 : x->n > y->n ? -1 : strcmp (x->name, y->name);
+}
+
+/* the table at idx, most samples first; the names point into the table,
+ * which stays on the stack */
+static void report (lua_State *L, int idx, const char *what, long total, unsigned top)
+{
+  entry_t e[LPROFILE_MAX_FUNCS + LPROFILE_RING_SIZE];
+  unsigned n = 0, i;
+
+  lua_pushnil (L);
+  while (lua_next (L, idx) && n < sizeof (e) / sizeof (e[0]))
+  {
+    e[n].name = lua_tostring (L, -2);
+    e[n++].n = lua_tointeger (L, -1);
+    lua_pop (L, 1);
+  }
+  qsort (e, n, sizeof (e[0]), by_count);
+  printf ("%-40s %8s %6s\n", what, "samples", "%");
+  for (i = 0; i < n && i < top; i++)
+    printf ("%-40s %8ld %6.1f\n", e[i].name, e[i].n, total ? 100.0 * e[i].n / total : 0);
+  printf ("\n");
+}
+
+int main (int argc, char **argv)
+{
+  uint32_t interval = 500;
+  const char *script;
+  lua_State *L;
+  long samples, recent;
+
+  if (argc > 2 && strcmp (argv[1], "-i") == 0)
+  {
+    interval = atoi (argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc != 2 || interval < PROFILE_MIN_INTERVAL)
+  {
+    fprintf (stderr, "usage: luaprofile [-i interval_us] script.lua\n");
+    return 2;
+  }
+  script = argv[1];
+
+  if (check ())
+    return 1;
+  printf ("profiler OK\n\n");
+
+  L = new_state ();
+  lua_getglobal (L, "node");
+  lua_getfield (L, -1, "profile");
+  lua_getfield (L, -1, "start");
+  lua_pushinteger (L, interval);
+  lua_call (L, 1, 0);
+  lua_settop (L, 0);
+
+  if (luaL_dofile (L, script))
+  {
+    fprintf (stderr, "%s\n", lua_tostring (L, -1));
+    return 1;
+  }
+  lua_settop (L, 0);
+  lua_pushcfunction (L, node_profile_stop);
+  if (lua_pcall (L, 0, 4, 0))
+  {
+    /* the script stopped the profiler itself and has seen the results */
+    return 0;
+  }
+  samples = lua_tointeger (L, 3);
+  recent = samples < LPROFILE_RING_SIZE ? samples : LPROFILE_RING_SIZE;
+  printf ("\n%ld samples every %u us of CPU time, %ld idle\n\n", samples, interval, (long)lua_tointeger (L, 4));
+  report (L, 1, "function", samples, 15);
+  report (L, 2, "line (most recent samples)", recent, 10);
+  lua_close (L);
+  return 0;
+}
@@ -0,0 +1,37 @@
+-- A stand-in application for tools/luaprofile: parses simulated sensor
+-- lines, keeps running averages and checksums the raw input now and then.
+-- Profile your own the same way: ./luaprofile app.lua
+
+local function checksum (s)
+  local c = 0
+  for i = 1, #s do
+    c = (c * 31 + s:byte (i)) % 65521
+  end
+  return c
+end
+
+local function parse (line)
+  local id, v = line:match ("^(%w+)=(%-?%d+)$")
+  return id, tonumber (v)
+end
+
+local avg = {}
+local function update (id, v)
+  avg[id] = (avg[id] or v) * 0.9 + v * 0.1
+end
+
+local input = {}
+for i = 1, 20000 do
+  input[i] = ("s%d=%d"):format (i % 7, (i * 7919) % 2000 - 1000)
+end
+
+local sum = 0
+for round = 1, 10 do
+  for i = 1, #input do
+    update (parse (input[i]))
+  end
+  for i = 1, #input, 4 do
+    sum = sum + checksum (input[i] .. input[i] .. input[i])
+  end
+end
+print (("s0 %.1f, checksums %d"):format (avg.s0, sum))
@@ -0,0 +1,293 @@
+/*
+ * Host test for the RTC sample FIFO behind the rtcfifo module
+ * (app/include/rtc/rtcfifo.h), in both the one-word-per-sample encoding
+ * and the packed one. Runs long random sequences of put, pop, peek and drop
+ * against a plain array model, including eviction of the oldest samples
+ * from a full FIFO and the restart on a delta-t or tag overflow, and checks
+ * every sample comes back as it went in. Then reports how many samples the
+ * default 96 words hold in either encoding for a few sensor workloads.
+ *
+ *   make            builds rtcfifo
+ *   make run        runs it
+ *
+ * RTC user memory is a plain array here: rtcaccess.h and rtctime.h are
+ * replaced by the definitions below before rtcfifo.h is included.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RTC_ACCESS_H
+#define _RTCTIME_H_
+
+static uint32_t rtc_mem[128];
+
+static inline uint32_t rtc_mem_read (uint32_t addr)
+{
+  if (addr >= 128)
+    abort ();
+  return rtc_mem[addr];
+}
+
+static inline void rtc_mem_write (uint32_t addr, uint32_t val)
+{
+  if (addr >= 128)
+    abort ();
+  rtc_mem[addr] = val;
+}
+
+static void sleep_aligned (uint32_t align, uint32_t min_us)
+{
+  (void)align;
+  (void)min_us;
+}
+#define RTCTIME_SLEEP_ALIGNED sleep_aligned
+
+#include "rtcfifo.h"
+
+static uint32_t tags[6];
+
+/* ----- the model: the samples the FIFO should hold, oldest first ----- */
+
+#define MODEL_LEN 4096
+
+static sample_t model[MODEL_LEN];
+static unsigned model_n;
+
+static void model_drop (unsigned n)
+{
+  memmove (model, model + n, (model_n - n) * sizeof (sample_t));
+  model_n -= n;
+}
+
+static int same (const sample_t *a, const sample_t *b)
+{
+  return a->timestamp == b->timestamp && a->value == b->value && a->decimals == b->decimals && a->tag == b->tag;
+}
+
+static void prepare (int packed)
+{
+  memset (rtc_mem, 0xa5, sizeof (rtc_mem));
+  rtc_fifo_prepare (0, 1000000, RTC_DEFAULT_TAGCOUNT);
+  if (packed)
+    rtc_fifo_init_packed (RTC_DEFAULT_FIFO_START, RTC_DEFAULT_FIFO_END, RTC_DEFAULT_TAGCOUNT);
+  model_n = 0;
+}
+
+/* stores s and follows up in the model: the FIFO may have dropped the
+ * oldest samples to make room, or started over */
+static int put (const sample_t *s, int restart)
+{
+  uint32_t before = rtc_fifo_get_count (), after;
+
+  rtc_fifo_store_sample (s);
+  after = rtc_fifo_get_count ();
+  if (restart)
+  {
+    model_n = 0;
+    before = 0;
+  }
+  if (after > before + 1 || after == 0)
+    return 1;
+  model_drop (before + 1 - after);
+  model[model_n++] = *s;
+  return 0;
+}
+
+static int check_all (void)
+{
+  sample_t s;
+  unsigned i;
+
+  if (rtc_fifo_get_count () != model_n)
+    return 1;
+  for (i = 0; i < model_n; i++)
+    if (!rtc_fifo_peek_sample (&s, i) || !same (&s, &model[i]))
+      return 1;
+  return rtc_fifo_peek_sample (&s, model_n);
+}
+
+static int check_random (int packed, unsigned seed, unsigned steps)
+{
+  uint32_t t = 1000, dt[6] = { 0 }, value[6] = { 0 }, decimals[6] = { 0 };
+  unsigned step, tag = 0, ntags = 3 + seed % 3;
+  sample_t s, got;
+
+  srand (seed);
+  prepare (packed);
+  for (step = 0; step < steps; step++)
+  {
+    int op = rand () % 100;
+
+    if (op < 80)
+    {
+      /* mostly round robin at a steady interval with small changes, with
+       * some of everything else mixed in */
+      int r = rand () % 100;
+      tag = r < 85 ? (tag + 1) % ntags : (unsigned)rand () % ntags;
+      if (tag == 0 || r >= 95)
+        dt[tag] = rand () % 20 ? dt[tag] : (uint32_t)rand () % 0x200;
+      else if (r >= 90)
+        dt[tag] = rand () % 3;
+      t += tag == 0 || r >= 90 ? dt[tag] : 0;
+
+      r = rand () % 100;
+      if (r < 30)
+        ;
+      else if (r < 80)
+        value[tag] += rand () % 9 - 4;
+      else if (r < 95)
+        value[tag] += rand () % 601 - 300;
+      else
+        value[tag] = rand ();
+      value[tag] &= 0xffff;
+      if (rand () % 200 == 0)
+        decimals[tag] = rand () % 8;
+
+      s.timestamp = t;
+      s.value = value[tag];
+      s.decimals = decimals[tag];
+      s.tag = tags[tag];
+      if (put (&s, 0))
+      {
+        printf ("FAIL %s seed %u step %u: put\n", packed ? "packed" : "raw", seed, step);
+        return 1;
+      }
+    }
+    else if (op < 90)
+    {
+      int have = rtc_fifo_pop_sample (&got);
+      if (have != (model_n > 0) || (have && !same (&got, &model[0])))
+      {
+        printf ("FAIL %s seed %u step %u: pop\n", packed ? "packed" : "raw", seed, step);
+        return 1;
+      }
+      if (have)
+        model_drop (1);
+    }
+    else if (op < 95)
+    {
+      unsigned n = rand () % 8;
+      rtc_fifo_drop_samples (n);
+      model_drop (n < model_n ? n : model_n);
+    }
+    if (op == 99 || step % 1000 == 0)
+    {
+      if (check_all ())
+      {
+        printf ("FAIL %s seed %u step %u: contents\n", packed ? "packed" : "raw", seed, step);
+        return 1;
+      }
+    }
+  }
+  return check_all ();
+}
+
+/* a gap longer than delta-t holds, or one tag too many, starts over */
+static int check_restart (int packed)
+{
+  sample_t s = { 100, 1, 0, 0 };
+  int i, fail = 0;
+
+  prepare (packed);
+  for (i = 0; i < 10; i++)
+  {
+    s.timestamp += 60;
+    s.tag = tags[i % 2];
+    fail |= put (&s, 0);
+  }
+  s.timestamp += 0x200;
+  fail |= put (&s, 1);
+  fail |= rtc_fifo_get_count () != 1 || check_all ();
+  for (i = 0; i < 5; i++)
+  {
+    s.timestamp += 1;
+    s.tag = tags[i];
+    fail |= put (&s, 0);
+  }
+  fail |= check_all ();
+  s.tag = tags[5];
+  fail |= put (&s, 1);
+  fail |= rtc_fifo_get_count () != 1 || check_all ();
+  if (fail)
+    printf ("FAIL %s restart\n", packed ? "packed" : "raw");
+  return fail;
+}
+
+/* ----- capacity ----- */
+
+typedef enum { STEADY, NOISY, WALK } workload_t;
+
+/* samples held by the default FIFO after a long run of nsensors sampled
+ * in turn every 60 s */
+static unsigned capacity (int packed, unsigned nsensors, workload_t w)
+{
+  uint32_t value[5] = { 2150, 4810, 10130, 520, 0 };
+  sample_t s;
+  unsigned i, j;
+
+  srand (1);
+  prepare (packed);
+  s.timestamp = 0;
+  s.decimals = 2;
+  for (i = 0; i < 2000; i++)
+  {
+    s.timestamp += 60;
+    for (j = 0; j < nsensors; j++)
+    {
+      if (w == WALK)
+        value[j] += rand () % 7 - 3;
+      else if (w == NOISY)
+        value[j] += rand () % 61 - 30;
+      else if (rand () % 10 == 0)
+        value[j] += rand () % 3 - 1;
+      s.value = value[j] & 0xffff;
+      s.tag = tags[j];
+      if (put (&s, 0))
+        return 0;
+    }
+  }
+  return check_all () ? 0 : rtc_fifo_get_count ();
+}
+
+int main (void)
+{
+  static const struct { const char *name; unsigned n; workload_t w; } loads[] = {
+    { "1 sensor, mostly steady", 1, STEADY },
+    { "3 sensors, mostly steady", 3, STEADY },
+    { "3 sensors, +-3 per sample", 3, WALK },
+    { "5 sensors, +-3 per sample", 5, WALK },
+    { "3 sensors, +-30 per sample", 3, NOISY },
+  };
+  static const char *names[] = { "t0", "t1", "hum", "pres", "lux", "co2" };
+  unsigned i, seed;
+  int fail = 0, packed;
+
+  for (i = 0; i < 6; i++)
+    tags[i] = rtc_fifo_make_tag ((const uint8_t *)names[i]);
+
+  for (packed = 0; packed < 2; packed++)
+  {
+    fail |= check_restart (packed);
+    for (seed = 1; seed <= 20 && !fail; seed++)
+      fail |= check_random (packed, seed, 20000);
+  }
+  if (fail)
+    return 1;
+  printf ("round trip OK\n\n");
+
+  printf ("%-28s %8s %8s\n", "samples in 96 words", "raw", "packed");
+  for (i = 0; i < sizeof (loads) / sizeof (loads[0]); i++)
+  {
+    unsigned raw = capacity (0, loads[i].n, loads[i].w);
+    unsigned pk = capacity (1, loads[i].n, loads[i].w);
+    if (!raw || !pk)
+    {
+      printf ("FAIL capacity %s\n", loads[i].name);
+      return 1;
+    }
+    printf ("%-28s %8u %8u  %.1fx\n", loads[i].name, raw, pk, (double)pk / raw);
+  }
+  return 0;
+}
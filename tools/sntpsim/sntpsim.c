@@ -0,0 +1,367 @@
+/*
+ * Host simulation of the sntp/rtctime clock discipline
+ * (app/include/rtc/rtcdiscipline.h).
+ *
+ * A sensor node wakes every 10 minutes for a few seconds and deep sleeps
+ * in between on a drifting RC sleep clock: 3% off its awake calibration,
+ * with a daily swing and a slow random walk on top. Every so many hours it
+ * syncs against fake NTP servers behind a jittery, lossy, asymmetric
+ * network; one of the three servers is 400 ms off. Requests and replies
+ * are real NTP frames in network byte order.
+ *
+ * Compared are the old scheme (one server, clock stepped, sleep calibration
+ * replaced by the last measurement in 2^-12 us) and the disciplined one
+ * (three servers, selection, filtered period in 2^-20 us), by the error of
+ * the node's clock at each wakeup, for several sync intervals.
+ *
+ *   make            builds sntpsim
+ *   make run        runs it
+ */
+#include <arpa/inet.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rtcdiscipline.h"
+
+#define DAY_US      86400000000LL
+#define WAKE_US     600000000LL   // wakeup period
+#define AWAKE_US    3000000LL     // awake time per wakeup
+#define XTAL_PPM    12.0          // awake clock error
+#define PERIOD_US   6.4           // sleep clock period when warm
+#define COOL        0.03          // how much faster it runs asleep
+#define SIM_DAYS    30
+
+/* ----- randomness ----- */
+
+static uint64_t rng;
+
+static double uniform (void)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return (rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double expo (double mean)
+{
+  return -mean * log (1.0 - uniform ());
+}
+
+/* ----- the world ----- */
+
+static int64_t now;            // true time, unix us
+static double walk;            // slow random part of the sleep clock error
+
+/* true sleep clock period at the true time t */
+static double sleep_period (int64_t t)
+{
+  double day = 2 * M_PI * (double)(t % DAY_US) / DAY_US;
+  return PERIOD_US * (1 - COOL) * (1 + 0.0005 * sin (day) + walk);
+}
+
+typedef struct
+{
+  uint8_t li_vn_mode, stratum, poll, precision;
+  uint32_t root_delay, root_dispersion, refid;
+  uint32_t ref[2], origin[2], recv[2], xmit[2];
+} ntp_frame_t;
+
+typedef struct
+{
+  double bias_us;              // how far off true time it is
+  uint32_t root_delay_us, root_disp_us;
+} server_t;
+
+static const server_t servers[] = {
+  { 0, 12000, 4000 },
+  { 1500, 30000, 8000 },
+  { 400000, 8000, 2000 },      // a falseticker that looks good
+};
+#define NSERVERS 3
+
+static void ntp_stamp (uint32_t ts[2], double unix_us)
+{
+  double sec = floor (unix_us / 1e6);
+  ts[0] = htonl ((uint32_t)(sec + NTP_TO_UNIX_EPOCH));
+  ts[1] = htonl ((uint32_t)((unix_us / 1e6 - sec) * 4294967296.0));
+}
+
+/* one way through the network: 0 if lost, else the delay */
+static double network (void)
+{
+  double d = 15000 + expo (8000);
+  if (uniform () < 0.05)
+    return 0;
+  if (uniform () < 0.05)
+    d += 200000;
+  return d;
+}
+
+/* the fake server: answers req arriving at true time t */
+static void server_reply (int k, const ntp_frame_t *req, ntp_frame_t *rep, double t)
+{
+  double clock = t + servers[k].bias_us + (uniform () - 0.5) * 200;
+  memset (rep, 0, sizeof (*rep));
+  rep->li_vn_mode = (4 << 3) | 4;
+  rep->stratum = 2;
+  rep->root_delay = htonl (((uint64_t)servers[k].root_delay_us << 16) / 1000000);
+  rep->root_dispersion = htonl (((uint64_t)servers[k].root_disp_us << 16) / 1000000);
+  memcpy (rep->origin, req->xmit, sizeof (rep->origin));
+  ntp_stamp (rep->recv, clock);
+  ntp_stamp (rep->xmit, clock + 40);
+}
+
+/* ----- the node ----- */
+
+typedef struct
+{
+  int disciplined;
+  int64_t local;               // its clock, unix us
+  uint32_t cali;               // sleep clock period, 2^-12 us
+  uint32_t period;             // sleep clock period, 2^-20 us, 0 if none
+  uint32_t last_dist;
+  uint64_t sleep_us, sleep_cycles;
+  unsigned syncs, failed, false_picks;
+} node_t;
+
+static void run_awake (node_t *n, int64_t us)
+{
+  now += us;
+  n->local += us + (int64_t)(us * XTAL_PPM * 1e-6);
+}
+
+/* one request to server k: 1 and the sample if answered */
+static int query (node_t *n, int k, rtc_ntp_sample_t *s)
+{
+  ntp_frame_t req, rep;
+  double out = network (), back = network ();
+  uint64_t t1 = n->local;
+
+  memset (&req, 0, sizeof (req));
+  req.li_vn_mode = (4 << 3) | 3;
+  ntp_stamp (req.xmit, (double)t1);
+  if (!out || !back)
+  {
+    run_awake (n, 1000000);    // the 1 s timeout
+    return 0;
+  }
+  server_reply (k, &req, &rep, now + out);
+  run_awake (n, (int64_t)(out + 40 + back));
+  if (memcmp (rep.origin, req.xmit, sizeof (rep.origin)))
+    return 0;
+  rtc_discipline_sample (s, t1, n->local, ntohl (rep.recv[0]), ntohl (rep.recv[1]),
+                         ntohl (rep.xmit[0]), ntohl (rep.xmit[1]),
+                         ntohl (rep.root_delay), ntohl (rep.root_dispersion));
+  return 1;
+}
+
+static void sync (node_t *n)
+{
+  rtc_ntp_sample_t s[NSERVERS];
+  int from[NSERVERS];
+  int got = 0, k, attempt, pick;
+  unsigned answered = 0;
+  int servers_used = n->disciplined ? NSERVERS : 1;
+
+  for (attempt = 0; attempt < 5 && got < servers_used; attempt++)
+    for (k = 0; k < servers_used; k++)
+      if (!(answered & (1 << k)) && query (n, k, &s[got]))
+      {
+        answered |= 1 << k;
+        from[got++] = k;
+      }
+  if (!got)
+  {
+    n->failed++;
+    return;
+  }
+  pick = n->disciplined ? rtc_discipline_select (s, got, servers_used) : 0;
+  if (pick < 0)
+  {
+    n->failed++;
+    return;
+  }
+  n->syncs++;
+  if (servers[from[pick]].bias_us > 100000)
+    n->false_picks++;
+
+  int64_t diff = -s[pick].offset_us;
+  n->local -= diff;
+  /* as rtc_time_settimeofday () does it */
+  if (n->sleep_us && n->sleep_cycles && (n->disciplined || n->sleep_us < 0xffffffff))
+  {
+    uint32_t period = n->disciplined ?
+      rtc_discipline_period (n->period, n->sleep_us, n->sleep_cycles, diff, s[pick].dist_us + n->last_dist) :
+      rtc_discipline_period (0, n->sleep_us, n->sleep_cycles, diff, 0) >> (RTC_DISCIPLINE_FRAC - 12) << (RTC_DISCIPLINE_FRAC - 12);
+    uint32_t cali = period >> (RTC_DISCIPLINE_FRAC - 12);
+    if (cali >= (4 << 12) && cali <= (10 << 12))
+    {
+      n->cali = cali;
+      if (n->disciplined)
+        n->period = period;
+    }
+    else
+      printf ("insane %u\n", cali);
+  }
+  n->last_dist = s[pick].dist_us;
+  n->sleep_us = n->sleep_cycles = 0;
+}
+
+static void deep_sleep (node_t *n, uint32_t us)
+{
+  uint32_t cycles = n->period ? ((uint64_t)us << RTC_DISCIPLINE_FRAC) / n->period
+                              : ((uint64_t)us << 12) / n->cali;
+  now += (int64_t)(cycles * sleep_period (now));
+  n->local += us;
+  if (!n->disciplined && n->sleep_us + us > 0xffffffff)
+  {
+    /* the old tracking is 32 bits wide, and gives up when it overflows */
+    n->sleep_us = n->sleep_cycles = 0xffffffff;
+    return;
+  }
+  n->sleep_us += us;
+  n->sleep_cycles += cycles;
+}
+
+typedef struct
+{
+  double max_ms, rms_ms;
+  unsigned syncs, failed, false_picks;
+} result_t;
+
+static result_t simulate (int disciplined, int64_t sync_every)
+{
+  node_t n;
+  result_t r;
+  int64_t last_sync = -DAY_US, start;
+  double sq = 0;
+  unsigned wakes = 0;
+
+  rng = 0x9e3779b97f4a7c15ull;
+  walk = 0;
+  now = start = 1500000000LL * 1000000;
+  memset (&n, 0, sizeof (n));
+  n.disciplined = disciplined;
+  n.local = now + 5000000;
+  n.cali = PERIOD_US * 4096;   // the warm calibration at power up
+  memset (&r, 0, sizeof (r));
+
+  while (now - start < SIM_DAYS * DAY_US)
+  {
+    double err = fabs ((double)(n.local - now)) / 1000;
+    if (n.syncs >= 2)          // once there was something to calibrate from
+    {
+      if (err > r.max_ms)
+        r.max_ms = err;
+      sq += err * err;
+      wakes++;
+    }
+    if (now - last_sync >= sync_every)
+    {
+      sync (&n);
+      last_sync = now;
+    }
+    run_awake (&n, AWAKE_US);
+
+    walk += (uniform () - 0.5) * 1e-5;
+    if (walk > 0.001 || walk < -0.001)
+      walk *= 0.9;
+    /* wake up aligned to the period, by the node's clock */
+    deep_sleep (&n, WAKE_US - n.local % WAKE_US);
+  }
+  r.rms_ms = sqrt (sq / wakes);
+  r.syncs = n.syncs;
+  r.failed = n.failed;
+  r.false_picks = n.false_picks;
+  return r;
+}
+
+/* ----- checks of the pieces ----- */
+
+static int check_select (void)
+{
+  rtc_ntp_sample_t s[4] = {
+    { 1000, 20000, 15000 },
+    { 5000, 30000, 20000 },
+    { 400000, 10000, 5000 },
+    { -2000, 40000, 25000 },
+  };
+  int fail = 0;
+
+  fail |= rtc_discipline_select (s, 1, 1) != 0;     // one server, believed
+  fail |= rtc_discipline_select (s + 1, 2, 2) != -1; // two that disagree
+  fail |= rtc_discipline_select (s, 2, 2) != 0;     // two that agree
+  fail |= rtc_discipline_select (s, 3, 3) != 0;     // falseticker outvoted
+  fail |= rtc_discipline_select (s, 4, 4) != 0;
+  fail |= rtc_discipline_select (s + 2, 1, 3) != -1; // the only answer of three
+  fail |= rtc_discipline_select (s, 1, 3) != -1;    // even a right one
+  fail |= rtc_discipline_select (s, 2, 3) != 0;     // two of three agree
+  fail |= rtc_discipline_select (s, 2, 4) != -1;    // two of four don't
+  s[0].dist_us = 26000;
+  fail |= rtc_discipline_select (s, 4, 4) != 1;     // smallest distance
+  if (fail)
+    printf ("FAIL select\n");
+  return fail;
+}
+
+static int check_sample (void)
+{
+  rtc_ntp_sample_t s;
+  /* sent at local 1000.000000, server 0.25 s ahead, 20 ms out, 30 ms back,
+   * 1 ms at the server */
+  uint64_t t1 = 1000000000ull, t4 = t1 + 51000;
+  uint32_t base = 1000 + NTP_TO_UNIX_EPOCH;
+  uint32_t recv_frac = (uint32_t)(0.270 * 4294967296.0), xmit_frac = (uint32_t)(0.271 * 4294967296.0);
+
+  rtc_discipline_sample (&s, t1, t4, base, recv_frac, base, xmit_frac, 1 << 16, 1 << 15);
+  if (s.offset_us < 244999 || s.offset_us > 245001 || s.delay_us < 49999 || s.delay_us > 50001 ||
+      s.dist_us < 1024999 || s.dist_us > 1025001)
+  {
+    printf ("FAIL sample: offset %lld delay %u dist %u\n", (long long)s.offset_us, s.delay_us, s.dist_us);
+    return 1;
+  }
+  return 0;
+}
+
+static int check_period (void)
+{
+  uint32_t p = 6 << RTC_DISCIPLINE_FRAC;
+  int fail = 0;
+
+  /* a day asleep, exact sync: the measurement wins */
+  fail |= rtc_discipline_period (p, 86400000, 86400000 / 5, 0, 0) != 5 << RTC_DISCIPLINE_FRAC;
+  /* nothing to go on yet: the measurement, whatever its error */
+  fail |= rtc_discipline_period (0, 60000000, 10000000, 0, 50000) != 6 << RTC_DISCIPLINE_FRAC;
+  /* a minute asleep, 50 ms of error: mostly the old value */
+  uint32_t q = rtc_discipline_period (p, 60000000, 12000000, 0, 50000);
+  fail |= q >= p || q < p - (p / 6) / 2;
+  if (fail)
+    printf ("FAIL period\n");
+  return fail;
+}
+
+int main (void)
+{
+  static const int hours[] = { 1, 6, 24, 72 };
+  unsigned i;
+
+  if (check_select () | check_sample () | check_period ())
+    return 1;
+  printf ("selection, samples and period filter OK\n\n");
+
+  printf ("clock error at wakeup over %d days, 10 min wakeups, from the second sync on\n", SIM_DAYS);
+  printf ("%-10s %26s %26s\n", "sync every", "1 server, replace", "3 servers, disciplined");
+  printf ("%-10s %13s %12s %13s %12s\n", "", "max ms", "rms ms", "max ms", "rms ms");
+  for (i = 0; i < sizeof (hours) / sizeof (hours[0]); i++)
+  {
+    result_t a = simulate (0, hours[i] * 3600000000LL);
+    result_t b = simulate (1, hours[i] * 3600000000LL);
+    printf ("%6d h   %13.1f %12.1f %13.1f %12.1f", hours[i], a.max_ms, a.rms_ms, b.max_ms, b.rms_ms);
+    if (b.false_picks)
+      printf ("  (%u falseticker syncs)", b.false_picks);
+    printf ("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,6 @@
+/* host stand-in for app/include/c_types.h, as far as timer_wheel.h needs it */
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+#include <stddef.h>
+#include <stdint.h>
+#endif
@@ -0,0 +1,284 @@
+/*
+ * Host test for the hashed timer wheel behind the tmr module
+ * (app/platform/timer_wheel.c). Checks insert and cancel, timers that
+ * stay in the wheel for several turns before they expire, callbacks that
+ * cancel and re-add timers while the expired ones are handed out, and the
+ * tick counter wrapping around. Then runs long random sequences against a
+ * plain model that knows the tick every timer is due.
+ *
+ *   make            builds timerwheel
+ *   make run        runs it
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer_wheel.h"
+
+static int failures;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond))                                \
+    {                                           \
+      printf ("FAIL %s:%d: ", __func__, __LINE__); \
+      printf (__VA_ARGS__);                     \
+      printf ("\n");                            \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+/* Advance one tick and take all that expired; returns how many */
+static unsigned tick (timer_wheel_t *w, tw_node_t **out, unsigned max)
+{
+  unsigned n = 0, expired = tw_advance (w);
+  tw_node_t *t;
+
+  while ((t = tw_take_expired (w)) != NULL)
+    if (n < max)
+      out[n++] = t;
+  if (n != expired)
+    printf ("FAIL tw_advance said %u, took %u\n", expired, n), failures++;
+  return n;
+}
+
+/* Ticks until t expires, or 0 if it doesn't within limit */
+static uint32_t expires_after (timer_wheel_t *w, tw_node_t *t, uint32_t limit)
+{
+  tw_node_t *out[8];
+  uint32_t i;
+  unsigned j, n;
+
+  for (i = 1; i <= limit; i++)
+  {
+    n = tick (w, out, 8);
+    for (j = 0; j < n; j++)
+      if (out[j] == t)
+        return i;
+  }
+  return 0;
+}
+
+static void test_insert (void)
+{
+  static const uint32_t delays[] = { 0, 1, 2, 63, 64, 65, 127, 128, 129, 1000, 4097 };
+  timer_wheel_t w;
+  tw_node_t t;
+  unsigned i;
+
+  for (i = 0; i < sizeof (delays) / sizeof (delays[0]); i++)
+  {
+    uint32_t want = delays[i] ? delays[i] : 1, got;
+    tw_init (&w);
+    tw_node_init (&t);
+    CHECK (!tw_active (&t), "fresh node active");
+    tw_add (&w, &t, delays[i]);
+    CHECK (tw_active (&t) && w.count == 1, "added node not active");
+    got = expires_after (&w, &t, want + TW_SLOTS);
+    CHECK (got == want, "add(%u) expired after %u ticks", (unsigned)delays[i], (unsigned)got);
+    CHECK (!tw_active (&t) && w.count == 0, "expired node still counted");
+  }
+}
+
+static void test_cancel (void)
+{
+  timer_wheel_t w;
+  tw_node_t a, b, c, *out[4];
+  unsigned n;
+
+  tw_init (&w);
+  tw_node_init (&a);
+  tw_node_init (&b);
+  tw_node_init (&c);
+  /* three in the same slot, cancel the middle one */
+  tw_add (&w, &a, 5);
+  tw_add (&w, &b, 5);
+  tw_add (&w, &c, 5 + TW_SLOTS);
+  tw_remove (&w, &b);
+  tw_remove (&w, &b);             /* again: no effect */
+  CHECK (!tw_active (&b) && w.count == 2, "cancel: count %u", (unsigned)w.count);
+  CHECK (expires_after (&w, &a, 10) == 5, "a not due after cancelling b");
+  /* c shares the slot and must survive the pass that took a */
+  CHECK (tw_active (&c), "c lost with a");
+  tw_remove (&w, &c);
+  CHECK (w.count == 0, "count %u after cancelling all", (unsigned)w.count);
+  for (n = 0; n < 2 * TW_SLOTS; n++)
+    CHECK (tick (&w, out, 4) == 0, "cancelled timer expired");
+
+  /* cancel one that is expired but not yet taken */
+  tw_add (&w, &a, 1);
+  tw_add (&w, &b, 1);
+  CHECK (tw_advance (&w) == 2, "two due");
+  tw_remove (&w, &a);
+  CHECK (tw_take_expired (&w) == &b && tw_take_expired (&w) == NULL, "a handed out after cancel");
+  CHECK (w.count == 0, "count %u", (unsigned)w.count);
+}
+
+/* Timers longer than a turn pass their slot several times before expiry */
+static void test_rounds (void)
+{
+  timer_wheel_t w;
+  tw_node_t t[4], *out[4];
+  uint32_t i, due[4] = { 3, 3 + TW_SLOTS, 3 + 2 * TW_SLOTS, 3 + 5 * TW_SLOTS };
+  unsigned j, n, seen = 0;
+
+  tw_init (&w);
+  for (j = 0; j < 4; j++)
+  {
+    tw_node_init (&t[j]);
+    tw_add (&w, &t[j], due[j]);
+  }
+  for (i = 1; i <= due[3]; i++)
+  {
+    n = tick (&w, out, 4);
+    for (j = 0; j < n; j++)
+    {
+      unsigned k = out[j] - t;
+      CHECK (due[k] == i, "timer %u due %u expired at %u", k, (unsigned)due[k], (unsigned)i);
+      seen++;
+    }
+  }
+  CHECK (seen == 4 && w.count == 0, "%u of 4 expired", seen);
+}
+
+/* Callbacks cancel or re-add timers, also ones due in the same tick */
+static void test_reentrant (void)
+{
+  timer_wheel_t w;
+  tw_node_t a, b, c, *t;
+  unsigned taken = 0;
+
+  tw_init (&w);
+  tw_node_init (&a);
+  tw_node_init (&b);
+  tw_node_init (&c);
+  tw_add (&w, &a, 2);
+  tw_add (&w, &b, 2);
+  tw_add (&w, &c, 2);
+  tw_advance (&w);
+  CHECK (tw_advance (&w) == 3, "three due");
+  while ((t = tw_take_expired (&w)) != NULL)
+  {
+    taken++;
+    if (t == &a)
+    {
+      tw_remove (&w, &b);         /* a cancels b, already expired */
+      tw_add (&w, &a, 1);         /* and rearms itself */
+    }
+  }
+  CHECK (taken == 2, "took %u, b should have been cancelled", taken);
+  CHECK (tw_active (&a) && !tw_active (&b) && w.count == 1, "a not rearmed");
+  CHECK (expires_after (&w, &a, 4) == 1, "rearmed a not due next tick");
+}
+
+/* The tick counter wraps; TW_SLOTS divides 2^32 so slots don't jump */
+static void test_wrap (void)
+{
+  timer_wheel_t w;
+  tw_node_t t[3];
+  uint32_t due[3] = { 1, 10, 10 + 3 * TW_SLOTS }, got;
+  unsigned j;
+
+  for (j = 0; j < 3; j++)
+  {
+    tw_init (&w);
+    w.now = 0xffffffffu - 4;
+    tw_node_init (&t[j]);
+    tw_add (&w, &t[j], due[j]);
+    got = expires_after (&w, &t[j], due[j] + TW_SLOTS);
+    CHECK (got == due[j], "across wrap: due %u, expired after %u", (unsigned)due[j], (unsigned)got);
+  }
+}
+
+/* ----- random sequences against a model ----- */
+
+#define NTIMERS 200
+
+static void test_random (unsigned seed, uint32_t start)
+{
+  timer_wheel_t w;
+  tw_node_t t[NTIMERS], *out[NTIMERS];
+  uint32_t due[NTIMERS];          /* tick it is due, valid if active */
+  unsigned i, j, n, active = 0;
+  uint32_t step;
+
+  srand (seed);
+  tw_init (&w);
+  w.now = start;
+  for (i = 0; i < NTIMERS; i++)
+    tw_node_init (&t[i]);
+
+  for (step = 0; step < 100000; step++)
+  {
+    i = rand () % NTIMERS;
+    switch (rand () % 4)
+    {
+    case 0:
+    case 1:
+      if (!tw_active (&t[i]))
+      {
+        /* mostly short, some several turns long */
+        uint32_t d = rand () % 8 ? 1 + rand () % 100 : 1 + rand () % (20 * TW_SLOTS);
+        tw_add (&w, &t[i], d);
+        due[i] = w.now + d;
+        active++;
+      }
+      break;
+    case 2:
+      if (tw_active (&t[i]))
+        active--;
+      tw_remove (&w, &t[i]);
+      break;
+    case 3:
+      n = tick (&w, out, NTIMERS);
+      for (j = 0; j < n; j++)
+      {
+        unsigned k = out[j] - t;
+        if (due[k] != w.now)
+        {
+          printf ("FAIL random %u: timer %u due %u expired at %u\n", seed, k,
+                  (unsigned)due[k], (unsigned)w.now);
+          failures++;
+          return;
+        }
+        active--;
+      }
+      /* nothing overdue left behind */
+      for (j = 0; j < NTIMERS; j++)
+        if (tw_active (&t[j]) && due[j] == w.now)
+        {
+          printf ("FAIL random %u: timer %u due %u not expired\n", seed, j, (unsigned)due[j]);
+          failures++;
+          return;
+        }
+      break;
+    }
+    if (w.count != active)
+    {
+      printf ("FAIL random %u: count %u, model %u\n", seed, (unsigned)w.count, active);
+      failures++;
+      return;
+    }
+  }
+}
+
+int main (void)
+{
+  unsigned seed;
+
+  test_insert ();
+  test_cancel ();
+  test_rounds ();
+  test_reentrant ();
+  test_wrap ();
+  for (seed = 1; seed <= 20; seed++)
+    test_random (seed, seed & 1 ? 0 : 0xffffffffu - 5000);
+
+  if (failures)
+  {
+    printf ("%d failures\n", failures);
+    return 1;
+  }
+  printf ("timer wheel OK\n");
+  return 0;
+}